@@ -39,6 +39,7 @@
 #include <babeltrace/debug-info.h>
 
 #include <babeltrace/iterator.h>
+#include <babeltrace/lttng-live-internal.h>
 #include <popt.h>
 #include <errno.h>
 #include <stdlib.h>
@@ -49,6 +50,7 @@
 #include <unistd.h>
 #include <inttypes.h>
 #include <ftw.h>
+#include <limits.h>
 #include <string.h>
 
 #include <babeltrace/ctf-ir/metadata.h>	/* for clocks */
@@ -80,6 +82,7 @@ void bt_dummy_hook(void);
 void bt_lttng_live_hook(void);
 void bt_ctf_hook(void);
 void bt_ctf_text_hook(void);
+void bt_ctf_json_hook(void);
 void bt_ctf_metadata_hook(void);
 
 static
@@ -111,7 +114,10 @@ enum {
 	OPT_CLOCK_GMT,
 	OPT_CLOCK_FORCE_CORRELATE,
 	OPT_STREAM_INTERSECTION,
+	OPT_METADATA_CACHE_DIR,
 	OPT_DEBUG_INFO_DIR,
+	OPT_DEBUG_INFO_CACHE_DIR,
+	OPT_DEBUG_INFO_JOBS,
 	OPT_DEBUG_INFO_FULL_PATH,
 	OPT_DEBUG_INFO_TARGET_PREFIX,
 };
@@ -144,8 +150,11 @@ static struct poptOption long_options[] = {
 	{ "clock-gmt", 0, POPT_ARG_NONE, NULL, OPT_CLOCK_GMT, NULL, NULL },
 	{ "clock-force-correlate", 0, POPT_ARG_NONE, NULL, OPT_CLOCK_FORCE_CORRELATE, NULL, NULL },
 	{ "stream-intersection", 0, POPT_ARG_NONE, NULL, OPT_STREAM_INTERSECTION, NULL, NULL },
+	{ "metadata-cache-dir", 0, POPT_ARG_STRING, NULL, OPT_METADATA_CACHE_DIR, NULL, NULL },
 #ifdef ENABLE_DEBUG_INFO
 	{ "debug-info-dir", 0, POPT_ARG_STRING, NULL, OPT_DEBUG_INFO_DIR, NULL, NULL },
+	{ "debug-info-cache-dir", 0, POPT_ARG_STRING, NULL, OPT_DEBUG_INFO_CACHE_DIR, NULL, NULL },
+	{ "debug-info-jobs", 0, POPT_ARG_STRING, NULL, OPT_DEBUG_INFO_JOBS, NULL, NULL },
 	{ "debug-info-full-path", 0, POPT_ARG_NONE, NULL, OPT_DEBUG_INFO_FULL_PATH, NULL, NULL },
 	{ "debug-info-target-prefix", 0, POPT_ARG_STRING, NULL, OPT_DEBUG_INFO_TARGET_PREFIX, NULL, NULL },
 #endif
@@ -195,9 +204,15 @@ static void usage(FILE *fp)
 	fprintf(fp, "      --clock-force-correlate    Assume that clocks are inherently correlated\n");
 	fprintf(fp, "                                 across traces.\n");
 	fprintf(fp, "      --stream-intersection      Only print events when all streams are active.\n");
+	fprintf(fp, "      --metadata-cache-dir       Directory in which to keep parsed trace metadata,\n");
+	fprintf(fp, "                                 for later runs\n");
 #ifdef ENABLE_DEBUG_INFO
 	fprintf(fp, "      --debug-info-dir           Directory in which to look for debugging information\n");
 	fprintf(fp, "                                 files. (default: /usr/lib/debug/)\n");
+	fprintf(fp, "      --debug-info-cache-dir     Directory in which to keep the address tables built\n");
+	fprintf(fp, "                                 from debugging information, for later runs\n");
+	fprintf(fp, "      --debug-info-jobs          Number of threads reading debugging information\n");
+	fprintf(fp, "                                 ahead of its use (default: 0, none)\n");
 	fprintf(fp, "      --debug-info-target-prefix Directory to use as a prefix for executable lookup\n");
 	fprintf(fp, "      --debug-info-full-path     Show full debug info source and binary paths (if available)\n");
 #endif
@@ -423,6 +438,13 @@ static int parse_options(int argc, char **argv)
 		case OPT_STREAM_INTERSECTION:
 			opt_stream_intersection = 1;
 			break;
+		case OPT_METADATA_CACHE_DIR:
+			opt_metadata_cache_dir = (char *) poptGetOptArg(pc);
+			if (!opt_metadata_cache_dir) {
+				ret = -EINVAL;
+				goto end;
+			}
+			break;
 		case OPT_DEBUG_INFO_DIR:
 			opt_debug_info_dir = (char *) poptGetOptArg(pc);
 			if (!opt_debug_info_dir) {
@@ -430,6 +452,38 @@ static int parse_options(int argc, char **argv)
 				goto end;
 			}
 			break;
+		case OPT_DEBUG_INFO_CACHE_DIR:
+			opt_debug_info_cache_dir = (char *) poptGetOptArg(pc);
+			if (!opt_debug_info_cache_dir) {
+				ret = -EINVAL;
+				goto end;
+			}
+			break;
+		case OPT_DEBUG_INFO_JOBS:
+		{
+			char *str;
+			char *endptr;
+			long jobs;
+
+			str = (char *) poptGetOptArg(pc);
+			if (!str) {
+				fprintf(stderr, "[error] Missing --debug-info-jobs argument\n");
+				ret = -EINVAL;
+				goto end;
+			}
+			errno = 0;
+			jobs = strtol(str, &endptr, 0);
+			if (*endptr != '\0' || str == endptr || errno != 0 ||
+					jobs < 0 || jobs > INT_MAX) {
+				fprintf(stderr, "[error] Incorrect --debug-info-jobs argument: %s\n", str);
+				ret = -EINVAL;
+				free(str);
+				goto end;
+			}
+			opt_debug_info_jobs = jobs;
+			free(str);
+			break;
+		}
 		case OPT_DEBUG_INFO_FULL_PATH:
 			opt_debug_info_full_path = 1;
 			break;
@@ -660,6 +714,45 @@ end:
 	return ret;
 }
 
+static
+struct bt_trace_descriptor *open_output_trace(struct bt_format *fmt_write)
+{
+	struct bt_trace_descriptor *td_write;
+
+	td_write = fmt_write->open_trace(opt_output_path, O_RDWR, NULL, NULL);
+	if (!td_write) {
+		fprintf(stderr, "Error opening trace \"%s\" for writing.\n\n",
+			opt_output_path ? : "<none>");
+	}
+	return td_write;
+}
+
+/*
+ * Read live traces to their end, as they are produced, writing their
+ * events to the output trace.
+ */
+static
+int read_live_traces(struct bt_format *fmt_write)
+{
+	struct bt_trace_descriptor *td_write;
+	int i, ret = 0;
+
+	td_write = open_output_trace(fmt_write);
+	if (!td_write)
+		return -1;
+	for (i = 0; i < opt_input_paths->len; i++) {
+		const char *ipath = g_ptr_array_index(opt_input_paths, i);
+
+		if (bt_lttng_live_read_trace(ipath, td_write) < 0) {
+			fprintf(stderr, "[error] reading trace \"%s\".\n\n",
+				ipath);
+			ret = -1;
+		}
+	}
+	fmt_write->close_trace(td_write);
+	return ret;
+}
+
 static
 int convert_trace(struct bt_trace_descriptor *td_write,
 		  struct bt_context *ctx)
@@ -715,6 +808,7 @@ void call_plugins_hooks(void)
 	bt_lttng_live_hook();
 	bt_ctf_hook();
 	bt_ctf_text_hook();
+	bt_ctf_json_hook();
 	bt_ctf_metadata_hook();
 }
 
@@ -789,6 +883,17 @@ int main(int argc, char **argv)
 		goto end;
 	}
 
+	/*
+	 * Live traces are read as they are produced: the format writes
+	 * their events to the output and calls the trace pre and post
+	 * handlers itself as traces come and go.
+	 */
+	if (fmt_read->name == g_quark_from_static_string("lttng-live")) {
+		if (read_live_traces(fmt_write))
+			partial_error = 1;
+		goto end;
+	}
+
 	ctx = bt_context_create();
 	if (!ctx) {
 		goto error_td_read;
@@ -812,15 +917,12 @@ int main(int argc, char **argv)
 	}
 	if (!open_success) {
 		fprintf(stderr, "[error] none of the specified trace paths could be opened.\n\n");
-		goto error_td_read;
+		goto error_td_write;
 	}
 
-	td_write = fmt_write->open_trace(opt_output_path, O_RDWR, NULL, NULL);
-	if (!td_write) {
-		fprintf(stderr, "Error opening trace \"%s\" for writing.\n\n",
-			opt_output_path ? : "<none>");
+	td_write = open_output_trace(fmt_write);
+	if (!td_write)
 		goto error_td_write;
-	}
 
 	/*
 	 * Errors happened when opening traces, but we continue anyway.
@@ -871,7 +973,9 @@ end:
 	free(opt_output_format);
 	free(opt_output_path);
 	free(opt_debug_info_dir);
+	free(opt_debug_info_cache_dir);
 	free(opt_debug_info_target_prefix);
+	free(opt_metadata_cache_dir);
 	g_ptr_array_free(opt_input_paths, TRUE);
 	if (partial_error)
 		exit(EXIT_FAILURE);
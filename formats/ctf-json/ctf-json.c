@@ -0,0 +1,1335 @@
+/*
+ * BabelTrace - Common Trace Format (CTF)
+ *
+ * CTF JSON Lines and CBOR Format registration.
+ *
+ * Copyright 2016 EfficiOS Inc. and Linux Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <babeltrace/format.h>
+#include <babeltrace/ctf-text/types.h>
+#include <babeltrace/ctf/metadata.h>
+#include <babeltrace/babeltrace-internal.h>
+#include <babeltrace/ctf/events-internal.h>
+#include <babeltrace/trace-debug-info.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Output is accumulated in a private buffer and handed to stdio in
+ * large chunks, rather than through one fprintf() per field.
+ */
+#define CTF_JSON_BUF_LEN	(1U << 20)
+
+/* CBOR major types (RFC 7049). */
+#define CBOR_UINT	(0U << 5)
+#define CBOR_NEGINT	(1U << 5)
+#define CBOR_BYTES	(2U << 5)
+#define CBOR_TEXT	(3U << 5)
+#define CBOR_ARRAY	(4U << 5)
+#define CBOR_MAP	(5U << 5)
+
+#define CBOR_INDEFINITE	31
+#define CBOR_BREAK	0xff
+#define CBOR_NULL	0xf6
+#define CBOR_FLOAT64	0xfb
+
+enum ctf_json_encoding {
+	CTF_JSON_ENCODING_JSON,
+	CTF_JSON_ENCODING_CBOR,
+};
+
+/*
+ * Inherits from struct ctf_text_stream_pos, which is how the converter
+ * accesses output positions. Its fp, depth, field_nr, string and
+ * last_*_timestamp fields keep the same meaning here.
+ */
+struct ctf_json_stream_pos {
+	struct ctf_text_stream_pos parent;
+	enum ctf_json_encoding encoding;
+	int in_array;		/* Current container is an array (no keys) */
+	int error;		/* Sticky output error */
+	/*
+	 * Field names encoded once, in the output encoding, with their
+	 * separator: GQuark to GString.
+	 */
+	GHashTable *keys;
+	size_t len;		/* Bytes used in buf */
+	char *buf;
+};
+
+static
+struct bt_trace_descriptor *ctf_json_open_trace(const char *path, int flags,
+		void (*packet_seek)(struct bt_stream_pos *pos, size_t index,
+			int whence), FILE *metadata_fp);
+static
+struct bt_trace_descriptor *ctf_cbor_open_trace(const char *path, int flags,
+		void (*packet_seek)(struct bt_stream_pos *pos, size_t index,
+			int whence), FILE *metadata_fp);
+static
+int ctf_json_close_trace(struct bt_trace_descriptor *descriptor);
+
+static
+int ctf_json_integer_write(struct bt_stream_pos *ppos,
+		struct bt_definition *definition);
+static
+int ctf_json_float_write(struct bt_stream_pos *ppos,
+		struct bt_definition *definition);
+static
+int ctf_json_enum_write(struct bt_stream_pos *ppos,
+		struct bt_definition *definition);
+static
+int ctf_json_string_write(struct bt_stream_pos *ppos,
+		struct bt_definition *definition);
+static
+int ctf_json_struct_write(struct bt_stream_pos *ppos,
+		struct bt_definition *definition);
+static
+int ctf_json_variant_write(struct bt_stream_pos *ppos,
+		struct bt_definition *definition);
+static
+int ctf_json_array_write(struct bt_stream_pos *ppos,
+		struct bt_definition *definition);
+static
+int ctf_json_sequence_write(struct bt_stream_pos *ppos,
+		struct bt_definition *definition);
+
+static
+rw_dispatch write_dispatch_table[] = {
+	[ CTF_TYPE_INTEGER ] = ctf_json_integer_write,
+	[ CTF_TYPE_FLOAT ] = ctf_json_float_write,
+	[ CTF_TYPE_ENUM ] = ctf_json_enum_write,
+	[ CTF_TYPE_STRING ] = ctf_json_string_write,
+	[ CTF_TYPE_STRUCT ] = ctf_json_struct_write,
+	[ CTF_TYPE_VARIANT ] = ctf_json_variant_write,
+	[ CTF_TYPE_ARRAY ] = ctf_json_array_write,
+	[ CTF_TYPE_SEQUENCE ] = ctf_json_sequence_write,
+};
+
+static
+struct bt_format ctf_json_format = {
+	.open_trace = ctf_json_open_trace,
+	.close_trace = ctf_json_close_trace,
+};
+
+static
+struct bt_format ctf_cbor_format = {
+	.open_trace = ctf_cbor_open_trace,
+	.close_trace = ctf_json_close_trace,
+};
+
+static GQuark Q_STREAM_PACKET_CONTEXT_TIMESTAMP_BEGIN,
+	Q_STREAM_PACKET_CONTEXT_TIMESTAMP_END,
+	Q_STREAM_PACKET_CONTEXT_EVENTS_DISCARDED,
+	Q_STREAM_PACKET_CONTEXT_CONTENT_SIZE,
+	Q_STREAM_PACKET_CONTEXT_PACKET_SIZE,
+	Q_STREAM_PACKET_CONTEXT_PACKET_SEQ_NUM;
+
+/* Keys of the fields added by this output. */
+static GQuark Q_TIMESTAMP, Q_DELTA, Q_TRACE, Q_TRACE_HOSTNAME,
+	Q_TRACE_DOMAIN, Q_TRACE_PROCNAME, Q_TRACE_VPID, Q_LOGLEVEL,
+	Q_MODEL_EMF_URI, Q_CALLSITE, Q_NAME, Q_STREAM_PACKET_CONTEXT,
+	Q_STREAM_EVENT_HEADER, Q_STREAM_EVENT_CONTEXT, Q_EVENT_CONTEXT,
+	Q_EVENT_FIELDS, Q_LABELS, Q_VALUE, Q_FUNC, Q_FILE, Q_LINE, Q_IP,
+	Q_DEBUG_INFO, Q_DEBUG_INFO_STACK, Q_INLINED, Q_BIN, Q_SRC;
+
+static
+void __attribute__((constructor)) init_quarks(void)
+{
+	Q_STREAM_PACKET_CONTEXT_TIMESTAMP_BEGIN = g_quark_from_string("stream.packet.context.timestamp_begin");
+	Q_STREAM_PACKET_CONTEXT_TIMESTAMP_END = g_quark_from_string("stream.packet.context.timestamp_end");
+	Q_STREAM_PACKET_CONTEXT_EVENTS_DISCARDED = g_quark_from_string("stream.packet.context.events_discarded");
+	Q_STREAM_PACKET_CONTEXT_CONTENT_SIZE = g_quark_from_string("stream.packet.context.content_size");
+	Q_STREAM_PACKET_CONTEXT_PACKET_SIZE = g_quark_from_string("stream.packet.context.packet_size");
+	Q_STREAM_PACKET_CONTEXT_PACKET_SEQ_NUM = g_quark_from_string("stream.packet.context.packet_seq_num");
+
+	Q_TIMESTAMP = g_quark_from_string("timestamp");
+	Q_DELTA = g_quark_from_string("delta");
+	Q_TRACE = g_quark_from_string("trace");
+	Q_TRACE_HOSTNAME = g_quark_from_string("trace:hostname");
+	Q_TRACE_DOMAIN = g_quark_from_string("trace:domain");
+	Q_TRACE_PROCNAME = g_quark_from_string("trace:procname");
+	Q_TRACE_VPID = g_quark_from_string("trace:vpid");
+	Q_LOGLEVEL = g_quark_from_string("loglevel");
+	Q_MODEL_EMF_URI = g_quark_from_string("model.emf.uri");
+	Q_CALLSITE = g_quark_from_string("callsite");
+	Q_NAME = g_quark_from_string("name");
+	Q_STREAM_PACKET_CONTEXT = g_quark_from_string("stream.packet.context");
+	Q_STREAM_EVENT_HEADER = g_quark_from_string("stream.event.header");
+	Q_STREAM_EVENT_CONTEXT = g_quark_from_string("stream.event.context");
+	Q_EVENT_CONTEXT = g_quark_from_string("event.context");
+	Q_EVENT_FIELDS = g_quark_from_string("event.fields");
+	Q_LABELS = g_quark_from_string("labels");
+	Q_VALUE = g_quark_from_string("value");
+	Q_FUNC = g_quark_from_string("func");
+	Q_FILE = g_quark_from_string("file");
+	Q_LINE = g_quark_from_string("line");
+	Q_IP = g_quark_from_string("ip");
+	Q_DEBUG_INFO = g_quark_from_string("debug_info");
+	Q_DEBUG_INFO_STACK = g_quark_from_string("debug_info_stack");
+	Q_INLINED = g_quark_from_string("inlined");
+	Q_BIN = g_quark_from_string("bin");
+	Q_SRC = g_quark_from_string("src");
+}
+
+void bt_ctf_json_hook(void)
+{
+	/*
+	 * Dummy function to prevent the linker from discarding this format as
+	 * "unused" in static builds.
+	 */
+}
+
+static inline
+struct ctf_json_stream_pos *ctf_json_pos(struct bt_stream_pos *pos)
+{
+	return container_of(pos, struct ctf_json_stream_pos, parent.parent);
+}
+
+/*
+ * Same packet context filtering as the text output.
+ */
+static
+int json_print_field(struct bt_definition *definition)
+{
+	if (babeltrace_verbose)
+		return 1;
+
+	if (definition->path == Q_STREAM_PACKET_CONTEXT_TIMESTAMP_BEGIN
+			|| definition->path == Q_STREAM_PACKET_CONTEXT_TIMESTAMP_END
+			|| definition->path == Q_STREAM_PACKET_CONTEXT_EVENTS_DISCARDED
+			|| definition->path == Q_STREAM_PACKET_CONTEXT_CONTENT_SIZE
+			|| definition->path == Q_STREAM_PACKET_CONTEXT_PACKET_SIZE
+			|| definition->path == Q_STREAM_PACKET_CONTEXT_PACKET_SEQ_NUM)
+		return 0;
+
+	return 1;
+}
+
+static
+void out_flush(struct ctf_json_stream_pos *pos)
+{
+	if (!pos->len)
+		return;
+	if (fwrite(pos->buf, 1, pos->len, pos->parent.fp) != pos->len)
+		pos->error = 1;
+	pos->len = 0;
+}
+
+static inline
+void out_write(struct ctf_json_stream_pos *pos, const void *data, size_t len)
+{
+	if (unlikely(pos->len + len > CTF_JSON_BUF_LEN)) {
+		out_flush(pos);
+		if (len > CTF_JSON_BUF_LEN) {
+			if (fwrite(data, 1, len, pos->parent.fp) != len)
+				pos->error = 1;
+			return;
+		}
+	}
+	memcpy(pos->buf + pos->len, data, len);
+	pos->len += len;
+}
+
+static inline
+void out_putc(struct ctf_json_stream_pos *pos, char c)
+{
+	if (unlikely(pos->len == CTF_JSON_BUF_LEN))
+		out_flush(pos);
+	pos->buf[pos->len++] = c;
+}
+
+/*
+ * Encode a CBOR initial byte and argument into "out", return the
+ * number of bytes used (at most 9).
+ */
+static
+size_t cbor_encode_head(uint8_t *out, uint8_t major, uint64_t v)
+{
+	if (v < 24) {
+		out[0] = major | v;
+		return 1;
+	} else if (v <= UINT8_MAX) {
+		out[0] = major | 24;
+		out[1] = v;
+		return 2;
+	} else if (v <= UINT16_MAX) {
+		out[0] = major | 25;
+		out[1] = v >> 8;
+		out[2] = v;
+		return 3;
+	} else if (v <= UINT32_MAX) {
+		out[0] = major | 26;
+		out[1] = v >> 24;
+		out[2] = v >> 16;
+		out[3] = v >> 8;
+		out[4] = v;
+		return 5;
+	} else {
+		int i;
+
+		out[0] = major | 27;
+		for (i = 0; i < 8; i++)
+			out[1 + i] = v >> (56 - (8 * i));
+		return 9;
+	}
+}
+
+static
+void cbor_write_head(struct ctf_json_stream_pos *pos, uint8_t major,
+		uint64_t v)
+{
+	uint8_t head[9];
+
+	out_write(pos, head, cbor_encode_head(head, major, v));
+}
+
+/*
+ * Append "str" as a quoted and escaped JSON string to "out".
+ *
+ * Bytes which are not part of a valid UTF-8 sequence are escaped as
+ * the code point of the same value (\u0080 to \u00ff), so that the
+ * output stays valid JSON.
+ */
+static
+void json_escape(GString *out, const char *str, size_t len)
+{
+	static const char hex[] = "0123456789abcdef";
+	size_t i, start = 0;
+
+	g_string_append_c(out, '"');
+	for (i = 0; i < len; i++) {
+		unsigned char c = str[i];
+		char esc[6] = { '\\', 'u', '0', '0', 0, 0 };
+
+		if (c >= 0x80) {
+			gunichar uc = g_utf8_get_char_validated(str + i,
+				len - i);
+
+			if (uc != (gunichar) -1 && uc != (gunichar) -2) {
+				i = g_utf8_next_char(str + i) - str - 1;
+				continue;
+			}
+		} else if (c >= 0x20 && c != '"' && c != '\\') {
+			continue;
+		}
+		g_string_append_len(out, str + start, i - start);
+		start = i + 1;
+		switch (c) {
+		case '"':
+		case '\\':
+			esc[1] = c;
+			g_string_append_len(out, esc, 2);
+			break;
+		case '\n':
+			g_string_append(out, "\\n");
+			break;
+		case '\t':
+			g_string_append(out, "\\t");
+			break;
+		case '\r':
+			g_string_append(out, "\\r");
+			break;
+		default:
+			esc[4] = hex[c >> 4];
+			esc[5] = hex[c & 0xf];
+			g_string_append_len(out, esc, 6);
+			break;
+		}
+	}
+	g_string_append_len(out, str + start, len - start);
+	g_string_append_c(out, '"');
+}
+
+/*
+ * Strings of the trace are not validated by the reader: those which are
+ * not valid UTF-8 are escaped in JSON, and written as byte strings
+ * rather than text strings in CBOR.
+ */
+static
+void out_string_len(struct ctf_json_stream_pos *pos, const char *str,
+		size_t len)
+{
+	switch (pos->encoding) {
+	case CTF_JSON_ENCODING_JSON:
+	{
+		int ascii = 1;
+		size_t i;
+
+		/* Fast path: nothing to escape. */
+		for (i = 0; i < len; i++) {
+			unsigned char c = str[i];
+
+			if (c < 0x20 || c == '"' || c == '\\')
+				break;
+			if (c >= 0x80)
+				ascii = 0;
+		}
+		if (i == len && (ascii || g_utf8_validate(str, len, NULL))) {
+			out_putc(pos, '"');
+			out_write(pos, str, len);
+			out_putc(pos, '"');
+		} else {
+			GString *escaped = g_string_sized_new(len + 16);
+
+			json_escape(escaped, str, len);
+			out_write(pos, escaped->str, escaped->len);
+			g_string_free(escaped, TRUE);
+		}
+		break;
+	}
+	case CTF_JSON_ENCODING_CBOR:
+		cbor_write_head(pos, g_utf8_validate(str, len, NULL) ?
+			CBOR_TEXT : CBOR_BYTES, len);
+		out_write(pos, str, len);
+		break;
+	}
+}
+
+static
+void out_string(struct ctf_json_stream_pos *pos, const char *str)
+{
+	out_string_len(pos, str, strlen(str));
+}
+
+static
+void out_uint(struct ctf_json_stream_pos *pos, uint64_t v)
+{
+	switch (pos->encoding) {
+	case CTF_JSON_ENCODING_JSON:
+	{
+		char digits[20];
+		int i = sizeof(digits);
+
+		do {
+			digits[--i] = '0' + (v % 10);
+			v /= 10;
+		} while (v);
+		out_write(pos, &digits[i], sizeof(digits) - i);
+		break;
+	}
+	case CTF_JSON_ENCODING_CBOR:
+		cbor_write_head(pos, CBOR_UINT, v);
+		break;
+	}
+}
+
+static
+void out_int(struct ctf_json_stream_pos *pos, int64_t v)
+{
+	if (v >= 0) {
+		out_uint(pos, (uint64_t) v);
+		return;
+	}
+	switch (pos->encoding) {
+	case CTF_JSON_ENCODING_JSON:
+		out_putc(pos, '-');
+		/* Negate in unsigned to handle INT64_MIN. */
+		out_uint(pos, -(uint64_t) v);
+		break;
+	case CTF_JSON_ENCODING_CBOR:
+		/* CBOR negative integers are encoded as -1 - n. */
+		cbor_write_head(pos, CBOR_NEGINT, -((uint64_t) v + 1));
+		break;
+	}
+}
+
+static
+void out_null(struct ctf_json_stream_pos *pos)
+{
+	switch (pos->encoding) {
+	case CTF_JSON_ENCODING_JSON:
+		out_write(pos, "null", 4);
+		break;
+	case CTF_JSON_ENCODING_CBOR:
+		out_putc(pos, CBOR_NULL);
+		break;
+	}
+}
+
+static
+void out_double(struct ctf_json_stream_pos *pos, double v)
+{
+	switch (pos->encoding) {
+	case CTF_JSON_ENCODING_JSON:
+	{
+		char str[32];
+		int len;
+
+		/* JSON has no representation for NaN and infinities. */
+		if (!isfinite(v)) {
+			out_null(pos);
+			break;
+		}
+		len = snprintf(str, sizeof(str), "%.17g", v);
+		out_write(pos, str, len);
+		break;
+	}
+	case CTF_JSON_ENCODING_CBOR:
+	{
+		uint8_t out[9];
+		union {
+			double d;
+			uint64_t u;
+		} u;
+		int i;
+
+		u.d = v;
+		out[0] = CBOR_FLOAT64;
+		for (i = 0; i < 8; i++)
+			out[1 + i] = u.u >> (56 - (8 * i));
+		out_write(pos, out, sizeof(out));
+		break;
+	}
+	}
+}
+
+/*
+ * Containers use indefinite-length encoding in CBOR: field filtering
+ * means the element count is not known up front.
+ */
+static
+void out_map_begin(struct ctf_json_stream_pos *pos)
+{
+	switch (pos->encoding) {
+	case CTF_JSON_ENCODING_JSON:
+		out_putc(pos, '{');
+		break;
+	case CTF_JSON_ENCODING_CBOR:
+		out_putc(pos, CBOR_MAP | CBOR_INDEFINITE);
+		break;
+	}
+}
+
+static
+void out_map_end(struct ctf_json_stream_pos *pos)
+{
+	switch (pos->encoding) {
+	case CTF_JSON_ENCODING_JSON:
+		out_putc(pos, '}');
+		break;
+	case CTF_JSON_ENCODING_CBOR:
+		out_putc(pos, CBOR_BREAK);
+		break;
+	}
+}
+
+static
+void out_array_begin(struct ctf_json_stream_pos *pos)
+{
+	switch (pos->encoding) {
+	case CTF_JSON_ENCODING_JSON:
+		out_putc(pos, '[');
+		break;
+	case CTF_JSON_ENCODING_CBOR:
+		out_putc(pos, CBOR_ARRAY | CBOR_INDEFINITE);
+		break;
+	}
+}
+
+static
+void out_array_end(struct ctf_json_stream_pos *pos)
+{
+	switch (pos->encoding) {
+	case CTF_JSON_ENCODING_JSON:
+		out_putc(pos, ']');
+		break;
+	case CTF_JSON_ENCODING_CBOR:
+		out_putc(pos, CBOR_BREAK);
+		break;
+	}
+}
+
+/*
+ * Emit the element separator, if needed.
+ */
+static
+void out_sep(struct ctf_json_stream_pos *pos)
+{
+	if (pos->parent.field_nr++ != 0
+			&& pos->encoding == CTF_JSON_ENCODING_JSON)
+		out_putc(pos, ',');
+}
+
+static
+void key_free(gpointer data)
+{
+	g_string_free(data, TRUE);
+}
+
+static
+GString *encode_key(struct ctf_json_stream_pos *pos, const char *name)
+{
+	GString *key;
+	size_t len = strlen(name);
+
+	key = g_string_sized_new(len + 4);
+	switch (pos->encoding) {
+	case CTF_JSON_ENCODING_JSON:
+		json_escape(key, name, len);
+		g_string_append_c(key, ':');
+		break;
+	case CTF_JSON_ENCODING_CBOR:
+	{
+		uint8_t head[9];
+
+		g_string_append_len(key, (const char *) head,
+			cbor_encode_head(head, CBOR_TEXT, len));
+		g_string_append_len(key, name, len);
+		break;
+	}
+	}
+	return key;
+}
+
+/*
+ * Emit the separator and key of a named field. Keys are only written
+ * within maps, and are encoded once per field name.
+ */
+static
+void out_field_key(struct ctf_json_stream_pos *pos, GQuark name)
+{
+	GString *key;
+
+	out_sep(pos);
+	if (pos->in_array)
+		return;
+	key = g_hash_table_lookup(pos->keys, (gpointer) (unsigned long) name);
+	if (unlikely(!key)) {
+		key = encode_key(pos, rem_(g_quark_to_string(name)));
+		g_hash_table_insert(pos->keys,
+			(gpointer) (unsigned long) name, key);
+	}
+	out_write(pos, key->str, key->len);
+}
+
+#ifdef ENABLE_DEBUG_INFO
+static
+int has_debug_info(struct debug_info_source *src)
+{
+	return src && (src->func || src->src_path || src->bin_path);
+}
+
+static
+void out_debug_info_map(struct ctf_json_stream_pos *pos,
+		struct debug_info_source *src, int with_inline_frames)
+{
+	out_map_begin(pos);
+	pos->parent.field_nr = 0;
+	if (src->bin_path) {
+		GString *bin = g_string_new(opt_debug_info_full_path ?
+			src->bin_path : src->short_bin_path);
+
+		g_string_append(bin, src->bin_loc);
+		out_field_key(pos, Q_BIN);
+		out_string_len(pos, bin->str, bin->len);
+		g_string_free(bin, TRUE);
+	}
+	if (src->func) {
+		out_field_key(pos, Q_FUNC);
+		out_string(pos, src->func);
+	}
+	if (src->src_path) {
+		out_field_key(pos, Q_SRC);
+		out_string(pos, opt_debug_info_full_path ?
+			src->src_path : src->short_src_path);
+		out_field_key(pos, Q_LINE);
+		out_uint(pos, src->line_no);
+	}
+	if (with_inline_frames && src->nr_inline_frames) {
+		unsigned int i;
+
+		/* Subroutines inlined at the address, innermost first. */
+		out_field_key(pos, Q_INLINED);
+		out_array_begin(pos);
+		for (i = 0; i < src->nr_inline_frames; i++) {
+			struct debug_info_inline_frame *frame =
+				&src->inline_frames[i];
+
+			if (i != 0 && pos->encoding == CTF_JSON_ENCODING_JSON)
+				out_putc(pos, ',');
+			out_map_begin(pos);
+			pos->parent.field_nr = 0;
+			if (frame->func) {
+				out_field_key(pos, Q_FUNC);
+				out_string(pos, frame->func);
+			}
+			if (frame->src_path) {
+				out_field_key(pos, Q_SRC);
+				out_string(pos, opt_debug_info_full_path ?
+					frame->src_path : frame->short_src_path);
+				out_field_key(pos, Q_LINE);
+				out_uint(pos, frame->line_no);
+			}
+			out_map_end(pos);
+		}
+		out_array_end(pos);
+	}
+	out_map_end(pos);
+}
+
+static
+void out_debug_info(struct ctf_json_stream_pos *pos,
+		struct debug_info_source *src)
+{
+	if (!has_debug_info(src))
+		return;
+
+	out_field_key(pos, Q_DEBUG_INFO);
+	out_debug_info_map(pos, src, 0);
+}
+
+/*
+ * The debug info of the addresses of a call stack follows it as an
+ * array, null for the addresses without any.
+ */
+static
+void out_debug_info_stack(struct ctf_json_stream_pos *pos,
+		GPtrArray *elems, uint64_t len)
+{
+	int field_nr_saved, in_array_saved;
+	uint64_t i;
+
+	for (i = 0; i < len; i++) {
+		struct definition_integer *integer_definition =
+			g_ptr_array_index(elems, i);
+
+		if (integer_definition->debug_info_stack_frame
+		    && has_debug_info(integer_definition->debug_info_src))
+			break;
+	}
+	if (i == len)
+		return;
+
+	out_field_key(pos, Q_DEBUG_INFO_STACK);
+	field_nr_saved = pos->parent.field_nr;
+	in_array_saved = pos->in_array;
+	out_array_begin(pos);
+	for (i = 0; i < len; i++) {
+		struct definition_integer *integer_definition =
+			g_ptr_array_index(elems, i);
+		struct debug_info_source *src =
+			integer_definition->debug_info_src;
+
+		if (i != 0 && pos->encoding == CTF_JSON_ENCODING_JSON)
+			out_putc(pos, ',');
+		pos->in_array = 0;
+		if (has_debug_info(src))
+			out_debug_info_map(pos, src, 1);
+		else
+			out_null(pos);
+	}
+	out_array_end(pos);
+	pos->in_array = in_array_saved;
+	pos->parent.field_nr = field_nr_saved;
+}
+#endif
+
+static
+int ctf_json_integer_write(struct bt_stream_pos *ppos,
+		struct bt_definition *definition)
+{
+	struct definition_integer *integer_definition =
+		container_of(definition, struct definition_integer, p);
+	const struct declaration_integer *integer_declaration =
+		integer_definition->declaration;
+	struct ctf_json_stream_pos *pos = ctf_json_pos(ppos);
+
+	if (!json_print_field(definition))
+		return 0;
+
+	if (pos->parent.string
+	    && (integer_declaration->encoding == CTF_STRING_ASCII
+	      || integer_declaration->encoding == CTF_STRING_UTF8)) {
+
+		if (!integer_declaration->signedness) {
+			g_string_append_c(pos->parent.string,
+				(int) integer_definition->value._unsigned);
+		} else {
+			g_string_append_c(pos->parent.string,
+				(int) integer_definition->value._signed);
+		}
+		return 0;
+	}
+
+	out_field_key(pos, definition->name);
+	if (!integer_declaration->signedness)
+		out_uint(pos, integer_definition->value._unsigned);
+	else
+		out_int(pos, integer_definition->value._signed);
+
+#ifdef ENABLE_DEBUG_INFO
+	if (integer_definition->debug_info_src && !pos->in_array) {
+		int field_nr_saved = pos->parent.field_nr;
+
+		out_debug_info(pos, integer_definition->debug_info_src);
+		pos->parent.field_nr = field_nr_saved;
+	}
+#endif
+	return 0;
+}
+
+static
+int ctf_json_float_write(struct bt_stream_pos *ppos,
+		struct bt_definition *definition)
+{
+	struct definition_float *float_definition =
+		container_of(definition, struct definition_float, p);
+	struct ctf_json_stream_pos *pos = ctf_json_pos(ppos);
+
+	if (!json_print_field(definition))
+		return 0;
+
+	out_field_key(pos, definition->name);
+	out_double(pos, float_definition->value);
+	return 0;
+}
+
+/*
+ * Enumerations are written as { "labels": [ ... ], "value": N }, an
+ * unknown value having an empty label array.
+ */
+static
+int ctf_json_enum_write(struct bt_stream_pos *ppos,
+		struct bt_definition *definition)
+{
+	struct definition_enum *enum_definition =
+		container_of(definition, struct definition_enum, p);
+	struct definition_integer *integer_definition =
+		enum_definition->integer;
+	struct ctf_json_stream_pos *pos = ctf_json_pos(ppos);
+	int field_nr_saved, in_array_saved;
+	GArray *qs;
+
+	if (!json_print_field(definition))
+		return 0;
+
+	out_field_key(pos, definition->name);
+	field_nr_saved = pos->parent.field_nr;
+	in_array_saved = pos->in_array;
+	pos->in_array = 0;
+	pos->parent.field_nr = 0;
+	out_map_begin(pos);
+
+	out_field_key(pos, Q_LABELS);
+	out_array_begin(pos);
+	qs = enum_definition->value;
+	if (qs) {
+		int i;
+
+		for (i = 0; i < qs->len; i++) {
+			GQuark q = g_array_index(qs, GQuark, i);
+
+			if (i != 0 && pos->encoding == CTF_JSON_ENCODING_JSON)
+				out_putc(pos, ',');
+			out_string(pos, g_quark_to_string(q));
+		}
+	}
+	out_array_end(pos);
+
+	out_field_key(pos, Q_VALUE);
+	if (!integer_definition->declaration->signedness)
+		out_uint(pos, integer_definition->value._unsigned);
+	else
+		out_int(pos, integer_definition->value._signed);
+
+	out_map_end(pos);
+	pos->in_array = in_array_saved;
+	pos->parent.field_nr = field_nr_saved;
+	return 0;
+}
+
+static
+int ctf_json_string_write(struct bt_stream_pos *ppos,
+		struct bt_definition *definition)
+{
+	struct definition_string *string_definition =
+		container_of(definition, struct definition_string, p);
+	struct ctf_json_stream_pos *pos = ctf_json_pos(ppos);
+
+	assert(string_definition->value != NULL);
+
+	if (!json_print_field(definition))
+		return 0;
+
+	out_field_key(pos, definition->name);
+	out_string(pos, string_definition->value);
+	return 0;
+}
+
+/*
+ * Write a compound definition as a map or an array, "rw" walking its
+ * children.
+ */
+static
+int write_compound(struct ctf_json_stream_pos *pos,
+		struct bt_definition *definition, int is_array,
+		int (*rw)(struct bt_stream_pos *pos,
+			struct bt_definition *definition))
+{
+	int field_nr_saved, in_array_saved;
+	int ret;
+
+	field_nr_saved = pos->parent.field_nr;
+	in_array_saved = pos->in_array;
+	if (is_array)
+		out_array_begin(pos);
+	else
+		out_map_begin(pos);
+	pos->parent.field_nr = 0;
+	pos->in_array = is_array;
+	pos->parent.depth++;
+	ret = rw(&pos->parent.parent, definition);
+	pos->parent.depth--;
+	if (is_array)
+		out_array_end(pos);
+	else
+		out_map_end(pos);
+	pos->in_array = in_array_saved;
+	pos->parent.field_nr = field_nr_saved;
+	return ret;
+}
+
+static
+int ctf_json_struct_write(struct bt_stream_pos *ppos,
+		struct bt_definition *definition)
+{
+	struct ctf_json_stream_pos *pos = ctf_json_pos(ppos);
+
+	if (!json_print_field(definition))
+		return 0;
+
+	out_field_key(pos, definition->name);
+	return write_compound(pos, definition, 0, bt_struct_rw);
+}
+
+static
+int ctf_json_variant_write(struct bt_stream_pos *ppos,
+		struct bt_definition *definition)
+{
+	struct ctf_json_stream_pos *pos = ctf_json_pos(ppos);
+
+	if (!json_print_field(definition))
+		return 0;
+
+	out_field_key(pos, definition->name);
+	return write_compound(pos, definition, 0, bt_variant_rw);
+}
+
+/*
+ * Arrays and sequences of text-encoded integers are written as
+ * strings, like the text output does.
+ */
+static
+int write_text_array(struct ctf_json_stream_pos *pos,
+		struct bt_definition *definition, struct bt_declaration *elem,
+		GString *string,
+		int (*rw)(struct bt_stream_pos *pos,
+			struct bt_definition *definition))
+{
+	struct declaration_integer *integer_declaration =
+		container_of(elem, struct declaration_integer, p);
+	int ret = 0;
+
+	if (!(integer_declaration->len == CHAR_BIT
+	    && integer_declaration->p.alignment == CHAR_BIT)) {
+		pos->parent.string = string;
+		g_string_assign(string, "");
+		ret = rw(&pos->parent.parent, definition);
+		pos->parent.string = NULL;
+	}
+	/* Strings stop at the first null character, as in the text output. */
+	out_string(pos, string->str);
+	return ret;
+}
+
+static
+int is_text_elem(struct bt_declaration *elem)
+{
+	struct declaration_integer *integer_declaration;
+
+	if (elem->id != BT_CTF_TYPE_ID_INTEGER)
+		return 0;
+	integer_declaration = container_of(elem, struct declaration_integer, p);
+	return integer_declaration->encoding == CTF_STRING_UTF8
+		|| integer_declaration->encoding == CTF_STRING_ASCII;
+}
+
+static
+int ctf_json_array_write(struct bt_stream_pos *ppos,
+		struct bt_definition *definition)
+{
+	struct ctf_json_stream_pos *pos = ctf_json_pos(ppos);
+	struct definition_array *array_definition =
+		container_of(definition, struct definition_array, p);
+	struct bt_declaration *elem = array_definition->declaration->elem;
+	int ret;
+
+	if (!json_print_field(definition))
+		return 0;
+
+	out_field_key(pos, definition->name);
+	if (is_text_elem(elem))
+		return write_text_array(pos, definition, elem,
+			array_definition->string, bt_array_rw);
+	ret = write_compound(pos, definition, 1, bt_array_rw);
+#ifdef ENABLE_DEBUG_INFO
+	if (!ret && elem->id == BT_CTF_TYPE_ID_INTEGER && !pos->in_array)
+		out_debug_info_stack(pos, array_definition->elems,
+			bt_array_len(array_definition));
+#endif
+	return ret;
+}
+
+static
+int ctf_json_sequence_write(struct bt_stream_pos *ppos,
+		struct bt_definition *definition)
+{
+	struct ctf_json_stream_pos *pos = ctf_json_pos(ppos);
+	struct definition_sequence *sequence_definition =
+		container_of(definition, struct definition_sequence, p);
+	struct bt_declaration *elem = sequence_definition->declaration->elem;
+	int ret;
+
+	if (!json_print_field(definition))
+		return 0;
+
+	out_field_key(pos, definition->name);
+	if (is_text_elem(elem))
+		return write_text_array(pos, definition, elem,
+			sequence_definition->string, bt_sequence_rw);
+	ret = write_compound(pos, definition, 1, bt_sequence_rw);
+#ifdef ENABLE_DEBUG_INFO
+	if (!ret && elem->id == BT_CTF_TYPE_ID_INTEGER && !pos->in_array)
+		out_debug_info_stack(pos, sequence_definition->elems,
+			bt_sequence_len(sequence_definition));
+#endif
+	return ret;
+}
+
+static
+int write_scope(struct ctf_json_stream_pos *pos, GQuark name,
+		struct definition_struct *scope)
+{
+	out_field_key(pos, name);
+	return write_compound(pos, &scope->p, 0, bt_struct_rw);
+}
+
+static
+void write_callsites(struct ctf_json_stream_pos *pos,
+		struct ctf_callsite_dups *cs_dups)
+{
+	struct ctf_callsite *callsite;
+	int field_nr_saved, i = 0;
+
+	out_field_key(pos, Q_CALLSITE);
+	field_nr_saved = pos->parent.field_nr;
+	out_array_begin(pos);
+	bt_list_for_each_entry(callsite, &cs_dups->head, node) {
+		if (i++ != 0 && pos->encoding == CTF_JSON_ENCODING_JSON)
+			out_putc(pos, ',');
+		pos->parent.field_nr = 0;
+		out_map_begin(pos);
+		out_field_key(pos, Q_FUNC);
+		out_string(pos, callsite->func);
+		out_field_key(pos, Q_FILE);
+		out_string(pos, callsite->file);
+		out_field_key(pos, Q_LINE);
+		out_uint(pos, callsite->line);
+		if (CTF_CALLSITE_FIELD_IS_SET(callsite, ip)) {
+			out_field_key(pos, Q_IP);
+			out_uint(pos, callsite->ip);
+		}
+		out_map_end(pos);
+	}
+	out_array_end(pos);
+	pos->parent.field_nr = field_nr_saved;
+}
+
+/*
+ * Each event is one self-contained map: one line of JSON, or one item
+ * of a CBOR sequence.
+ */
+static
+int ctf_json_write_event(struct bt_stream_pos *ppos,
+		struct ctf_stream_definition *stream)
+{
+	struct ctf_json_stream_pos *pos = ctf_json_pos(ppos);
+	struct ctf_stream_declaration *stream_class = stream->stream_class;
+	struct ctf_trace *trace = stream_class->trace;
+	struct ctf_event_declaration *event_class;
+	struct ctf_event_definition *event;
+	uint64_t id;
+	int ret;
+
+	id = stream->event_id;
+
+	if (id >= stream_class->events_by_id->len) {
+		fprintf(stderr, "[error] Event id %" PRIu64 " is outside range.\n", id);
+		return -EINVAL;
+	}
+	event = g_ptr_array_index(stream->events_by_id, id);
+	if (!event) {
+		fprintf(stderr, "[error] Event id %" PRIu64 " is unknown.\n", id);
+		return -EINVAL;
+	}
+	event_class = g_ptr_array_index(stream_class->events_by_id, id);
+	if (!event_class) {
+		fprintf(stderr, "[error] Event class id %" PRIu64 " is unknown.\n", id);
+		return -EINVAL;
+	}
+
+	handle_debug_info_event(stream_class, event);
+
+	pos->parent.field_nr = 0;
+	pos->in_array = 0;
+	out_map_begin(pos);
+
+	if (stream->has_timestamp) {
+		out_field_key(pos, Q_TIMESTAMP);
+		out_uint(pos, opt_clock_cycles ? stream->cycles_timestamp :
+			stream->real_timestamp);
+	}
+	if (opt_delta_field && stream->has_timestamp) {
+		out_field_key(pos, Q_DELTA);
+		if (pos->parent.last_real_timestamp != -1ULL) {
+			out_uint(pos, stream->real_timestamp -
+				pos->parent.last_real_timestamp);
+		} else {
+			out_null(pos);
+		}
+		pos->parent.last_real_timestamp = stream->real_timestamp;
+		pos->parent.last_cycles_timestamp = stream->cycles_timestamp;
+	}
+	if ((opt_trace_field || opt_all_fields) && trace->parent.path[0] != '\0') {
+		out_field_key(pos, Q_TRACE);
+		out_string(pos, trace->parent.path);
+	}
+	if ((opt_trace_hostname_field || opt_all_fields || opt_trace_default_fields)
+			&& trace->env.hostname[0] != '\0') {
+		out_field_key(pos, Q_TRACE_HOSTNAME);
+		out_string(pos, trace->env.hostname);
+	}
+	if ((opt_trace_domain_field || opt_all_fields) && trace->env.domain[0] != '\0') {
+		out_field_key(pos, Q_TRACE_DOMAIN);
+		out_string(pos, trace->env.domain);
+	}
+	if ((opt_trace_procname_field || opt_all_fields || opt_trace_default_fields)
+			&& trace->env.procname[0] != '\0') {
+		out_field_key(pos, Q_TRACE_PROCNAME);
+		out_string(pos, trace->env.procname);
+	}
+	if ((opt_trace_vpid_field || opt_all_fields || opt_trace_default_fields)
+			&& trace->env.vpid != -1) {
+		out_field_key(pos, Q_TRACE_VPID);
+		out_int(pos, trace->env.vpid);
+	}
+	if ((opt_loglevel_field || opt_all_fields) && event_class->loglevel != -1) {
+		out_field_key(pos, Q_LOGLEVEL);
+		out_int(pos, event_class->loglevel);
+	}
+	if ((opt_emf_field || opt_all_fields) && event_class->model_emf_uri) {
+		out_field_key(pos, Q_MODEL_EMF_URI);
+		out_string(pos, g_quark_to_string(event_class->model_emf_uri));
+	}
+	if (opt_callsite_field || opt_all_fields) {
+		struct ctf_callsite_dups *cs_dups;
+
+		cs_dups = g_hash_table_lookup(trace->callsites,
+			(gpointer) (unsigned long) event_class->name);
+		if (cs_dups)
+			write_callsites(pos, cs_dups);
+	}
+	out_field_key(pos, Q_NAME);
+	out_string(pos, g_quark_to_string(event_class->name));
+
+	if (stream->stream_packet_context) {
+		ret = write_scope(pos, Q_STREAM_PACKET_CONTEXT,
+			stream->stream_packet_context);
+		if (ret)
+			goto error;
+	}
+	/* Only show the event header in verbose mode */
+	if (babeltrace_verbose && stream->stream_event_header) {
+		ret = write_scope(pos, Q_STREAM_EVENT_HEADER,
+			stream->stream_event_header);
+		if (ret)
+			goto error;
+	}
+	if (stream->stream_event_context) {
+		ret = write_scope(pos, Q_STREAM_EVENT_CONTEXT,
+			stream->stream_event_context);
+		if (ret)
+			goto error;
+	}
+	if (event->event_context) {
+		ret = write_scope(pos, Q_EVENT_CONTEXT, event->event_context);
+		if (ret)
+			goto error;
+	}
+	if (event->event_fields) {
+		ret = write_scope(pos, Q_EVENT_FIELDS, event->event_fields);
+		if (ret)
+			goto error;
+	}
+
+	out_map_end(pos);
+	if (pos->encoding == CTF_JSON_ENCODING_JSON)
+		out_putc(pos, '\n');
+	if (pos->error) {
+		perror("Error writing event");
+		return -EIO;
+	}
+	return 0;
+
+error:
+	fprintf(stderr, "[error] Unexpected end of stream. Either the trace data stream is corrupted or metadata description does not match data layout.\n");
+	return ret;
+}
+
+static
+int ctf_json_flush(struct bt_stream_pos *ppos)
+{
+	struct ctf_json_stream_pos *pos = ctf_json_pos(ppos);
+
+	out_flush(pos);
+	if (pos->error || fflush(pos->parent.fp)) {
+		perror("Error on write");
+		return -1;
+	}
+	return 0;
+}
+
+static
+struct bt_trace_descriptor *open_trace(const char *path, int flags,
+		enum ctf_json_encoding encoding)
+{
+	struct ctf_json_stream_pos *pos;
+	FILE *fp;
+
+	pos = g_new0(struct ctf_json_stream_pos, 1);
+	if (!pos) {
+		goto error;
+	}
+	init_trace_descriptor(&pos->parent.trace_descriptor);
+
+	pos->encoding = encoding;
+	pos->parent.last_real_timestamp = -1ULL;
+	pos->parent.last_cycles_timestamp = -1ULL;
+	switch (flags & O_ACCMODE) {
+	case O_RDWR:
+		if (!path)
+			fp = stdout;
+		else
+			fp = fopen(path, "w");
+		if (!fp)
+			goto error;
+		pos->buf = g_malloc(CTF_JSON_BUF_LEN);
+		pos->keys = g_hash_table_new_full(g_direct_hash,
+			g_direct_equal, NULL, key_free);
+		pos->parent.fp = fp;
+		pos->parent.parent.rw_table = write_dispatch_table;
+		pos->parent.parent.event_cb = ctf_json_write_event;
+		pos->parent.parent.flush_cb = ctf_json_flush;
+		pos->parent.parent.trace = &pos->parent.trace_descriptor;
+		babeltrace_ctf_console_output++;
+		break;
+	case O_RDONLY:
+	default:
+		fprintf(stderr, "[error] Incorrect open flags.\n");
+		goto error;
+	}
+
+	return &pos->parent.trace_descriptor;
+error:
+	g_free(pos);
+	return NULL;
+}
+
+static
+struct bt_trace_descriptor *ctf_json_open_trace(const char *path, int flags,
+		void (*packet_seek)(struct bt_stream_pos *pos, size_t index,
+			int whence), FILE *metadata_fp)
+{
+	return open_trace(path, flags, CTF_JSON_ENCODING_JSON);
+}
+
+static
+struct bt_trace_descriptor *ctf_cbor_open_trace(const char *path, int flags,
+		void (*packet_seek)(struct bt_stream_pos *pos, size_t index,
+			int whence), FILE *metadata_fp)
+{
+	return open_trace(path, flags, CTF_JSON_ENCODING_CBOR);
+}
+
+static
+int ctf_json_close_trace(struct bt_trace_descriptor *td)
+{
+	int ret = 0;
+	struct ctf_json_stream_pos *pos =
+		container_of(td, struct ctf_json_stream_pos,
+			parent.trace_descriptor);
+
+	babeltrace_ctf_console_output--;
+	out_flush(pos);
+	if (pos->error) {
+		perror("Error on write");
+		ret = -1;
+	}
+	if (pos->parent.fp != stdout) {
+		if (fclose(pos->parent.fp)) {
+			perror("Error on fclose");
+			ret = -1;
+		}
+	} else if (fflush(stdout)) {
+		perror("Error on fflush");
+		ret = -1;
+	}
+	g_hash_table_destroy(pos->keys);
+	g_free(pos->buf);
+	g_free(pos);
+	return ret;
+}
+
+static
+void __attribute__((constructor)) ctf_json_init(void)
+{
+	int ret;
+
+	ctf_json_format.name = g_quark_from_string("json");
+	ret = bt_register_format(&ctf_json_format);
+	assert(!ret);
+	ctf_cbor_format.name = g_quark_from_string("cbor");
+	ret = bt_register_format(&ctf_cbor_format);
+	assert(!ret);
+}
+
+static
+void __attribute__((destructor)) ctf_json_exit(void)
+{
+	bt_unregister_format(&ctf_json_format);
+	bt_unregister_format(&ctf_cbor_format);
+}
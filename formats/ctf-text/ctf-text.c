@@ -88,6 +88,18 @@ enum bt_loglevel {
         BT_LOGLEVEL_DEBUG                  = 14,
 };
 
+static
+int ctf_text_flush(struct bt_stream_pos *ppos)
+{
+	struct ctf_text_stream_pos *pos = ctf_text_pos(ppos);
+
+	if (fflush(pos->fp)) {
+		perror("Error on fflush");
+		return -1;
+	}
+	return 0;
+}
+
 static
 struct bt_trace_descriptor *ctf_text_open_trace(const char *path, int flags,
 		void (*packet_seek)(struct bt_stream_pos *pos, size_t index,
@@ -573,6 +585,7 @@ struct bt_trace_descriptor *ctf_text_open_trace(const char *path, int flags,
 		pos->fp = fp;
 		pos->parent.rw_table = write_dispatch_table;
 		pos->parent.event_cb = ctf_text_write_event;
+		pos->parent.flush_cb = ctf_text_flush;
 		pos->parent.trace = &pos->trace_descriptor;
 		pos->print_names = 0;
 		babeltrace_ctf_console_output++;
@@ -54,6 +54,7 @@
 #include "metadata/ctf-parser.h"
 #include "metadata/ctf-ast.h"
 #include "events-private.h"
+#include "output-private.h"
 #include <babeltrace/compat/memstream.h>
 #include <babeltrace/compat/fcntl.h>
 
@@ -83,7 +84,10 @@ int64_t opt_clock_offset_ns;
 
 extern int yydebug;
 char *opt_debug_info_dir;
+char *opt_debug_info_cache_dir;
+int opt_debug_info_jobs;
 char *opt_debug_info_target_prefix;
+char *opt_metadata_cache_dir;
 
 /*
  * TODO: babeltrace_ctf_console_output ensures that we only print
@@ -1461,6 +1465,345 @@ int ctf_trace_metadata_stream_read(struct ctf_trace *td, FILE **fp,
 	return 0;
 }
 
+/*
+ * Metadata declaration cache.
+ *
+ * Traces recorded by the same tracer session usually carry
+ * byte-for-byte identical metadata (e.g. one trace per CPU or per
+ * process). Parsing the TSDL and constructing its declarations is by
+ * far the most expensive part of opening such traces, so the
+ * declarations constructed for each distinct metadata are kept in a
+ * template trace for as long as a trace opened from it is alive. Each
+ * trace then shares the template declarations by reference (see
+ * ctf_copy_metadata()).
+ *
+ * Declarations depend on the byte order and UUID known before the
+ * metadata is visited (packetized metadata), so these are part of the
+ * key. Only used for on-disk traces, which never append metadata.
+ */
+struct ctf_metadata_cache_entry {
+	char *text;			/* Metadata text */
+	int byte_order;
+	int has_uuid;
+	unsigned char uuid[BABELTRACE_UUID_LEN];
+	int refcount;
+	struct ctf_trace *metadata;	/* Template owning the declarations */
+};
+
+static
+GHashTable *metadata_cache;		/* Set of struct ctf_metadata_cache_entry */
+
+static
+guint ctf_metadata_cache_hash(gconstpointer key)
+{
+	const struct ctf_metadata_cache_entry *entry = key;
+
+	return g_str_hash(entry->text) ^ entry->byte_order;
+}
+
+static
+gboolean ctf_metadata_cache_equal(gconstpointer a, gconstpointer b)
+{
+	const struct ctf_metadata_cache_entry *ea = a, *eb = b;
+
+	if (ea->byte_order != eb->byte_order || ea->has_uuid != eb->has_uuid)
+		return FALSE;
+	if (ea->has_uuid && bt_uuid_compare(ea->uuid, eb->uuid))
+		return FALSE;
+	return !strcmp(ea->text, eb->text);
+}
+
+static
+void ctf_metadata_cache_put(struct ctf_metadata_cache_entry *entry)
+{
+	if (!entry)
+		return;
+	if (--entry->refcount)
+		return;
+	g_hash_table_remove(metadata_cache, entry);
+	if (!g_hash_table_size(metadata_cache)) {
+		g_hash_table_destroy(metadata_cache);
+		metadata_cache = NULL;
+	}
+	ctf_destroy_metadata(entry->metadata);
+	g_free(entry->metadata);
+	g_free(entry->text);
+	g_free(entry);
+}
+
+static
+char *ctf_metadata_read_text(FILE *fp, size_t *len)
+{
+	GString *text;
+	char buf[4096];
+	size_t nr_read;
+
+	text = g_string_sized_new(sizeof(buf));
+	while ((nr_read = fread(buf, 1, sizeof(buf), fp)) > 0)
+		g_string_append_len(text, buf, nr_read);
+	if (ferror(fp)) {
+		perror("Metadata read");
+		g_string_free(text, TRUE);
+		return NULL;
+	}
+	*len = text->len;
+	return g_string_free(text, FALSE);
+}
+
+/*
+ * Path of the parsed metadata image of a metadata text within the
+ * metadata cache directory, named after the SHA-256 of the text.
+ */
+static
+char *ctf_metadata_image_path(const char *text, size_t len)
+{
+	gchar *checksum, *path;
+
+	checksum = g_compute_checksum_for_data(G_CHECKSUM_SHA256,
+			(const guchar *) text, len);
+	if (!checksum)
+		return NULL;
+	path = g_build_filename(opt_metadata_cache_dir, checksum, NULL);
+	g_free(checksum);
+	return path;
+}
+
+/*
+ * Load the AST of a metadata text from its image in the metadata cache
+ * directory. Returns 0 on success, -1 if there is no usable image.
+ */
+static
+int ctf_metadata_image_load(struct ctf_scanner *scanner, const char *path,
+		size_t text_len)
+{
+	gchar *image;
+	gsize len;
+	int ret;
+
+	if (!g_file_get_contents(path, &image, &len, NULL))
+		return -1;
+	ret = ctf_scanner_load_ast_image(scanner, image, len, text_len);
+	g_free(image);
+	if (ret) {
+		printf_verbose("Ignoring invalid metadata cache file %s\n",
+				path);
+		return -1;
+	}
+	printf_verbose("Loaded parsed metadata from %s\n", path);
+	return 0;
+}
+
+/*
+ * Write the image of a validated metadata AST to the metadata cache
+ * directory. The image is written to a temporary file renamed once
+ * complete, so that concurrent readers only ever load complete images.
+ */
+static
+void ctf_metadata_image_save(struct ctf_node *root, const char *path,
+		size_t text_len)
+{
+	GString *image;
+	char *tmp_path = NULL;
+	const char *buf;
+	size_t len;
+	int fd = -1;
+
+	image = ctf_ast_image_create(root, text_len);
+	if (!image)
+		goto error;
+	if (g_mkdir_with_parents(opt_metadata_cache_dir, 0755))
+		goto error;
+	tmp_path = g_strconcat(path, ".XXXXXX", NULL);
+	fd = mkstemp(tmp_path);
+	if (fd < 0)
+		goto error;
+	buf = image->str;
+	len = image->len;
+	while (len) {
+		ssize_t written = write(fd, buf, len);
+
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			goto error;
+		}
+		buf += written;
+		len -= written;
+	}
+	if (close(fd)) {
+		fd = -1;
+		goto error;
+	}
+	fd = -1;
+	if (rename(tmp_path, path))
+		goto error;
+	goto end;
+
+error:
+	printf_verbose("Unable to write metadata cache file %s\n", path);
+	if (fd >= 0)
+		close(fd);
+	if (tmp_path)
+		unlink(tmp_path);
+end:
+	g_free(tmp_path);
+	if (image)
+		g_string_free(image, TRUE);
+}
+
+/*
+ * Parse and validate a metadata text into the scanner AST.
+ */
+static
+int ctf_metadata_parse(struct ctf_scanner *scanner, char *text, size_t len)
+{
+	FILE *text_fp;
+	int ret, closeret;
+
+	text_fp = babeltrace_fmemopen(text, len, "rb");
+	if (!text_fp) {
+		perror("Metadata fmemopen");
+		return -errno;
+	}
+	ret = ctf_scanner_append_ast(scanner, text_fp);
+	closeret = fclose(text_fp);
+	if (closeret) {
+		perror("Error on fclose");
+	}
+	if (ret) {
+		fprintf(stderr, "[error] Error creating AST\n");
+		return ret;
+	}
+
+	ret = ctf_visitor_semantic_check(stderr, 0, &scanner->ast->root);
+	if (ret) {
+		fprintf(stderr, "[error] Error in CTF semantic validation %d\n", ret);
+		return ret;
+	}
+	return 0;
+}
+
+/*
+ * Construct the template trace of a new cache entry from its metadata
+ * text. With a metadata cache directory, the validated AST of each
+ * distinct metadata text is kept on disk, so that later runs skip
+ * lexing, parsing and validating it.
+ */
+static
+int ctf_metadata_cache_construct(struct ctf_metadata_cache_entry *entry,
+		size_t len)
+{
+	struct ctf_scanner *scanner;
+	char *image_path = NULL;
+	int ret;
+
+	scanner = ctf_scanner_alloc();
+	if (!scanner) {
+		fprintf(stderr, "[error] Error allocating scanner\n");
+		return -ENOMEM;
+	}
+	if (opt_metadata_cache_dir)
+		image_path = ctf_metadata_image_path(entry->text, len);
+	if (image_path && !ctf_metadata_image_load(scanner, image_path, len)) {
+		ret = ctf_visitor_parent_links(stderr, 0, &scanner->ast->root);
+		if (ret) {
+			fprintf(stderr, "[error] Error creating AST parent links\n");
+			goto end;
+		}
+	} else {
+		ret = ctf_metadata_parse(scanner, entry->text, len);
+		if (ret)
+			goto end;
+		if (image_path)
+			ctf_metadata_image_save(&scanner->ast->root, image_path,
+					len);
+	}
+
+	if (babeltrace_debug) {
+		ret = ctf_visitor_print_xml(stderr, 0, &scanner->ast->root);
+		if (ret) {
+			fprintf(stderr, "[error] Error visiting AST for XML output\n");
+			goto end;
+		}
+	}
+
+	entry->metadata = g_new0(struct ctf_trace, 1);
+	if (entry->has_uuid) {
+		memcpy(entry->metadata->uuid, entry->uuid, sizeof(entry->uuid));
+		CTF_TRACE_SET_FIELD(entry->metadata, uuid);
+	}
+	entry->metadata->declaration_arena = bt_declaration_arena_create();
+	ret = ctf_visitor_construct_metadata(stderr, 0, &scanner->ast->root,
+			entry->metadata, entry->byte_order);
+	if (ret) {
+		fprintf(stderr, "[error] Error in CTF metadata constructor %d\n", ret);
+		bt_declaration_arena_destroy(entry->metadata->declaration_arena);
+		g_free(entry->metadata);
+		entry->metadata = NULL;
+		goto end;
+	}
+end:
+	g_free(image_path);
+	ctf_scanner_free(scanner);
+	return ret;
+}
+
+/*
+ * Read the whole metadata text from fp and return the cache entry
+ * holding its declarations, constructing them only if no other open
+ * trace shares the same metadata. The caller owns a reference on the
+ * entry.
+ */
+static
+int ctf_metadata_cache_get(struct ctf_trace *td, FILE *fp,
+		struct ctf_metadata_cache_entry **entryp)
+{
+	struct ctf_metadata_cache_entry *entry;
+	char *text;
+	size_t len;
+	int ret;
+
+	text = ctf_metadata_read_text(fp, &len);
+	if (!text)
+		return -errno;
+
+	entry = g_new0(struct ctf_metadata_cache_entry, 1);
+	entry->text = text;
+	entry->byte_order = td->byte_order;
+	if (CTF_TRACE_FIELD_IS_SET(td, uuid)) {
+		entry->has_uuid = 1;
+		memcpy(entry->uuid, td->uuid, sizeof(entry->uuid));
+	}
+
+	if (metadata_cache) {
+		struct ctf_metadata_cache_entry *cached;
+
+		cached = g_hash_table_lookup(metadata_cache, entry);
+		if (cached) {
+			printf_verbose("Sharing metadata declarations with a previously opened trace.\n");
+			g_free(entry->text);
+			g_free(entry);
+			cached->refcount++;
+			*entryp = cached;
+			return 0;
+		}
+	}
+
+	ret = ctf_metadata_cache_construct(entry, len);
+	if (ret) {
+		g_free(entry->text);
+		g_free(entry);
+		return ret;
+	}
+	entry->refcount = 1;
+	if (!metadata_cache)
+		metadata_cache = g_hash_table_new(ctf_metadata_cache_hash,
+				ctf_metadata_cache_equal);
+	g_hash_table_insert(metadata_cache, entry, entry);
+	*entryp = entry;
+	return 0;
+}
+
 static
 int ctf_trace_metadata_read(struct ctf_trace *td, FILE *metadata_fp,
 		struct ctf_scanner *scanner, int append)
@@ -1524,6 +1867,15 @@ int ctf_trace_metadata_read(struct ctf_trace *td, FILE *metadata_fp,
 		}
 	}
 
+	if (!scanner) {
+		/* No incremental append: share cached declarations. */
+		ret = ctf_metadata_cache_get(td, fp, &td->metadata_cache);
+		if (ret)
+			goto end;
+		ctf_copy_metadata(td, td->metadata_cache->metadata);
+		goto end;
+	}
+
 	ret = ctf_scanner_append_ast(scanner, fp);
 	if (ret) {
 		fprintf(stderr, "[error] Error creating AST\n");
@@ -1543,6 +1895,8 @@ int ctf_trace_metadata_read(struct ctf_trace *td, FILE *metadata_fp,
 		fprintf(stderr, "[error] Error in CTF semantic validation %d\n", ret);
 		goto end;
 	}
+	if (!td->declaration_arena)
+		td->declaration_arena = bt_declaration_arena_create();
 	ret = ctf_visitor_construct_metadata(stderr, 0, &scanner->ast->root,
 			td, td->byte_order);
 	if (ret) {
@@ -2335,7 +2689,6 @@ int ctf_open_trace_read(struct ctf_trace *td,
 		void (*packet_seek)(struct bt_stream_pos *pos, size_t index,
 			int whence), FILE *metadata_fp)
 {
-	struct ctf_scanner *scanner;
 	int ret, closeret;
 	struct dirent *dirent;
 	struct dirent *diriter;
@@ -2365,17 +2718,11 @@ int ctf_open_trace_read(struct ctf_trace *td,
 
 	/*
 	 * Keep the metadata file separate.
-	 * Keep scanner object local to the open. We don't support
-	 * incremental metadata append for on-disk traces.
+	 * We don't support incremental metadata append for on-disk
+	 * traces, so the metadata declarations come from the metadata
+	 * cache and may be shared with other traces.
 	 */
-	scanner = ctf_scanner_alloc();
-	if (!scanner) {
-		fprintf(stderr, "[error] Error allocating scanner\n");
-		ret = -ENOMEM;
-		goto error_metadata;
-	}
-	ret = ctf_trace_metadata_read(td, metadata_fp, scanner, 0);
-	ctf_scanner_free(scanner);
+	ret = ctf_trace_metadata_read(td, metadata_fp, NULL, 0);
 	if (ret) {
 		if (ret == -ENOENT) {
 			fprintf(stderr, "[warning] Empty metadata.\n");
@@ -2436,6 +2783,8 @@ int ctf_open_trace_read(struct ctf_trace *td,
 readdir_error:
 	free(dirent);
 error_metadata:
+	ctf_metadata_cache_put(td->metadata_cache);
+	td->metadata_cache = NULL;
 	closeret = close(td->dirfd);
 	if (closeret) {
 		perror("Error on fd close");
@@ -2468,6 +2817,10 @@ struct bt_trace_descriptor *ctf_open_trace(const char *path, int flags,
 	if (!packet_seek)
 		packet_seek = ctf_packet_seek;
 
+	/* Output traces are written with the CTF writer. */
+	if ((flags & O_ACCMODE) == O_RDWR)
+		return ctf_output_open_trace(path);
+
 	td = g_new0(struct ctf_trace, 1);
 	if (!td) {
 		goto error;
@@ -2484,9 +2837,6 @@ struct bt_trace_descriptor *ctf_open_trace(const char *path, int flags,
 		if (ret)
 			goto error;
 		break;
-	case O_RDWR:
-		fprintf(stderr, "[error] Opening CTF traces for output is not supported yet.\n");
-		goto error;
 	default:
 		fprintf(stderr, "[error] Incorrect open flags.\n");
 		goto error;
@@ -2789,6 +3139,8 @@ int ctf_close_trace(struct bt_trace_descriptor *tdp)
 	struct ctf_trace *td = container_of(tdp, struct ctf_trace, parent);
 	int ret;
 
+	if (ctf_output_is_trace(tdp))
+		return ctf_output_close_trace(tdp);
 	if (td->streams) {
 		int i;
 
@@ -2811,6 +3163,7 @@ int ctf_close_trace(struct bt_trace_descriptor *tdp)
 	}
 	ctf_destroy_metadata(td);
 	ctf_scanner_free(td->scanner);
+	ctf_metadata_cache_put(td->metadata_cache);
 	if (td->dirfd >= 0) {
 		ret = close(td->dirfd);
 		if (ret) {
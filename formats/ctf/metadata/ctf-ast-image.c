@@ -0,0 +1,616 @@
+/*
+ * ctf-ast-image.c
+ *
+ * Common Trace Format Metadata AST Image Writer and Loader.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * An AST image is a flat, host-endian serialization of a validated
+ * metadata AST, which lets a trace skip lexing, parsing and semantic
+ * checking of metadata it has already seen. Nodes are written in
+ * preorder: type and line number, followed by the fields of that node
+ * type. Lists are written as a node count followed by the nodes,
+ * optional child nodes as a presence byte followed by the node, and
+ * strings as a length (IMAGE_NULL_STRING for NULL) followed by the
+ * characters. Parent links are not part of the image.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <glib.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <babeltrace/babeltrace-internal.h>
+#include <babeltrace/list.h>
+#include "ctf-scanner.h"
+#include "ctf-ast.h"
+#include "objstack.h"
+
+#define IMAGE_MAGIC		0x54534443U	/* Byte-swapped on foreign hosts */
+#define IMAGE_VERSION		1
+#define IMAGE_NULL_STRING	UINT32_MAX
+
+struct image_reader {
+	const char *p;
+	const char *end;
+	struct objstack *objstack;
+};
+
+static
+int image_put_node(GString *image, struct ctf_node *node);
+
+static
+void image_put_u32(GString *image, uint32_t v)
+{
+	g_string_append_len(image, (const char *) &v, sizeof(v));
+}
+
+static
+void image_put_u64(GString *image, uint64_t v)
+{
+	g_string_append_len(image, (const char *) &v, sizeof(v));
+}
+
+static
+void image_put_string(GString *image, const char *str)
+{
+	size_t len;
+
+	if (!str) {
+		image_put_u32(image, IMAGE_NULL_STRING);
+		return;
+	}
+	len = strlen(str);
+	image_put_u32(image, len);
+	g_string_append_len(image, str, len);
+}
+
+static
+int image_put_list(GString *image, struct bt_list_head *head)
+{
+	struct ctf_node *iter;
+	uint32_t count = 0;
+	int ret;
+
+	bt_list_for_each_entry(iter, head, siblings)
+		count++;
+	image_put_u32(image, count);
+	bt_list_for_each_entry(iter, head, siblings) {
+		ret = image_put_node(image, iter);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+static
+int image_put_opt_node(GString *image, struct ctf_node *node)
+{
+	g_string_append_c(image, node ? 1 : 0);
+	if (!node)
+		return 0;
+	return image_put_node(image, node);
+}
+
+static
+int image_put_node(GString *image, struct ctf_node *node)
+{
+	int ret = 0;
+
+	image_put_u32(image, node->type);
+	image_put_u32(image, node->lineno);
+
+	switch (node->type) {
+	case NODE_ROOT:
+		ret = image_put_list(image, &node->u.root.declaration_list);
+		if (ret)
+			return ret;
+		ret = image_put_list(image, &node->u.root.trace);
+		if (ret)
+			return ret;
+		ret = image_put_list(image, &node->u.root.env);
+		if (ret)
+			return ret;
+		ret = image_put_list(image, &node->u.root.stream);
+		if (ret)
+			return ret;
+		ret = image_put_list(image, &node->u.root.event);
+		if (ret)
+			return ret;
+		ret = image_put_list(image, &node->u.root.clock);
+		if (ret)
+			return ret;
+		ret = image_put_list(image, &node->u.root.callsite);
+		break;
+	case NODE_EVENT:
+		ret = image_put_list(image, &node->u.event.declaration_list);
+		break;
+	case NODE_STREAM:
+		ret = image_put_list(image, &node->u.stream.declaration_list);
+		break;
+	case NODE_ENV:
+		ret = image_put_list(image, &node->u.env.declaration_list);
+		break;
+	case NODE_TRACE:
+		ret = image_put_list(image, &node->u.trace.declaration_list);
+		break;
+	case NODE_CLOCK:
+		ret = image_put_list(image, &node->u.clock.declaration_list);
+		break;
+	case NODE_CALLSITE:
+		ret = image_put_list(image, &node->u.callsite.declaration_list);
+		break;
+	case NODE_CTF_EXPRESSION:
+		ret = image_put_list(image, &node->u.ctf_expression.left);
+		if (ret)
+			return ret;
+		ret = image_put_list(image, &node->u.ctf_expression.right);
+		break;
+	case NODE_UNARY_EXPRESSION:
+		image_put_u32(image, node->u.unary_expression.type);
+		image_put_u32(image, node->u.unary_expression.link);
+		switch (node->u.unary_expression.type) {
+		case UNARY_STRING:
+			image_put_string(image, node->u.unary_expression.u.string);
+			break;
+		case UNARY_SIGNED_CONSTANT:
+			image_put_u64(image, node->u.unary_expression.u.signed_constant);
+			break;
+		case UNARY_UNSIGNED_CONSTANT:
+			image_put_u64(image, node->u.unary_expression.u.unsigned_constant);
+			break;
+		case UNARY_SBRAC:
+			ret = image_put_opt_node(image, node->u.unary_expression.u.sbrac_exp);
+			break;
+		default:
+			return -EINVAL;
+		}
+		break;
+	/* These four node types share the same layout. */
+	case NODE_TYPEDEF:
+	case NODE_TYPEALIAS_TARGET:
+	case NODE_TYPEALIAS_ALIAS:
+	case NODE_STRUCT_OR_VARIANT_DECLARATION:
+		ret = image_put_opt_node(image, node->u._typedef.type_specifier_list);
+		if (ret)
+			return ret;
+		ret = image_put_list(image, &node->u._typedef.type_declarators);
+		break;
+	case NODE_TYPEALIAS:
+		ret = image_put_opt_node(image, node->u.typealias.target);
+		if (ret)
+			return ret;
+		ret = image_put_opt_node(image, node->u.typealias.alias);
+		break;
+	case NODE_TYPE_SPECIFIER:
+		image_put_u32(image, node->u.type_specifier.type);
+		image_put_string(image, node->u.type_specifier.id_type);
+		ret = image_put_opt_node(image, node->u.type_specifier.node);
+		break;
+	case NODE_TYPE_SPECIFIER_LIST:
+		ret = image_put_list(image, &node->u.type_specifier_list.head);
+		break;
+	case NODE_POINTER:
+		image_put_u32(image, node->u.pointer.const_qualifier);
+		break;
+	case NODE_TYPE_DECLARATOR:
+		ret = image_put_list(image, &node->u.type_declarator.pointers);
+		if (ret)
+			return ret;
+		image_put_u32(image, node->u.type_declarator.type);
+		switch (node->u.type_declarator.type) {
+		case TYPEDEC_ID:
+			image_put_string(image, node->u.type_declarator.u.id);
+			break;
+		case TYPEDEC_NESTED:
+			ret = image_put_opt_node(image, node->u.type_declarator.u.nested.type_declarator);
+			if (ret)
+				return ret;
+			ret = image_put_list(image, &node->u.type_declarator.u.nested.length);
+			if (ret)
+				return ret;
+			image_put_u32(image, node->u.type_declarator.u.nested.abstract_array);
+			break;
+		default:
+			return -EINVAL;
+		}
+		ret = image_put_opt_node(image, node->u.type_declarator.bitfield_len);
+		break;
+	case NODE_FLOATING_POINT:
+		ret = image_put_list(image, &node->u.floating_point.expressions);
+		break;
+	case NODE_INTEGER:
+		ret = image_put_list(image, &node->u.integer.expressions);
+		break;
+	case NODE_STRING:
+		ret = image_put_list(image, &node->u.string.expressions);
+		break;
+	case NODE_ENUMERATOR:
+		image_put_string(image, node->u.enumerator.id);
+		ret = image_put_list(image, &node->u.enumerator.values);
+		break;
+	case NODE_ENUM:
+		image_put_string(image, node->u._enum.enum_id);
+		image_put_u32(image, node->u._enum.has_body);
+		ret = image_put_opt_node(image, node->u._enum.container_type);
+		if (ret)
+			return ret;
+		ret = image_put_list(image, &node->u._enum.enumerator_list);
+		break;
+	case NODE_VARIANT:
+		image_put_string(image, node->u.variant.name);
+		image_put_string(image, node->u.variant.choice);
+		image_put_u32(image, node->u.variant.has_body);
+		ret = image_put_list(image, &node->u.variant.declaration_list);
+		break;
+	case NODE_STRUCT:
+		image_put_string(image, node->u._struct.name);
+		image_put_u32(image, node->u._struct.has_body);
+		ret = image_put_list(image, &node->u._struct.declaration_list);
+		if (ret)
+			return ret;
+		ret = image_put_list(image, &node->u._struct.min_align);
+		break;
+	case NODE_UNKNOWN:
+	case NODE_ERROR:
+	default:
+		return -EINVAL;
+	}
+	return ret;
+}
+
+GString *ctf_ast_image_create(struct ctf_node *root, uint64_t text_len)
+{
+	GString *image;
+
+	image = g_string_sized_new(4096);
+	image_put_u32(image, IMAGE_MAGIC);
+	image_put_u32(image, IMAGE_VERSION);
+	image_put_u64(image, text_len);
+	if (image_put_node(image, root)) {
+		g_string_free(image, TRUE);
+		return NULL;
+	}
+	return image;
+}
+
+static
+int image_get(struct image_reader *r, void *v, size_t len)
+{
+	if ((size_t) (r->end - r->p) < len)
+		return -EINVAL;
+	memcpy(v, r->p, len);
+	r->p += len;
+	return 0;
+}
+
+static
+int image_get_u32(struct image_reader *r, uint32_t *v)
+{
+	return image_get(r, v, sizeof(*v));
+}
+
+static
+int image_get_string(struct image_reader *r, char **str)
+{
+	uint32_t len;
+	char *s;
+
+	if (image_get_u32(r, &len))
+		return -EINVAL;
+	if (len == IMAGE_NULL_STRING) {
+		*str = NULL;
+		return 0;
+	}
+	if ((size_t) (r->end - r->p) < len)
+		return -EINVAL;
+	s = objstack_alloc(r->objstack, len + 1);
+	if (!s)
+		return -ENOMEM;
+	memcpy(s, r->p, len);	/* Zeroed by objstack_alloc */
+	r->p += len;
+	*str = s;
+	return 0;
+}
+
+static
+int image_get_node(struct image_reader *r, struct ctf_node *node);
+
+static
+int image_get_list(struct image_reader *r, struct bt_list_head *head)
+{
+	uint32_t count;
+	int ret;
+
+	BT_INIT_LIST_HEAD(head);
+	if (image_get_u32(r, &count))
+		return -EINVAL;
+	while (count--) {
+		struct ctf_node *node;
+
+		node = objstack_alloc(r->objstack, sizeof(*node));
+		if (!node)
+			return -ENOMEM;
+		ret = image_get_node(r, node);
+		if (ret)
+			return ret;
+		bt_list_add_tail(&node->siblings, head);
+	}
+	return 0;
+}
+
+static
+int image_get_opt_node(struct image_reader *r, struct ctf_node **nodep)
+{
+	struct ctf_node *node;
+	char present;
+
+	*nodep = NULL;
+	if (image_get(r, &present, sizeof(present)))
+		return -EINVAL;
+	if (!present)
+		return 0;
+	node = objstack_alloc(r->objstack, sizeof(*node));
+	if (!node)
+		return -ENOMEM;
+	*nodep = node;
+	return image_get_node(r, node);
+}
+
+static
+int image_get_node(struct image_reader *r, struct ctf_node *node)
+{
+	uint32_t type, lineno, v;
+	int ret = 0;
+
+	if (image_get_u32(r, &type) || image_get_u32(r, &lineno))
+		return -EINVAL;
+	node->type = type;
+	node->lineno = lineno;
+	BT_INIT_LIST_HEAD(&node->siblings);
+	BT_INIT_LIST_HEAD(&node->tmp_head);
+
+	switch (node->type) {
+	case NODE_ROOT:
+		ret = image_get_list(r, &node->u.root.declaration_list);
+		if (ret)
+			return ret;
+		ret = image_get_list(r, &node->u.root.trace);
+		if (ret)
+			return ret;
+		ret = image_get_list(r, &node->u.root.env);
+		if (ret)
+			return ret;
+		ret = image_get_list(r, &node->u.root.stream);
+		if (ret)
+			return ret;
+		ret = image_get_list(r, &node->u.root.event);
+		if (ret)
+			return ret;
+		ret = image_get_list(r, &node->u.root.clock);
+		if (ret)
+			return ret;
+		ret = image_get_list(r, &node->u.root.callsite);
+		break;
+	case NODE_EVENT:
+		ret = image_get_list(r, &node->u.event.declaration_list);
+		break;
+	case NODE_STREAM:
+		ret = image_get_list(r, &node->u.stream.declaration_list);
+		break;
+	case NODE_ENV:
+		ret = image_get_list(r, &node->u.env.declaration_list);
+		break;
+	case NODE_TRACE:
+		ret = image_get_list(r, &node->u.trace.declaration_list);
+		break;
+	case NODE_CLOCK:
+		ret = image_get_list(r, &node->u.clock.declaration_list);
+		break;
+	case NODE_CALLSITE:
+		ret = image_get_list(r, &node->u.callsite.declaration_list);
+		break;
+	case NODE_CTF_EXPRESSION:
+		ret = image_get_list(r, &node->u.ctf_expression.left);
+		if (ret)
+			return ret;
+		ret = image_get_list(r, &node->u.ctf_expression.right);
+		break;
+	case NODE_UNARY_EXPRESSION:
+		if (image_get_u32(r, &v))
+			return -EINVAL;
+		node->u.unary_expression.type = v;
+		if (image_get_u32(r, &v))
+			return -EINVAL;
+		node->u.unary_expression.link = v;
+		switch (node->u.unary_expression.type) {
+		case UNARY_STRING:
+			ret = image_get_string(r, &node->u.unary_expression.u.string);
+			break;
+		case UNARY_SIGNED_CONSTANT:
+			ret = image_get(r, &node->u.unary_expression.u.signed_constant,
+					sizeof(int64_t));
+			break;
+		case UNARY_UNSIGNED_CONSTANT:
+			ret = image_get(r, &node->u.unary_expression.u.unsigned_constant,
+					sizeof(uint64_t));
+			break;
+		case UNARY_SBRAC:
+			ret = image_get_opt_node(r, &node->u.unary_expression.u.sbrac_exp);
+			break;
+		default:
+			return -EINVAL;
+		}
+		break;
+	/* These four node types share the same layout. */
+	case NODE_TYPEDEF:
+	case NODE_TYPEALIAS_TARGET:
+	case NODE_TYPEALIAS_ALIAS:
+	case NODE_STRUCT_OR_VARIANT_DECLARATION:
+		ret = image_get_opt_node(r, &node->u._typedef.type_specifier_list);
+		if (ret)
+			return ret;
+		ret = image_get_list(r, &node->u._typedef.type_declarators);
+		break;
+	case NODE_TYPEALIAS:
+		ret = image_get_opt_node(r, &node->u.typealias.target);
+		if (ret)
+			return ret;
+		ret = image_get_opt_node(r, &node->u.typealias.alias);
+		break;
+	case NODE_TYPE_SPECIFIER:
+	{
+		char *id_type;
+
+		if (image_get_u32(r, &v))
+			return -EINVAL;
+		node->u.type_specifier.type = v;
+		ret = image_get_string(r, &id_type);
+		if (ret)
+			return ret;
+		node->u.type_specifier.id_type = id_type;
+		ret = image_get_opt_node(r, &node->u.type_specifier.node);
+		break;
+	}
+	case NODE_TYPE_SPECIFIER_LIST:
+		ret = image_get_list(r, &node->u.type_specifier_list.head);
+		break;
+	case NODE_POINTER:
+		ret = image_get_u32(r, &v);
+		node->u.pointer.const_qualifier = v;
+		break;
+	case NODE_TYPE_DECLARATOR:
+		ret = image_get_list(r, &node->u.type_declarator.pointers);
+		if (ret)
+			return ret;
+		if (image_get_u32(r, &v))
+			return -EINVAL;
+		node->u.type_declarator.type = v;
+		switch (node->u.type_declarator.type) {
+		case TYPEDEC_ID:
+			ret = image_get_string(r, &node->u.type_declarator.u.id);
+			break;
+		case TYPEDEC_NESTED:
+			ret = image_get_opt_node(r, &node->u.type_declarator.u.nested.type_declarator);
+			if (ret)
+				return ret;
+			ret = image_get_list(r, &node->u.type_declarator.u.nested.length);
+			if (ret)
+				return ret;
+			ret = image_get_u32(r, &v);
+			node->u.type_declarator.u.nested.abstract_array = v;
+			break;
+		default:
+			return -EINVAL;
+		}
+		if (ret)
+			return ret;
+		ret = image_get_opt_node(r, &node->u.type_declarator.bitfield_len);
+		break;
+	case NODE_FLOATING_POINT:
+		ret = image_get_list(r, &node->u.floating_point.expressions);
+		break;
+	case NODE_INTEGER:
+		ret = image_get_list(r, &node->u.integer.expressions);
+		break;
+	case NODE_STRING:
+		ret = image_get_list(r, &node->u.string.expressions);
+		break;
+	case NODE_ENUMERATOR:
+		ret = image_get_string(r, &node->u.enumerator.id);
+		if (ret)
+			return ret;
+		ret = image_get_list(r, &node->u.enumerator.values);
+		break;
+	case NODE_ENUM:
+		ret = image_get_string(r, &node->u._enum.enum_id);
+		if (ret)
+			return ret;
+		if (image_get_u32(r, &v))
+			return -EINVAL;
+		node->u._enum.has_body = v;
+		ret = image_get_opt_node(r, &node->u._enum.container_type);
+		if (ret)
+			return ret;
+		ret = image_get_list(r, &node->u._enum.enumerator_list);
+		break;
+	case NODE_VARIANT:
+		ret = image_get_string(r, &node->u.variant.name);
+		if (ret)
+			return ret;
+		ret = image_get_string(r, &node->u.variant.choice);
+		if (ret)
+			return ret;
+		if (image_get_u32(r, &v))
+			return -EINVAL;
+		node->u.variant.has_body = v;
+		ret = image_get_list(r, &node->u.variant.declaration_list);
+		break;
+	case NODE_STRUCT:
+		ret = image_get_string(r, &node->u._struct.name);
+		if (ret)
+			return ret;
+		if (image_get_u32(r, &v))
+			return -EINVAL;
+		node->u._struct.has_body = v;
+		ret = image_get_list(r, &node->u._struct.declaration_list);
+		if (ret)
+			return ret;
+		ret = image_get_list(r, &node->u._struct.min_align);
+		break;
+	default:
+		return -EINVAL;
+	}
+	return ret;
+}
+
+int ctf_scanner_load_ast_image(struct ctf_scanner *scanner,
+		const char *image, size_t len, uint64_t text_len)
+{
+	struct image_reader r;
+	struct ctf_ast *ast;
+	uint32_t magic, version;
+	uint64_t image_text_len;
+	int ret;
+
+	r.p = image;
+	r.end = image + len;
+	r.objstack = scanner->objstack;
+	if (image_get_u32(&r, &magic) || magic != IMAGE_MAGIC)
+		return -EINVAL;
+	if (image_get_u32(&r, &version) || version != IMAGE_VERSION)
+		return -EINVAL;
+	if (image_get(&r, &image_text_len, sizeof(image_text_len))
+			|| image_text_len != text_len)
+		return -EINVAL;
+	ast = objstack_alloc(scanner->objstack, sizeof(*ast));
+	if (!ast)
+		return -ENOMEM;
+	ret = image_get_node(&r, &ast->root);
+	if (ret)
+		return ret;
+	if (ast->root.type != NODE_ROOT || r.p != r.end)
+		return -EINVAL;
+	scanner->ast = ast;
+	scanner->ast_used = 1;
+	return 0;
+}
@@ -77,8 +77,9 @@ struct ctf_node {
 	 * We mark nodes visited in the generate-io-struct phase (last
 	 * phase). We only mark the 1-depth level nodes as visited
 	 * (never the root node, and not their sub-nodes). This allows
-	 * skipping already visited nodes when doing incremental
-	 * metadata append.
+	 * skipping already visited nodes when the trace declaration
+	 * restarts the visit of root declarations. Incremental metadata
+	 * append parses each fragment into its own AST instead.
 	 */
 	int visited;
 
@@ -314,6 +315,10 @@ BT_HIDDEN
 int ctf_visitor_construct_metadata(FILE *fd, int depth, struct ctf_node *node,
 			struct ctf_trace *trace, int byte_order);
 BT_HIDDEN
+void ctf_copy_metadata(struct ctf_trace *trace, struct ctf_trace *src);
+BT_HIDDEN
 int ctf_destroy_metadata(struct ctf_trace *trace);
+BT_HIDDEN
+GString *ctf_ast_image_create(struct ctf_node *root, uint64_t text_len);
 
 #endif /* _CTF_AST_H */
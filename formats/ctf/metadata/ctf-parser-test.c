@@ -28,6 +28,7 @@
 #include <stdio.h>
 #include <glib.h>
 #include <errno.h>
+#include <string.h>
 #include <babeltrace/endian.h>
 #include <babeltrace/babeltrace-internal.h>
 #include <babeltrace/ctf/metadata.h>
@@ -37,47 +38,109 @@
 
 int babeltrace_verbose, babeltrace_debug;
 
-int main(int argc, char **argv)
+/*
+ * Parse one metadata fragment and construct its declarations on top of
+ * the ones already constructed for the trace.
+ */
+static
+int append_fragment(struct ctf_scanner *scanner, struct ctf_trace *trace,
+		FILE *input)
 {
-	struct ctf_scanner *scanner;
-	struct ctf_trace *trace;
-	int ret = 0;
+	int ret;
 
-	babeltrace_debug = 1;
-	babeltrace_verbose = 1;
-	scanner = ctf_scanner_alloc();
-	if (!scanner) {
-		fprintf(stderr, "Error allocating scanner\n");
-		return -ENOMEM;
-	}
-	ret = ctf_scanner_append_ast(scanner, stdin);
+	ret = ctf_scanner_append_ast(scanner, input);
 	if (ret) {
 		fprintf(stderr, "Error creating AST\n");
-		goto end;
+		return ret;
 	}
 
-	ret = ctf_visitor_print_xml(stderr, 0, &scanner->ast->root);
-	if (ret) {
-		fprintf(stderr, "Error visiting AST for XML output\n");
-		goto end;
+	if (babeltrace_debug) {
+		ret = ctf_visitor_print_xml(stderr, 0, &scanner->ast->root);
+		if (ret) {
+			fprintf(stderr, "Error visiting AST for XML output\n");
+			return ret;
+		}
 	}
 
 	ret = ctf_visitor_semantic_check(stderr, 0, &scanner->ast->root);
 	if (ret) {
 		fprintf(stderr, "Error in CTF semantic validation %d\n", ret);
-		goto end;
+		return ret;
 	}
-	trace = malloc(sizeof(*trace));
-	memset(trace, 0, sizeof(*trace));
 	ret = ctf_visitor_construct_metadata(stderr, 0, &scanner->ast->root,
 			trace, BYTE_ORDER);
 	if (ret) {
 		fprintf(stderr, "Error in CTF metadata constructor %d\n", ret);
+		return ret;
+	}
+	return 0;
+}
+
+/*
+ * Without arguments, parse the metadata read from stdin and dump its
+ * AST. Otherwise, append each file given as argument as a metadata
+ * fragment, in order, and print the time taken by each append, which
+ * should not grow with the amount of metadata already parsed, and then
+ * the time taken to release the declarations. With -n as first
+ * argument, declarations are reference counted and released one by one
+ * instead of being allocated from an arena.
+ */
+int main(int argc, char **argv)
+{
+	struct ctf_scanner *scanner;
+	struct ctf_trace *trace;
+	GTimer *timer;
+	int ret = 0, i, first = 1, use_arena = 1;
+
+	if (argc > 1 && !strcmp(argv[1], "-n")) {
+		use_arena = 0;
+		first = 2;
+	}
+	babeltrace_debug = argc <= first;
+	babeltrace_verbose = argc <= first;
+	scanner = ctf_scanner_alloc();
+	if (!scanner) {
+		fprintf(stderr, "Error allocating scanner\n");
+		return -ENOMEM;
+	}
+	trace = malloc(sizeof(*trace));
+	memset(trace, 0, sizeof(*trace));
+	/* Allocate declarations like ctf_open_trace() does. */
+	if (use_arena)
+		trace->declaration_arena = bt_declaration_arena_create();
+
+	if (argc <= first) {
+		ret = append_fragment(scanner, trace, stdin);
 		goto free_trace;
 	}
+	for (i = first; i < argc; i++) {
+		FILE *input;
+
+		input = fopen(argv[i], "r");
+		if (!input) {
+			perror("fopen");
+			ret = -errno;
+			goto free_trace;
+		}
+		timer = g_timer_new();
+		ret = append_fragment(scanner, trace, input);
+		g_timer_stop(timer);
+		fclose(input);
+		if (!ret)
+			printf("%s: %.0f us\n", argv[i],
+				g_timer_elapsed(timer, NULL) * 1e6);
+		g_timer_destroy(timer);
+		if (ret)
+			goto free_trace;
+	}
+	timer = g_timer_new();
+	ctf_destroy_metadata(trace);
+	g_timer_stop(timer);
+	printf("release: %.0f us\n", g_timer_elapsed(timer, NULL) * 1e6);
+	g_timer_destroy(timer);
 free_trace:
+	bt_declaration_arena_destroy(trace->declaration_arena);
 	free(trace);
-end:
 	ctf_scanner_free(scanner);
 	return ret;
-} 
+}
@@ -974,6 +974,19 @@ static struct ctf_ast *ctf_ast_alloc(struct ctf_scanner *scanner)
 
 int ctf_scanner_append_ast(struct ctf_scanner *scanner, FILE *input)
 {
+	/*
+	 * Parse each appended metadata fragment into its own AST, so
+	 * that visitors only walk the newly appended declarations.
+	 * Previous fragments stay allocated in the object stack, and
+	 * type names stay known to the lexer through the root scope.
+	 */
+	if (scanner->ast_used) {
+		scanner->ast = ctf_ast_alloc(scanner);
+		if (!scanner->ast)
+			return -ENOMEM;
+	}
+	scanner->ast_used = 1;
+
 	/* Start processing new stream */
 	yyrestart(input, scanner->scanner);
 	if (yydebug)
@@ -33,7 +33,8 @@ struct ctf_scanner_scope {
 
 struct ctf_scanner {
 	yyscan_t scanner;
-	struct ctf_ast *ast;
+	struct ctf_ast *ast;		/* Last appended metadata fragment */
+	int ast_used;
 	struct ctf_scanner_scope root_scope;
 	struct ctf_scanner_scope *cs;
 	struct objstack *objstack;
@@ -42,6 +43,9 @@ struct ctf_scanner {
 struct ctf_scanner *ctf_scanner_alloc(void);
 void ctf_scanner_free(struct ctf_scanner *scanner);
 int ctf_scanner_append_ast(struct ctf_scanner *scanner, FILE *input);
+BT_HIDDEN
+int ctf_scanner_load_ast_image(struct ctf_scanner *scanner,
+		const char *image, size_t len, uint64_t text_len);
 
 static inline
 struct ctf_ast *ctf_scanner_get_ast(struct ctf_scanner *scanner)
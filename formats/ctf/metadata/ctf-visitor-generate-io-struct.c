@@ -478,7 +478,7 @@ struct bt_declaration *ctf_type_declarator_visit(FILE *fd, int depth,
 					integer_declaration = bt_integer_declaration_new(integer_declaration->len,
 						integer_declaration->byte_order, integer_declaration->signedness,
 						integer_declaration->p.alignment, 16, integer_declaration->encoding,
-						integer_declaration->clock);
+						integer_declaration->clock, trace->declaration_arena);
 					nested_declaration = &integer_declaration->p;
 				}
 			}
@@ -1477,7 +1477,7 @@ struct bt_declaration *ctf_declaration_integer_visit(FILE *fd, int depth,
 	}
 	integer_declaration = bt_integer_declaration_new(size,
 				byte_order, signedness, alignment,
-				base, encoding, clock);
+				base, encoding, clock, trace->declaration_arena);
 	return &integer_declaration->p;
 }
 
@@ -1557,7 +1557,7 @@ struct bt_declaration *ctf_declaration_floating_point_visit(FILE *fd, int depth,
 		}
 	}
 	float_declaration = bt_float_declaration_new(mant_dig, exp_dig,
-				byte_order, alignment);
+				byte_order, alignment, trace->declaration_arena);
 	return &float_declaration->p;
 }
 
@@ -1593,7 +1593,8 @@ struct bt_declaration *ctf_declaration_string_visit(FILE *fd, int depth,
 	}
 	if (encoding_c && !strcmp(encoding_c, "ASCII"))
 		encoding = CTF_STRING_ASCII;
-	string_declaration = bt_string_declaration_new(encoding);
+	string_declaration = bt_string_declaration_new(encoding,
+				trace->declaration_arena);
 	return &string_declaration->p;
 }
 
@@ -2977,19 +2978,26 @@ int ctf_root_declaration_visit(FILE *fd, int depth, struct ctf_node *node, struc
 int ctf_visitor_construct_metadata(FILE *fd, int depth, struct ctf_node *node,
 		struct ctf_trace *trace, int byte_order)
 {
-	int ret = 0;
+	int ret = 0, first;
 	struct ctf_node *iter;
 
 	printf_verbose("CTF visitor: metadata construction...\n");
-	trace->byte_order = byte_order;
-	trace->parent.clocks = g_hash_table_new_full(g_direct_hash,
-				g_direct_equal, NULL, clock_free);
-	trace->callsites = g_hash_table_new_full(g_direct_hash, g_direct_equal,
-				NULL, callsite_free);
+	/*
+	 * Appended metadata fragments are constructed on top of the
+	 * clocks, callsites and root declaration scope of the trace.
+	 */
+	first = !trace->root_declaration_scope;
+	if (first) {
+		trace->byte_order = byte_order;
+		trace->parent.clocks = g_hash_table_new_full(g_direct_hash,
+					g_direct_equal, NULL, clock_free);
+		trace->callsites = g_hash_table_new_full(g_direct_hash,
+					g_direct_equal, NULL, callsite_free);
+		trace->root_declaration_scope =
+			bt_new_root_declaration_scope(trace->declaration_arena);
+	}
 
 retry:
-	trace->root_declaration_scope = bt_new_declaration_scope(NULL);
-
 	switch (node->type) {
 	case NODE_ROOT:
 		/*
@@ -2997,7 +3005,8 @@ retry:
 		 * so clock need to be treated first.
 		 */
 		if (bt_list_empty(&node->u.root.clock)) {
-			ctf_clock_default(fd, depth + 1, trace);
+			if (!trace->parent.single_clock)
+				ctf_clock_default(fd, depth + 1, trace);
 		} else {
 			bt_list_for_each_entry(iter, &node->u.root.clock, siblings) {
 				ret = ctf_clock_visit(fd, depth + 1, iter,
@@ -3021,6 +3030,8 @@ retry:
 			if (ret == -EINTR) {
 				trace->restart_root_decl = 1;
 				bt_free_declaration_scope(trace->root_declaration_scope);
+				trace->root_declaration_scope =
+					bt_new_root_declaration_scope(trace->declaration_arena);
 				/*
 				 * Need to restart creation of type
 				 * definitions, aliases and
@@ -3082,12 +3093,147 @@ retry:
 	return ret;
 
 error:
-	bt_free_declaration_scope(trace->root_declaration_scope);
-	g_hash_table_destroy(trace->callsites);
-	g_hash_table_destroy(trace->parent.clocks);
+	if (first) {
+		bt_free_declaration_scope(trace->root_declaration_scope);
+		trace->root_declaration_scope = NULL;
+		g_hash_table_destroy(trace->callsites);
+		g_hash_table_destroy(trace->parent.clocks);
+	}
 	return ret;
 }
 
+/*
+ * Copy the metadata constructed for trace "src" into "trace".
+ *
+ * Declarations are immutable once constructed, so they are shared
+ * with "src" by reference. Clocks, callsites, stream and event
+ * declarations hold per-trace state (definitions, lookup tables), so
+ * they are duplicated. The declaration scopes are only needed while
+ * visiting the AST, and are left empty. "src" must outlive "trace",
+ * since shared integer declarations point to its clocks.
+ */
+void ctf_copy_metadata(struct ctf_trace *trace, struct ctf_trace *src)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+	int i;
+
+	printf_verbose("CTF visitor: sharing metadata declarations...\n");
+	trace->field_mask = src->field_mask;
+	trace->major = src->major;
+	trace->minor = src->minor;
+	memcpy(trace->uuid, src->uuid, sizeof(trace->uuid));
+	trace->byte_order = src->byte_order;
+	trace->env = src->env;
+
+	trace->parent.clocks = g_hash_table_new_full(g_direct_hash,
+				g_direct_equal, NULL, clock_free);
+	g_hash_table_iter_init(&iter, src->parent.clocks);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		struct ctf_clock *clock;
+
+		clock = g_new0(struct ctf_clock, 1);
+		*clock = *(struct ctf_clock *) value;
+		clock->description = g_strdup(clock->description);
+		g_hash_table_insert(trace->parent.clocks, key, clock);
+		if (value == src->parent.single_clock)
+			trace->parent.single_clock = clock;
+	}
+
+	trace->callsites = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+				NULL, callsite_free);
+	g_hash_table_iter_init(&iter, src->callsites);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		struct ctf_callsite_dups *src_dups = value, *cs_dups;
+		struct ctf_callsite *src_callsite;
+
+		cs_dups = g_new0(struct ctf_callsite_dups, 1);
+		BT_INIT_LIST_HEAD(&cs_dups->head);
+		bt_list_for_each_entry(src_callsite, &src_dups->head, node) {
+			struct ctf_callsite *callsite;
+
+			callsite = g_new0(struct ctf_callsite, 1);
+			*callsite = *src_callsite;
+			callsite->func = g_strdup(src_callsite->func);
+			callsite->file = g_strdup(src_callsite->file);
+			bt_list_add_tail(&callsite->node, &cs_dups->head);
+		}
+		g_hash_table_insert(trace->callsites, key, cs_dups);
+	}
+
+	trace->root_declaration_scope = bt_new_declaration_scope(NULL);
+	trace->declaration_scope = bt_new_declaration_scope(trace->root_declaration_scope);
+	if (src->packet_header_decl) {
+		bt_declaration_ref(&src->packet_header_decl->p);
+		trace->packet_header_decl = src->packet_header_decl;
+	}
+
+	trace->streams = g_ptr_array_new();
+	g_ptr_array_set_size(trace->streams, src->streams->len);
+	for (i = 0; i < src->streams->len; i++) {
+		struct ctf_stream_declaration *src_stream, *stream;
+
+		src_stream = g_ptr_array_index(src->streams, i);
+		if (!src_stream)
+			continue;
+		stream = g_new0(struct ctf_stream_declaration, 1);
+		stream->trace = trace;
+		stream->declaration_scope = bt_new_declaration_scope(trace->root_declaration_scope);
+		stream->events_by_id = g_ptr_array_new();
+		g_ptr_array_set_size(stream->events_by_id, src_stream->events_by_id->len);
+		stream->event_quark_to_id = g_hash_table_new(g_direct_hash, g_direct_equal);
+		stream->streams = g_ptr_array_new();
+		if (src_stream->packet_context_decl) {
+			bt_declaration_ref(&src_stream->packet_context_decl->p);
+			stream->packet_context_decl = src_stream->packet_context_decl;
+		}
+		if (src_stream->event_header_decl) {
+			bt_declaration_ref(&src_stream->event_header_decl->p);
+			stream->event_header_decl = src_stream->event_header_decl;
+		}
+		if (src_stream->event_context_decl) {
+			bt_declaration_ref(&src_stream->event_context_decl->p);
+			stream->event_context_decl = src_stream->event_context_decl;
+		}
+		stream->stream_id = src_stream->stream_id;
+		stream->field_mask = src_stream->field_mask;
+		g_ptr_array_index(trace->streams, i) = stream;
+	}
+
+	trace->event_declarations = g_ptr_array_new();
+	for (i = 0; i < src->event_declarations->len; i++) {
+		struct bt_ctf_event_decl *src_event_decl, *event_decl;
+		struct ctf_event_declaration *src_event, *event;
+
+		src_event_decl = g_ptr_array_index(src->event_declarations, i);
+		src_event = &src_event_decl->parent;
+		event_decl = g_new0(struct bt_ctf_event_decl, 1);
+		event = &event_decl->parent;
+		event->stream = trace_stream_lookup(trace, src_event->stream_id);
+		event->declaration_scope = bt_new_declaration_scope(trace->root_declaration_scope);
+		if (src_event->context_decl) {
+			bt_declaration_ref(&src_event->context_decl->p);
+			event->context_decl = src_event->context_decl;
+		}
+		if (src_event->fields_decl) {
+			bt_declaration_ref(&src_event->fields_decl->p);
+			event->fields_decl = src_event->fields_decl;
+		}
+		event->name = src_event->name;
+		event->id = src_event->id;
+		event->stream_id = src_event->stream_id;
+		event->loglevel = src_event->loglevel;
+		event->model_emf_uri = src_event->model_emf_uri;
+		event->field_mask = src_event->field_mask;
+
+		g_ptr_array_index(event->stream->events_by_id, event->id) = event;
+		g_hash_table_insert(event->stream->event_quark_to_id,
+				    (gpointer) (unsigned long) event->name,
+				    &event->id);
+		g_ptr_array_add(trace->event_declarations, event_decl);
+	}
+}
+
 int ctf_destroy_metadata(struct ctf_trace *trace)
 {
 	int i;
@@ -3181,6 +3327,8 @@ int ctf_destroy_metadata(struct ctf_trace *trace)
 
 	bt_free_declaration_scope(trace->root_declaration_scope);
 	bt_free_declaration_scope(trace->declaration_scope);
+	bt_declaration_arena_destroy(trace->declaration_arena);
+	trace->declaration_arena = NULL;
 
 	g_hash_table_destroy(trace->callsites);
 	g_hash_table_destroy(trace->parent.clocks);
@@ -0,0 +1,49 @@
+#ifndef _CTF_OUTPUT_PRIVATE_H
+#define _CTF_OUTPUT_PRIVATE_H
+
+/*
+ * ctf/output-private.h
+ *
+ * Babeltrace Library
+ *
+ * Copyright 2016 EfficiOS Inc. and Linux Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <babeltrace/babeltrace-internal.h>
+#include <babeltrace/format.h>
+
+/*
+ * CTF traces opened for output are written with the CTF writer, in the
+ * directory given as path.
+ */
+BT_HIDDEN
+struct bt_trace_descriptor *ctf_output_open_trace(const char *path);
+
+/*
+ * Returns whether the trace descriptor is one of the output traces.
+ */
+BT_HIDDEN
+int ctf_output_is_trace(struct bt_trace_descriptor *descriptor);
+
+BT_HIDDEN
+int ctf_output_close_trace(struct bt_trace_descriptor *descriptor);
+
+#endif /* _CTF_OUTPUT_PRIVATE_H */
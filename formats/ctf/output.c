@@ -0,0 +1,1151 @@
+/*
+ * BabelTrace - Common Trace Format (CTF)
+ *
+ * CTF output: events read from any trace, written with the CTF writer.
+ *
+ * Copyright 2016 EfficiOS Inc. and Linux Foundation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <babeltrace/format.h>
+#include <babeltrace/format-internal.h>
+#include <babeltrace/babeltrace-internal.h>
+#include <babeltrace/ctf-text/types.h>
+#include <babeltrace/ctf-ir/metadata.h>
+#include <babeltrace/ctf-writer/writer.h>
+#include <babeltrace/ctf-writer/clock.h>
+#include <babeltrace/ctf-writer/stream.h>
+#include <babeltrace/ctf-writer/stream-class.h>
+#include <babeltrace/ctf-writer/event.h>
+#include <babeltrace/ctf-writer/event-types.h>
+#include <babeltrace/ctf-writer/event-fields.h>
+#include <babeltrace/ref.h>
+#include <babeltrace/values.h>
+#include <babeltrace/endian.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <glib.h>
+#include "output-private.h"
+
+/*
+ * Input packets are written out as they are, except that events are
+ * written by packets of at most this many events.
+ */
+#define CTF_OUTPUT_PACKET_EVENTS_MAX	65536
+
+struct ctf_output {
+	struct ctf_text_stream_pos parent;
+	struct bt_ctf_writer *writer;
+	/* All timestamps are written in ns, on a single clock. */
+	struct bt_ctf_clock *clock;
+	/* Type of the fields used to set sequence lengths. */
+	struct bt_ctf_field_type *length_type;
+	/* Input stream class to output stream class. */
+	GHashTable *stream_classes;
+	/* Input event class to output event class. */
+	GHashTable *event_classes;
+	/* Input stream to struct ctf_output_stream. */
+	GHashTable *streams;
+	int env_set;		/* Environment copied from the first trace */
+	int metadata_dirty;	/* Classes added since metadata was written */
+};
+
+struct ctf_output_stream {
+	struct bt_ctf_stream *stream;
+	struct ctf_stream_definition *input;
+	/* Input packet the events being appended come from. */
+	struct ctf_stream_packet_limits packet;
+	uint64_t nr_events;	/* Events appended to the current packet */
+	int context_set;	/* Packet context of the current packet set */
+};
+
+/*
+ * Packet context fields which the CTF writer sets itself. The other
+ * fields of the input packet contexts are copied.
+ */
+static const char * const writer_packet_context_fields[] = {
+	"timestamp_begin",
+	"timestamp_end",
+	"content_size",
+	"packet_size",
+	"events_discarded",
+	"packet_seq_num",
+};
+
+/* Output traces currently open, to tell them from input traces. */
+static GList *output_traces;
+
+static
+struct bt_ctf_field_type *type_from_declaration(
+		struct bt_declaration *declaration);
+static
+int copy_field(struct ctf_output *output, struct bt_ctf_field *field,
+		struct bt_definition *definition);
+
+static
+int is_writer_packet_context_field(GQuark name)
+{
+	int i;
+
+	for (i = 0; i < sizeof(writer_packet_context_fields)
+			/ sizeof(writer_packet_context_fields[0]); i++) {
+		if (!strcmp(g_quark_to_string(name),
+				writer_packet_context_fields[i]))
+			return 1;
+	}
+	return 0;
+}
+
+static
+enum bt_ctf_byte_order byte_order_from_declaration(int byte_order)
+{
+	switch (byte_order) {
+	case BIG_ENDIAN:
+		return BT_CTF_BYTE_ORDER_BIG_ENDIAN;
+	case LITTLE_ENDIAN:
+		return BT_CTF_BYTE_ORDER_LITTLE_ENDIAN;
+	default:
+		return BT_CTF_BYTE_ORDER_NATIVE;
+	}
+}
+
+/*
+ * Dotted path of a variant tag or sequence length, which the writer
+ * resolves like the CTF reader did.
+ */
+static
+GString *path_from_quarks(GArray *quarks)
+{
+	GString *path;
+	int i;
+
+	path = g_string_new("");
+	for (i = 0; i < quarks->len; i++) {
+		if (i)
+			g_string_append_c(path, '.');
+		g_string_append(path,
+			g_quark_to_string(g_array_index(quarks, GQuark, i)));
+	}
+	return path;
+}
+
+static
+struct bt_ctf_field_type *integer_type(struct declaration_integer *integer)
+{
+	struct bt_ctf_field_type *type;
+	enum bt_ctf_integer_base base;
+
+	type = bt_ctf_field_type_integer_create(integer->len);
+	if (!type)
+		return NULL;
+	switch (integer->base) {
+	case 2:
+	case 8:
+	case 16:
+		base = integer->base;
+		break;
+	default:
+		base = BT_CTF_INTEGER_BASE_DECIMAL;
+		break;
+	}
+	if (bt_ctf_field_type_integer_set_signed(type, integer->signedness)
+			|| bt_ctf_field_type_integer_set_base(type, base)
+			|| bt_ctf_field_type_integer_set_encoding(type,
+				(enum bt_ctf_string_encoding) integer->encoding)
+			|| bt_ctf_field_type_set_byte_order(type,
+				byte_order_from_declaration(
+					integer->byte_order))
+			|| bt_ctf_field_type_set_alignment(type,
+				integer->p.alignment))
+		BT_PUT(type);
+	return type;
+}
+
+static
+struct bt_ctf_field_type *float_type(struct declaration_float *float_decl)
+{
+	struct bt_ctf_field_type *type;
+
+	type = bt_ctf_field_type_floating_point_create();
+	if (!type)
+		return NULL;
+	/* The mantissa declaration does not count the implicit bit. */
+	if (bt_ctf_field_type_floating_point_set_exponent_digits(type,
+				float_decl->exp->len)
+			|| bt_ctf_field_type_floating_point_set_mantissa_digits(
+				type, float_decl->mantissa->len + 1)
+			|| bt_ctf_field_type_set_byte_order(type,
+				byte_order_from_declaration(
+					float_decl->byte_order))
+			|| bt_ctf_field_type_set_alignment(type,
+				float_decl->p.alignment))
+		BT_PUT(type);
+	return type;
+}
+
+/*
+ * The writer refuses overlapping ranges, which CTF allows: such mappings
+ * are left out, the values are still copied.
+ */
+static
+void add_enum_mappings(struct bt_ctf_field_type *type, const char *name,
+		GArray *ranges, int signedness)
+{
+	int i;
+
+	for (i = 0; i < ranges->len; i++) {
+		struct enum_range *range =
+			&g_array_index(ranges, struct enum_range, i);
+
+		if (signedness)
+			bt_ctf_field_type_enumeration_add_mapping(type, name,
+				range->start._signed, range->end._signed);
+		else
+			bt_ctf_field_type_enumeration_add_mapping_unsigned(
+				type, name, range->start._unsigned,
+				range->end._unsigned);
+	}
+}
+
+static
+struct bt_ctf_field_type *enum_type(struct declaration_enum *enum_decl)
+{
+	struct bt_ctf_field_type *container, *type;
+	GHashTableIter iter;
+	gpointer key, value;
+
+	container = integer_type(enum_decl->integer_declaration);
+	if (!container)
+		return NULL;
+	type = bt_ctf_field_type_enumeration_create(container);
+	bt_put(container);
+	if (!type)
+		return NULL;
+	g_hash_table_iter_init(&iter, enum_decl->table.quark_to_range_set);
+	while (g_hash_table_iter_next(&iter, &key, &value))
+		add_enum_mappings(type,
+			g_quark_to_string((GQuark) (unsigned long) key),
+			value, enum_decl->integer_declaration->signedness);
+	return type;
+}
+
+static
+struct bt_ctf_field_type *string_type(struct declaration_string *string)
+{
+	struct bt_ctf_field_type *type;
+
+	type = bt_ctf_field_type_string_create();
+	if (!type)
+		return NULL;
+	if (string->encoding != CTF_STRING_NONE
+			&& bt_ctf_field_type_string_set_encoding(type,
+				(enum bt_ctf_string_encoding) string->encoding))
+		BT_PUT(type);
+	return type;
+}
+
+static
+struct bt_ctf_field_type *struct_type(struct declaration_struct *struct_decl)
+{
+	struct bt_ctf_field_type *type;
+	int i;
+
+	type = bt_ctf_field_type_structure_create();
+	if (!type)
+		return NULL;
+	for (i = 0; i < struct_decl->fields->len; i++) {
+		struct declaration_field *field = &g_array_index(
+			struct_decl->fields, struct declaration_field, i);
+		struct bt_ctf_field_type *field_type;
+		int ret;
+
+		field_type = type_from_declaration(field->declaration);
+		if (!field_type)
+			goto error;
+		ret = bt_ctf_field_type_structure_add_field(type, field_type,
+			g_quark_to_string(field->name));
+		bt_put(field_type);
+		if (ret)
+			goto error;
+	}
+	return type;
+error:
+	bt_put(type);
+	return NULL;
+}
+
+static
+struct bt_ctf_field_type *variant_type(struct declaration_variant *variant)
+{
+	struct declaration_untagged_variant *untagged =
+		variant->untagged_variant;
+	struct bt_ctf_field_type *type;
+	GString *tag_name;
+	int i;
+
+	/* The tag type is looked up when the class is added. */
+	tag_name = path_from_quarks(variant->tag_name);
+	type = bt_ctf_field_type_variant_create(NULL, tag_name->str);
+	g_string_free(tag_name, TRUE);
+	if (!type)
+		return NULL;
+	for (i = 0; i < untagged->fields->len; i++) {
+		struct declaration_field *field = &g_array_index(
+			untagged->fields, struct declaration_field, i);
+		struct bt_ctf_field_type *field_type;
+		int ret;
+
+		field_type = type_from_declaration(field->declaration);
+		if (!field_type)
+			goto error;
+		ret = bt_ctf_field_type_variant_add_field(type, field_type,
+			g_quark_to_string(field->name));
+		bt_put(field_type);
+		if (ret)
+			goto error;
+	}
+	return type;
+error:
+	bt_put(type);
+	return NULL;
+}
+
+static
+struct bt_ctf_field_type *array_type(struct declaration_array *array)
+{
+	struct bt_ctf_field_type *elem, *type;
+
+	elem = type_from_declaration(array->elem);
+	if (!elem)
+		return NULL;
+	type = bt_ctf_field_type_array_create(elem, array->len);
+	bt_put(elem);
+	return type;
+}
+
+static
+struct bt_ctf_field_type *sequence_type(struct declaration_sequence *sequence)
+{
+	struct bt_ctf_field_type *elem, *type;
+	GString *length_name;
+
+	elem = type_from_declaration(sequence->elem);
+	if (!elem)
+		return NULL;
+	length_name = path_from_quarks(sequence->length_name);
+	type = bt_ctf_field_type_sequence_create(elem, length_name->str);
+	g_string_free(length_name, TRUE);
+	bt_put(elem);
+	return type;
+}
+
+static
+struct bt_ctf_field_type *type_from_declaration(
+		struct bt_declaration *declaration)
+{
+	switch (declaration->id) {
+	case BT_CTF_TYPE_ID_INTEGER:
+		return integer_type(container_of(declaration,
+			struct declaration_integer, p));
+	case BT_CTF_TYPE_ID_FLOAT:
+		return float_type(container_of(declaration,
+			struct declaration_float, p));
+	case BT_CTF_TYPE_ID_ENUM:
+		return enum_type(container_of(declaration,
+			struct declaration_enum, p));
+	case BT_CTF_TYPE_ID_STRING:
+		return string_type(container_of(declaration,
+			struct declaration_string, p));
+	case BT_CTF_TYPE_ID_STRUCT:
+		return struct_type(container_of(declaration,
+			struct declaration_struct, p));
+	case BT_CTF_TYPE_ID_VARIANT:
+		return variant_type(container_of(declaration,
+			struct declaration_variant, p));
+	case BT_CTF_TYPE_ID_ARRAY:
+		return array_type(container_of(declaration,
+			struct declaration_array, p));
+	case BT_CTF_TYPE_ID_SEQUENCE:
+		return sequence_type(container_of(declaration,
+			struct declaration_sequence, p));
+	case BT_CTF_TYPE_ID_UNTAGGED_VARIANT:
+	default:
+		fprintf(stderr, "[error] Type %d cannot be written to a CTF trace.\n",
+			(int) declaration->id);
+		return NULL;
+	}
+}
+
+static
+int copy_integer(struct bt_ctf_field *field,
+		struct definition_integer *integer)
+{
+	if (integer->declaration->signedness)
+		return bt_ctf_field_signed_integer_set_value(field,
+			integer->value._signed);
+	return bt_ctf_field_unsigned_integer_set_value(field,
+		integer->value._unsigned);
+}
+
+static
+int copy_enum(struct bt_ctf_field *field, struct definition_enum *enum_def)
+{
+	struct bt_ctf_field *container;
+	int ret;
+
+	container = bt_ctf_field_enumeration_get_container(field);
+	if (!container)
+		return -1;
+	ret = copy_integer(container, enum_def->integer);
+	bt_put(container);
+	return ret;
+}
+
+static
+int copy_struct(struct ctf_output *output, struct bt_ctf_field *field,
+		struct definition_struct *struct_def)
+{
+	int i;
+
+	for (i = 0; i < struct_def->fields->len; i++) {
+		struct bt_ctf_field *child;
+		int ret;
+
+		child = bt_ctf_field_structure_get_field_by_index(field, i);
+		if (!child)
+			return -1;
+		ret = copy_field(output, child,
+			g_ptr_array_index(struct_def->fields, i));
+		bt_put(child);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+/*
+ * The writer selects the variant field from a tag field of its own:
+ * one is made with the value of the input tag.
+ */
+static
+int copy_variant(struct ctf_output *output, struct bt_ctf_field *field,
+		struct definition_variant *variant)
+{
+	struct bt_ctf_field_type *type, *tag_type;
+	struct bt_ctf_field *tag = NULL, *current = NULL;
+	int ret = -1;
+
+	type = bt_ctf_field_get_type(field);
+	tag_type = bt_ctf_field_type_variant_get_tag_type(type);
+	bt_put(type);
+	if (!tag_type)
+		goto end;
+	tag = bt_ctf_field_create(tag_type);
+	bt_put(tag_type);
+	if (!tag)
+		goto end;
+	ret = copy_enum(tag, container_of(variant->enum_tag,
+		struct definition_enum, p));
+	if (ret)
+		goto end;
+	current = bt_ctf_field_variant_get_field(field, tag);
+	if (!current) {
+		ret = -1;
+		goto end;
+	}
+	ret = copy_field(output, current, variant->current_field);
+end:
+	bt_put(current);
+	bt_put(tag);
+	return ret;
+}
+
+static
+int copy_array(struct ctf_output *output, struct bt_ctf_field *field,
+		struct definition_array *array)
+{
+	int i;
+
+	for (i = 0; i < array->elems->len; i++) {
+		struct bt_ctf_field *elem;
+		int ret;
+
+		elem = bt_ctf_field_array_get_field(field, i);
+		if (!elem)
+			return -1;
+		ret = copy_field(output, elem,
+			g_ptr_array_index(array->elems, i));
+		bt_put(elem);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+static
+int copy_sequence(struct ctf_output *output, struct bt_ctf_field *field,
+		struct definition_sequence *sequence)
+{
+	/* The element array keeps the size of the longest sequence read. */
+	uint64_t len = sequence->length->value._unsigned;
+	struct bt_ctf_field *length;
+	uint64_t i;
+	int ret;
+
+	length = bt_ctf_field_create(output->length_type);
+	if (!length)
+		return -1;
+	ret = bt_ctf_field_unsigned_integer_set_value(length, len);
+	if (!ret)
+		ret = bt_ctf_field_sequence_set_length(field, length);
+	bt_put(length);
+	if (ret)
+		return ret;
+	for (i = 0; i < len; i++) {
+		struct bt_ctf_field *elem;
+
+		elem = bt_ctf_field_sequence_get_field(field, i);
+		if (!elem)
+			return -1;
+		ret = copy_field(output, elem,
+			g_ptr_array_index(sequence->elems, i));
+		bt_put(elem);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+static
+int copy_field(struct ctf_output *output, struct bt_ctf_field *field,
+		struct bt_definition *definition)
+{
+	switch (definition->declaration->id) {
+	case BT_CTF_TYPE_ID_INTEGER:
+		return copy_integer(field, container_of(definition,
+			struct definition_integer, p));
+	case BT_CTF_TYPE_ID_FLOAT:
+		return bt_ctf_field_floating_point_set_value(field,
+			container_of(definition, struct definition_float,
+				p)->value);
+	case BT_CTF_TYPE_ID_ENUM:
+		return copy_enum(field, container_of(definition,
+			struct definition_enum, p));
+	case BT_CTF_TYPE_ID_STRING:
+	{
+		struct definition_string *string = container_of(definition,
+			struct definition_string, p);
+
+		return bt_ctf_field_string_set_value(field,
+			string->value ? : "");
+	}
+	case BT_CTF_TYPE_ID_STRUCT:
+		return copy_struct(output, field, container_of(definition,
+			struct definition_struct, p));
+	case BT_CTF_TYPE_ID_VARIANT:
+		return copy_variant(output, field, container_of(definition,
+			struct definition_variant, p));
+	case BT_CTF_TYPE_ID_ARRAY:
+		return copy_array(output, field, container_of(definition,
+			struct definition_array, p));
+	case BT_CTF_TYPE_ID_SEQUENCE:
+		return copy_sequence(output, field, container_of(definition,
+			struct definition_sequence, p));
+	default:
+		return -1;
+	}
+}
+
+/*
+ * Add the input packet context fields which the writer does not set
+ * itself to the output packet context.
+ */
+static
+int add_packet_context_fields(struct bt_ctf_stream_class *stream_class,
+		struct declaration_struct *packet_context_decl)
+{
+	struct bt_ctf_field_type *packet_context;
+	int i, ret = 0;
+
+	packet_context = bt_ctf_stream_class_get_packet_context_type(
+		stream_class);
+	if (!packet_context)
+		return -1;
+	for (i = 0; i < packet_context_decl->fields->len; i++) {
+		struct declaration_field *field = &g_array_index(
+			packet_context_decl->fields, struct declaration_field,
+			i);
+		struct bt_ctf_field_type *field_type;
+
+		if (is_writer_packet_context_field(field->name))
+			continue;
+		field_type = type_from_declaration(field->declaration);
+		if (!field_type) {
+			ret = -1;
+			break;
+		}
+		ret = bt_ctf_field_type_structure_add_field(packet_context,
+			field_type, g_quark_to_string(field->name));
+		bt_put(field_type);
+		if (ret)
+			break;
+	}
+	bt_put(packet_context);
+	return ret;
+}
+
+static
+struct bt_ctf_stream_class *get_stream_class(struct ctf_output *output,
+		struct ctf_stream_declaration *stream_class)
+{
+	struct bt_ctf_stream_class *out_class;
+	struct bt_ctf_field_type *type = NULL;
+
+	out_class = g_hash_table_lookup(output->stream_classes, stream_class);
+	if (out_class)
+		return out_class;
+	out_class = bt_ctf_stream_class_create(NULL);
+	if (!out_class)
+		goto error;
+	if (bt_ctf_stream_class_set_clock(out_class, output->clock))
+		goto error;
+	if (stream_class->event_context_decl) {
+		type = type_from_declaration(
+			&stream_class->event_context_decl->p);
+		if (!type)
+			goto error;
+		if (bt_ctf_stream_class_set_event_context_type(out_class,
+				type))
+			goto error;
+		BT_PUT(type);
+	}
+	if (stream_class->packet_context_decl
+			&& add_packet_context_fields(out_class,
+				stream_class->packet_context_decl))
+		goto error;
+	g_hash_table_insert(output->stream_classes, stream_class, out_class);
+	return out_class;
+
+error:
+	fprintf(stderr, "[error] Cannot create the output stream class.\n");
+	bt_put(type);
+	bt_put(out_class);
+	return NULL;
+}
+
+static
+int set_event_class_attributes(struct bt_ctf_event_class *out_class,
+		struct ctf_event_declaration *event_class)
+{
+	struct bt_value *value;
+	int ret;
+
+	if (event_class->field_mask & CTF_EVENT_loglevel) {
+		value = bt_value_integer_create_init(event_class->loglevel);
+		ret = bt_ctf_event_class_set_attribute(out_class, "loglevel",
+			value);
+		bt_put(value);
+		if (ret)
+			return ret;
+	}
+	if (event_class->field_mask & CTF_EVENT_model_emf_uri) {
+		value = bt_value_string_create_init(
+			g_quark_to_string(event_class->model_emf_uri));
+		ret = bt_ctf_event_class_set_attribute(out_class,
+			"model.emf.uri", value);
+		bt_put(value);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+static
+struct bt_ctf_event_class *get_event_class(struct ctf_output *output,
+		struct bt_ctf_stream_class *stream_class,
+		struct ctf_event_declaration *event_class)
+{
+	struct bt_ctf_event_class *out_class;
+	struct bt_ctf_field_type *type = NULL;
+
+	out_class = g_hash_table_lookup(output->event_classes, event_class);
+	if (out_class)
+		return out_class;
+	out_class = bt_ctf_event_class_create(
+		g_quark_to_string(event_class->name));
+	if (!out_class)
+		goto error;
+	if (bt_ctf_event_class_set_id(out_class, event_class->id))
+		goto error;
+	if (event_class->context_decl) {
+		type = type_from_declaration(&event_class->context_decl->p);
+		if (!type || bt_ctf_event_class_set_context_type(out_class,
+				type))
+			goto error;
+		BT_PUT(type);
+	}
+	if (event_class->fields_decl) {
+		type = type_from_declaration(&event_class->fields_decl->p);
+		if (!type || bt_ctf_event_class_set_payload_type(out_class,
+				type))
+			goto error;
+		BT_PUT(type);
+	}
+	if (set_event_class_attributes(out_class, event_class))
+		goto error;
+	if (bt_ctf_stream_class_add_event_class(stream_class, out_class))
+		goto error;
+	g_hash_table_insert(output->event_classes, event_class, out_class);
+	output->metadata_dirty = 1;
+	return out_class;
+
+error:
+	fprintf(stderr, "[error] Cannot create the output class of event \"%s\".\n",
+		g_quark_to_string(event_class->name));
+	bt_put(type);
+	bt_put(out_class);
+	return NULL;
+}
+
+static
+struct ctf_output_stream *get_stream(struct ctf_output *output,
+		struct ctf_stream_definition *input)
+{
+	struct ctf_output_stream *ostream;
+	struct bt_ctf_stream_class *stream_class;
+	struct bt_ctf_stream *stream;
+
+	ostream = g_hash_table_lookup(output->streams, input);
+	if (ostream)
+		return ostream;
+	stream_class = get_stream_class(output, input->stream_class);
+	if (!stream_class)
+		return NULL;
+	stream = bt_ctf_writer_create_stream(output->writer, stream_class);
+	if (!stream) {
+		fprintf(stderr, "[error] Cannot create the output stream.\n");
+		return NULL;
+	}
+	ostream = g_new0(struct ctf_output_stream, 1);
+	ostream->stream = stream;
+	ostream->input = input;
+	/* No input packet yet: the first event starts one. */
+	ostream->packet.begin = -1ULL;
+	ostream->packet.end = -1ULL;
+	g_hash_table_insert(output->streams, input, ostream);
+	output->metadata_dirty = 1;
+	return ostream;
+}
+
+static
+void ctf_output_stream_free(gpointer data)
+{
+	struct ctf_output_stream *ostream = data;
+
+	bt_put(ostream->stream);
+	g_free(ostream);
+}
+
+static
+int flush_stream(struct ctf_output_stream *ostream)
+{
+	int ret;
+
+	if (!ostream->nr_events)
+		return 0;
+	ret = bt_ctf_stream_flush(ostream->stream);
+	if (ret)
+		fprintf(stderr, "[error] Cannot write an output packet.\n");
+	/* The writer resets the packet context. */
+	ostream->nr_events = 0;
+	ostream->context_set = 0;
+	return ret;
+}
+
+static
+void flush_metadata(struct ctf_output *output)
+{
+	if (!output->metadata_dirty)
+		return;
+	bt_ctf_writer_flush_metadata(output->writer);
+	output->metadata_dirty = 0;
+}
+
+static
+int copy_packet_context(struct ctf_output *output,
+		struct ctf_output_stream *ostream)
+{
+	struct definition_struct *input_context =
+		ostream->input->stream_packet_context;
+	struct declaration_struct *decl = input_context->declaration;
+	struct bt_ctf_field *packet_context;
+	int i, ret = 0;
+
+	packet_context = bt_ctf_stream_get_packet_context(ostream->stream);
+	if (!packet_context)
+		return -1;
+	for (i = 0; i < decl->fields->len; i++) {
+		struct declaration_field *field = &g_array_index(decl->fields,
+			struct declaration_field, i);
+		struct bt_ctf_field *out_field;
+
+		if (is_writer_packet_context_field(field->name))
+			continue;
+		out_field = bt_ctf_field_structure_get_field(packet_context,
+			g_quark_to_string(field->name));
+		if (!out_field) {
+			ret = -1;
+			break;
+		}
+		ret = copy_field(output, out_field,
+			g_ptr_array_index(input_context->fields, i));
+		bt_put(out_field);
+		if (ret)
+			break;
+	}
+	bt_put(packet_context);
+	return ret;
+}
+
+/*
+ * Start a new output packet when the input stream moved to another
+ * packet, carrying over its discarded events count, and set the packet
+ * context from the input one.
+ */
+static
+int begin_packet(struct ctf_output *output, struct ctf_output_stream *ostream)
+{
+	struct ctf_stream_definition *input = ostream->input;
+	int ret;
+
+	if (input->current.cycles.begin != ostream->packet.begin
+			|| input->current.cycles.end != ostream->packet.end) {
+		ret = flush_stream(ostream);
+		if (ret)
+			return ret;
+		ostream->packet = input->current.cycles;
+		if (input->events_discarded)
+			bt_ctf_stream_append_discarded_events(ostream->stream,
+				input->events_discarded);
+	}
+	if (ostream->context_set || !input->stream_packet_context)
+		return 0;
+	ret = copy_packet_context(output, ostream);
+	if (ret) {
+		fprintf(stderr, "[error] Cannot copy the packet context.\n");
+		return ret;
+	}
+	ostream->context_set = 1;
+	return 0;
+}
+
+static
+int copy_event(struct ctf_output *output, struct bt_ctf_event *out_event,
+		struct ctf_stream_definition *stream,
+		struct ctf_event_definition *event)
+{
+	struct bt_ctf_field *field;
+	int ret;
+
+	if (stream->stream_event_context) {
+		field = bt_ctf_event_get_stream_event_context(out_event);
+		ret = copy_field(output, field,
+			&stream->stream_event_context->p);
+		bt_put(field);
+		if (ret)
+			return ret;
+	}
+	if (event->event_context) {
+		field = bt_ctf_event_get_event_context(out_event);
+		ret = copy_field(output, field, &event->event_context->p);
+		bt_put(field);
+		if (ret)
+			return ret;
+	}
+	if (event->event_fields) {
+		field = bt_ctf_event_get_payload_field(out_event);
+		ret = copy_field(output, field, &event->event_fields->p);
+		bt_put(field);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+static
+int ctf_output_write_event(struct bt_stream_pos *ppos,
+		struct ctf_stream_definition *stream)
+{
+	struct ctf_output *output =
+		container_of(ppos, struct ctf_output, parent.parent);
+	struct ctf_stream_declaration *stream_class = stream->stream_class;
+	struct ctf_event_declaration *event_class;
+	struct ctf_event_definition *event;
+	struct ctf_output_stream *ostream;
+	struct bt_ctf_event_class *out_class;
+	struct bt_ctf_event *out_event;
+	uint64_t id;
+	int ret;
+
+	id = stream->event_id;
+
+	if (id >= stream_class->events_by_id->len) {
+		fprintf(stderr, "[error] Event id %" PRIu64 " is outside range.\n", id);
+		return -EINVAL;
+	}
+	event = g_ptr_array_index(stream->events_by_id, id);
+	if (!event) {
+		fprintf(stderr, "[error] Event id %" PRIu64 " is unknown.\n", id);
+		return -EINVAL;
+	}
+	event_class = g_ptr_array_index(stream_class->events_by_id, id);
+	if (!event_class) {
+		fprintf(stderr, "[error] Event class id %" PRIu64 " is unknown.\n", id);
+		return -EINVAL;
+	}
+
+	ostream = get_stream(output, stream);
+	if (!ostream)
+		return -EINVAL;
+	out_class = get_event_class(output,
+		g_hash_table_lookup(output->stream_classes, stream_class),
+		event_class);
+	if (!out_class)
+		return -EINVAL;
+	ret = begin_packet(output, ostream);
+	if (ret)
+		return -EINVAL;
+
+	out_event = bt_ctf_event_create(out_class);
+	if (!out_event)
+		return -ENOMEM;
+	ret = copy_event(output, out_event, stream, event);
+	if (ret) {
+		fprintf(stderr, "[error] Cannot copy event \"%s\".\n",
+			g_quark_to_string(event_class->name));
+		goto end;
+	}
+	/*
+	 * The writer takes the event timestamp from the clock, which only
+	 * moves forward: out of order input keeps the last timestamp.
+	 */
+	if (stream->has_timestamp)
+		(void) bt_ctf_clock_set_value(output->clock,
+			stream->real_timestamp);
+	ret = bt_ctf_stream_append_event(ostream->stream, out_event);
+	if (ret) {
+		fprintf(stderr, "[error] Cannot append event \"%s\".\n",
+			g_quark_to_string(event_class->name));
+		goto end;
+	}
+	if (++ostream->nr_events >= CTF_OUTPUT_PACKET_EVENTS_MAX)
+		ret = flush_stream(ostream);
+end:
+	bt_put(out_event);
+	return ret ? -EINVAL : 0;
+}
+
+static
+int add_env_string(struct bt_ctf_writer *writer, const char *name,
+		const char *value)
+{
+	if (!value[0])
+		return 0;
+	return bt_ctf_writer_add_environment_field(writer, name, value);
+}
+
+/*
+ * The output trace has a single environment: the one of the first
+ * input trace is kept.
+ */
+static
+int ctf_output_trace_pre_handler(struct bt_stream_pos *ppos,
+		struct bt_trace_descriptor *td)
+{
+	struct ctf_output *output =
+		container_of(ppos, struct ctf_output, parent.parent);
+	struct ctf_tracer_env *env =
+		&container_of(td, struct ctf_trace, parent)->env;
+	struct bt_ctf_writer *writer = output->writer;
+	int ret;
+
+	if (output->env_set)
+		return 0;
+	output->env_set = 1;
+	ret = add_env_string(writer, "hostname", env->hostname)
+		|| add_env_string(writer, "domain", env->domain)
+		|| add_env_string(writer, "sysname", env->sysname)
+		|| add_env_string(writer, "kernel_release", env->release)
+		|| add_env_string(writer, "kernel_version", env->version)
+		|| add_env_string(writer, "tracer_name", env->tracer_name)
+		|| add_env_string(writer, "procname", env->procname);
+	if (!ret && env->vpid >= 0)
+		ret = bt_ctf_writer_add_environment_field_int64(writer,
+			"vpid", env->vpid);
+	if (ret)
+		fprintf(stderr, "[error] Cannot set the output trace environment.\n");
+	return ret;
+}
+
+/*
+ * Write out the streams of a trace which is done with, and forget its
+ * classes: the trace descriptor may not outlive this call.
+ */
+static
+int ctf_output_trace_post_handler(struct bt_stream_pos *ppos,
+		struct bt_trace_descriptor *td)
+{
+	struct ctf_output *output =
+		container_of(ppos, struct ctf_output, parent.parent);
+	struct ctf_trace *trace = container_of(td, struct ctf_trace, parent);
+	GHashTableIter iter;
+	gpointer key, value;
+	int ret = 0;
+
+	g_hash_table_iter_init(&iter, output->streams);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		struct ctf_output_stream *ostream = value;
+
+		if (ostream->input->stream_class->trace != trace)
+			continue;
+		if (flush_stream(ostream))
+			ret = -1;
+		g_hash_table_iter_remove(&iter);
+	}
+	g_hash_table_iter_init(&iter, output->event_classes);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		struct ctf_event_declaration *event_class = key;
+
+		if (event_class->stream->trace == trace)
+			g_hash_table_iter_remove(&iter);
+	}
+	g_hash_table_iter_init(&iter, output->stream_classes);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		struct ctf_stream_declaration *stream_class = key;
+
+		if (stream_class->trace == trace)
+			g_hash_table_iter_remove(&iter);
+	}
+	flush_metadata(output);
+	return ret;
+}
+
+static
+int ctf_output_flush(struct bt_stream_pos *ppos)
+{
+	struct ctf_output *output =
+		container_of(ppos, struct ctf_output, parent.parent);
+	GHashTableIter iter;
+	gpointer key, value;
+	int ret = 0;
+
+	g_hash_table_iter_init(&iter, output->streams);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		if (flush_stream(value))
+			ret = -1;
+	}
+	flush_metadata(output);
+	return ret;
+}
+
+static
+void ctf_output_destroy(struct ctf_output *output)
+{
+	if (output->streams)
+		g_hash_table_destroy(output->streams);
+	if (output->event_classes)
+		g_hash_table_destroy(output->event_classes);
+	if (output->stream_classes)
+		g_hash_table_destroy(output->stream_classes);
+	bt_put(output->length_type);
+	bt_put(output->clock);
+	bt_put(output->writer);
+	g_free(output);
+}
+
+BT_HIDDEN
+struct bt_trace_descriptor *ctf_output_open_trace(const char *path)
+{
+	struct ctf_output *output;
+
+	if (!path) {
+		fprintf(stderr, "[error] Path missing for output CTF trace.\n");
+		return NULL;
+	}
+	output = g_new0(struct ctf_output, 1);
+	init_trace_descriptor(&output->parent.trace_descriptor);
+
+	output->writer = bt_ctf_writer_create(path);
+	if (!output->writer) {
+		fprintf(stderr, "[error] Cannot create CTF trace \"%s\".\n",
+			path);
+		goto error;
+	}
+	output->clock = bt_ctf_clock_create("monotonic");
+	if (!output->clock
+			|| bt_ctf_clock_set_frequency(output->clock, 1000000000)
+			|| bt_ctf_clock_set_is_absolute(output->clock, 1)
+			|| bt_ctf_writer_add_clock(output->writer,
+				output->clock))
+		goto error;
+	output->length_type = bt_ctf_field_type_integer_create(64);
+	if (!output->length_type)
+		goto error;
+	output->stream_classes = g_hash_table_new_full(g_direct_hash,
+		g_direct_equal, NULL, (GDestroyNotify) bt_put);
+	output->event_classes = g_hash_table_new_full(g_direct_hash,
+		g_direct_equal, NULL, (GDestroyNotify) bt_put);
+	output->streams = g_hash_table_new_full(g_direct_hash,
+		g_direct_equal, NULL, ctf_output_stream_free);
+
+	output->parent.parent.event_cb = ctf_output_write_event;
+	output->parent.parent.pre_trace_cb = ctf_output_trace_pre_handler;
+	output->parent.parent.post_trace_cb = ctf_output_trace_post_handler;
+	output->parent.parent.flush_cb = ctf_output_flush;
+	output->parent.parent.trace = &output->parent.trace_descriptor;
+	output_traces = g_list_prepend(output_traces, output);
+	return &output->parent.trace_descriptor;
+
+error:
+	ctf_output_destroy(output);
+	return NULL;
+}
+
+BT_HIDDEN
+int ctf_output_is_trace(struct bt_trace_descriptor *descriptor)
+{
+	return !!g_list_find(output_traces, container_of(descriptor,
+		struct ctf_output, parent.trace_descriptor));
+}
+
+BT_HIDDEN
+int ctf_output_close_trace(struct bt_trace_descriptor *descriptor)
+{
+	struct ctf_output *output = container_of(descriptor,
+		struct ctf_output, parent.trace_descriptor);
+	int ret;
+
+	ret = ctf_output_flush(&output->parent.parent);
+	output_traces = g_list_remove(output_traces, output);
+	ctf_output_destroy(output);
+	return ret;
+}
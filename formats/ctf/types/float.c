@@ -299,12 +299,12 @@ void __attribute__((constructor)) ctf_float_init(void)
 		bt_float_declaration_new(FLT_MANT_DIG,
 				sizeof(float) * CHAR_BIT - FLT_MANT_DIG,
 				BYTE_ORDER,
-				__alignof__(float));
+				__alignof__(float), NULL);
 	static_double_declaration =
 		bt_float_declaration_new(DBL_MANT_DIG,
 				sizeof(double) * CHAR_BIT - DBL_MANT_DIG,
 				BYTE_ORDER,
-				__alignof__(double));
+				__alignof__(double), NULL);
 }
 
 static
@@ -24,6 +24,7 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -57,27 +58,22 @@
 #include "lttng-live.h"
 #include "lttng-viewer-abi.h"
 
-#define ACTIVE_POLL_DELAY	100	/* ms */
-
 /*
  * Memory allocation zeroed
  */
 #define zmalloc(x) calloc(1, x)
 
-#ifndef max_t
-#define max_t(type, a, b)	\
-	((type) (a) > (type) (b) ? (type) (a) : (type) (b))
-#endif
+/* Events read between two checks of the statistics period. */
+#define STATS_CHECK_EVENTS	4096
 
 static void ctf_live_packet_seek(struct bt_stream_pos *stream_pos,
 		size_t index, int whence);
 static int add_traces(struct lttng_live_ctx *ctx);
 static int del_traces(gpointer key, gpointer value, gpointer user_data);
-static int get_new_metadata(struct lttng_live_ctx *ctx,
-		struct lttng_live_viewer_stream *viewer_stream,
-		char **metadata_buf);
+static int get_new_metadata(struct lttng_live_ctx *ctx, GPtrArray *streams);
+static FILE *open_metadata(struct lttng_live_viewer_stream *metadata_stream);
+static void release_metadata(struct lttng_live_viewer_stream *metadata_stream);
 
-static
 ssize_t lttng_live_recv(int fd, void *buf, size_t len)
 {
 	ssize_t ret;
@@ -98,7 +94,6 @@ ssize_t lttng_live_recv(int fd, void *buf, size_t len)
 	return ret;
 }
 
-static
 ssize_t lttng_live_send(int fd, const void *buf, size_t len)
 {
 	ssize_t ret;
@@ -109,16 +104,300 @@ ssize_t lttng_live_send(int fd, const void *buf, size_t len)
 	return ret;
 }
 
-int lttng_live_connect_viewer(struct lttng_live_ctx *ctx)
+/*
+ * Wait before polling the relay again. The delay starts at
+ * LTTNG_LIVE_MIN_POLL_DELAY and doubles on each consecutive wait, up
+ * to the latency target, so idle sources are polled less and less
+ * often while a source which just produced data is polled right away.
+ */
+static
+void lttng_live_backoff(struct lttng_live_ctx *ctx, int *delay)
+{
+	if (*delay < LTTNG_LIVE_MIN_POLL_DELAY)
+		*delay = LTTNG_LIVE_MIN_POLL_DELAY;
+	if (*delay > ctx->latency_target)
+		*delay = ctx->latency_target;
+	(void) poll(NULL, 0, *delay);
+	*delay <<= 1;
+}
+
+static
+int recv_index_response(struct lttng_live_ctx *ctx,
+		struct lttng_live_viewer_stream *stream)
+{
+	ssize_t ret_len;
+
+	ret_len = lttng_live_recv(ctx->control_sock, &stream->next_index,
+			sizeof(stream->next_index));
+	if (ret_len == 0) {
+		fprintf(stderr, "[error] Remote side has closed connection\n");
+		goto error;
+	}
+	if (ret_len < 0) {
+		perror("[error] Error receiving index response");
+		goto error;
+	}
+	assert(ret_len == sizeof(stream->next_index));
+	stream->index_state = LTTNG_LIVE_REQUEST_RECEIVED;
+	return 0;
+
+error:
+	return -1;
+}
+
+/*
+ * The packet data follows the header only when the status is OK. It is
+ * received into a buffer of the pool, handed over to the stream
+ * position by get_data_packet().
+ */
+static
+int recv_packet_response(struct lttng_live_ctx *ctx,
+		struct lttng_live_viewer_stream *stream)
+{
+	struct lttng_viewer_trace_packet *rp = &stream->next_packet;
+	ssize_t ret_len;
+
+	ret_len = lttng_live_recv(ctx->control_sock, rp, sizeof(*rp));
+	if (ret_len == 0) {
+		fprintf(stderr, "[error] Remote side has closed connection\n");
+		goto error;
+	}
+	if (ret_len < 0) {
+		perror("[error] Error receiving data response");
+		goto error;
+	}
+	if (ret_len != sizeof(*rp)) {
+		fprintf(stderr, "[error] get_data_packet: expected %zu"
+				", received %zd\n", sizeof(*rp), ret_len);
+		goto error;
+	}
+	rp->status = be32toh(rp->status);
+	rp->flags = be32toh(rp->flags);
+	rp->len = be32toh(rp->len);
+	if (rp->status == LTTNG_VIEWER_GET_PACKET_OK && rp->len > 0) {
+		stream->next_packet_mma = lttng_live_pool_get(&ctx->pool,
+				rp->len);
+		if (!stream->next_packet_mma)
+			goto error;
+		ret_len = lttng_live_recv(ctx->control_sock,
+				mmap_align_addr(stream->next_packet_mma),
+				rp->len);
+		if (ret_len == 0) {
+			fprintf(stderr, "[error] Remote side has closed connection\n");
+			goto error;
+		}
+		if (ret_len < 0) {
+			perror("[error] Error receiving trace packet");
+			goto error;
+		}
+		assert(ret_len == rp->len);
+	}
+	stream->packet_state = LTTNG_LIVE_REQUEST_RECEIVED;
+	return 0;
+
+error:
+	return -1;
+}
+
+/*
+ * Receive the response to the oldest request in flight into the slot
+ * of the stream it was sent for.
+ */
+static
+int recv_next_response(struct lttng_live_ctx *ctx)
+{
+	struct lttng_live_request *request;
+
+	request = g_queue_pop_head(ctx->requests);
+	assert(request);
+	if (request->type == LTTNG_LIVE_REQUEST_PACKET)
+		return recv_packet_response(ctx, request->stream);
+	return recv_index_response(ctx, request->stream);
+}
+
+/*
+ * Receive all the responses still in flight. Must be called before
+ * waiting for the response of any other command.
+ */
+static
+int flush_requests(struct lttng_live_ctx *ctx)
 {
-	struct hostent *host;
-	struct sockaddr_in server_addr;
 	int ret;
 
-	if (lttng_live_should_quit()) {
-		ret = -1;
-		goto end;
+	while (!g_queue_is_empty(ctx->requests)) {
+		ret = recv_next_response(ctx);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+static
+int send_next_index_request(struct lttng_live_ctx *ctx,
+		struct lttng_live_viewer_stream *stream)
+{
+	struct {
+		struct lttng_viewer_cmd cmd;
+		struct lttng_viewer_get_next_index rq;
+	} __attribute__((__packed__)) msg;
+	ssize_t ret_len;
+
+	msg.cmd.cmd = htobe32(LTTNG_VIEWER_GET_NEXT_INDEX);
+	msg.cmd.data_size = htobe64((uint64_t) sizeof(msg.rq));
+	msg.cmd.cmd_version = htobe32(0);
+
+	memset(&msg.rq, 0, sizeof(msg.rq));
+	msg.rq.stream_id = htobe64(stream->id);
+
+	/* Header and payload in a single segment. */
+	ret_len = lttng_live_send(ctx->control_sock, &msg, sizeof(msg));
+	if (ret_len < 0) {
+		perror("[error] Error sending get_next_index request");
+		return -1;
+	}
+	assert(ret_len == sizeof(msg));
+	stream->index_request.stream = stream;
+	stream->index_request.type = LTTNG_LIVE_REQUEST_INDEX;
+	g_queue_push_tail(ctx->requests, &stream->index_request);
+	stream->index_state = LTTNG_LIVE_REQUEST_SENT;
+	return 0;
+}
+
+static
+int send_packet_request(struct lttng_live_ctx *ctx,
+		struct lttng_live_viewer_stream *stream, uint64_t offset,
+		uint64_t len)
+{
+	struct {
+		struct lttng_viewer_cmd cmd;
+		struct lttng_viewer_get_packet rq;
+	} __attribute__((__packed__)) msg;
+	ssize_t ret_len;
+
+	msg.cmd.cmd = htobe32(LTTNG_VIEWER_GET_PACKET);
+	msg.cmd.data_size = htobe64((uint64_t) sizeof(msg.rq));
+	msg.cmd.cmd_version = htobe32(0);
+
+	memset(&msg.rq, 0, sizeof(msg.rq));
+	msg.rq.stream_id = htobe64(stream->id);
+	msg.rq.offset = htobe64(offset);
+	msg.rq.len = htobe32(len);
+
+	ret_len = lttng_live_send(ctx->control_sock, &msg, sizeof(msg));
+	if (ret_len < 0) {
+		perror("[error] Error sending get_data_packet request");
+		return -1;
+	}
+	assert(ret_len == sizeof(msg));
+	stream->packet_request.stream = stream;
+	stream->packet_request.type = LTTNG_LIVE_REQUEST_PACKET;
+	g_queue_push_tail(ctx->requests, &stream->packet_request);
+	stream->next_packet_offset = offset;
+	stream->packet_state = LTTNG_LIVE_REQUEST_SENT;
+	return 0;
+}
+
+/*
+ * Forget the packet received ahead for a stream, if any. The response
+ * must not be in flight anymore.
+ */
+static
+void drop_next_packet(struct lttng_live_ctx *ctx,
+		struct lttng_live_viewer_stream *stream)
+{
+	lttng_live_pool_put(&ctx->pool, stream->next_packet_mma);
+	stream->next_packet_mma = NULL;
+	stream->packet_state = LTTNG_LIVE_REQUEST_NONE;
+}
+
+/*
+ * Index whose packet can be asked for ahead of the packet seek: the
+ * index consumed last if its packet has not been read yet, the index
+ * received ahead otherwise. Packets announcing new metadata or streams
+ * are left to get_data_packet(), which has to handle them first.
+ */
+static
+struct lttng_viewer_index *packet_to_prefetch(
+		struct lttng_live_viewer_stream *stream)
+{
+	struct lttng_viewer_index *index;
+
+	if (stream->data_pending)
+		index = &stream->current_index;
+	else if (stream->index_state == LTTNG_LIVE_REQUEST_RECEIVED
+			&& be32toh(stream->next_index.status)
+				== LTTNG_VIEWER_INDEX_OK)
+		index = &stream->next_index;
+	else
+		return NULL;
+	if (index->flags & (LTTNG_VIEWER_FLAG_NEW_METADATA
+				| LTTNG_VIEWER_FLAG_NEW_STREAM))
+		return NULL;
+	return index;
+}
+
+/*
+ * Ask for the next index of every stream of the traces being read
+ * which has neither an index in flight nor an unread packet, and for
+ * the packets of the indexes already known, so the round trips overlap
+ * instead of being serialized per stream. Packets are only asked for
+ * while the buffer pool has room for them.
+ */
+static
+int prefetch_requests(struct lttng_live_ctx *ctx)
+{
+	struct lttng_live_ctf_trace *trace;
+	struct lttng_live_viewer_stream *stream;
+	struct lttng_viewer_index *index;
+	GHashTableIter it;
+	gpointer key, value;
+	int i, ret;
+
+	g_hash_table_iter_init(&it, ctx->session->ctf_traces);
+	while (g_hash_table_iter_next(&it, &key, &value)) {
+		trace = value;
+		if (!trace->in_use)
+			continue;
+		for (i = 0; i < trace->streams->len; i++) {
+			stream = g_ptr_array_index(trace->streams, i);
+			if (stream->metadata_flag || stream->conn
+					|| stream->id == -1ULL)
+				continue;
+			if (g_queue_get_length(ctx->requests)
+					>= LTTNG_LIVE_PIPELINE_DEPTH)
+				return 0;
+			index = packet_to_prefetch(stream);
+			if (index && stream->packet_state
+					== LTTNG_LIVE_REQUEST_NONE
+					&& !lttng_live_pool_full(&ctx->pool)) {
+				ret = send_packet_request(ctx, stream,
+					be64toh(index->offset),
+					be64toh(index->packet_size) / CHAR_BIT);
+				if (ret)
+					return ret;
+			}
+			if (stream->data_pending
+					|| stream->index_state
+						!= LTTNG_LIVE_REQUEST_NONE)
+				continue;
+			if (g_queue_get_length(ctx->requests)
+					>= LTTNG_LIVE_PIPELINE_DEPTH)
+				return 0;
+			ret = send_next_index_request(ctx, stream);
+			if (ret)
+				return ret;
+			stream->index_prefetched = 1;
+		}
 	}
+	return 0;
+}
+
+static
+int connect_socket(struct lttng_live_ctx *ctx, int *sock)
+{
+	struct hostent *host;
+	struct sockaddr_in server_addr;
+	int fd, one = 1;
 
 	host = gethostbyname(ctx->relay_hostname);
 	if (!host) {
@@ -127,7 +406,7 @@ int lttng_live_connect_viewer(struct lttng_live_ctx *ctx)
 		goto error;
 	}
 
-	if ((ctx->control_sock = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
+	if ((fd = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
 		perror("Socket");
 		goto error;
 	}
@@ -137,13 +416,38 @@ int lttng_live_connect_viewer(struct lttng_live_ctx *ctx)
 	server_addr.sin_addr = *((struct in_addr *) host->h_addr);
 	memset(&(server_addr.sin_zero), 0, 8);
 
-	if (connect(ctx->control_sock, (struct sockaddr *) &server_addr,
+	if (connect(fd, (struct sockaddr *) &server_addr,
 				sizeof(struct sockaddr)) == -1) {
 		perror("Connect");
+		close(fd);
 		goto error;
 	}
 
-	ret = 0;
+	/* Requests are small and pipelined, don't let them wait for ACKs. */
+	if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY,
+			&one, sizeof(one)) < 0) {
+		perror("setsockopt");
+	}
+	*sock = fd;
+	return 0;
+
+error:
+	return -1;
+}
+
+int lttng_live_connect_viewer(struct lttng_live_ctx *ctx)
+{
+	int ret;
+
+	if (lttng_live_should_quit()) {
+		ret = -1;
+		goto end;
+	}
+
+	ret = connect_socket(ctx, &ctx->control_sock);
+	if (ret < 0) {
+		goto error;
+	}
 
 end:
 	return ret;
@@ -153,7 +457,8 @@ error:
 	return -1;
 }
 
-int lttng_live_establish_connection(struct lttng_live_ctx *ctx)
+static
+int establish_connection(struct lttng_live_ctx *ctx, int sock)
 {
 	struct lttng_viewer_cmd cmd;
 	struct lttng_viewer_connect connect;
@@ -174,21 +479,21 @@ int lttng_live_establish_connection(struct lttng_live_ctx *ctx)
 	connect.minor = htobe32(LTTNG_LIVE_MINOR);
 	connect.type = htobe32(LTTNG_VIEWER_CLIENT_COMMAND);
 
-	ret_len = lttng_live_send(ctx->control_sock, &cmd, sizeof(cmd));
+	ret_len = lttng_live_send(sock, &cmd, sizeof(cmd));
 	if (ret_len < 0) {
 		perror("[error] Error sending cmd");
 		goto error;
 	}
 	assert(ret_len == sizeof(cmd));
 
-	ret_len = lttng_live_send(ctx->control_sock, &connect, sizeof(connect));
+	ret_len = lttng_live_send(sock, &connect, sizeof(connect));
 	if (ret_len < 0) {
 		perror("[error] Error sending version");
 		goto error;
 	}
 	assert(ret_len == sizeof(connect));
 
-	ret_len = lttng_live_recv(ctx->control_sock, &connect, sizeof(connect));
+	ret_len = lttng_live_recv(sock, &connect, sizeof(connect));
 	if (ret_len == 0) {
 		fprintf(stderr, "[error] Remote side has closed connection\n");
 		goto error;
@@ -224,6 +529,11 @@ error:
 	return -1;
 }
 
+int lttng_live_establish_connection(struct lttng_live_ctx *ctx)
+{
+	return establish_connection(ctx, ctx->control_sock);
+}
+
 static
 void free_session_list(GPtrArray *session_list)
 {
@@ -401,110 +711,68 @@ int lttng_live_ctf_trace_assign(struct lttng_live_viewer_stream *stream,
 	return ret;
 }
 
+/*
+ * Take back a stream known before the connection to the relay daemon
+ * was lost, under the ID the relay daemon now gives it. Its indexes are
+ * served from the beginning again, up to the last one handed to the
+ * reader, and so is its metadata.
+ */
 static
-int open_metadata_fp_write(struct lttng_live_viewer_stream *stream,
-		char **metadata_buf, size_t *size)
+void resume_stream(struct lttng_live_viewer_stream *vstream,
+		struct lttng_viewer_stream *stream)
 {
-	int ret = 0;
-
-	stream->metadata_fp_write =
-		babeltrace_open_memstream(metadata_buf, size);
-	if (!stream->metadata_fp_write) {
-		perror("Metadata open_memstream");
-		ret = -1;
+	struct lttng_live_ctf_trace *trace = vstream->ctf_trace;
+	uint64_t ctf_trace_id = be64toh(stream->ctf_trace_id);
+
+	printf_verbose("    resuming stream %" PRIu64 " as %" PRIu64 "\n",
+			vstream->id, be64toh(stream->id));
+	vstream->id = be64toh(stream->id);
+	if (trace->ctf_trace_id != ctf_trace_id) {
+		g_hash_table_steal(vstream->session->ctf_traces,
+				&trace->ctf_trace_id);
+		trace->ctf_trace_id = ctf_trace_id;
+		g_hash_table_insert(vstream->session->ctf_traces,
+				&trace->ctf_trace_id, trace);
+	}
+	if (vstream->metadata_flag) {
+		vstream->metadata_skip = trace->metadata_size;
+	} else {
+		vstream->skipping = vstream->consumed;
+		vstream->skip_offset = vstream->consumed_offset;
+		vstream->skip_timestamp_end = vstream->consumed_timestamp_end;
+		vstream->skip_next_offset = vstream->consumed_offset
+				+ vstream->consumed_size / CHAR_BIT;
+		vstream->skipped_flags = 0;
 	}
-
-	return ret;
 }
 
-int lttng_live_attach_session(struct lttng_live_ctx *ctx, uint64_t id)
+/*
+ * Receive the streams announced by an attach or a new streams response,
+ * and assign them to their trace. While reconnecting, the streams
+ * already known are resumed instead, and the ones which have hung up
+ * are ignored.
+ *
+ * Returns the number of new streams or a negative value on error.
+ */
+static
+int recv_streams(struct lttng_live_ctx *ctx, uint32_t stream_count)
 {
-	struct lttng_viewer_cmd cmd;
-	struct lttng_viewer_attach_session_request rq;
-	struct lttng_viewer_attach_session_response rp;
 	struct lttng_viewer_stream stream;
-	int ret, i;
+	struct lttng_live_viewer_stream *streams = NULL, *vstream;
+	char name[sizeof(vstream->path)];
 	ssize_t ret_len;
+	int ret, i, nr_new = 0;
 
-	if (lttng_live_should_quit()) {
-		ret = -1;
-		goto end;
-	}
-
-	cmd.cmd = htobe32(LTTNG_VIEWER_ATTACH_SESSION);
-	cmd.data_size = htobe64((uint64_t) sizeof(rq));
-	cmd.cmd_version = htobe32(0);
-
-	memset(&rq, 0, sizeof(rq));
-	rq.session_id = htobe64(id);
-	// TODO: add cmd line parameter to select seek beginning
-	// rq.seek = htobe32(LTTNG_VIEWER_SEEK_BEGINNING);
-	rq.seek = htobe32(LTTNG_VIEWER_SEEK_LAST);
-
-	ret_len = lttng_live_send(ctx->control_sock, &cmd, sizeof(cmd));
-	if (ret_len < 0) {
-		perror("[error] Error sending cmd");
-		goto error;
-	}
-	assert(ret_len == sizeof(cmd));
-
-	ret_len = lttng_live_send(ctx->control_sock, &rq, sizeof(rq));
-	if (ret_len < 0) {
-		perror("[error] Error sending attach request");
-		goto error;
-	}
-	assert(ret_len == sizeof(rq));
-
-	ret_len = lttng_live_recv(ctx->control_sock, &rp, sizeof(rp));
-	if (ret_len == 0) {
-		fprintf(stderr, "[error] Remote side has closed connection\n");
-		goto error;
-	}
-	if (ret_len < 0) {
-		perror("[error] Error receiving attach response");
-		goto error;
-	}
-	assert(ret_len == sizeof(rp));
-
-	switch(be32toh(rp.status)) {
-	case LTTNG_VIEWER_ATTACH_OK:
-		break;
-	case LTTNG_VIEWER_ATTACH_UNK:
-		ret = -LTTNG_VIEWER_ATTACH_UNK;
-		goto end;
-	case LTTNG_VIEWER_ATTACH_ALREADY:
-		fprintf(stderr, "[error] There is already a viewer attached to this session\n");
-		goto error;
-	case LTTNG_VIEWER_ATTACH_NOT_LIVE:
-		fprintf(stderr, "[error] Not a live session\n");
-		goto error;
-	case LTTNG_VIEWER_ATTACH_SEEK_ERR:
-		fprintf(stderr, "[error] Wrong seek parameter\n");
-		goto error;
-	default:
-		fprintf(stderr, "[error] Unknown attach return code %u\n",
-				be32toh(rp.status));
-		goto error;
-	}
-	if (be32toh(rp.status) != LTTNG_VIEWER_ATTACH_OK) {
-		goto error;
-	}
-
-	ctx->session->stream_count += be32toh(rp.streams_count);
 	/*
 	 * When the session is created but not started, we do an active wait
 	 * until it starts. It allows the viewer to start processing the trace
 	 * as soon as the session starts.
 	 */
-	if (ctx->session->stream_count == 0) {
-		ret = 0;
-		goto end;
+	if (!stream_count) {
+		return 0;
 	}
-	printf_verbose("Waiting for %" PRIu64 " streams:\n",
-		ctx->session->stream_count);
-	ctx->session->streams = g_new0(struct lttng_live_viewer_stream,
-			ctx->session->stream_count);
-	for (i = 0; i < be32toh(rp.streams_count); i++) {
+	printf_verbose("Waiting for %" PRIu32 " streams:\n", stream_count);
+	for (i = 0; i < stream_count; i++) {
 		ret_len = lttng_live_recv(ctx->control_sock, &stream, sizeof(stream));
 		if (ret_len == 0) {
 			fprintf(stderr, "[error] Remote side has closed connection\n");
@@ -521,75 +789,372 @@ int lttng_live_attach_session(struct lttng_live_ctx *ctx, uint64_t id)
 		printf_verbose("    stream %" PRIu64 " : %s/%s\n",
 				be64toh(stream.id), stream.path_name,
 				stream.channel_name);
-		ctx->session->streams[i].id = be64toh(stream.id);
-		ctx->session->streams[i].session = ctx->session;
-
-		ctx->session->streams[i].mmap_size = 0;
-		ctx->session->streams[i].ctf_stream_id = -1ULL;
+		snprintf(name, sizeof(name), "%s/%s", stream.path_name,
+				stream.channel_name);
+		if (ctx->resume_streams) {
+			vstream = g_hash_table_lookup(ctx->resume_streams, name);
+			if (vstream) {
+				resume_stream(vstream, &stream);
+				g_hash_table_remove(ctx->resume_streams, name);
+				continue;
+			}
+			if (g_hash_table_lookup(ctx->hup_streams, name)) {
+				printf_verbose("    already read\n");
+				continue;
+			}
+		}
+		if (!streams) {
+			streams = g_new0(struct lttng_live_viewer_stream,
+					stream_count - i);
+			ctx->session->streams = streams;
+		}
+		vstream = &streams[nr_new++];
+		vstream->id = be64toh(stream.id);
+		vstream->session = ctx->session;
+		vstream->ctf_stream_id = -1ULL;
+		strcpy(vstream->path, name);
 
 		if (be32toh(stream.metadata_flag)) {
-			ctx->session->streams[i].metadata_flag = 1;
+			vstream->metadata_flag = 1;
 		}
-		ret = lttng_live_ctf_trace_assign(&ctx->session->streams[i],
+		ret = lttng_live_ctf_trace_assign(vstream,
 				be64toh(stream.ctf_trace_id));
 		if (ret < 0) {
 			goto error;
 		}
-
+		ctx->session->stream_count++;
 	}
-	ret = 0;
-end:
-	return ret;
+	return nr_new;
 
 error:
 	return -1;
 }
 
+static
+int send_attach_request(int sock, uint64_t id, uint32_t seek)
+{
+	struct {
+		struct lttng_viewer_cmd cmd;
+		struct lttng_viewer_attach_session_request rq;
+	} __attribute__((__packed__)) msg;
+	ssize_t ret_len;
+
+	msg.cmd.cmd = htobe32(LTTNG_VIEWER_ATTACH_SESSION);
+	msg.cmd.data_size = htobe64((uint64_t) sizeof(msg.rq));
+	msg.cmd.cmd_version = htobe32(0);
+
+	memset(&msg.rq, 0, sizeof(msg.rq));
+	msg.rq.session_id = htobe64(id);
+	msg.rq.seek = htobe32(seek);
+
+	ret_len = lttng_live_send(sock, &msg, sizeof(msg));
+	if (ret_len < 0) {
+		perror("[error] Error sending attach request");
+		return -1;
+	}
+	assert(ret_len == sizeof(msg));
+	return 0;
+}
+
 /*
- * Ask the relay for new streams.
- *
- * Returns the number of new streams received or a negative value on error.
+ * Receive the descriptions of the streams announced on a connection
+ * other than the control connection. They are the streams already
+ * known through the control connection, so they are only skipped.
  */
 static
-int ask_new_streams(struct lttng_live_ctx *ctx)
+int skip_streams(int sock, uint32_t stream_count)
 {
-	int i, ret = 0, nb_streams = 0;
-	uint64_t id;
+	struct lttng_viewer_stream stream;
+	ssize_t ret_len;
+	uint32_t i;
 
-restart:
-	for (i = 0; i < ctx->session_ids->len; i++) {
-		id = g_array_index(ctx->session_ids, uint64_t, i);
-		ret = lttng_live_get_new_streams(ctx, id);
-		printf_verbose("Asking for new streams returns %d\n", ret);
-		if (ret < 0) {
-			if (lttng_live_should_quit()) {
+	for (i = 0; i < stream_count; i++) {
+		ret_len = lttng_live_recv(sock, &stream, sizeof(stream));
+		if (ret_len == 0) {
+			fprintf(stderr, "[error] Remote side has closed connection\n");
+			return -1;
+		}
+		if (ret_len < 0) {
+			perror("[error] Error receiving stream");
+			return -1;
+		}
+		assert(ret_len == sizeof(stream));
+	}
+	return 0;
+}
+
+/*
+ * Returns 0 on success, -LTTNG_VIEWER_ATTACH_UNK if the session is
+ * unknown, -1 on error.
+ */
+static
+int recv_attach_response(struct lttng_live_ctx *ctx, int sock)
+{
+	struct lttng_viewer_attach_session_response rp;
+	ssize_t ret_len;
+
+	ret_len = lttng_live_recv(sock, &rp, sizeof(rp));
+	if (ret_len == 0) {
+		fprintf(stderr, "[error] Remote side has closed connection\n");
+		goto error;
+	}
+	if (ret_len < 0) {
+		perror("[error] Error receiving attach response");
+		goto error;
+	}
+	assert(ret_len == sizeof(rp));
+
+	switch(be32toh(rp.status)) {
+	case LTTNG_VIEWER_ATTACH_OK:
+		break;
+	case LTTNG_VIEWER_ATTACH_UNK:
+		return -LTTNG_VIEWER_ATTACH_UNK;
+	case LTTNG_VIEWER_ATTACH_ALREADY:
+		fprintf(stderr, "[error] There is already a viewer attached to this session\n");
+		goto error;
+	case LTTNG_VIEWER_ATTACH_NOT_LIVE:
+		fprintf(stderr, "[error] Not a live session\n");
+		goto error;
+	case LTTNG_VIEWER_ATTACH_SEEK_ERR:
+		fprintf(stderr, "[error] Wrong seek parameter\n");
+		goto error;
+	default:
+		fprintf(stderr, "[error] Unknown attach return code %u\n",
+				be32toh(rp.status));
+		goto error;
+	}
+
+	if (sock != ctx->control_sock) {
+		if (skip_streams(sock, be32toh(rp.streams_count)) < 0)
+			goto error;
+	} else if (recv_streams(ctx, be32toh(rp.streams_count)) < 0) {
+		goto error;
+	}
+	return 0;
+
+error:
+	return -1;
+}
+
+/*
+ * Attach a connection to all the sessions of ctx->session_ids, from
+ * the position given by seek. The requests are sent LTTNG_LIVE_PIPELINE_DEPTH at a
+ * time, and the relay daemon answers them in order, so attaching to
+ * many sessions does not cost one round trip each.
+ *
+ * Returns 0 on success or a negative value on error.
+ */
+static
+int attach_sessions(struct lttng_live_ctx *ctx, int sock, uint32_t seek)
+{
+	unsigned int i, j, nr;
+	uint64_t id;
+	int ret;
+
+	for (i = 0; i < ctx->session_ids->len; i += nr) {
+		if (lttng_live_should_quit()) {
+			return -1;
+		}
+		nr = MIN(ctx->session_ids->len - i, LTTNG_LIVE_PIPELINE_DEPTH);
+		for (j = 0; j < nr; j++) {
+			id = g_array_index(ctx->session_ids, uint64_t, i + j);
+			printf_verbose("Attaching to session %" PRIu64 "\n", id);
+			ret = send_attach_request(sock, id, seek);
+			if (ret < 0) {
+				return ret;
+			}
+		}
+		for (j = 0; j < nr; j++) {
+			id = g_array_index(ctx->session_ids, uint64_t, i + j);
+			ret = recv_attach_response(ctx, sock);
+			printf_verbose("Attaching session %" PRIu64
+					" returns %d\n", id, ret);
+			if (ret < 0) {
+				if (ret == -LTTNG_VIEWER_ATTACH_UNK) {
+					fprintf(stderr, "[error] Unknown session ID\n");
+				}
+				return ret;
+			}
+		}
+	}
+	return 0;
+}
+
+static
+int send_new_streams_request(struct lttng_live_ctx *ctx, uint64_t id)
+{
+	struct {
+		struct lttng_viewer_cmd cmd;
+		struct lttng_viewer_new_streams_request rq;
+	} __attribute__((__packed__)) msg;
+	ssize_t ret_len;
+
+	msg.cmd.cmd = htobe32(LTTNG_VIEWER_GET_NEW_STREAMS);
+	msg.cmd.data_size = htobe64((uint64_t) sizeof(msg.rq));
+	msg.cmd.cmd_version = htobe32(0);
+
+	memset(&msg.rq, 0, sizeof(msg.rq));
+	msg.rq.session_id = htobe64(id);
+
+	ret_len = lttng_live_send(ctx->control_sock, &msg, sizeof(msg));
+	if (ret_len < 0) {
+		perror("[error] Error sending get_new_streams request");
+		return -1;
+	}
+	assert(ret_len == sizeof(msg));
+	return 0;
+}
+
+/*
+ * Returns the number of streams received, -LTTNG_VIEWER_NEW_STREAMS_HUP
+ * if the session is closed, or -1 on error.
+ */
+static
+int recv_new_streams_response(struct lttng_live_ctx *ctx)
+{
+	struct lttng_viewer_new_streams_response rp;
+	uint32_t stream_count;
+	ssize_t ret_len;
+	int ret;
+
+	ret_len = lttng_live_recv(ctx->control_sock, &rp, sizeof(rp));
+	if (ret_len == 0) {
+		fprintf(stderr, "[error] Remote side has closed connection\n");
+		goto error;
+	}
+	if (ret_len < 0) {
+		perror("[error] Error receiving get_new_streams response");
+		goto error;
+	}
+	assert(ret_len == sizeof(rp));
+
+	switch(be32toh(rp.status)) {
+	case LTTNG_VIEWER_NEW_STREAMS_OK:
+		break;
+	case LTTNG_VIEWER_NEW_STREAMS_NO_NEW:
+		return 0;
+	case LTTNG_VIEWER_NEW_STREAMS_HUP:
+		return -LTTNG_VIEWER_NEW_STREAMS_HUP;
+	case LTTNG_VIEWER_NEW_STREAMS_ERR:
+		fprintf(stderr, "[error] get_new_streams error\n");
+		goto error;
+	default:
+		fprintf(stderr, "[error] Unknown return code %u\n",
+				be32toh(rp.status));
+		goto error;
+	}
+
+	stream_count = be32toh(rp.streams_count);
+	ret = recv_streams(ctx, stream_count);
+	if (ret < 0) {
+		goto error;
+	}
+	return ret;
+
+error:
+	return -1;
+}
+
+/*
+ * Ask the relay for the new streams of all the sessions, with the
+ * requests pipelined like in attach_sessions(). Closed sessions are
+ * removed from ctx->session_ids.
+ *
+ * Returns the number of new streams received or a negative value on error.
+ */
+static
+int ask_new_streams(struct lttng_live_ctx *ctx)
+{
+	unsigned int i, j, nr;
+	int ret = 0, nb_streams = 0;
+	char *hup;
+	uint64_t id;
+
+	ret = flush_requests(ctx);
+	if (ret)
+		return -1;
+
+	hup = g_new0(char, ctx->session_ids->len);
+	for (i = 0; i < ctx->session_ids->len; i += nr) {
+		if (lttng_live_should_quit()) {
+			ret = -1;
+			goto end;
+		}
+		nr = MIN(ctx->session_ids->len - i, LTTNG_LIVE_PIPELINE_DEPTH);
+		for (j = 0; j < nr; j++) {
+			id = g_array_index(ctx->session_ids, uint64_t, i + j);
+			ret = send_new_streams_request(ctx, id);
+			if (ret < 0) {
 				goto end;
 			}
+		}
+		for (j = 0; j < nr; j++) {
+			ret = recv_new_streams_response(ctx);
+			printf_verbose("Asking for new streams returns %d\n", ret);
 			if (ret == -LTTNG_VIEWER_NEW_STREAMS_HUP) {
-				printf_verbose("Session %" PRIu64 " closed\n",
-						id);
-				/*
-				 * The streams have already been closed during
-				 * the reading, so we only need to get rid of
-				 * the trace in our internal table of sessions.
-				 */
-				g_array_remove_index(ctx->session_ids, i);
-				/*
-				 * We can't continue iterating on the g_array
-				 * after a remove, we have to start again.
-				 */
-				goto restart;
-			} else {
+				hup[i + j] = 1;
+			} else if (ret < 0) {
 				ret = -1;
 				goto end;
+			} else {
+				nb_streams += ret;
 			}
-		} else {
-			nb_streams += ret;
 		}
 	}
+
+	/*
+	 * The streams of the closed sessions have already been closed
+	 * during the reading, so we only need to get rid of them in our
+	 * internal table of sessions.
+	 */
+	for (i = ctx->session_ids->len; i-- > 0;) {
+		if (!hup[i])
+			continue;
+		printf_verbose("Session %" PRIu64 " closed\n",
+				g_array_index(ctx->session_ids, uint64_t, i));
+		g_array_remove_index(ctx->session_ids, i);
+	}
 	ret = nb_streams;
 
 end:
+	g_free(hup);
+	return ret;
+}
+
+/*
+ * Parse the metadata received for a trace already added to the context,
+ * and release its buffer.
+ */
+static
+int parse_new_metadata(struct lttng_live_ctf_trace *trace)
+{
+	struct lttng_live_viewer_stream *metadata = trace->metadata_stream;
+	size_t len;
+	FILE *fp;
+	int ret;
+
+	/* Nothing new, or only metadata parsed before a reconnection. */
+	if (!metadata->metadata || !metadata->metadata->len) {
+		ret = 0;
+		goto end;
+	}
+	len = metadata->metadata->len;
+	fp = open_metadata(metadata);
+	if (!fp) {
+		ret = -1;
+		goto end;
+	}
+	/* The reader closes the file. */
+	ret = ctf_append_trace_metadata(trace->handle->td, fp);
+	/* We accept empty metadata packets */
+	if (ret != 0 && ret != -ENOENT) {
+		fprintf(stderr, "[error] Appending metadata\n");
+		goto end;
+	}
+	trace->metadata_size += len;
+	ret = 0;
+end:
+	release_metadata(metadata);
 	return ret;
 }
 
@@ -599,37 +1164,208 @@ int append_metadata(struct lttng_live_ctx *ctx,
 {
 	int ret;
 	struct lttng_live_viewer_stream *metadata;
-	char *metadata_buf = NULL;
+	GPtrArray *streams;
 
 	printf_verbose("get_next_index: new metadata needed\n");
-	ret = get_new_metadata(ctx, viewer_stream, &metadata_buf);
-	if (ret < 0) {
-		free(metadata_buf);
-		goto error;
-	}
-
 	metadata = viewer_stream->ctf_trace->metadata_stream;
-	metadata->ctf_trace->metadata_fp =
-		babeltrace_fmemopen(metadata_buf,
-				metadata->metadata_len, "rb");
-	if (!metadata->ctf_trace->metadata_fp) {
-		perror("Metadata fmemopen");
-		free(metadata_buf);
+	if (!metadata) {
+		fprintf(stderr, "[error] No metadata stream\n");
 		ret = -1;
 		goto error;
 	}
-	ret = ctf_append_trace_metadata(
-			viewer_stream->ctf_trace->handle->td,
-			metadata->ctf_trace->metadata_fp);
-	/* We accept empty metadata packets */
-	if (ret != 0 && ret != -ENOENT) {
-		fprintf(stderr, "[error] Appending metadata\n");
+	streams = g_ptr_array_new();
+	g_ptr_array_add(streams, metadata);
+	ret = get_new_metadata(ctx, streams);
+	g_ptr_array_free(streams, TRUE);
+	if (ret < 0) {
+		release_metadata(metadata);
 		goto error;
 	}
-	ret = 0;
+	ret = parse_new_metadata(viewer_stream->ctf_trace);
+error:
+	return ret;
+}
+
+/*
+ * Print the usage of the packet buffer pool and, for each trace, the
+ * metadata received and the packets each stream holds or has dropped.
+ */
+void lttng_live_print_stats(struct lttng_live_ctx *ctx, FILE *fp)
+{
+	GHashTableIter it;
+	gpointer value;
+
+	fprintf(fp, "[stats] Packet buffers: %" PRIu64 " of %" PRIu64
+			" bytes mapped\n",
+			lttng_live_pool_allocated(&ctx->pool), ctx->pool.cap);
+	if (ctx->reconnect_timeout)
+		fprintf(fp, "[stats] Reconnections: %" PRIu64 "\n",
+				ctx->reconnects);
+	fprintf(fp, "[stats] Events discarded or dropped: %" PRIu64 "\n",
+			ctx->lost_events);
+	if (!ctx->session->ctf_traces)
+		return;
+	g_hash_table_iter_init(&it, ctx->session->ctf_traces);
+	while (g_hash_table_iter_next(&it, NULL, &value)) {
+		struct lttng_live_ctf_trace *trace = value;
+		int i;
+
+		fprintf(fp, "[stats] Trace %" PRIu64 ": %" PRIu64
+				" bytes of metadata\n",
+				trace->ctf_trace_id, trace->metadata_size);
+		for (i = 0; i < trace->streams->len; i++) {
+			struct lttng_live_viewer_stream *stream;
+			struct lttng_live_stream_stats stats;
+
+			stream = g_ptr_array_index(trace->streams, i);
+			if (stream->metadata_flag)
+				continue;
+			lttng_live_get_stream_stats(stream, &stats);
+			fprintf(fp, "[stats]   Stream %" PRIu64 ": %" PRIu64
+					" packets (%" PRIu64 " bytes) not read yet, %"
+					PRIu64 " dropped\n",
+					stream->id, stats.lag,
+					stats.buffered_bytes, stats.dropped);
+		}
+	}
+}
+
+/*
+ * Print the statistics on stderr if the "stats" period has elapsed.
+ */
+static
+void print_stats_periodically(struct lttng_live_ctx *ctx)
+{
+	int64_t now;
+
+	if (!ctx->stats_period)
+		return;
+	now = lttng_live_now_us();
+	if (now < ctx->next_stats)
+		return;
+	lttng_live_print_stats(ctx, stderr);
+	ctx->next_stats = now + ctx->stats_period * 1000000LL;
+}
+
+/*
+ * Write out the events delivered to the output so far, when the reader
+ * is about to wait for the relay daemon.
+ */
+static
+int flush_output(struct lttng_live_ctx *ctx)
+{
+	struct bt_stream_pos *output = ctx->output;
+
+	print_stats_periodically(ctx);
+	if (output->flush_cb) {
+		return output->flush_cb(output);
+	}
+	if (fflush(LTTNG_LIVE_OUTPUT_FP) < 0) {
+		perror("fflush");
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Fetch the new metadata and streams the relay daemon asks for before
+ * it serves a packet. Returns 1 if the packet request can be retried,
+ * 0 if no flag was set, a negative value on error.
+ */
+static
+int handle_packet_flags(struct lttng_live_ctx *ctx,
+		struct lttng_live_viewer_stream *stream, uint32_t flags)
+{
+	int ret;
+
+	if (flags & LTTNG_VIEWER_FLAG_NEW_METADATA) {
+		printf_verbose("get_data_packet: new metadata needed\n");
+		ret = append_metadata(ctx, stream);
+		if (ret)
+			return -1;
+	}
+	if (flags & LTTNG_VIEWER_FLAG_NEW_STREAM) {
+		printf_verbose("get_data_packet: new streams needed\n");
+		ret = ask_new_streams(ctx);
+		if (ret < 0) {
+			return -1;
+		} else if (ret > 0) {
+			ret = add_traces(ctx);
+			if (ret < 0) {
+				return -1;
+			}
+		}
+	}
+	return !!(flags & (LTTNG_VIEWER_FLAG_NEW_METADATA
+			| LTTNG_VIEWER_FLAG_NEW_STREAM));
+}
+
+/*
+ * Get the packet of the current index of a stream served by a data
+ * connection, from the responses queued by its I/O thread.
+ *
+ * Returns 0 on success, -2 if the packet is not available yet, -1 on
+ * error.
+ */
+static
+int get_queued_data_packet(struct lttng_live_ctx *ctx,
+		struct ctf_stream_pos *pos,
+		struct lttng_live_viewer_stream *stream)
+{
+	struct lttng_live_packet *packet;
+	int ret;
+
+	for (;;) {
+		packet = stream->packet;
+		if (packet && packet->mma) {
+			/* The previous packet has been read. */
+			lttng_live_pool_put(&ctx->pool, pos->base_mma);
+			pos->base_mma = packet->mma;
+			packet->mma = NULL;
+			lttng_live_packet_free(ctx, packet);
+			stream->packet = NULL;
+			return 0;
+		}
+		if (!lttng_live_stream_ready(stream) && flush_output(ctx) < 0) {
+			goto error;
+		}
+		packet = lttng_live_pop_packet(stream);
+		if (!packet) {
+			goto error;
+		}
+		if (packet->is_index) {
+			fprintf(stderr, "[error] get_data_packet: unexpected index\n");
+			lttng_live_packet_free(ctx, packet);
+			goto error;
+		}
+		switch (packet->status) {
+		case LTTNG_VIEWER_GET_PACKET_OK:
+			lttng_live_packet_free(ctx, stream->packet);
+			stream->packet = packet;
+			break;
+		case LTTNG_VIEWER_GET_PACKET_ERR:
+			ret = handle_packet_flags(ctx, stream, packet->flags);
+			lttng_live_packet_free(ctx, packet);
+			if (ret <= 0) {
+				if (!ret)
+					fprintf(stderr, "[error] get_data_packet: error\n");
+				goto error;
+			}
+			lttng_live_resume_stream(stream);
+			break;
+		case LTTNG_VIEWER_GET_PACKET_EOF:
+			lttng_live_packet_free(ctx, packet);
+			lttng_live_resume_stream(stream);
+			return -2;
+		default:
+			printf_verbose("get_data_packet: unknown\n");
+			lttng_live_packet_free(ctx, packet);
+			goto error;
+		}
+	}
 
 error:
-	return ret;
+	return -1;
 }
 
 static
@@ -638,90 +1374,61 @@ int get_data_packet(struct lttng_live_ctx *ctx,
 		struct lttng_live_viewer_stream *stream, uint64_t offset,
 		uint64_t len)
 {
-	struct lttng_viewer_cmd cmd;
-	struct lttng_viewer_get_packet rq;
-	struct lttng_viewer_trace_packet rp;
-	ssize_t ret_len;
+	struct lttng_viewer_trace_packet *rp;
+	struct mmap_align *mma;
 	int ret;
 
+	if (stream->conn) {
+		return get_queued_data_packet(ctx, pos, stream);
+	}
+
 retry:
 	if (lttng_live_should_quit()) {
 		ret = -1;
 		goto end;
 	}
 
-	cmd.cmd = htobe32(LTTNG_VIEWER_GET_PACKET);
-	cmd.data_size = htobe64((uint64_t) sizeof(rq));
-	cmd.cmd_version = htobe32(0);
-
-	memset(&rq, 0, sizeof(rq));
-	rq.stream_id = htobe64(stream->id);
-	rq.offset = htobe64(offset);
-	rq.len = htobe32(len);
-
-	ret_len = lttng_live_send(ctx->control_sock, &cmd, sizeof(cmd));
-	if (ret_len < 0) {
-		perror("[error] Error sending cmd");
-		goto error;
-	}
-	assert(ret_len == sizeof(cmd));
-
-	ret_len = lttng_live_send(ctx->control_sock, &rq, sizeof(rq));
-	if (ret_len < 0) {
-		perror("[error] Error sending get_data_packet request");
-		goto error;
-	}
-	assert(ret_len == sizeof(rq));
-
-	ret_len = lttng_live_recv(ctx->control_sock, &rp, sizeof(rp));
-	if (ret_len == 0) {
-		fprintf(stderr, "[error] Remote side has closed connection\n");
-		goto error;
+	/* A packet asked for ahead may belong to an index skipped since. */
+	while (stream->packet_state == LTTNG_LIVE_REQUEST_SENT) {
+		ret = recv_next_response(ctx);
+		if (ret)
+			goto error;
 	}
-	if (ret_len < 0) {
-		perror("[error] Error receiving data response");
-		goto error;
+	if (stream->packet_state == LTTNG_LIVE_REQUEST_RECEIVED
+			&& stream->next_packet_offset != offset)
+		drop_next_packet(ctx, stream);
+	if (stream->packet_state == LTTNG_LIVE_REQUEST_NONE) {
+		ret = send_packet_request(ctx, stream, offset, len);
+		if (ret)
+			goto error;
+		ret = prefetch_requests(ctx);
+		if (ret)
+			goto error;
 	}
-	if (ret_len != sizeof(rp)) {
-		fprintf(stderr, "[error] get_data_packet: expected %zu"
-				", received %zd\n", sizeof(rp),
-				ret_len);
-		goto error;
+	while (stream->packet_state != LTTNG_LIVE_REQUEST_RECEIVED) {
+		ret = recv_next_response(ctx);
+		if (ret)
+			goto error;
 	}
+	rp = &stream->next_packet;
+	mma = stream->next_packet_mma;
+	stream->next_packet_mma = NULL;
+	stream->packet_state = LTTNG_LIVE_REQUEST_NONE;
 
-	rp.flags = be32toh(rp.flags);
-
-	switch (be32toh(rp.status)) {
+	switch (rp->status) {
 	case LTTNG_VIEWER_GET_PACKET_OK:
-		len = be32toh(rp.len);
-		printf_verbose("get_data_packet: Ok, packet size : %" PRIu64
-				"\n", len);
+		printf_verbose("get_data_packet: Ok, packet size : %" PRIu32
+				"\n", rp->len);
 		break;
 	case LTTNG_VIEWER_GET_PACKET_RETRY:
 		/* Unimplemented by relay daemon */
 		printf_verbose("get_data_packet: retry\n");
 		goto error;
 	case LTTNG_VIEWER_GET_PACKET_ERR:
-		if (rp.flags & LTTNG_VIEWER_FLAG_NEW_METADATA) {
-			printf_verbose("get_data_packet: new metadata needed\n");
-			ret = append_metadata(ctx, stream);
-			if (ret)
-				goto error;
-		}
-		if (rp.flags & LTTNG_VIEWER_FLAG_NEW_STREAM) {
-			printf_verbose("get_data_packet: new streams needed\n");
-			ret = ask_new_streams(ctx);
-			if (ret < 0) {
-				goto error;
-			} else if (ret > 0) {
-				ret = add_traces(ctx);
-				if (ret < 0) {
-					goto error;
-				}
-			}
-		}
-		if (rp.flags & (LTTNG_VIEWER_FLAG_NEW_METADATA
-				| LTTNG_VIEWER_FLAG_NEW_STREAM)) {
+		ret = handle_packet_flags(ctx, stream, rp->flags);
+		if (ret < 0) {
+			goto error;
+		} else if (ret > 0) {
 			goto retry;
 		}
 		fprintf(stderr, "[error] get_data_packet: error\n");
@@ -734,48 +1441,15 @@ retry:
 		goto error;
 	}
 
-	if (len == 0) {
+	if (!mma) {
 		goto error;
 	}
 
-	if (len > stream->mmap_size) {
-		uint64_t new_size;
-
-		new_size = max_t(uint64_t, len, stream->mmap_size << 1);
-		if (pos->base_mma) {
-			/* unmap old base */
-			ret = munmap_align(pos->base_mma);
-			if (ret) {
-				perror("[error] Unable to unmap old base");
-				goto error;
-			}
-			pos->base_mma = NULL;
-		}
-		pos->base_mma = mmap_align(new_size,
-				PROT_READ | PROT_WRITE,
-				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-		if (pos->base_mma == MAP_FAILED) {
-			perror("[error] mmap error");
-			pos->base_mma = NULL;
-			goto error;
-		}
-
-		stream->mmap_size = new_size;
-		printf_verbose("Expanding stream mmap size to %" PRIu64 " bytes\n",
-				stream->mmap_size);
-	}
-
-	ret_len = lttng_live_recv(ctx->control_sock,
-			mmap_align_addr(pos->base_mma), len);
-	if (ret_len == 0) {
-		fprintf(stderr, "[error] Remote side has closed connection\n");
-		goto error;
-	}
-	if (ret_len < 0) {
-		perror("[error] Error receiving trace packet");
-		goto error;
-	}
-	assert(ret_len == len);
+	/* The previous packet has been read. */
+	lttng_live_pool_put(&ctx->pool, pos->base_mma);
+	pos->base_mma = mma;
+	stream->packets_received++;
+	stream->packets_consumed++;
 	ret = 0;
 end:
 	return ret;
@@ -785,40 +1459,47 @@ error:
 }
 
 static
-int get_one_metadata_packet(struct lttng_live_ctx *ctx,
+int send_metadata_request(struct lttng_live_ctx *ctx,
 		struct lttng_live_viewer_stream *metadata_stream)
 {
-	uint64_t len = 0;
-	int ret;
-	struct lttng_viewer_cmd cmd;
-	struct lttng_viewer_get_metadata rq;
-	struct lttng_viewer_metadata_packet rp;
-	char *data = NULL;
+	struct {
+		struct lttng_viewer_cmd cmd;
+		struct lttng_viewer_get_metadata rq;
+	} __attribute__((__packed__)) msg;
 	ssize_t ret_len;
 
-	if (lttng_live_should_quit()) {
-		ret = -1;
-		goto end;
-	}
-
-	rq.stream_id = htobe64(metadata_stream->id);
-	cmd.cmd = htobe32(LTTNG_VIEWER_GET_METADATA);
-	cmd.data_size = htobe64((uint64_t) sizeof(rq));
-	cmd.cmd_version = htobe32(0);
+	msg.cmd.cmd = htobe32(LTTNG_VIEWER_GET_METADATA);
+	msg.cmd.data_size = htobe64((uint64_t) sizeof(msg.rq));
+	msg.cmd.cmd_version = htobe32(0);
 
-	ret_len = lttng_live_send(ctx->control_sock, &cmd, sizeof(cmd));
-	if (ret_len < 0) {
-		perror("[error] Error sending cmd");
-		goto error;
-	}
-	assert(ret_len == sizeof(cmd));
+	memset(&msg.rq, 0, sizeof(msg.rq));
+	msg.rq.stream_id = htobe64(metadata_stream->id);
 
-	ret_len = lttng_live_send(ctx->control_sock, &rq, sizeof(rq));
+	ret_len = lttng_live_send(ctx->control_sock, &msg, sizeof(msg));
 	if (ret_len < 0) {
 		perror("[error] Error sending get_metadata request");
-		goto error;
+		return -1;
 	}
-	assert(ret_len == sizeof(rq));
+	assert(ret_len == sizeof(msg));
+	return 0;
+}
+
+/*
+ * Receive a metadata response, and append the metadata to the buffer of
+ * the stream, except the part parsed before a reconnection.
+ *
+ * Returns the number of bytes received, 0 when the relay daemon has no
+ * new metadata, a negative value on error.
+ */
+static
+int recv_metadata_response(struct lttng_live_ctx *ctx,
+		struct lttng_live_viewer_stream *metadata_stream)
+{
+	struct lttng_viewer_metadata_packet rp;
+	GString *metadata = metadata_stream->metadata;
+	size_t prev_len = metadata->len;
+	ssize_t ret_len;
+	uint64_t len, skip;
 
 	ret_len = lttng_live_recv(ctx->control_sock, &rp, sizeof(rp));
 	if (ret_len == 0) {
@@ -837,8 +1518,7 @@ int get_one_metadata_packet(struct lttng_live_ctx *ctx,
 			break;
 		case LTTNG_VIEWER_NO_NEW_METADATA:
 			printf_verbose("get_metadata : NO NEW\n");
-			ret = 0;
-			goto end;
+			return 0;
 		case LTTNG_VIEWER_METADATA_ERR:
 			printf_verbose("get_metadata : ERR\n");
 			goto error;
@@ -849,105 +1529,146 @@ int get_one_metadata_packet(struct lttng_live_ctx *ctx,
 
 	len = be64toh(rp.len);
 	printf_verbose("Writing %" PRIu64" bytes to metadata\n", len);
-	if (len <= 0) {
+	if (len <= 0 || len > INT_MAX) {
 		goto error;
 	}
 
-	data = zmalloc(len);
-	if (!data) {
-		perror("relay data zmalloc");
-		goto error;
-	}
-	ret_len = lttng_live_recv(ctx->control_sock, data, len);
+	/* Received right after the metadata already buffered. */
+	g_string_set_size(metadata, prev_len + len);
+	ret_len = lttng_live_recv(ctx->control_sock,
+			metadata->str + prev_len, len);
 	if (ret_len == 0) {
 		fprintf(stderr, "[error] Remote side has closed connection\n");
-		goto error_free_data;
+		goto error;
 	}
 	if (ret_len < 0) {
 		perror("[error] Error receiving trace packet");
-		goto error_free_data;
+		goto error;
 	}
 	assert(ret_len == len);
-
-	do {
-		ret_len = fwrite(data, 1, len,
-				metadata_stream->metadata_fp_write);
-	} while (ret_len < 0 && errno == EINTR);
-	if (ret_len < 0) {
-		fprintf(stderr, "[error] Writing in the metadata fp\n");
-		goto error_free_data;
+	skip = MIN(metadata_stream->metadata_skip, len);
+	if (skip) {
+		g_string_erase(metadata, prev_len, skip);
+		metadata_stream->metadata_skip -= skip;
 	}
-	assert(ret_len == len);
-	metadata_stream->metadata_len += len;
-	free(data);
-	ret = len;
-end:
-	return ret;
+	return len;
 
-error_free_data:
-	free(data);
 error:
+	g_string_truncate(metadata, prev_len);
 	return -1;
 }
 
 /*
+ * Get all the metadata available for a set of metadata streams, into
+ * their buffer. The requests for all the streams are pipelined,
+ * LTTNG_LIVE_PIPELINE_DEPTH at a time, and a stream is asked again
+ * until the relay daemon has no new metadata for it, once some has
+ * been received.
+ *
  * Return 0 on success, a negative value on error.
  */
 static
-int get_new_metadata(struct lttng_live_ctx *ctx,
-		struct lttng_live_viewer_stream *viewer_stream,
-		char **metadata_buf)
+int get_new_metadata(struct lttng_live_ctx *ctx, GPtrArray *streams)
 {
-	int ret = 0;
-	struct lttng_live_viewer_stream *metadata_stream;
-	size_t size, len_read = 0;
+	GPtrArray *todo, *next;
+	unsigned int i, j, nr;
+	int ret, delay = 0, received;
 
-	metadata_stream = viewer_stream->ctf_trace->metadata_stream;
-	if (!metadata_stream) {
-		fprintf(stderr, "[error] No metadata stream\n");
-		ret = -1;
-		goto error;
-	}
-	metadata_stream->metadata_len = 0;
-	ret = open_metadata_fp_write(metadata_stream, metadata_buf, &size);
-	if (ret < 0) {
-		goto error;
+	ret = flush_requests(ctx);
+	if (ret)
+		return ret;
+
+	todo = g_ptr_array_new();
+	for (i = 0; i < streams->len; i++) {
+		struct lttng_live_viewer_stream *stream;
+
+		stream = g_ptr_array_index(streams, i);
+		if (!stream->metadata)
+			stream->metadata = g_string_new(NULL);
+		g_ptr_array_add(todo, stream);
 	}
 
-	do {
+	while (todo->len) {
 		if (lttng_live_should_quit()) {
 			ret = -1;
-			goto error;
+			goto end;
 		}
-		/*
-		 * get_one_metadata_packet returns the number of bytes
-		 * received, 0 when we have received everything, a
-		 * negative value on error.
-		 */
-		ret = get_one_metadata_packet(ctx, metadata_stream);
-		if (ret > 0) {
-			len_read += ret;
+		next = g_ptr_array_new();
+		received = 0;
+		for (i = 0; i < todo->len; i += nr) {
+			nr = MIN(todo->len - i, LTTNG_LIVE_PIPELINE_DEPTH);
+			for (j = 0; j < nr; j++) {
+				ret = send_metadata_request(ctx,
+						g_ptr_array_index(todo, i + j));
+				if (ret < 0)
+					break;
+			}
+			for (j = 0; !ret && j < nr; j++) {
+				struct lttng_live_viewer_stream *stream;
+
+				stream = g_ptr_array_index(todo, i + j);
+				ret = recv_metadata_response(ctx, stream);
+				if (ret < 0)
+					break;
+				if (ret > 0)
+					received = 1;
+				/* Wait for the metadata of a new trace. */
+				if (ret > 0 || (!stream->metadata->len
+						&& !stream->ctf_trace->metadata_size))
+					g_ptr_array_add(next, stream);
+				ret = 0;
+			}
+			if (ret < 0) {
+				g_ptr_array_free(next, TRUE);
+				goto end;
+			}
 		}
-		if (!len_read) {
-			(void) poll(NULL, 0, ACTIVE_POLL_DELAY);
+		g_ptr_array_free(todo, TRUE);
+		todo = next;
+		if (todo->len && !received) {
+			lttng_live_backoff(ctx, &delay);
 		}
-	} while (ret > 0 || !len_read);
-
-	if (babeltrace_close_memstream(metadata_buf, &size,
-			metadata_stream->metadata_fp_write)) {
-		perror("babeltrace_close_memstream");
 	}
-	metadata_stream->metadata_fp_write = NULL;
+	ret = 0;
 
-error:
+end:
+	g_ptr_array_free(todo, TRUE);
 	return ret;
 }
 
+/*
+ * Open the metadata received for a stream for the CTF parser, which
+ * closes the file. The buffer is then released with
+ * release_metadata().
+ */
+static
+FILE *open_metadata(struct lttng_live_viewer_stream *metadata_stream)
+{
+	FILE *fp;
+
+	fp = babeltrace_fmemopen(metadata_stream->metadata->str,
+			metadata_stream->metadata->len, "rb");
+	if (!fp) {
+		perror("Metadata fmemopen");
+	}
+	return fp;
+}
+
+static
+void release_metadata(struct lttng_live_viewer_stream *metadata_stream)
+{
+	if (metadata_stream->metadata) {
+		g_string_free(metadata_stream->metadata, TRUE);
+		metadata_stream->metadata = NULL;
+	}
+}
+
 /*
  * Assign the fields from a lttng_viewer_index to a packet_index.
  */
 static
-void lttng_index_to_packet_index(struct lttng_viewer_index *lindex,
+void lttng_index_to_packet_index(struct lttng_live_viewer_stream *stream,
+		struct lttng_viewer_index *lindex,
 		struct packet_index *pindex)
 {
 	assert(lindex);
@@ -958,12 +1679,57 @@ void lttng_index_to_packet_index(struct lttng_viewer_index *lindex,
 	pindex->content_size = be64toh(lindex->content_size);
 	pindex->ts_cycles.timestamp_begin = be64toh(lindex->timestamp_begin);
 	pindex->ts_cycles.timestamp_end = be64toh(lindex->timestamp_end);
-	pindex->events_discarded = be64toh(lindex->events_discarded);
+	/*
+	 * Packets dropped by backpressure account for at least one
+	 * discarded event each, so that the loss is reported.
+	 */
+	pindex->events_discarded = be64toh(lindex->events_discarded)
+			+ stream->events_discarded_offset;
+}
+
+/*
+ * Get the next index response queued for a stream by its I/O thread.
+ * The response is kept in viewer_stream->packet, along with the packet
+ * data if the I/O thread has already received it.
+ */
+static
+int get_queued_index(struct lttng_live_ctx *ctx,
+		struct lttng_live_viewer_stream *viewer_stream)
+{
+	struct lttng_live_packet *packet;
+
+	if (!lttng_live_stream_ready(viewer_stream) && flush_output(ctx) < 0) {
+		return -1;
+	}
+	packet = lttng_live_pop_packet(viewer_stream);
+	if (!packet) {
+		return -1;
+	}
+	if (!packet->is_index) {
+		fprintf(stderr, "[error] get_next_index: unexpected packet\n");
+		lttng_live_packet_free(ctx, packet);
+		return -1;
+	}
+	if (packet->dropped) {
+		printf_verbose("get_next_index: %" PRIu64 " packets dropped "
+				"on stream %" PRIu64 "\n",
+				packet->dropped, viewer_stream->id);
+		viewer_stream->events_discarded_offset += packet->dropped;
+	}
+	lttng_live_packet_free(ctx, viewer_stream->packet);
+	viewer_stream->packet = packet;
+	viewer_stream->current_index = packet->index;
+	return 0;
 }
 
 /*
  * Get one index for a stream.
  *
+ * The index may already have been requested, or even received, by
+ * prefetch_requests(). Otherwise the request is sent along with
+ * prefetch requests for the other streams, and responses are received
+ * in order until ours arrives.
+ *
  * Returns 0 on success or a negative value on error.
  */
 static
@@ -971,48 +1737,51 @@ int get_next_index(struct lttng_live_ctx *ctx,
 		struct lttng_live_viewer_stream *viewer_stream,
 		struct packet_index *index, uint64_t *stream_id)
 {
-	struct lttng_viewer_cmd cmd;
-	struct lttng_viewer_get_next_index rq;
-	int ret;
-	ssize_t ret_len;
+	int ret, prefetched;
 	struct lttng_viewer_index *rp = &viewer_stream->current_index;
 
-	cmd.cmd = htobe32(LTTNG_VIEWER_GET_NEXT_INDEX);
-	cmd.data_size = htobe64((uint64_t) sizeof(rq));
-	cmd.cmd_version = htobe32(0);
-
-	memset(&rq, 0, sizeof(rq));
-	rq.stream_id = htobe64(viewer_stream->id);
-
 retry:
 	if (lttng_live_should_quit()) {
 		ret = -1;
 		goto end;
 	}
-	ret_len = lttng_live_send(ctx->control_sock, &cmd, sizeof(cmd));
-	if (ret_len < 0) {
-		perror("[error] Error sending cmd");
-		goto error;
+	if (viewer_stream->conn) {
+		ret = get_queued_index(ctx, viewer_stream);
+		if (ret)
+			goto error;
+		prefetched = 0;
+		goto received;
 	}
-	assert(ret_len == sizeof(cmd));
-
-	ret_len = lttng_live_send(ctx->control_sock, &rq, sizeof(rq));
-	if (ret_len < 0) {
-		perror("[error] Error sending get_next_index request");
-		goto error;
+	if (viewer_stream->index_state == LTTNG_LIVE_REQUEST_NONE) {
+		ret = send_next_index_request(ctx, viewer_stream);
+		if (ret)
+			goto error;
+		viewer_stream->index_prefetched = 0;
+		ret = prefetch_requests(ctx);
+		if (ret)
+			goto error;
 	}
-	assert(ret_len == sizeof(rq));
-
-	ret_len = lttng_live_recv(ctx->control_sock, rp, sizeof(*rp));
-	if (ret_len == 0) {
-		fprintf(stderr, "[error] Remote side has closed connection\n");
-		goto error;
+	while (viewer_stream->index_state != LTTNG_LIVE_REQUEST_RECEIVED) {
+		ret = recv_next_response(ctx);
+		if (ret)
+			goto error;
 	}
-	if (ret_len < 0) {
-		perror("[error] Error receiving index response");
-		goto error;
+	*rp = viewer_stream->next_index;
+	prefetched = viewer_stream->index_prefetched;
+	viewer_stream->index_state = LTTNG_LIVE_REQUEST_NONE;
+	viewer_stream->index_prefetched = 0;
+	if (lttng_live_skip_index(viewer_stream, rp)) {
+		printf_verbose("get_next_index: already read\n");
+		goto retry;
 	}
-	assert(ret_len == sizeof(*rp));
+	/*
+	 * Packets the relay daemon no longer had once reconnected. The
+	 * I/O threads hand theirs over along with the indexes they queue.
+	 */
+	viewer_stream->events_discarded_offset += viewer_stream->dropped_pending;
+	viewer_stream->dropped_pending = 0;
+
+received:
 
 	rp->flags = be32toh(rp->flags);
 
@@ -1026,37 +1795,40 @@ retry:
 	case LTTNG_VIEWER_INDEX_OK:
 		printf_verbose("get_next_index: Ok, need metadata update : %u\n",
 				rp->flags & LTTNG_VIEWER_FLAG_NEW_METADATA);
-		lttng_index_to_packet_index(rp, index);
+		lttng_index_to_packet_index(viewer_stream, rp, index);
 		*stream_id = be64toh(rp->stream_id);
 		viewer_stream->data_pending = 1;
-
-		if (rp->flags & LTTNG_VIEWER_FLAG_NEW_METADATA) {
-			ret = append_metadata(ctx, viewer_stream);
-			if (ret)
-				goto error;
-		}
-		if (rp->flags & LTTNG_VIEWER_FLAG_NEW_STREAM) {
-			printf_verbose("get_next_index: need new streams\n");
-			ret = ask_new_streams(ctx);
-			if (ret < 0) {
-				goto error;
-			} else if (ret > 0) {
-				ret = add_traces(ctx);
-				if (ret < 0) {
-					goto error;
-				}
-			}
+		viewer_stream->consumed_offset = be64toh(rp->offset);
+		viewer_stream->consumed_size = be64toh(rp->packet_size);
+		viewer_stream->consumed_timestamp_end =
+				be64toh(rp->timestamp_end);
+		viewer_stream->consumed = 1;
+		/* Data is flowing, poll again without delay next time. */
+		viewer_stream->poll_delay = 0;
+
+		ret = handle_packet_flags(ctx, viewer_stream, rp->flags);
+		/* Reconnecting gets the new metadata and streams as well. */
+		if (ret < 0 && lttng_live_reconnect(ctx))
+			goto error;
+		/* The I/O thread waits for the flags to be handled. */
+		if (viewer_stream->conn && !viewer_stream->packet->mma) {
+			lttng_live_resume_stream(viewer_stream);
 		}
 		break;
 	case LTTNG_VIEWER_INDEX_RETRY:
 		printf_verbose("get_next_index: retry\n");
-		(void) poll(NULL, 0, ACTIVE_POLL_DELAY);
+		/* A prefetched answer may be stale, ask again right away. */
+		if (!prefetched)
+			lttng_live_backoff(ctx, &viewer_stream->poll_delay);
 		goto retry;
 	case LTTNG_VIEWER_INDEX_HUP:
 		printf_verbose("get_next_index: stream hung up\n");
+		g_hash_table_insert(ctx->hup_streams,
+				g_strdup(viewer_stream->path), GINT_TO_POINTER(1));
 		viewer_stream->id = -1ULL;
 		index->offset = EOF;
 		ctx->session->stream_count--;
+		ctx->session->streams_hup = 1;
 		break;
 	case LTTNG_VIEWER_INDEX_ERR:
 		fprintf(stderr, "[error] get_next_index: error\n");
@@ -1065,6 +1837,11 @@ retry:
 		fprintf(stderr, "[error] get_next_index: unkwown value\n");
 		goto error;
 	}
+	if (viewer_stream->conn && !viewer_stream->data_pending) {
+		/* No packet follows this index. */
+		lttng_live_packet_free(ctx, viewer_stream->packet);
+		viewer_stream->packet = NULL;
+	}
 	ret = 0;
 end:
 	return ret;
@@ -1166,6 +1943,7 @@ void ctf_live_packet_seek(struct bt_stream_pos *stream_pos, size_t index,
 	pos = ctf_pos(stream_pos);
 	file_stream = container_of(pos, struct ctf_file_stream, pos);
 	viewer_stream = (struct lttng_live_viewer_stream *) pos->priv;
+	viewer_stream->pos = pos;
 	session = viewer_stream->session;
 
 	ret = handle_seek_position(index, whence, viewer_stream, pos,
@@ -1204,10 +1982,17 @@ retry:
 	}
 
 	if (viewer_stream->data_pending) {
-		lttng_index_to_packet_index(&viewer_stream->current_index, cur_index);
+		lttng_index_to_packet_index(viewer_stream,
+				&viewer_stream->current_index, cur_index);
 	} else {
 		printf_verbose("get_next_index for stream %" PRIu64 "\n", viewer_stream->id);
 		ret = get_next_index(session->ctx, viewer_stream, cur_index, &stream_id);
+		/* Unless the failure happened once the index was received. */
+		while (ret < 0 && !viewer_stream->data_pending
+				&& !lttng_live_reconnect(session->ctx)) {
+			ret = get_next_index(session->ctx, viewer_stream,
+					cur_index, &stream_id);
+		}
 		if (ret < 0) {
 			pos->offset = EOF;
 			if (!lttng_live_should_quit()) {
@@ -1287,9 +2072,9 @@ retry:
 	 * ensuring we flush at least at the periodical timer period.
 	 * This ensures the output remains reactive for interactive users and
 	 * that the output is flushed when redirected to a file by the shell.
+	 * Streams served by a data connection flush only before waiting.
 	 */
-	if (fflush(LTTNG_LIVE_OUTPUT_FP) < 0) {
-		perror("fflush");
+	if (!viewer_stream->conn && flush_output(session->ctx) < 0) {
 		goto end;
 	}
 
@@ -1302,6 +2087,11 @@ retry:
 	ret = get_data_packet(session->ctx, pos, viewer_stream,
 			cur_index->offset,
 			cur_index->packet_size / CHAR_BIT);
+	while (ret == -1 && !lttng_live_reconnect(session->ctx)) {
+		ret = get_data_packet(session->ctx, pos, viewer_stream,
+				cur_index->offset,
+				cur_index->packet_size / CHAR_BIT);
+	}
 	if (ret == -2) {
 		goto retry;
 	} else if (ret < 0) {
@@ -1319,7 +2109,8 @@ end:
 	return;
 }
 
-int lttng_live_create_viewer_session(struct lttng_live_ctx *ctx)
+static
+int create_viewer_session(struct lttng_live_ctx *ctx, int sock)
 {
 	struct lttng_viewer_cmd cmd;
 	struct lttng_viewer_create_session_response resp;
@@ -1335,14 +2126,14 @@ int lttng_live_create_viewer_session(struct lttng_live_ctx *ctx)
 	cmd.data_size = htobe64((uint64_t) 0);
 	cmd.cmd_version = htobe32(0);
 
-	ret_len = lttng_live_send(ctx->control_sock, &cmd, sizeof(cmd));
+	ret_len = lttng_live_send(sock, &cmd, sizeof(cmd));
 	if (ret_len < 0) {
 		perror("[error] Error sending cmd");
 		goto error;
 	}
 	assert(ret_len == sizeof(cmd));
 
-	ret_len = lttng_live_recv(ctx->control_sock, &resp, sizeof(resp));
+	ret_len = lttng_live_recv(sock, &resp, sizeof(resp));
 	if (ret_len == 0) {
 		fprintf(stderr, "[error] Remote side has closed connection\n");
 		goto error;
@@ -1357,27 +2148,127 @@ int lttng_live_create_viewer_session(struct lttng_live_ctx *ctx)
 		fprintf(stderr, "[error] Error creating viewer session\n");
 		goto error;
 	}
-	ret = 0;
-end:
-	return ret;
+	ret = 0;
+end:
+	return ret;
+
+error:
+	return -1;
+}
+
+/*
+ * Open an additional connection to the relay daemon, ready for data
+ * commands. Used by the I/O threads.
+ *
+ * Each connection gets its own viewer session, and the relay daemon
+ * only serves the streams of the sessions attached to it, so the
+ * connection is attached to the sessions being read. The relay keeps
+ * the position of a stream across viewer sessions: attaching again
+ * does not move the streams already being read.
+ */
+int lttng_live_open_connection(struct lttng_live_ctx *ctx, int *sock)
+{
+	int ret;
+
+	ret = connect_socket(ctx, sock);
+	if (ret < 0) {
+		goto end;
+	}
+	ret = establish_connection(ctx, *sock);
+	if (ret < 0) {
+		goto error_close;
+	}
+	ret = create_viewer_session(ctx, *sock);
+	if (ret < 0) {
+		goto error_close;
+	}
+	ret = attach_sessions(ctx, *sock, LTTNG_VIEWER_SEEK_LAST);
+	if (ret < 0) {
+		goto error_close;
+	}
+end:
+	return ret;
+
+error_close:
+	close(*sock);
+	return ret;
+}
+
+static
+int del_traces(gpointer key, gpointer value, gpointer user_data)
+{
+	struct lttng_live_ctx *ctx = user_data;
+	struct lttng_live_ctf_trace *trace = value;
+	int i, ret;
+
+	/* Give the packet buffers back before the streams are closed. */
+	for (i = 0; i < trace->streams->len; i++) {
+		struct lttng_live_viewer_stream *stream;
+
+		stream = g_ptr_array_index(trace->streams, i);
+		release_metadata(stream);
+		/* No response may be received for a stream gone. */
+		if ((stream->index_state == LTTNG_LIVE_REQUEST_SENT
+				|| stream->packet_state
+					== LTTNG_LIVE_REQUEST_SENT)
+				&& flush_requests(ctx))
+			g_queue_clear(ctx->requests);
+		drop_next_packet(ctx, stream);
+		if (stream->pos) {
+			lttng_live_pool_put(&ctx->pool, stream->pos->base_mma);
+			stream->pos->base_mma = NULL;
+			stream->pos = NULL;
+		}
+	}
+
+	if (trace->in_use && ctx->output->post_trace_cb) {
+		ret = ctx->output->post_trace_cb(ctx->output,
+				trace->handle->td);
+		if (ret)
+			fprintf(stderr, "[error] Writing to trace post handler failed.\n");
+	}
 
-error:
-	return -1;
+	ret = bt_context_remove_trace(ctx->bt_ctx, trace->trace_id);
+	if (ret < 0)
+		fprintf(stderr, "[error] removing trace from context\n");
+
+	/* remove the key/value pair from the HT. */
+	return 1;
 }
 
+/*
+ * Remove a trace once all its data streams have hung up. They are out
+ * of the iterator heap by then, so the other traces keep being read by
+ * the same iterator.
+ */
 static
-int del_traces(gpointer key, gpointer value, gpointer user_data)
+int del_hup_traces(gpointer key, gpointer value, gpointer user_data)
 {
-	struct bt_context *bt_ctx = user_data;
+	struct lttng_live_ctx *ctx = user_data;
 	struct lttng_live_ctf_trace *trace = value;
-	int ret;
+	struct lttng_live_viewer_stream *stream;
+	int i, nr_data_streams = 0;
 
-	ret = bt_context_remove_trace(bt_ctx, trace->trace_id);
-	if (ret < 0)
-		fprintf(stderr, "[error] removing trace from context\n");
+	if (!trace->in_use)
+		return 0;
+	for (i = 0; i < trace->streams->len; i++) {
+		stream = g_ptr_array_index(trace->streams, i);
+		if (stream->metadata_flag)
+			continue;
+		if (stream->id != -1ULL)
+			return 0;
+		nr_data_streams++;
+	}
+	if (!nr_data_streams)
+		return 0;
 
-	/* remove the key/value pair from the HT. */
-	return 1;
+	printf_verbose("Removing hung up trace %" PRIu64 "\n",
+			trace->ctf_trace_id);
+	for (i = 0; i < trace->streams->len; i++) {
+		stream = g_ptr_array_index(trace->streams, i);
+		lttng_live_conn_remove_stream(ctx, stream);
+	}
+	return del_traces(key, value, user_data);
 }
 
 static
@@ -1412,32 +2303,28 @@ int add_one_trace(struct lttng_live_ctx *ctx,
 		stream = g_ptr_array_index(trace->streams, i);
 
 		if (!stream->metadata_flag) {
+			/*
+			 * The first index is read when the trace is added
+			 * to the context, the stream must be served by then.
+			 */
+			if (ctx->nr_conns) {
+				lttng_live_conn_add_stream(ctx, stream);
+			}
 			new_mmap_stream = zmalloc(sizeof(struct bt_mmap_stream));
 			new_mmap_stream->priv = (void *) stream;
 			new_mmap_stream->fd = -1;
 			bt_list_add(&new_mmap_stream->list, &mmap_list.head);
 		} else {
-			char *metadata_buf = NULL;
-
-			/* Get all possible metadata before starting */
-			ret = get_new_metadata(ctx, stream, &metadata_buf);
-			if (ret) {
-				free(metadata_buf);
-				goto end_free;
-			}
-			if (!stream->metadata_len) {
+			/* The metadata has been received by add_traces(). */
+			if (!stream->metadata || !stream->metadata->len) {
 				fprintf(stderr, "[error] empty metadata\n");
 				ret = -1;
-				free(metadata_buf);
 				goto end_free;
 			}
 
-			trace->metadata_fp = babeltrace_fmemopen(metadata_buf,
-					stream->metadata_len, "rb");
+			trace->metadata_fp = open_metadata(stream);
 			if (!trace->metadata_fp) {
-				perror("Metadata fmemopen");
 				ret = -1;
-				free(metadata_buf);
 				goto end_free;
 			}
 		}
@@ -1449,14 +2336,21 @@ int add_one_trace(struct lttng_live_ctx *ctx,
 		goto end_free;
 	}
 
+	/*
+	 * Counted as parsed already, in case the connection is lost while
+	 * the first indexes are read.
+	 */
+	trace->metadata_size += trace->metadata_stream->metadata->len;
 	ret = bt_context_add_trace(bt_ctx, NULL, "ctf",
 			ctf_live_packet_seek, &mmap_list, trace->metadata_fp);
+	/* The reader is done with the metadata and has closed the file. */
+	trace->metadata_fp = NULL;
+	release_metadata(trace->metadata_stream);
 	if (ret < 0) {
 		fprintf(stderr, "[error] Error adding trace\n");
 		ret = -1;
 		goto end_free;
 	}
-	trace->metadata_stream->metadata_len = 0;
 
 	handle = (struct bt_trace_handle *) g_hash_table_lookup(
 			bt_ctx->trace_handles,
@@ -1470,6 +2364,16 @@ int add_one_trace(struct lttng_live_ctx *ctx,
 	trace->trace_id = ret;
 	trace->in_use = 1;
 
+	if (ctx->output->pre_trace_cb) {
+		ret = ctx->output->pre_trace_cb(ctx->output, td);
+		if (ret) {
+			fprintf(stderr, "[error] Writing to trace pre handler failed.\n");
+			ret = -1;
+			goto end;
+		}
+		ret = trace->trace_id;
+	}
+
 	goto end;
 
 end_free:
@@ -1486,6 +2390,22 @@ int add_traces(struct lttng_live_ctx *ctx)
 	GHashTableIter it;
 	gpointer key;
 	gpointer value;
+	GPtrArray *metadata_streams;
+
+	/* Get the metadata of all the new traces at once. */
+	metadata_streams = g_ptr_array_new();
+	g_hash_table_iter_init(&it, ctx->session->ctf_traces);
+	while (g_hash_table_iter_next(&it, &key, &value)) {
+		trace = (struct lttng_live_ctf_trace *) value;
+		if (!trace->in_use && trace->metadata_stream)
+			g_ptr_array_add(metadata_streams,
+					trace->metadata_stream);
+	}
+	ret = get_new_metadata(ctx, metadata_streams);
+	g_ptr_array_free(metadata_streams, TRUE);
+	if (ret < 0) {
+		goto end;
+	}
 
 	g_hash_table_iter_init(&it, ctx->session->ctf_traces);
 	while (g_hash_table_iter_next(&it, &key, &value)) {
@@ -1503,142 +2423,298 @@ end:
 }
 
 /*
- * Request new streams for a session.
- * Returns the number of streams received or a negative value on error.
+ * Close the connections to the relay daemon, and forget the requests in
+ * flight and the metadata not parsed yet, which are sent again once
+ * reconnected. The streams detached from the data connections are
+ * appended to detached.
  */
-int lttng_live_get_new_streams(struct lttng_live_ctx *ctx, uint64_t id)
+static
+void close_connections(struct lttng_live_ctx *ctx, GPtrArray *detached)
 {
-	struct lttng_viewer_cmd cmd;
-	struct lttng_viewer_new_streams_request rq;
-	struct lttng_viewer_new_streams_response rp;
-	struct lttng_viewer_stream stream;
-	int ret, i, nb_streams = 0;
-	ssize_t ret_len;
-	uint32_t stream_count;
+	GHashTableIter it;
+	gpointer value;
+	int i;
 
-	if (lttng_live_should_quit()) {
-		ret = -1;
-		goto end;
+	lttng_live_detach_connections(ctx, detached);
+	lttng_live_stop_connections(ctx);
+	if (ctx->control_sock >= 0) {
+		close(ctx->control_sock);
+		ctx->control_sock = -1;
 	}
+	g_queue_clear(ctx->requests);
+	g_hash_table_iter_init(&it, ctx->session->ctf_traces);
+	while (g_hash_table_iter_next(&it, NULL, &value)) {
+		struct lttng_live_ctf_trace *trace = value;
 
-	cmd.cmd = htobe32(LTTNG_VIEWER_GET_NEW_STREAMS);
-	cmd.data_size = htobe64((uint64_t) sizeof(rq));
-	cmd.cmd_version = htobe32(0);
-
-	memset(&rq, 0, sizeof(rq));
-	rq.session_id = htobe64(id);
+		for (i = 0; i < trace->streams->len; i++) {
+			struct lttng_live_viewer_stream *stream;
 
-	ret_len = lttng_live_send(ctx->control_sock, &cmd, sizeof(cmd));
-	if (ret_len < 0) {
-		perror("[error] Error sending cmd");
-		goto error;
+			stream = g_ptr_array_index(trace->streams, i);
+			stream->index_state = LTTNG_LIVE_REQUEST_NONE;
+			stream->index_prefetched = 0;
+			drop_next_packet(ctx, stream);
+			release_metadata(stream);
+		}
 	}
-	assert(ret_len == sizeof(cmd));
+}
 
-	ret_len = lttng_live_send(ctx->control_sock, &rq, sizeof(rq));
-	if (ret_len < 0) {
-		perror("[error] Error sending get_new_streams request");
-		goto error;
+/*
+ * Map the name of the streams which have not hung up to the streams, to
+ * recognize them when they are announced again.
+ */
+static
+GHashTable *resume_table(struct lttng_live_ctx *ctx)
+{
+	GHashTable *table;
+	GHashTableIter it;
+	gpointer value;
+	int i;
+
+	table = g_hash_table_new(g_str_hash, g_str_equal);
+	g_hash_table_iter_init(&it, ctx->session->ctf_traces);
+	while (g_hash_table_iter_next(&it, NULL, &value)) {
+		struct lttng_live_ctf_trace *trace = value;
+
+		for (i = 0; i < trace->streams->len; i++) {
+			struct lttng_live_viewer_stream *stream;
+
+			stream = g_ptr_array_index(trace->streams, i);
+			if (stream->id == -1ULL)
+				continue;
+			g_hash_table_insert(table, stream->path, stream);
+		}
 	}
-	assert(ret_len == sizeof(rq));
+	return table;
+}
 
-	ret_len = lttng_live_recv(ctx->control_sock, &rp, sizeof(rp));
-	if (ret_len == 0) {
-		fprintf(stderr, "[error] Remote side has closed connection\n");
-		goto error;
+/*
+ * Get the metadata the traces being read have gained while the
+ * connection was lost.
+ */
+static
+int refresh_metadata(struct lttng_live_ctx *ctx)
+{
+	GPtrArray *streams;
+	GHashTableIter it;
+	gpointer value;
+	int i, ret;
+
+	streams = g_ptr_array_new();
+	g_hash_table_iter_init(&it, ctx->session->ctf_traces);
+	while (g_hash_table_iter_next(&it, NULL, &value)) {
+		struct lttng_live_ctf_trace *trace = value;
+
+		if (trace->in_use && trace->metadata_stream)
+			g_ptr_array_add(streams, trace->metadata_stream);
 	}
-	if (ret_len < 0) {
-		perror("[error] Error receiving get_new_streams response");
-		goto error;
+	ret = get_new_metadata(ctx, streams);
+	for (i = 0; i < streams->len; i++) {
+		struct lttng_live_viewer_stream *stream;
+
+		stream = g_ptr_array_index(streams, i);
+		if (ret < 0)
+			release_metadata(stream);
+		else
+			ret = parse_new_metadata(stream->ctf_trace);
 	}
-	assert(ret_len == sizeof(rp));
+	g_ptr_array_free(streams, TRUE);
+	return ret;
+}
 
-	switch(be32toh(rp.status)) {
-	case LTTNG_VIEWER_NEW_STREAMS_OK:
-		break;
-	case LTTNG_VIEWER_NEW_STREAMS_NO_NEW:
-		ret = 0;
+/*
+ * Connect to the relay daemon again and attach to the sessions from
+ * their beginning. The streams already known are resumed after the
+ * last packet received, and served again by the data connections if
+ * they were.
+ *
+ * Returns 0 on success, a negative value on error.
+ */
+static
+int resume_sessions(struct lttng_live_ctx *ctx, GPtrArray *detached)
+{
+	uint64_t stream_count = ctx->session->stream_count;
+	unsigned int i, nr_missing;
+	int ret;
+
+	ret = connect_socket(ctx, &ctx->control_sock);
+	if (ret < 0) {
 		goto end;
-	case LTTNG_VIEWER_NEW_STREAMS_HUP:
-		ret = -LTTNG_VIEWER_NEW_STREAMS_HUP;
+	}
+	ret = establish_connection(ctx, ctx->control_sock);
+	if (ret < 0) {
+		goto end;
+	}
+	ret = create_viewer_session(ctx, ctx->control_sock);
+	if (ret < 0) {
+		goto end;
+	}
+	/* The session IDs change if the relay daemon has restarted. */
+	g_array_set_size(ctx->session_ids, 0);
+	ret = lttng_live_list_sessions(ctx, NULL);
+	if (ret < 0) {
+		goto end;
+	}
+	if (!ctx->session_ids->len) {
+		fprintf(stderr, "[warning] Session not found on the relay daemon\n");
+		ret = -1;
 		goto end;
-	case LTTNG_VIEWER_NEW_STREAMS_ERR:
-		fprintf(stderr, "[error] get_new_streams error\n");
-		goto error;
-	default:
-		fprintf(stderr, "[error] Unknown return code %u\n",
-				be32toh(rp.status));
-		goto error;
 	}
 
-	stream_count = be32toh(rp.streams_count);
-	ctx->session->stream_count += stream_count;
 	/*
-	 * When the session is created but not started, we do an active wait
-	 * until it starts. It allows the viewer to start processing the trace
-	 * as soon as the session starts.
+	 * Attach from the beginning, so that the relay daemon serves
+	 * again whatever it still has past the packets already received.
 	 */
-	if (ctx->session->stream_count == 0) {
-		ret = 0;
+	ctx->resume_streams = resume_table(ctx);
+	ret = attach_sessions(ctx, ctx->control_sock,
+			LTTNG_VIEWER_SEEK_BEGINNING);
+	nr_missing = g_hash_table_size(ctx->resume_streams);
+	g_hash_table_destroy(ctx->resume_streams);
+	ctx->resume_streams = NULL;
+	if (ret < 0) {
+		goto end;
+	}
+	if (nr_missing) {
+		fprintf(stderr, "[warning] %u streams not found on the relay "
+				"daemon\n", nr_missing);
+		ret = -1;
 		goto end;
 	}
-	printf_verbose("Waiting for %" PRIu64 " streams:\n",
-		ctx->session->stream_count);
-	ctx->session->streams = g_new0(struct lttng_live_viewer_stream,
-			ctx->session->stream_count);
-	for (i = 0; i < stream_count; i++) {
-		ret_len = lttng_live_recv(ctx->control_sock, &stream, sizeof(stream));
-		if (ret_len == 0) {
-			fprintf(stderr, "[error] Remote side has closed connection\n");
-			goto error;
-		}
-		if (ret_len < 0) {
-			perror("[error] Error receiving stream");
-			goto error;
-		}
-		assert(ret_len == sizeof(stream));
-		stream.path_name[LTTNG_VIEWER_PATH_MAX - 1] = '\0';
-		stream.channel_name[LTTNG_VIEWER_NAME_MAX - 1] = '\0';
 
-		printf_verbose("    stream %" PRIu64 " : %s/%s\n",
-				be64toh(stream.id), stream.path_name,
-				stream.channel_name);
-		ctx->session->streams[i].id = be64toh(stream.id);
-		ctx->session->streams[i].session = ctx->session;
+	ret = refresh_metadata(ctx);
+	if (ret < 0) {
+		goto end;
+	}
+	ret = lttng_live_start_connections(ctx);
+	if (ret < 0) {
+		goto end;
+	}
+	for (i = 0; i < detached->len; i++) {
+		struct lttng_live_viewer_stream *stream;
+
+		stream = g_ptr_array_index(detached, i);
+		if (stream->id != -1ULL)
+			lttng_live_conn_add_stream(ctx, stream);
+	}
+	g_ptr_array_set_size(detached, 0);
 
-		ctx->session->streams[i].mmap_size = 0;
-		ctx->session->streams[i].ctf_stream_id = -1ULL;
+	if (ctx->session->stream_count > stream_count) {
+		ret = add_traces(ctx);
+	}
+end:
+	return ret;
+}
 
-		if (be32toh(stream.metadata_flag)) {
-			ctx->session->streams[i].metadata_flag = 1;
+/*
+ * Reconnect to the relay daemon after a failure, and resume reading the
+ * sessions without reading again what the reader has consumed. The
+ * delay between two attempts doubles up to
+ * LTTNG_LIVE_RECONNECT_MAX_DELAY, for up to ctx->reconnect_timeout
+ * seconds.
+ *
+ * Returns 0 once reconnected, -1 if reconnecting is disabled or has
+ * failed.
+ */
+int lttng_live_reconnect(struct lttng_live_ctx *ctx)
+{
+	GPtrArray *detached;
+	int64_t deadline;
+	unsigned int i;
+	int ret = -1, delay = LTTNG_LIVE_MIN_POLL_DELAY;
+
+	/* A failure while reconnecting is left to the current attempt. */
+	if (!ctx->reconnect_timeout || ctx->reconnecting
+			|| lttng_live_should_quit()) {
+		return -1;
+	}
+	ctx->reconnecting = 1;
+	fprintf(stderr, "[warning] Connection to the relay daemon lost, "
+			"reconnecting\n");
+	deadline = lttng_live_now_us() + ctx->reconnect_timeout * 1000000LL;
+	detached = g_ptr_array_new();
+	for (;;) {
+		close_connections(ctx, detached);
+		if (lttng_live_should_quit()) {
+			break;
 		}
-		ret = lttng_live_ctf_trace_assign(&ctx->session->streams[i],
-				be64toh(stream.ctf_trace_id));
-		if (ret < 0) {
-			goto error;
+		ret = resume_sessions(ctx, detached);
+		if (!ret) {
+			break;
 		}
-		nb_streams++;
-
+		if (lttng_live_now_us() + delay * 1000LL > deadline) {
+			fprintf(stderr, "[error] Unable to reconnect to the "
+					"relay daemon\n");
+			break;
+		}
+		(void) poll(NULL, 0, delay);
+		delay = MIN(delay << 1, LTTNG_LIVE_RECONNECT_MAX_DELAY);
+	}
+	/* Packets kept for streams which are not served anymore. */
+	for (i = 0; i < detached->len; i++)
+		lttng_live_drop_detached(ctx, g_ptr_array_index(detached, i));
+	g_ptr_array_free(detached, TRUE);
+	ctx->reconnecting = 0;
+	if (!ret) {
+		ctx->reconnects++;
+		printf_verbose("Reconnected to the relay daemon\n");
 	}
-	ret = nb_streams;
-end:
 	return ret;
+}
 
-error:
-	return -1;
+/*
+ * Deliver the current event to the output, and move the iterator past
+ * it.
+ *
+ * Returns 1 at the end of the traces, 0 once the event is delivered or
+ * if the iterator has to wait for data, and a negative value on error.
+ */
+static
+int deliver_event(struct lttng_live_ctx *ctx, struct bt_ctf_iter *iter)
+{
+	struct bt_stream_pos *output = ctx->output;
+	const struct bt_ctf_event *event;
+	int flags, ret;
+
+	event = bt_ctf_iter_read_event_flags(iter, &flags);
+	if (!(flags & BT_ITER_FLAG_RETRY)) {
+		if (!event) {
+			/* End of trace */
+			return 1;
+		}
+		/*
+		 * Lost events are counted in the statistics. The text
+		 * output already warns about those the tracer discarded.
+		 */
+		if (flags & BT_ITER_FLAG_LOST_EVENTS) {
+			uint64_t lost = bt_ctf_get_lost_events_count(iter);
+
+			ctx->lost_events += lost;
+			if (babeltrace_verbose)
+				fprintf(stderr, "[verbose] %" PRIu64
+					" events discarded or dropped "
+					"before this one\n", lost);
+		}
+		ret = output->event_cb(output, event->parent->stream);
+		if (ret) {
+			fprintf(stderr, "[error] Writing event failed.\n");
+			return -1;
+		}
+		if (!ctx->stats_countdown--) {
+			ctx->stats_countdown = STATS_CHECK_EVENTS;
+			print_stats_periodically(ctx);
+		}
+	}
+	ret = bt_iter_next(bt_ctf_get_iter(iter));
+	return ret < 0 ? ret : 0;
 }
 
 int lttng_live_read(struct lttng_live_ctx *ctx)
 {
 	int ret = -1;
-	int i;
-	struct bt_ctf_iter *iter;
-	const struct bt_ctf_event *event;
+	struct bt_ctf_iter *iter = NULL;
 	struct bt_iter_pos begin_pos;
 	struct bt_trace_descriptor *td_write;
-	struct bt_format *fmt_write;
+	struct bt_format *fmt_write = NULL;
 	struct ctf_text_stream_pos *sout;
-	uint64_t id;
 
 	ctx->bt_ctx = bt_context_create();
 	if (!ctx->bt_ctx) {
@@ -1646,47 +2722,50 @@ int lttng_live_read(struct lttng_live_ctx *ctx)
 		goto end;
 	}
 
-	fmt_write = bt_lookup_format(g_quark_from_string("text"));
-	if (!fmt_write) {
-		fprintf(stderr, "[error] ctf-text error\n");
-		goto end;
-	}
-
-	td_write = fmt_write->open_trace(NULL, O_RDWR, NULL, NULL);
+	td_write = ctx->output_td;
 	if (!td_write) {
-		fprintf(stderr, "[error] Error opening output trace\n");
-		goto end_free;
+		fmt_write = bt_lookup_format(g_quark_from_string("text"));
+		if (!fmt_write) {
+			fprintf(stderr, "[error] ctf-text error\n");
+			goto end;
+		}
+
+		td_write = fmt_write->open_trace(NULL, O_RDWR, NULL, NULL);
+		if (!td_write) {
+			fprintf(stderr, "[error] Error opening output trace\n");
+			goto end_free;
+		}
 	}
 
+	/* All output formats inherit from ctf_text_stream_pos. */
 	sout = container_of(td_write, struct ctf_text_stream_pos,
 			trace_descriptor);
-	if (!sout->parent.event_cb) {
+	ctx->output = &sout->parent;
+	if (!ctx->output->event_cb) {
 		goto end_free;
 	}
 
-	ret = lttng_live_create_viewer_session(ctx);
+	ret = create_viewer_session(ctx, ctx->control_sock);
 	if (ret < 0) {
 		goto end_free;
 	}
 
-	for (i = 0; i < ctx->session_ids->len; i++) {
-		id = g_array_index(ctx->session_ids, uint64_t, i);
-		printf_verbose("Attaching to session %" PRIu64 "\n", id);
-		ret = lttng_live_attach_session(ctx, id);
-		printf_verbose("Attaching session returns %d\n", ret);
-		if (ret < 0) {
-			if (ret == -LTTNG_VIEWER_ATTACH_UNK) {
-				fprintf(stderr, "[error] Unknown session ID\n");
-			}
-			goto end_free;
-		}
+	ret = attach_sessions(ctx, ctx->control_sock, LTTNG_VIEWER_SEEK_LAST);
+	if (ret < 0) {
+		goto end_free;
+	}
+
+	ret = lttng_live_start_connections(ctx);
+	if (ret < 0) {
+		goto end_free;
 	}
+	ctx->next_stats = lttng_live_now_us() + ctx->stats_period * 1000000LL;
 
 	/*
 	 * As long as the session is active, we try to get new streams.
 	 */
 	for (;;) {
-		int flags;
+		int delay = 0;
 
 		if (lttng_live_should_quit()) {
 			ret = 0;
@@ -1701,61 +2780,82 @@ int lttng_live_read(struct lttng_live_ctx *ctx)
 			}
 			ret = ask_new_streams(ctx);
 			if (ret < 0) {
-				goto end_free;
+				if (lttng_live_reconnect(ctx)) {
+					goto end_free;
+				}
+				continue;
 			}
 			if (!ctx->session->stream_count) {
-				(void) poll(NULL, 0, ACTIVE_POLL_DELAY);
+				lttng_live_backoff(ctx, &delay);
 			}
 		}
 
+		/*
+		 * Once the iterator exists, new traces are added to it
+		 * as they come, it is only created once.
+		 */
 		ret = add_traces(ctx);
 		if (ret < 0) {
-			goto end_free;
+			if (lttng_live_reconnect(ctx)) {
+				goto end_free;
+			}
+			continue;
 		}
 
-		begin_pos.type = BT_SEEK_BEGIN;
-		iter = bt_ctf_iter_create(ctx->bt_ctx, &begin_pos, NULL);
 		if (!iter) {
-			if (lttng_live_should_quit()) {
-				ret = 0;
+			begin_pos.type = BT_SEEK_BEGIN;
+			iter = bt_ctf_iter_create(ctx->bt_ctx, &begin_pos,
+					NULL);
+			if (!iter) {
+				if (lttng_live_should_quit()) {
+					ret = 0;
+					goto end;
+				}
+				fprintf(stderr, "[error] Iterator creation error\n");
 				goto end;
 			}
-			fprintf(stderr, "[error] Iterator creation error\n");
-			goto end;
 		}
 		for (;;) {
 			if (lttng_live_should_quit()) {
 				ret = 0;
 				goto end_free;
 			}
-			event = bt_ctf_iter_read_event_flags(iter, &flags);
-			if (!(flags & BT_ITER_FLAG_RETRY)) {
-				if (!event) {
-					/* End of trace */
-					break;
-				}
-				ret = sout->parent.event_cb(&sout->parent,
-						event->parent->stream);
-				if (ret) {
-					fprintf(stderr, "[error] Writing "
-							"event failed.\n");
-					goto end_free;
-				}
-			}
-			ret = bt_iter_next(bt_ctf_get_iter(iter));
+			ret = deliver_event(ctx, iter);
 			if (ret < 0) {
 				goto end_free;
 			}
+			if (ret > 0) {
+				break;
+			}
+			if (ctx->session->streams_hup) {
+				g_hash_table_foreach_remove(
+						ctx->session->ctf_traces,
+						del_hup_traces, ctx);
+				ctx->session->streams_hup = 0;
+			}
 		}
-		bt_ctf_iter_destroy(iter);
+		/*
+		 * Every stream has hung up and the iterator heap is empty:
+		 * forget the traces, and keep the iterator for the streams
+		 * to come.
+		 */
 		g_hash_table_foreach_remove(ctx->session->ctf_traces,
-				del_traces, ctx->bt_ctx);
+				del_traces, ctx);
+		ctx->session->streams_hup = 0;
+		lttng_live_conn_clear_streams(ctx);
 		ctx->session->stream_count = 0;
 	}
 
 end_free:
+	if (iter) {
+		bt_ctf_iter_destroy(iter);
+	}
 	bt_context_put(ctx->bt_ctx);
+	if (fmt_write && td_write) {
+		fmt_write->close_trace(td_write);
+	}
 end:
+	lttng_live_stop_connections(ctx);
 	if (lttng_live_should_quit()) {
 		ret = 0;
 	}
@@ -0,0 +1,849 @@
+/*
+ * BabelTrace - LTTng live data connections
+ *
+ * Streams are sharded across a pool of connections to the relay daemon.
+ * Each connection is served by an I/O thread which requests the next
+ * index and packet of its streams, and queues the responses per stream
+ * for the packet seek, which runs in the reader thread.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <assert.h>
+#include <pthread.h>
+#include <glib.h>
+
+#include <babeltrace/babeltrace-internal.h>
+#include <babeltrace/endian.h>
+#include <babeltrace/mmap-align.h>
+
+#include "lttng-live.h"
+#include "lttng-viewer-abi.h"
+
+/* Longest wait before checking whether we should quit, in ms. */
+#define IO_WAIT_PERIOD		100
+
+int64_t lttng_live_now_us(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static
+void us_to_timespec(int64_t us, struct timespec *ts)
+{
+	ts->tv_sec = us / 1000000;
+	ts->tv_nsec = (us % 1000000) * 1000;
+}
+
+void lttng_live_packet_free(struct lttng_live_ctx *ctx,
+		struct lttng_live_packet *packet)
+{
+	if (!packet)
+		return;
+	lttng_live_pool_put(&ctx->pool, packet->mma);
+	g_free(packet);
+}
+
+/*
+ * Queue a response for the reader. Called with conn->lock held.
+ */
+static
+struct lttng_live_packet *queue_packet(struct lttng_live_conn *conn,
+		struct lttng_live_viewer_stream *stream, int is_index)
+{
+	struct lttng_live_packet *packet;
+
+	packet = g_new0(struct lttng_live_packet, 1);
+	packet->is_index = is_index;
+	packet->index = stream->io_index;
+	g_queue_push_tail(stream->packets, packet);
+	pthread_cond_broadcast(&conn->ready_cond);
+	return packet;
+}
+
+static
+uint64_t packet_len(struct lttng_live_packet *packet)
+{
+	return be64toh(packet->index.packet_size) / CHAR_BIT;
+}
+
+/*
+ * Index and packet received in a single response, which can be dropped
+ * without leaving the reader with half of an exchange.
+ */
+static
+int packet_droppable(struct lttng_live_packet *packet)
+{
+	return packet->is_index && packet->mma;
+}
+
+/*
+ * Make room in the queue of a stream for a packet received ahead,
+ * according to the backpressure policy: drop the oldest complete
+ * packets, or all of them to skip to the newest one. Responses the
+ * reader must see (statuses, flags) are never dropped. Called with
+ * conn->lock held.
+ */
+static
+void make_room(struct lttng_live_conn *conn,
+		struct lttng_live_viewer_stream *stream)
+{
+	struct lttng_live_ctx *ctx = conn->ctx;
+	unsigned int nr = 0, limit, keep;
+	GList *l, *next;
+
+	if (ctx->backpressure == LTTNG_LIVE_BACKPRESSURE_BLOCK)
+		return;
+	limit = lttng_live_pool_full(&ctx->pool) ?
+			1 : LTTNG_LIVE_STREAM_QUEUE_DEPTH;
+	for (l = stream->packets->head; l; l = l->next) {
+		if (packet_droppable(l->data))
+			nr++;
+	}
+	if (nr < limit)
+		return;
+	keep = ctx->backpressure == LTTNG_LIVE_BACKPRESSURE_SKIP ?
+			0 : limit - 1;
+	for (l = stream->packets->head; l && nr > keep; l = next) {
+		struct lttng_live_packet *packet = l->data;
+
+		next = l->next;
+		if (!packet_droppable(packet))
+			continue;
+		g_queue_delete_link(stream->packets, l);
+		stream->buffered_bytes -= packet_len(packet);
+		stream->packets_dropped++;
+		stream->dropped_pending++;
+		lttng_live_packet_free(ctx, packet);
+		nr--;
+	}
+}
+
+/*
+ * Delay the next index request of a stream which has no new data, with
+ * the same exponential backoff as the reader thread.
+ */
+static
+void schedule_retry(struct lttng_live_conn *conn,
+		struct lttng_live_viewer_stream *stream)
+{
+	if (stream->poll_delay < LTTNG_LIVE_MIN_POLL_DELAY)
+		stream->poll_delay = LTTNG_LIVE_MIN_POLL_DELAY;
+	if (stream->poll_delay > conn->ctx->latency_target)
+		stream->poll_delay = conn->ctx->latency_target;
+	stream->io_next_poll = lttng_live_now_us() + stream->poll_delay * 1000LL;
+	stream->poll_delay <<= 1;
+}
+
+/*
+ * Whether an index received after a reconnection is for a packet
+ * already received, in which case it must be skipped. The flags of the
+ * skipped indexes are carried over to the first index kept. When the
+ * first packet kept lies past the one which followed, the relay daemon
+ * no longer has the packets in between, which are accounted as
+ * dropped. A beacon received meanwhile may be older than the packets
+ * already read, so it is turned into a RETRY.
+ */
+int lttng_live_skip_index(struct lttng_live_viewer_stream *stream,
+		struct lttng_viewer_index *index)
+{
+	if (!stream->skipping)
+		return 0;
+	switch (be32toh(index->status)) {
+	case LTTNG_VIEWER_INDEX_OK:
+		/* The timestamp tells a trace file rotation apart. */
+		if (be64toh(index->offset) <= stream->skip_offset
+				&& be64toh(index->timestamp_end)
+					<= stream->skip_timestamp_end) {
+			stream->skipped_flags |= be32toh(index->flags);
+			return 1;
+		}
+		if (be64toh(index->offset) > stream->skip_next_offset)
+			stream->dropped_pending++;
+		break;
+	case LTTNG_VIEWER_INDEX_INACTIVE:
+		index->status = htobe32(LTTNG_VIEWER_INDEX_RETRY);
+		/* Fall-through */
+	case LTTNG_VIEWER_INDEX_RETRY:
+		return 0;
+	default:
+		break;
+	}
+	stream->skipping = 0;
+	index->flags |= htobe32(stream->skipped_flags);
+	stream->skipped_flags = 0;
+	return 0;
+}
+
+/*
+ * Pick up to LTTNG_LIVE_PIPELINE_DEPTH streams with work to do, in
+ * round-robin order. Called with conn->lock held. Returns the number
+ * of streams picked, and the time at which the next stream becomes
+ * ready in *wakeup.
+ */
+static
+int pick_streams(struct lttng_live_conn *conn,
+		struct lttng_live_viewer_stream **batch, int64_t *wakeup)
+{
+	unsigned int i, len = conn->streams->len;
+	int64_t now = lttng_live_now_us();
+	int nr = 0, full;
+
+	/* Only receive ahead while the packet buffer pool has room. */
+	full = lttng_live_pool_full(&conn->ctx->pool);
+
+	*wakeup = now + IO_WAIT_PERIOD * 1000LL;
+	for (i = 0; i < len && nr < LTTNG_LIVE_PIPELINE_DEPTH; i++) {
+		struct lttng_live_viewer_stream *stream;
+
+		stream = g_ptr_array_index(conn->streams,
+				(conn->next_stream + i) % len);
+		if (stream->io_state != LTTNG_LIVE_IO_INDEX
+				&& stream->io_state != LTTNG_LIVE_IO_PACKET)
+			continue;
+		/* Unless packets are dropped to make room. */
+		if (conn->ctx->backpressure == LTTNG_LIVE_BACKPRESSURE_BLOCK
+				&& g_queue_get_length(stream->packets)
+				>= (full ? 1 : LTTNG_LIVE_STREAM_QUEUE_DEPTH))
+			continue;
+		if (stream->io_next_poll > now) {
+			if (stream->io_next_poll < *wakeup)
+				*wakeup = stream->io_next_poll;
+			continue;
+		}
+		batch[nr++] = stream;
+	}
+	if (len)
+		conn->next_stream = (conn->next_stream + 1) % len;
+	return nr;
+}
+
+static
+int send_request(int sock, uint32_t cmd_id, const void *rq, size_t len)
+{
+	char buf[sizeof(struct lttng_viewer_cmd)
+		+ sizeof(struct lttng_viewer_get_packet)];
+	struct lttng_viewer_cmd cmd;
+	ssize_t ret_len;
+
+	assert(len <= sizeof(struct lttng_viewer_get_packet));
+	cmd.cmd = htobe32(cmd_id);
+	cmd.data_size = htobe64((uint64_t) len);
+	cmd.cmd_version = htobe32(0);
+	memcpy(buf, &cmd, sizeof(cmd));
+	memcpy(buf + sizeof(cmd), rq, len);
+
+	ret_len = lttng_live_send(sock, buf, sizeof(cmd) + len);
+	if (ret_len < 0) {
+		perror("[error] Error sending request");
+		return -1;
+	}
+	assert(ret_len == sizeof(cmd) + len);
+	return 0;
+}
+
+static
+int recv_response(int sock, void *buf, size_t len)
+{
+	ssize_t ret_len;
+
+	ret_len = lttng_live_recv(sock, buf, len);
+	if (ret_len == 0) {
+		fprintf(stderr, "[error] Remote side has closed connection\n");
+		return -1;
+	}
+	if (ret_len < 0) {
+		perror("[error] Error receiving response");
+		return -1;
+	}
+	assert(ret_len == len);
+	return 0;
+}
+
+/*
+ * Keep the streams of the batch in a given state. The list of requests
+ * sent must not change until all their responses are received, even if
+ * the reader changes the state of a stream meanwhile.
+ */
+static
+int filter_streams(struct lttng_live_conn *conn,
+		struct lttng_live_viewer_stream **batch, int nr,
+		enum lttng_live_io_state state,
+		struct lttng_live_viewer_stream **out)
+{
+	int i, nr_out = 0;
+
+	pthread_mutex_lock(&conn->lock);
+	for (i = 0; i < nr; i++) {
+		if (batch[i]->io_state == state)
+			out[nr_out++] = batch[i];
+	}
+	pthread_mutex_unlock(&conn->lock);
+	return nr_out;
+}
+
+/*
+ * Request the next index of the streams of the batch which need one,
+ * then receive the responses in order.
+ */
+static
+int serve_indexes(struct lttng_live_conn *conn,
+		struct lttng_live_viewer_stream **batch, int nr)
+{
+	struct lttng_live_viewer_stream *req[LTTNG_LIVE_PIPELINE_DEPTH];
+	struct lttng_viewer_get_next_index rq;
+	int i, ret;
+
+	nr = filter_streams(conn, batch, nr, LTTNG_LIVE_IO_INDEX, req);
+	for (i = 0; i < nr; i++) {
+		memset(&rq, 0, sizeof(rq));
+		rq.stream_id = htobe64(req[i]->id);
+		ret = send_request(conn->sock, LTTNG_VIEWER_GET_NEXT_INDEX,
+				&rq, sizeof(rq));
+		if (ret)
+			return ret;
+	}
+	for (i = 0; i < nr; i++) {
+		struct lttng_live_viewer_stream *stream = req[i];
+		uint32_t flags;
+
+		ret = recv_response(conn->sock, &stream->io_index,
+				sizeof(stream->io_index));
+		if (ret)
+			return ret;
+
+		pthread_mutex_lock(&conn->lock);
+		if (lttng_live_skip_index(stream, &stream->io_index)) {
+			/* Read before the reconnection, ask for the next one. */
+			stream->io_next_poll = 0;
+			pthread_mutex_unlock(&conn->lock);
+			continue;
+		}
+		flags = be32toh(stream->io_index.flags);
+		switch (be32toh(stream->io_index.status)) {
+		case LTTNG_VIEWER_INDEX_OK:
+			stream->poll_delay = 0;
+			stream->io_index_queued = 0;
+			if (flags & (LTTNG_VIEWER_FLAG_NEW_METADATA
+					| LTTNG_VIEWER_FLAG_NEW_STREAM)) {
+				/*
+				 * The relay won't serve the packet before
+				 * the reader has fetched the new metadata.
+				 */
+				queue_packet(conn, stream, 1);
+				stream->io_index_queued = 1;
+				stream->io_state = LTTNG_LIVE_IO_PAUSED;
+			} else {
+				stream->io_state = LTTNG_LIVE_IO_PACKET;
+			}
+			break;
+		case LTTNG_VIEWER_INDEX_RETRY:
+			schedule_retry(conn, stream);
+			break;
+		case LTTNG_VIEWER_INDEX_INACTIVE:
+			queue_packet(conn, stream, 1);
+			schedule_retry(conn, stream);
+			break;
+		case LTTNG_VIEWER_INDEX_HUP:
+		case LTTNG_VIEWER_INDEX_ERR:
+		default:
+			/* The reader reports the status. */
+			queue_packet(conn, stream, 1);
+			stream->io_state = LTTNG_LIVE_IO_HUP;
+			break;
+		}
+		pthread_mutex_unlock(&conn->lock);
+	}
+	return 0;
+}
+
+/*
+ * Request the packets of the streams of the batch which have an index,
+ * then receive the responses in order.
+ */
+static
+int serve_packets(struct lttng_live_conn *conn,
+		struct lttng_live_viewer_stream **batch, int nr)
+{
+	struct lttng_live_viewer_stream *req[LTTNG_LIVE_PIPELINE_DEPTH];
+	struct lttng_viewer_get_packet rq;
+	struct lttng_viewer_trace_packet rp;
+	int i, ret;
+
+	nr = filter_streams(conn, batch, nr, LTTNG_LIVE_IO_PACKET, req);
+	for (i = 0; i < nr; i++) {
+		struct lttng_live_viewer_stream *stream = req[i];
+
+		memset(&rq, 0, sizeof(rq));
+		rq.stream_id = htobe64(stream->id);
+		rq.offset = stream->io_index.offset;
+		rq.len = htobe32(be64toh(stream->io_index.packet_size)
+				/ CHAR_BIT);
+		ret = send_request(conn->sock, LTTNG_VIEWER_GET_PACKET,
+				&rq, sizeof(rq));
+		if (ret)
+			return ret;
+	}
+	for (i = 0; i < nr; i++) {
+		struct lttng_live_viewer_stream *stream = req[i];
+		struct lttng_live_packet *packet;
+		struct mmap_align *mma = NULL;
+		uint32_t status;
+		uint64_t len;
+
+		ret = recv_response(conn->sock, &rp, sizeof(rp));
+		if (ret)
+			return ret;
+		status = be32toh(rp.status);
+		if (status == LTTNG_VIEWER_GET_PACKET_OK) {
+			len = be32toh(rp.len);
+			if (len == 0) {
+				fprintf(stderr, "[error] Empty packet\n");
+				return -1;
+			}
+			mma = lttng_live_pool_get(&conn->ctx->pool, len);
+			if (!mma)
+				return -1;
+			ret = recv_response(conn->sock, mmap_align_addr(mma),
+					len);
+			if (ret) {
+				lttng_live_pool_put(&conn->ctx->pool, mma);
+				return ret;
+			}
+		}
+
+		pthread_mutex_lock(&conn->lock);
+		if (status == LTTNG_VIEWER_GET_PACKET_OK) {
+			if (!stream->io_index_queued) {
+				/* Index and packet in a single response. */
+				make_room(conn, stream);
+				packet = queue_packet(conn, stream, 1);
+			} else {
+				packet = queue_packet(conn, stream, 0);
+				packet->status = status;
+			}
+			packet->mma = mma;
+			stream->packets_received++;
+			stream->buffered_bytes += packet_len(packet);
+			stream->io_state = LTTNG_LIVE_IO_INDEX;
+		} else {
+			/*
+			 * Let the reader handle the status and the flags,
+			 * and resume the stream when the packet can be
+			 * requested again.
+			 */
+			if (!stream->io_index_queued) {
+				queue_packet(conn, stream, 1);
+				stream->io_index_queued = 1;
+			}
+			packet = queue_packet(conn, stream, 0);
+			packet->status = status;
+			packet->flags = be32toh(rp.flags);
+			stream->io_state = LTTNG_LIVE_IO_PAUSED;
+		}
+		pthread_mutex_unlock(&conn->lock);
+	}
+	return 0;
+}
+
+static
+void *io_thread(void *data)
+{
+	struct lttng_live_conn *conn = data;
+	struct lttng_live_viewer_stream *batch[LTTNG_LIVE_PIPELINE_DEPTH];
+	struct timespec ts;
+	int64_t wakeup;
+	int nr, ret;
+
+	pthread_mutex_lock(&conn->lock);
+	while (!conn->quit && !lttng_live_should_quit()) {
+		nr = pick_streams(conn, batch, &wakeup);
+		if (!nr) {
+			us_to_timespec(wakeup, &ts);
+			(void) pthread_cond_timedwait(&conn->io_cond,
+					&conn->lock, &ts);
+			continue;
+		}
+		pthread_mutex_unlock(&conn->lock);
+		ret = serve_indexes(conn, batch, nr);
+		if (!ret)
+			ret = serve_packets(conn, batch, nr);
+		pthread_mutex_lock(&conn->lock);
+		if (ret) {
+			conn->error = 1;
+			pthread_cond_broadcast(&conn->ready_cond);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&conn->lock);
+	return NULL;
+}
+
+/*
+ * Wait for the next response queued for a stream. Returns NULL on
+ * error or when we should quit.
+ */
+struct lttng_live_packet *lttng_live_pop_packet(
+		struct lttng_live_viewer_stream *stream)
+{
+	struct lttng_live_conn *conn = stream->conn;
+	struct lttng_live_packet *packet;
+	struct timespec ts;
+
+	pthread_mutex_lock(&conn->lock);
+	while (!(packet = g_queue_pop_head(stream->packets))) {
+		if (conn->error || lttng_live_should_quit())
+			break;
+		us_to_timespec(lttng_live_now_us() + IO_WAIT_PERIOD * 1000LL, &ts);
+		(void) pthread_cond_timedwait(&conn->ready_cond,
+				&conn->lock, &ts);
+	}
+	if (packet) {
+		if (packet->mma) {
+			stream->buffered_bytes -= packet_len(packet);
+			stream->packets_consumed++;
+		}
+		if (packet->is_index) {
+			packet->dropped = stream->dropped_pending;
+			stream->dropped_pending = 0;
+		}
+		/* There is room in the queue again. */
+		pthread_cond_signal(&conn->io_cond);
+	} else if (conn->error) {
+		fprintf(stderr, "[error] Data connection failed\n");
+	}
+	pthread_mutex_unlock(&conn->lock);
+	return packet;
+}
+
+/*
+ * Whether a response is queued for a stream, so that popping it won't
+ * block.
+ */
+int lttng_live_stream_ready(struct lttng_live_viewer_stream *stream)
+{
+	struct lttng_live_conn *conn = stream->conn;
+	int ready;
+
+	pthread_mutex_lock(&conn->lock);
+	ready = !g_queue_is_empty(stream->packets);
+	pthread_mutex_unlock(&conn->lock);
+	return ready;
+}
+
+/*
+ * Get the accounting of a stream, served by a data connection or not.
+ */
+void lttng_live_get_stream_stats(struct lttng_live_viewer_stream *stream,
+		struct lttng_live_stream_stats *stats)
+{
+	struct lttng_live_conn *conn = stream->conn;
+
+	if (conn)
+		pthread_mutex_lock(&conn->lock);
+	stats->lag = stream->packets_received - stream->packets_consumed;
+	stats->buffered_bytes = stream->buffered_bytes;
+	stats->dropped = stream->packets_dropped;
+	if (conn)
+		pthread_mutex_unlock(&conn->lock);
+}
+
+/*
+ * Let the I/O thread request the packet of the last index again, once
+ * the reader has handled the flags or the status which paused it.
+ */
+void lttng_live_resume_stream(struct lttng_live_viewer_stream *stream)
+{
+	struct lttng_live_conn *conn = stream->conn;
+
+	pthread_mutex_lock(&conn->lock);
+	if (stream->io_state == LTTNG_LIVE_IO_PAUSED) {
+		stream->io_state = LTTNG_LIVE_IO_PACKET;
+		pthread_cond_signal(&conn->io_cond);
+	}
+	pthread_mutex_unlock(&conn->lock);
+}
+
+/*
+ * Assign a data stream to the connection serving the fewest streams.
+ */
+void lttng_live_conn_add_stream(struct lttng_live_ctx *ctx,
+		struct lttng_live_viewer_stream *stream)
+{
+	struct lttng_live_conn *conn = NULL;
+	int i;
+
+	for (i = 0; i < ctx->nr_conns; i++) {
+		if (!conn || ctx->conns[i].streams->len < conn->streams->len)
+			conn = &ctx->conns[i];
+	}
+	assert(conn);
+
+	if (!stream->packets)
+		stream->packets = g_queue_new();
+	pthread_mutex_lock(&conn->lock);
+	stream->conn = conn;
+	stream->io_state = LTTNG_LIVE_IO_INDEX;
+	stream->io_next_poll = 0;
+	if (!g_queue_is_empty(stream->packets)) {
+		struct lttng_live_packet *last;
+
+		/* Resume after the packets kept across a reconnection. */
+		last = g_queue_peek_tail(stream->packets);
+		stream->skipping = 1;
+		stream->skip_offset = be64toh(last->index.offset);
+		stream->skip_timestamp_end = be64toh(last->index.timestamp_end);
+		stream->skip_next_offset = stream->skip_offset
+				+ packet_len(last);
+		stream->skipped_flags = 0;
+	} else if (stream->data_pending && stream->packet
+			&& !stream->packet->mma) {
+		/* Reconnected while the reader waits for this packet. */
+		stream->io_index = stream->packet->index;
+		stream->io_index_queued = 1;
+		stream->io_state = LTTNG_LIVE_IO_PACKET;
+	}
+	g_ptr_array_add(conn->streams, stream);
+	pthread_cond_signal(&conn->io_cond);
+	pthread_mutex_unlock(&conn->lock);
+}
+
+/*
+ * Drop the responses queued for a stream. Called with conn->lock held.
+ */
+static
+void forget_stream(struct lttng_live_ctx *ctx,
+		struct lttng_live_viewer_stream *stream)
+{
+	struct lttng_live_packet *packet;
+
+	while ((packet = g_queue_pop_head(stream->packets)))
+		lttng_live_packet_free(ctx, packet);
+	lttng_live_packet_free(ctx, stream->packet);
+	stream->packet = NULL;
+	stream->io_state = LTTNG_LIVE_IO_HUP;
+}
+
+/*
+ * Stop serving a stream which has hung up, when its trace is removed
+ * while other traces are still being read.
+ */
+void lttng_live_conn_remove_stream(struct lttng_live_ctx *ctx,
+		struct lttng_live_viewer_stream *stream)
+{
+	struct lttng_live_conn *conn = stream->conn;
+
+	if (!conn)
+		return;
+	pthread_mutex_lock(&conn->lock);
+	forget_stream(ctx, stream);
+	g_ptr_array_remove(conn->streams, stream);
+	if (conn->next_stream >= conn->streams->len)
+		conn->next_stream = 0;
+	stream->conn = NULL;
+	pthread_mutex_unlock(&conn->lock);
+}
+
+/*
+ * Forget all the streams served, once they have all hung up.
+ */
+void lttng_live_conn_clear_streams(struct lttng_live_ctx *ctx)
+{
+	int i;
+	unsigned int j;
+
+	for (i = 0; i < ctx->nr_conns; i++) {
+		struct lttng_live_conn *conn = &ctx->conns[i];
+
+		pthread_mutex_lock(&conn->lock);
+		for (j = 0; j < conn->streams->len; j++)
+			forget_stream(ctx, g_ptr_array_index(conn->streams, j));
+		g_ptr_array_set_size(conn->streams, 0);
+		conn->next_stream = 0;
+		pthread_mutex_unlock(&conn->lock);
+	}
+}
+
+/*
+ * Drop the responses queued after the last packet received for a
+ * stream: an index whose packet is still to be requested, a status or
+ * a beacon. They are received again once reconnected.
+ */
+static
+void trim_stream(struct lttng_live_ctx *ctx,
+		struct lttng_live_viewer_stream *stream)
+{
+	struct lttng_live_packet *packet;
+
+	while ((packet = g_queue_peek_tail(stream->packets))
+			&& !packet->mma) {
+		g_queue_pop_tail(stream->packets);
+		lttng_live_packet_free(ctx, packet);
+	}
+}
+
+/*
+ * Stop the I/O threads after a connection failure, and detach their
+ * streams, which are appended to an array so they can be served again
+ * by new connections. The packets already received stay queued for the
+ * reader, and the connections then resume after them. The connections
+ * are then freed with lttng_live_stop_connections().
+ */
+void lttng_live_detach_connections(struct lttng_live_ctx *ctx,
+		GPtrArray *streams)
+{
+	int i;
+	unsigned int j;
+
+	if (!ctx->conns)
+		return;
+	for (i = 0; i < ctx->nr_conns; i++) {
+		struct lttng_live_conn *conn = &ctx->conns[i];
+
+		if (conn->sock < 0)
+			continue;
+		pthread_mutex_lock(&conn->lock);
+		conn->quit = 1;
+		pthread_cond_signal(&conn->io_cond);
+		pthread_mutex_unlock(&conn->lock);
+		(void) shutdown(conn->sock, SHUT_RDWR);
+		pthread_join(conn->thread, NULL);
+		close(conn->sock);
+		conn->sock = -1;
+	}
+	for (i = 0; i < ctx->nr_conns; i++) {
+		struct lttng_live_conn *conn = &ctx->conns[i];
+
+		for (j = 0; j < conn->streams->len; j++) {
+			struct lttng_live_viewer_stream *stream;
+
+			stream = g_ptr_array_index(conn->streams, j);
+			trim_stream(ctx, stream);
+			stream->conn = NULL;
+			g_ptr_array_add(streams, stream);
+		}
+		g_ptr_array_set_size(conn->streams, 0);
+		conn->next_stream = 0;
+	}
+}
+
+/*
+ * Drop the packets kept for a detached stream, when it is not served
+ * again because reconnecting has failed.
+ */
+void lttng_live_drop_detached(struct lttng_live_ctx *ctx,
+		struct lttng_live_viewer_stream *stream)
+{
+	struct lttng_live_packet *packet;
+
+	while ((packet = g_queue_pop_head(stream->packets))) {
+		if (packet->mma)
+			stream->buffered_bytes -= packet_len(packet);
+		lttng_live_packet_free(ctx, packet);
+	}
+}
+
+int lttng_live_start_connections(struct lttng_live_ctx *ctx)
+{
+	int i, ret;
+
+	if (!ctx->nr_conns)
+		return 0;
+	ctx->conns = g_new0(struct lttng_live_conn, ctx->nr_conns);
+	for (i = 0; i < ctx->nr_conns; i++) {
+		struct lttng_live_conn *conn = &ctx->conns[i];
+
+		conn->ctx = ctx;
+		conn->sock = -1;
+		conn->streams = g_ptr_array_new();
+		pthread_mutex_init(&conn->lock, NULL);
+		pthread_cond_init(&conn->io_cond, NULL);
+		pthread_cond_init(&conn->ready_cond, NULL);
+	}
+	for (i = 0; i < ctx->nr_conns; i++) {
+		struct lttng_live_conn *conn = &ctx->conns[i];
+
+		ret = lttng_live_open_connection(ctx, &conn->sock);
+		if (ret < 0) {
+			conn->sock = -1;
+			goto error;
+		}
+		ret = pthread_create(&conn->thread, NULL, io_thread, conn);
+		if (ret) {
+			fprintf(stderr, "[error] Cannot create I/O thread: %s\n",
+				strerror(ret));
+			close(conn->sock);
+			conn->sock = -1;
+			goto error;
+		}
+	}
+	printf_verbose("Opened %d data connection(s)\n", ctx->nr_conns);
+	return 0;
+
+error:
+	lttng_live_stop_connections(ctx);
+	return -1;
+}
+
+void lttng_live_stop_connections(struct lttng_live_ctx *ctx)
+{
+	int i;
+
+	if (!ctx->conns)
+		return;
+	lttng_live_conn_clear_streams(ctx);
+	for (i = 0; i < ctx->nr_conns; i++) {
+		struct lttng_live_conn *conn = &ctx->conns[i];
+
+		if (conn->sock < 0)
+			continue;
+		pthread_mutex_lock(&conn->lock);
+		conn->quit = 1;
+		pthread_cond_signal(&conn->io_cond);
+		pthread_mutex_unlock(&conn->lock);
+		/* Unblock the thread if it is waiting for a response. */
+		(void) shutdown(conn->sock, SHUT_RDWR);
+		pthread_join(conn->thread, NULL);
+		close(conn->sock);
+	}
+	for (i = 0; i < ctx->nr_conns; i++) {
+		struct lttng_live_conn *conn = &ctx->conns[i];
+
+		pthread_mutex_destroy(&conn->lock);
+		pthread_cond_destroy(&conn->io_cond);
+		pthread_cond_destroy(&conn->ready_cond);
+		g_ptr_array_free(conn->streams, TRUE);
+	}
+	g_free(ctx->conns);
+	ctx->conns = NULL;
+}
@@ -37,6 +37,7 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <signal.h>
+#include <babeltrace/lttng-live-internal.h>
 #include "lttng-live.h"
 
 static volatile int should_quit;
@@ -97,6 +98,103 @@ int setup_sighandler(void)
 	return 0;
 }
 
+/*
+ * Parse and strip the options following '?' in the URL, separated by
+ * '&'. Known options are "latency=<ms>", "connections=<n>",
+ * "buffers=<MiB>", "backpressure=block|drop|skip", "stats=<s>" and
+ * "reconnect=<s>".
+ */
+static
+int parse_url_options(char *url, struct lttng_live_ctx *ctx)
+{
+	char *opt, *next;
+	int latency, nr_conns, buffers, stats, reconnect;
+	static const char *backpressure[] = {
+		[LTTNG_LIVE_BACKPRESSURE_BLOCK] = "block",
+		[LTTNG_LIVE_BACKPRESSURE_DROP] = "drop",
+		[LTTNG_LIVE_BACKPRESSURE_SKIP] = "skip",
+	};
+
+	opt = strchr(url, '?');
+	if (!opt) {
+		return 0;
+	}
+	*opt++ = '\0';
+	for (; opt; opt = next) {
+		next = strchr(opt, '&');
+		if (next) {
+			*next++ = '\0';
+		}
+		if (sscanf(opt, "latency=%d", &latency) == 1) {
+			if (latency < LTTNG_LIVE_MIN_POLL_DELAY) {
+				fprintf(stderr, "[error] Latency target must be at "
+					"least %d ms\n", LTTNG_LIVE_MIN_POLL_DELAY);
+				return -1;
+			}
+			ctx->latency_target = latency;
+			printf_verbose("Latency target : %d ms\n", latency);
+		} else if (sscanf(opt, "connections=%d", &nr_conns) == 1) {
+			if (nr_conns < 0 || nr_conns > LTTNG_LIVE_MAX_CONNECTIONS) {
+				fprintf(stderr, "[error] Number of data connections "
+					"must be between 0 and %d\n",
+					LTTNG_LIVE_MAX_CONNECTIONS);
+				return -1;
+			}
+			ctx->nr_conns = nr_conns;
+			printf_verbose("Data connections : %d\n", nr_conns);
+		} else if (sscanf(opt, "buffers=%d", &buffers) == 1) {
+			if (buffers < 1) {
+				fprintf(stderr, "[error] Packet buffers cap must "
+					"be at least 1 MiB\n");
+				return -1;
+			}
+			ctx->pool.cap = (uint64_t) buffers << 20;
+			printf_verbose("Packet buffers cap : %d MiB\n", buffers);
+		} else if (!strncmp(opt, "backpressure=",
+				strlen("backpressure="))) {
+			const char *policy = opt + strlen("backpressure=");
+			int i;
+
+			for (i = 0; i < G_N_ELEMENTS(backpressure); i++) {
+				if (!strcmp(policy, backpressure[i]))
+					break;
+			}
+			if (i == G_N_ELEMENTS(backpressure)) {
+				fprintf(stderr, "[error] Backpressure policy must "
+					"be block, drop or skip\n");
+				return -1;
+			}
+			ctx->backpressure = i;
+			printf_verbose("Backpressure : %s\n", policy);
+		} else if (sscanf(opt, "stats=%d", &stats) == 1) {
+			if (stats < 1) {
+				fprintf(stderr, "[error] Statistics period must "
+					"be at least 1 s\n");
+				return -1;
+			}
+			ctx->stats_period = stats;
+			printf_verbose("Statistics period : %d s\n", stats);
+		} else if (sscanf(opt, "reconnect=%d", &reconnect) == 1) {
+			if (reconnect < 1) {
+				fprintf(stderr, "[error] Reconnection timeout "
+					"must be at least 1 s\n");
+				return -1;
+			}
+			ctx->reconnect_timeout = reconnect;
+			printf_verbose("Reconnection timeout : %d s\n", reconnect);
+		} else {
+			fprintf(stderr, "[error] Unknown URL option : %s\n", opt);
+			return -1;
+		}
+	}
+	if (ctx->backpressure != LTTNG_LIVE_BACKPRESSURE_BLOCK
+			&& !ctx->nr_conns) {
+		fprintf(stderr, "[warning] Packets are only dropped when "
+			"received ahead by data connections\n");
+	}
+	return 0;
+}
+
 /*
  * hostname parameter needs to hold MAXNAMLEN chars.
  */
@@ -223,10 +321,16 @@ gboolean g_uint64p_equal(gconstpointer a, gconstpointer b)
 	return TRUE;
 }
 
-static int lttng_live_open_trace_read(const char *path)
+/*
+ * Read the live session at path until it ends, writing its events to
+ * td_write, or as text on stdout if it is NULL.
+ */
+static int lttng_live_open_trace_read(const char *path,
+		struct bt_trace_descriptor *td_write)
 {
 	int ret = 0;
 	struct lttng_live_ctx *ctx;
+	char url[MAXNAMLEN];
 
 	ctx = g_new0(struct lttng_live_ctx, 1);
 	ctx->session = g_new0(struct lttng_live_session, 1);
@@ -238,9 +342,24 @@ static int lttng_live_open_trace_read(const char *path)
 	ctx->session->ctf_traces = g_hash_table_new(g_uint64p_hash,
 			g_uint64p_equal);
 	ctx->port = -1;
+	ctx->latency_target = LTTNG_LIVE_DEFAULT_LATENCY;
+	ctx->output_td = td_write;
 	ctx->session_ids = g_array_new(FALSE, TRUE, sizeof(uint64_t));
+	ctx->requests = g_queue_new();
+	ctx->hup_streams = g_hash_table_new_full(g_str_hash, g_str_equal,
+			g_free, NULL);
+	lttng_live_pool_init(&ctx->pool, LTTNG_LIVE_DEFAULT_POOL_CAP);
 
-	ret = parse_url(path, ctx);
+	if (strlen(path) >= MAXNAMLEN) {
+		ret = -1;
+		goto end_free;
+	}
+	strcpy(url, path);
+	ret = parse_url_options(url, ctx);
+	if (ret < 0) {
+		goto end_free;
+	}
+	ret = parse_url(url, ctx);
 	if (ret < 0) {
 		goto end_free;
 	}
@@ -260,7 +379,7 @@ static int lttng_live_open_trace_read(const char *path)
 	}
 
 	printf_verbose("Listing sessions\n");
-	ret = lttng_live_list_sessions(ctx, path);
+	ret = lttng_live_list_sessions(ctx, url);
 	if (ret < 0) {
 		goto end_free;
 	}
@@ -273,6 +392,9 @@ end_free:
 	g_hash_table_destroy(ctx->session->ctf_traces);
 	g_free(ctx->session);
 	g_free(ctx->session->streams);
+	g_queue_free(ctx->requests);
+	g_hash_table_destroy(ctx->hup_streams);
+	lttng_live_pool_fini(&ctx->pool);
 	g_free(ctx);
 
 	if (lttng_live_should_quit()) {
@@ -307,10 +429,10 @@ struct bt_trace_descriptor *lttng_live_open_trace(const char *path, int flags,
 	/*
 	 * Since we do *everything* in this function, we are skipping
 	 * the output plugin handling that is part of Babeltrace 1.x.
-	 * Therefore, don't expect the --output cmd line option to work.
-	 * This limits the output of lttng-live to stderr and stdout.
+	 * Events are written as text on stdout, bt_lttng_live_read_trace()
+	 * gives them to an output trace instead.
 	 */
-	if (lttng_live_open_trace_read(path) < 0) {
+	if (lttng_live_open_trace_read(path, NULL) < 0) {
 		goto error;
 	}
 	return &pos->trace_descriptor;
@@ -319,6 +441,12 @@ error:
 	return NULL;
 }
 
+int bt_lttng_live_read_trace(const char *path,
+		struct bt_trace_descriptor *td_write)
+{
+	return lttng_live_open_trace_read(path, td_write);
+}
+
 static
 int lttng_live_close_trace(struct bt_trace_descriptor *td)
 {
@@ -0,0 +1,187 @@
+/*
+ * BabelTrace - LTTng live packet buffer pool
+ *
+ * Packets received from the relay daemon are stored in anonymous
+ * mappings, rounded up to a power of two size class. A buffer is taken
+ * from the pool when a packet is received and given back when the
+ * packet seek moves to the next packet of the stream, so that streams
+ * share a bounded amount of memory instead of each keeping a mapping
+ * sized for the largest packet it has ever seen.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <sys/types.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <glib.h>
+
+#include <babeltrace/babeltrace-internal.h>
+#include <babeltrace/mmap-align.h>
+
+#include "lttng-live.h"
+
+static
+unsigned int size_class(size_t len)
+{
+	unsigned int class = 0;
+
+	while (class < LTTNG_LIVE_POOL_NR_CLASSES - 1
+			&& ((size_t) LTTNG_LIVE_POOL_MIN_SIZE << class) < len)
+		class++;
+	return class;
+}
+
+static
+void unmap_buffer(struct lttng_live_pool *pool, struct mmap_align *mma)
+{
+	pool->allocated -= mma->page_aligned_length;
+	if (munmap_align(mma))
+		perror("[error] Unable to unmap packet buffer");
+}
+
+/*
+ * Release free buffers, largest first, until len more bytes fit under
+ * the cap. Called with pool->lock held.
+ */
+static
+void trim_free_buffers(struct lttng_live_pool *pool, uint64_t len)
+{
+	int class;
+
+	for (class = LTTNG_LIVE_POOL_NR_CLASSES - 1; class >= 0; class--) {
+		struct mmap_align *mma;
+
+		while (pool->allocated + len > pool->cap
+				&& (mma = g_queue_pop_head(pool->free[class])))
+			unmap_buffer(pool, mma);
+	}
+}
+
+void lttng_live_pool_init(struct lttng_live_pool *pool, uint64_t cap)
+{
+	int i;
+
+	pthread_mutex_init(&pool->lock, NULL);
+	for (i = 0; i < LTTNG_LIVE_POOL_NR_CLASSES; i++)
+		pool->free[i] = g_queue_new();
+	pool->allocated = 0;
+	pool->cap = cap;
+}
+
+void lttng_live_pool_fini(struct lttng_live_pool *pool)
+{
+	int i;
+
+	for (i = 0; i < LTTNG_LIVE_POOL_NR_CLASSES; i++) {
+		struct mmap_align *mma;
+
+		while ((mma = g_queue_pop_head(pool->free[i])))
+			unmap_buffer(pool, mma);
+		g_queue_free(pool->free[i]);
+	}
+	pthread_mutex_destroy(&pool->lock);
+}
+
+/*
+ * Get a buffer of at least len bytes. The cap is not enforced here:
+ * the packet the reader is waiting for must always be received. Read
+ * ahead is limited by checking lttng_live_pool_full() instead.
+ *
+ * Returns NULL on error.
+ */
+struct mmap_align *lttng_live_pool_get(struct lttng_live_pool *pool,
+		size_t len)
+{
+	unsigned int class = size_class(len);
+	size_t class_size = (size_t) LTTNG_LIVE_POOL_MIN_SIZE << class;
+	struct mmap_align *mma;
+
+	pthread_mutex_lock(&pool->lock);
+	mma = g_queue_pop_head(pool->free[class]);
+	if (mma && mma->length >= len)
+		goto end;
+	if (mma) {
+		/* Beyond the largest class, buffers are sized exactly. */
+		unmap_buffer(pool, mma);
+	}
+	if (len > class_size)
+		class_size = len;
+	trim_free_buffers(pool, class_size);
+	mma = mmap_align(class_size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mma == MAP_FAILED) {
+		perror("[error] mmap error");
+		mma = NULL;
+		goto end;
+	}
+	pool->allocated += mma->page_aligned_length;
+	printf_verbose("Packet buffer pool: %" PRIu64 " bytes mapped\n",
+			pool->allocated);
+end:
+	pthread_mutex_unlock(&pool->lock);
+	return mma;
+}
+
+/*
+ * Give a buffer back. It is kept for reuse unless the pool is over its
+ * cap.
+ */
+void lttng_live_pool_put(struct lttng_live_pool *pool,
+		struct mmap_align *mma)
+{
+	if (!mma)
+		return;
+	pthread_mutex_lock(&pool->lock);
+	if (pool->allocated > pool->cap)
+		unmap_buffer(pool, mma);
+	else
+		g_queue_push_head(pool->free[size_class(mma->length)], mma);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ * Whether buffers in use and kept for reuse have reached the cap.
+ */
+int lttng_live_pool_full(struct lttng_live_pool *pool)
+{
+	int full;
+
+	pthread_mutex_lock(&pool->lock);
+	trim_free_buffers(pool, 0);
+	full = pool->allocated >= pool->cap;
+	pthread_mutex_unlock(&pool->lock);
+	return full;
+}
+
+/*
+ * Bytes mapped, by buffers in use and kept for reuse.
+ */
+uint64_t lttng_live_pool_allocated(struct lttng_live_pool *pool)
+{
+	uint64_t allocated;
+
+	pthread_mutex_lock(&pool->lock);
+	allocated = pool->allocated;
+	pthread_mutex_unlock(&pool->lock);
+	return allocated;
+}
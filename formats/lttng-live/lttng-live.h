@@ -25,7 +25,9 @@
  */
 
 #include <stdint.h>
+#include <pthread.h>
 #include <sys/param.h>
+#include <sys/types.h>
 #include "lttng-viewer-abi.h"
 
 #define LTTNG_DEFAULT_NETWORK_VIEWER_PORT	5344
@@ -34,12 +36,140 @@
 #define LTTNG_LIVE_MINOR			4
 
 /*
- * The lttng-live output file pointer is currently hardcoded to stdout,
- * and is expected to be hardcoded to this by fflush() performed between
- * each packet.
+ * The session list is printed on stdout. Events go to the output trace
+ * given to bt_lttng_live_read_trace(), the text format on stdout if
+ * none.
  */
 #define LTTNG_LIVE_OUTPUT_FP			stdout
 
+/*
+ * Maximum number of GET_NEXT_INDEX and GET_PACKET requests kept in
+ * flight on the control connection. The relay daemon answers the commands of a
+ * connection in order, so responses are matched with a FIFO.
+ */
+#define LTTNG_LIVE_PIPELINE_DEPTH		16
+
+/*
+ * Bounds of the delay between two polls of a relay source with no new
+ * data, in ms. The upper bound is the latency target, which can be set
+ * with the "latency" URL option.
+ */
+#define LTTNG_LIVE_MIN_POLL_DELAY		1
+#define LTTNG_LIVE_DEFAULT_LATENCY		100
+
+/*
+ * Longest delay between two attempts to reconnect to the relay daemon,
+ * in ms. Reconnecting is attempted for the number of seconds given with
+ * the "reconnect" URL option.
+ */
+#define LTTNG_LIVE_RECONNECT_MAX_DELAY		1000
+
+/*
+ * Number of packets an I/O thread may queue ahead for each stream, and
+ * maximum number of data connections.
+ */
+#define LTTNG_LIVE_STREAM_QUEUE_DEPTH		4
+#define LTTNG_LIVE_MAX_CONNECTIONS		64
+
+/*
+ * Packet buffers are rounded up to LTTNG_LIVE_POOL_MIN_SIZE << n bytes.
+ * The default cap of the memory mapped for packets is 64 MiB, it can
+ * be set in MiB with the "buffers" URL option.
+ */
+#define LTTNG_LIVE_POOL_MIN_SIZE		4096
+#define LTTNG_LIVE_POOL_NR_CLASSES		20
+#define LTTNG_LIVE_DEFAULT_POOL_CAP		(64ULL << 20)
+
+/*
+ * What the I/O threads do with a stream whose queue is full, because
+ * the reader is slower than the relay daemon. Set with the
+ * "backpressure" URL option.
+ */
+enum lttng_live_backpressure {
+	LTTNG_LIVE_BACKPRESSURE_BLOCK = 0,	/* Stop receiving ahead */
+	LTTNG_LIVE_BACKPRESSURE_DROP,		/* Drop the oldest packet */
+	LTTNG_LIVE_BACKPRESSURE_SKIP,		/* Keep only the newest packet */
+};
+
+enum lttng_live_request_state {
+	LTTNG_LIVE_REQUEST_NONE = 0,	/* No request in flight */
+	LTTNG_LIVE_REQUEST_SENT,	/* Request sent, response pending */
+	LTTNG_LIVE_REQUEST_RECEIVED,	/* Response received, not consumed */
+};
+
+enum lttng_live_request_type {
+	LTTNG_LIVE_REQUEST_INDEX = 0,	/* GET_NEXT_INDEX */
+	LTTNG_LIVE_REQUEST_PACKET,	/* GET_PACKET */
+};
+
+/* Command in flight on the control connection. */
+struct lttng_live_request {
+	struct lttng_live_viewer_stream *stream;
+	enum lttng_live_request_type type;
+};
+
+enum lttng_live_io_state {
+	LTTNG_LIVE_IO_INDEX = 0,	/* Next index to request */
+	LTTNG_LIVE_IO_PACKET,		/* Packet of io_index to request */
+	LTTNG_LIVE_IO_PAUSED,		/* Waiting for the reader */
+	LTTNG_LIVE_IO_HUP,		/* Stream hung up */
+};
+
+struct mmap_align;
+struct ctf_stream_pos;
+struct bt_stream_pos;
+struct bt_trace_descriptor;
+
+/*
+ * Response received by an I/O thread for a stream, consumed in order
+ * by the packet seek of that stream.
+ */
+struct lttng_live_packet {
+	/* GET_NEXT_INDEX response if set, GET_PACKET response otherwise. */
+	int is_index;
+	struct lttng_viewer_index index;	/* As received */
+	uint32_t status;			/* GET_PACKET status */
+	uint32_t flags;				/* GET_PACKET flags */
+	struct mmap_align *mma;			/* Packet data, or NULL */
+	/* Packets dropped before this index, set when popped. */
+	uint64_t dropped;
+};
+
+struct lttng_live_stream_stats {
+	uint64_t lag;			/* Packets received, not consumed */
+	uint64_t buffered_bytes;	/* Size of those packets */
+	uint64_t dropped;		/* Packets dropped by backpressure */
+};
+
+/*
+ * Packet buffers shared by all the streams, see lttng-live-pool.c.
+ */
+struct lttng_live_pool {
+	pthread_mutex_t lock;
+	/* Buffers kept for reuse, per size class. */
+	GQueue *free[LTTNG_LIVE_POOL_NR_CLASSES];
+	uint64_t allocated;		/* Bytes mapped, in use or free */
+	uint64_t cap;
+};
+
+/*
+ * Data connection to the relay daemon, served by its own I/O thread.
+ * The control connection keeps carrying every other command.
+ */
+struct lttng_live_conn {
+	struct lttng_live_ctx *ctx;
+	int sock;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t io_cond;		/* Work available for the I/O thread */
+	pthread_cond_t ready_cond;	/* Packets available for the reader */
+	/* Streams served by this connection, protected by lock. */
+	GPtrArray *streams;
+	unsigned int next_stream;	/* Round-robin start */
+	int quit;
+	int error;
+};
+
 struct lttng_live_ctx {
 	char traced_hostname[MAXNAMLEN];
 	char session_name[MAXNAMLEN];
@@ -49,22 +179,101 @@ struct lttng_live_ctx {
 	/* Protocol version to use for this connection. */
 	uint32_t major;
 	uint32_t minor;
+	/* Maximum delay between two polls of an idle source, in ms. */
+	int latency_target;
 	struct lttng_live_session *session;
 	struct bt_context *bt_ctx;
+	/* Output trace to write events to, NULL for the default. */
+	struct bt_trace_descriptor *output_td;
+	/* Position events are written to. */
+	struct bt_stream_pos *output;
 	GArray *session_ids;
+	/* Requests in flight on the control connection, in send order. */
+	GQueue *requests;
+	/* Data connections, none if the control connection reads the data. */
+	int nr_conns;
+	struct lttng_live_conn *conns;
+	struct lttng_live_pool pool;
+	enum lttng_live_backpressure backpressure;
+	/* Period of the statistics report, in s, 0 if disabled. */
+	int stats_period;
+	int64_t next_stats;		/* us */
+	unsigned int stats_countdown;	/* Events until next time check */
+	uint64_t lost_events;		/* Discarded or dropped, so far */
+	/* Time allowed to reconnect to the relay daemon, in s, 0 if disabled. */
+	int reconnect_timeout;
+	int reconnecting;
+	uint64_t reconnects;
+	/* Streams known before reconnecting, by name, while attaching again. */
+	GHashTable *resume_streams;
+	/* Names of the streams which have hung up, not to be read again. */
+	GHashTable *hup_streams;
 };
 
 struct lttng_live_viewer_stream {
 	uint64_t id;
-	uint64_t mmap_size;
 	uint64_t ctf_stream_id;
-	FILE *metadata_fp_write;
-	ssize_t metadata_len;
+	/* Metadata received and not parsed yet, NULL when there is none. */
+	GString *metadata;
 	int metadata_flag;
 	int data_pending;
 	struct lttng_live_session *session;
 	struct lttng_live_ctf_trace *ctf_trace;
 	struct lttng_viewer_index current_index;
+	/* Index received ahead of its use by the packet seek. */
+	struct lttng_viewer_index next_index;
+	enum lttng_live_request_state index_state;
+	int index_prefetched;
+	struct lttng_live_request index_request;
+	/* Packet received ahead of its use, header in host byte order. */
+	struct lttng_viewer_trace_packet next_packet;
+	struct mmap_align *next_packet_mma;
+	uint64_t next_packet_offset;
+	enum lttng_live_request_state packet_state;
+	struct lttng_live_request packet_request;
+	/* Next delay before asking again for an index, in ms. */
+	int poll_delay;
+	/* Data connection serving this stream, if any. */
+	struct lttng_live_conn *conn;
+	/* Responses queued by the I/O thread, protected by conn->lock. */
+	GQueue *packets;
+	/* Response being consumed by the packet seek. */
+	struct lttng_live_packet *packet;
+	/* I/O thread state, see lttng-live-io.c. */
+	enum lttng_live_io_state io_state;
+	struct lttng_viewer_index io_index;
+	int io_index_queued;
+	int64_t io_next_poll;		/* us */
+	/* Position of the stream in the trace being read. */
+	struct ctf_stream_pos *pos;
+	/*
+	 * Accounting, protected by conn->lock when the stream is served
+	 * by a data connection.
+	 */
+	uint64_t packets_received;
+	uint64_t packets_consumed;
+	uint64_t buffered_bytes;
+	uint64_t packets_dropped;
+	uint64_t dropped_pending;	/* Not seen by the reader yet */
+	/* Added to the discarded events count of the relay daemon. */
+	uint64_t events_discarded_offset;
+	/*
+	 * Last packet handed to the reader. After a reconnection, the
+	 * relay daemon serves the streams again from their beginning:
+	 * the indexes up to the last packet received are skipped, along
+	 * with the metadata already parsed.
+	 */
+	uint64_t consumed_offset;
+	uint64_t consumed_size;		/* Bits */
+	uint64_t consumed_timestamp_end;
+	int consumed;
+	uint64_t skip_offset;
+	uint64_t skip_timestamp_end;
+	uint64_t skip_next_offset;	/* Offset of the packet expected next */
+	int skipping;
+	uint32_t skipped_flags;		/* Flags of the indexes skipped */
+	uint64_t metadata_skip;		/* Bytes */
+	/* "path/channel", which identifies the stream across reconnections. */
 	char path[PATH_MAX];
 };
 
@@ -73,6 +282,8 @@ struct lttng_live_session {
 	uint64_t stream_count;
 	struct lttng_live_ctx *ctx;
 	struct lttng_live_viewer_stream *streams;
+	/* Set when a data stream hangs up, until hung up traces are removed. */
+	int streams_hup;
 	/* HashTable mapping trace_ids to ptrs to struct lttng_live_ctf_trace */
 	GHashTable *ctf_traces;
 };
@@ -82,6 +293,7 @@ struct lttng_live_ctf_trace {
 	struct lttng_live_viewer_stream *metadata_stream;
 	GPtrArray *streams;
 	FILE *metadata_fp;
+	uint64_t metadata_size;		/* Metadata parsed, in bytes */
 	struct bt_trace_handle *handle;
 	int trace_id;
 	int in_use;
@@ -99,9 +311,44 @@ struct lttng_live_relay_session {
 int lttng_live_connect_viewer(struct lttng_live_ctx *ctx);
 int lttng_live_establish_connection(struct lttng_live_ctx *ctx);
 int lttng_live_list_sessions(struct lttng_live_ctx *ctx, const char *path);
-int lttng_live_attach_session(struct lttng_live_ctx *ctx, uint64_t id);
 int lttng_live_read(struct lttng_live_ctx *ctx);
-int lttng_live_get_new_streams(struct lttng_live_ctx *ctx, uint64_t id);
 int lttng_live_should_quit(void);
+int lttng_live_open_connection(struct lttng_live_ctx *ctx, int *sock);
+ssize_t lttng_live_recv(int fd, void *buf, size_t len);
+ssize_t lttng_live_send(int fd, const void *buf, size_t len);
+int lttng_live_reconnect(struct lttng_live_ctx *ctx);
+
+int lttng_live_start_connections(struct lttng_live_ctx *ctx);
+void lttng_live_stop_connections(struct lttng_live_ctx *ctx);
+void lttng_live_conn_add_stream(struct lttng_live_ctx *ctx,
+		struct lttng_live_viewer_stream *stream);
+void lttng_live_conn_remove_stream(struct lttng_live_ctx *ctx,
+		struct lttng_live_viewer_stream *stream);
+void lttng_live_conn_clear_streams(struct lttng_live_ctx *ctx);
+void lttng_live_detach_connections(struct lttng_live_ctx *ctx,
+		GPtrArray *streams);
+void lttng_live_drop_detached(struct lttng_live_ctx *ctx,
+		struct lttng_live_viewer_stream *stream);
+int lttng_live_skip_index(struct lttng_live_viewer_stream *stream,
+		struct lttng_viewer_index *index);
+struct lttng_live_packet *lttng_live_pop_packet(
+		struct lttng_live_viewer_stream *stream);
+void lttng_live_resume_stream(struct lttng_live_viewer_stream *stream);
+int lttng_live_stream_ready(struct lttng_live_viewer_stream *stream);
+int64_t lttng_live_now_us(void);
+void lttng_live_get_stream_stats(struct lttng_live_viewer_stream *stream,
+		struct lttng_live_stream_stats *stats);
+void lttng_live_print_stats(struct lttng_live_ctx *ctx, FILE *fp);
+void lttng_live_packet_free(struct lttng_live_ctx *ctx,
+		struct lttng_live_packet *packet);
+
+void lttng_live_pool_init(struct lttng_live_pool *pool, uint64_t cap);
+void lttng_live_pool_fini(struct lttng_live_pool *pool);
+struct mmap_align *lttng_live_pool_get(struct lttng_live_pool *pool,
+		size_t len);
+void lttng_live_pool_put(struct lttng_live_pool *pool,
+		struct mmap_align *mma);
+int lttng_live_pool_full(struct lttng_live_pool *pool);
+uint64_t lttng_live_pool_allocated(struct lttng_live_pool *pool);
 
 #endif /* _LTTNG_LIVE_H */
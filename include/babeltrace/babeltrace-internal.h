@@ -206,6 +206,9 @@ extern int64_t opt_clock_offset;
 extern int64_t opt_clock_offset_ns;
 extern int babeltrace_ctf_console_output;
 extern char *opt_debug_info_dir;
+extern char *opt_debug_info_cache_dir;
+extern int opt_debug_info_jobs;
 extern char *opt_debug_info_target_prefix;
+extern char *opt_metadata_cache_dir;
 
 #endif
@@ -29,6 +29,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <pthread.h>
 #include <gelf.h>
 #include <elfutils/libdw.h>
 #include <babeltrace/babeltrace-internal.h>
@@ -38,19 +39,39 @@
 #define BUILD_ID_SUBDIR ".build-id/"
 #define BUILD_ID_SUFFIX ".debug"
 
-struct bin_info {
-	/* Base virtual memory address. */
-	uint64_t low_addr;
-	/* Upper bound of exec address space. */
-	uint64_t high_addr;
-	/* Size of exec address space. */
-	uint64_t memsz;
+struct bin_info_dwarf_index;
+struct bin_info_elf_symbols;
+
+/*
+ * Files and debug info of an executable, shared by the bin_info
+ * instances of all the processes mapping it.
+ */
+struct bin_info_data {
+	/* Key in the registry of shared data, and reference count. */
+	char *key;
+	unsigned long refcount;
+	/* Serializes the lookups, which read the files lazily. */
+	pthread_mutex_t lock;
 	/* Paths to ELF and DWARF files. */
 	char *elf_path;
 	char *dwarf_path;
-	/* libelf and libdw objects representing the files. */
+	/*
+	 * libelf and libdw objects representing the files. The DWARF
+	 * info is released once its address tables are built.
+	 */
 	Elf *elf_file;
 	Dwarf *dwarf_info;
+	/*
+	 * Address tables of the DWARF info, built on the first lookup;
+	 * owned by bin_info_data.
+	 */
+	struct bin_info_dwarf_index *dwarf_index;
+	/*
+	 * Function symbols of the ELF file sorted by address, built on
+	 * the first lookup of an executable without DWARF info; owned
+	 * by bin_info_data.
+	 */
+	struct bin_info_elf_symbols *elf_symbols;
 	/* Optional build ID info. */
 	uint8_t *build_id;
 	size_t build_id_len;
@@ -60,8 +81,6 @@ struct bin_info {
 	/* FDs to ELF and DWARF files. */
 	int elf_fd;
 	int dwarf_fd;
-	/* Denotes whether the executable is position independent code. */
-	bool is_pic:1;
 	/*
 	 * Denotes whether the executable only has ELF symbols and no
 	 * DWARF info.
@@ -69,11 +88,36 @@ struct bin_info {
 	bool is_elf_only:1;
 };
 
+struct bin_info {
+	/* Base virtual memory address. */
+	uint64_t low_addr;
+	/* Upper bound of exec address space. */
+	uint64_t high_addr;
+	/* Size of exec address space. */
+	uint64_t memsz;
+	/* Path to the ELF file, owned by data. */
+	const char *elf_path;
+	/* Shared files and debug info of the executable. */
+	struct bin_info_data *data;
+	/* Denotes whether the executable is position independent code. */
+	bool is_pic:1;
+};
+
 struct source_location {
 	uint64_t line_no;
 	char *filename;
 };
 
+/*
+ * Subroutine inlined at an address, and the source location within it.
+ */
+struct inline_frame {
+	char *func_name;
+	/* 0 and NULL if unknown. */
+	uint64_t line_no;
+	char *filename;
+};
+
 /**
  * Initializes the bin_info framework. Call this before calling
  * anything else.
@@ -110,6 +154,9 @@ void bin_info_destroy(struct bin_info *bin);
 /**
  * Sets the build ID information for a given bin_info instance.
  *
+ * The instance then shares its data with the other instances of the
+ * same executable and build ID.
+ *
  * @param bin		The bin_info instance for which to set
  *			the build ID
  * @param build_id	Array of bytes containing the actual ID
@@ -132,6 +179,29 @@ int bin_info_set_build_id(struct bin_info *bin, uint8_t *build_id,
 BT_HIDDEN
 int bin_info_set_debug_link(struct bin_info *bin, char *filename, uint32_t crc);
 
+/**
+ * Reads the ELF or DWARF info of a given bin_info instance and builds
+ * its address tables, as its first lookup would, so that lookups only
+ * search them afterwards.
+ *
+ * This may be called from another thread than the one doing the
+ * lookups, provided the bin_info instance is not used meanwhile.
+ *
+ * @param bin		The bin_info instance to prepare
+ */
+BT_HIDDEN
+void bin_info_prefetch(struct bin_info *bin);
+
+/**
+ * Returns whether the lookups of a given bin_info instance found it
+ * only has ELF symbols, and no DWARF info.
+ *
+ * @param bin		bin_info instance
+ * @returns		true if \p bin only has ELF symbols
+ */
+BT_HIDDEN
+bool bin_info_is_elf_only(struct bin_info *bin);
+
 /**
  * Returns whether or not the given bin info \p bin contains the
  * address \p addr.
@@ -195,6 +265,34 @@ int bin_info_lookup_function_name(struct bin_info *bin, uint64_t addr,
 BT_HIDDEN
 int bin_info_lookup_source_location(struct bin_info *bin, uint64_t addr,
 		struct source_location **src_loc);
+
+/**
+ * Get the subroutines inlined at a given address within an executable,
+ * innermost first, each with the source location of the address within
+ * it: the call site of the next one, or the line at the address for
+ * the innermost one.
+ *
+ * The source location found by bin_info_lookup_source_location() is
+ * then the call site of the outermost one, within the function they
+ * are inlined in.
+ *
+ * On success, the out parameters `frames` and `nr_frames` are set,
+ * `frames` being NULL if the address is not within an inlined
+ * subroutine. The ownership of `frames` is passed to the caller. On
+ * failure, they remain unchanged.
+ *
+ * @param bin		bin_info instance for the executable containing
+ *			the address
+ * @param addr		Virtual memory address for which to find the
+ *			inlined subroutines
+ * @param frames	Out parameter, the inlined subroutines
+ * @param nr_frames	Out parameter, the number of inlined subroutines
+ * @returns		0 on success, -1 on failure
+ */
+BT_HIDDEN
+int bin_info_lookup_inline_frames(struct bin_info *bin, uint64_t addr,
+		struct inline_frame **frames, unsigned int *nr_frames);
+
 /**
  * Get a string representing the location within the binary of a given
  * address.
@@ -223,4 +321,14 @@ int bin_info_get_bin_loc(struct bin_info *bin, uint64_t addr, char **bin_loc);
 BT_HIDDEN
 void source_location_destroy(struct source_location *src_loc);
 
+/**
+ * Destroy the given inline_frame instances
+ *
+ * @param frames	Array of inline_frame instances to destroy
+ * @param nr_frames	Number of instances in \p frames
+ */
+BT_HIDDEN
+void inline_frames_destroy(struct inline_frame *frames,
+		unsigned int nr_frames);
+
 #endif	/* _BABELTRACE_BIN_INFO_H */
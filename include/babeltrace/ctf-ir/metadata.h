@@ -43,6 +43,8 @@ struct ctf_event_declaration;
 struct ctf_clock;
 struct ctf_callsite;
 struct ctf_scanner;
+struct ctf_metadata_cache_entry;
+struct declaration_arena;
 
 struct ctf_stream_packet_limits {
 	uint64_t begin;
@@ -213,6 +215,8 @@ struct ctf_trace {
 
 	struct declaration_struct *packet_header_decl;
 	struct ctf_scanner *scanner;
+	struct ctf_metadata_cache_entry *metadata_cache;	/* Shared declarations, on-disk traces only */
+	struct declaration_arena *declaration_arena;	/* Owns the declarations constructed for this trace */
 	int restart_root_decl;
 
 	uint64_t major;
@@ -38,6 +38,24 @@ struct ctf_event_definition;
 #include <stddef.h>
 #include <babeltrace/babeltrace-internal.h>
 
+/*
+ * Maximum number of instruction pointers for which debug information is
+ * kept per process; the least recently used one is evicted beyond that.
+ */
+#define DEBUG_INFO_IP_CACHE_SIZE	16384
+
+/*
+ * Subroutine inlined at the address of a debug_info_source.
+ */
+struct debug_info_inline_frame {
+	/* Strings are owned by debug_info_source. */
+	char *func;
+	uint64_t line_no;
+	char *src_path;
+	/* short_src_path points inside src_path, no need to free. */
+	const char *short_src_path;
+};
+
 struct debug_info_source {
 	/* Strings are owned by debug_info_source. */
 	char *func;
@@ -53,6 +71,21 @@ struct debug_info_source {
 	 * relative (+0x4321).
 	 */
 	char *bin_loc;
+	/*
+	 * Subroutines inlined at the address, innermost first; func and
+	 * src_path are the ones of the function they are inlined in.
+	 */
+	struct debug_info_inline_frame *inline_frames;
+	unsigned int nr_inline_frames;
+};
+
+/*
+ * Statistics of the IP cache of a debug_info instance.
+ */
+struct debug_info_stats {
+	uint64_t ip_cache_hits;
+	uint64_t ip_cache_misses;
+	uint64_t ip_cache_evictions;
 };
 
 BT_HIDDEN
@@ -65,6 +98,27 @@ BT_HIDDEN
 void debug_info_handle_event(struct debug_info *debug_info,
 		struct ctf_event_definition *event);
 
+/*
+ * Debug info of an address of a process, owned by debug_info and valid
+ * until the next event is handled; NULL if not found.
+ */
+BT_HIDDEN
+struct debug_info_source *debug_info_query(struct debug_info *debug_info,
+		int64_t vpid, uint64_t ip);
+
+/*
+ * Debug info of the addresses of a call stack of a process, set in
+ * srcs in the same order, as debug_info_query() would.
+ */
+BT_HIDDEN
+void debug_info_query_stack(struct debug_info *debug_info, int64_t vpid,
+		const uint64_t *ips, unsigned int nr_ips,
+		struct debug_info_source **srcs);
+
+BT_HIDDEN
+void debug_info_get_stats(struct debug_info *debug_info,
+		struct debug_info_stats *stats);
+
 #else /* ifdef ENABLE_DEBUG_INFO */
 
 static inline
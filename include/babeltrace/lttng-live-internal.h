@@ -0,0 +1,39 @@
+#ifndef _BABELTRACE_LTTNG_LIVE_INTERNAL_H
+#define _BABELTRACE_LTTNG_LIVE_INTERNAL_H
+
+/*
+ * Babeltrace - LTTng live reader, for the converter
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <babeltrace/format.h>
+
+/*
+ * Read the live session at the lttng-live URL path to its end, writing
+ * its events to the output trace td_write, opened in O_RDWR mode.
+ * Live traces are read as they are produced, so they can't be opened
+ * beforehand and iterated on like other formats.
+ *
+ * Returns 0 on success, a negative value on error.
+ */
+int bt_lttng_live_read_trace(const char *path,
+		struct bt_trace_descriptor *td_write);
+
+#endif /* _BABELTRACE_LTTNG_LIVE_INTERNAL_H */
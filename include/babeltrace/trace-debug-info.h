@@ -34,6 +34,43 @@
 #include <babeltrace/ctf-text/types.h>
 #include <stdbool.h>
 
+/*
+ * Print the subroutines inlined at the address of a call stack,
+ * innermost first.
+ */
+static inline
+void ctf_text_write_debug_info_inline_frames(struct ctf_text_stream_pos *pos,
+		struct debug_info_source *debug_info_src)
+{
+	unsigned int i;
+
+	fprintf(pos->fp, ", inlined = [");
+
+	for (i = 0; i < debug_info_src->nr_inline_frames; i++) {
+		struct debug_info_inline_frame *frame =
+				&debug_info_src->inline_frames[i];
+
+		fprintf(pos->fp, "%s {", i ? "," : "");
+
+		if (frame->func) {
+			fprintf(pos->fp, " func = \"%s\"", frame->func);
+		}
+
+		if (frame->src_path) {
+			fprintf(pos->fp, "%s src = \"%s:%" PRIu64 "\"",
+					frame->func ? "," : "",
+					opt_debug_info_full_path ?
+					frame->src_path :
+					frame->short_src_path,
+					frame->line_no);
+		}
+
+		fprintf(pos->fp, " }");
+	}
+
+	fprintf(pos->fp, " ]");
+}
+
 static inline
 void ctf_text_integer_write_debug_info(struct bt_stream_pos *ppos,
 		struct bt_definition *definition)
@@ -83,6 +120,12 @@ void ctf_text_integer_write_debug_info(struct bt_stream_pos *ppos,
 						debug_info_src->line_no);
 			}
 
+			if (integer_definition->debug_info_stack_frame &&
+					debug_info_src->nr_inline_frames) {
+				ctf_text_write_debug_info_inline_frames(pos,
+						debug_info_src);
+			}
+
 			fprintf(pos->fp, " }");
 		}
 	}
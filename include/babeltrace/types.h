@@ -49,6 +49,8 @@ struct bt_definition;
 struct ctf_clock;
 
 /* type scope */
+struct declaration_arena;
+
 struct declaration_scope {
 	/* Hash table mapping type name GQuark to "struct declaration" */
 	/* Used for both typedef and typealias. */
@@ -60,6 +62,7 @@ struct declaration_scope {
 	/* Hash table mapping enum name GQuark to "struct type_enum" */
 	GHashTable *enum_declarations;
 	struct declaration_scope *parent_scope;
+	struct declaration_arena *arena;	/* Owner, NULL if freed explicitly */
 };
 
 /* definition scope */
@@ -82,6 +85,7 @@ struct bt_declaration {
 	enum bt_ctf_type_id id;
 	size_t alignment;	/* type alignment, in bits */
 	int ref;		/* number of references to the type */
+	struct declaration_arena *arena;	/* owner, NULL if reference counted */
 	/*
 	 * declaration_free called with declaration ref is decremented to 0.
 	 */
@@ -119,6 +123,8 @@ struct bt_stream_pos {
 			struct bt_trace_descriptor *trace);
 	int (*post_trace_cb)(struct bt_stream_pos *pos,
 			struct bt_trace_descriptor *trace);
+	/* Write out buffered output, optional. */
+	int (*flush_cb)(struct bt_stream_pos *pos);
 	struct bt_trace_descriptor *trace;
 };
 
@@ -167,9 +173,15 @@ struct definition_integer {
 	 *
 	 * This is extended debug informations set by the CTF input plugin
 	 * itself when available. If it's set, then this integer definition
-	 * is the "_ip" field of the stream event context.
+	 * is the "_ip" field of the stream event context, or an address of
+	 * its "_callstack_user" call stack.
 	 */
 	struct debug_info_source *debug_info_src;
+	/*
+	 * Whether this integer definition is an address of a call stack,
+	 * printed along with the subroutines inlined at it.
+	 */
+	int debug_info_stack_frame;
 #endif
 };
 
@@ -355,8 +367,14 @@ struct declaration_enum *
 	bt_lookup_enum_declaration(GQuark enum_name,
 			        struct declaration_scope *scope);
 
+/*
+ * Child scopes belong to the declaration arena of their parent scope,
+ * if any.
+ */
 struct declaration_scope *
 	bt_new_declaration_scope(struct declaration_scope *parent_scope);
+struct declaration_scope *
+	bt_new_root_declaration_scope(struct declaration_arena *arena);
 void bt_free_declaration_scope(struct declaration_scope *scope);
 
 /*
@@ -387,13 +405,46 @@ int compare_definition_path(struct bt_definition *definition, GQuark path)
 void bt_declaration_ref(struct bt_declaration *declaration);
 void bt_declaration_unref(struct bt_declaration *declaration);
 
+/*
+ * Declaration arenas.
+ *
+ * A declaration arena owns the declarations and declaration scopes
+ * created in it, along with their hash tables and arrays, and releases
+ * them all at once when it is destroyed. References to declarations of
+ * an arena are not counted, and freeing their scopes has no effect:
+ * the arena must outlive every definition and every user of its
+ * declarations. Declarations are created in the arena of the scope
+ * they are declared in, or of the declaration they extend; integer,
+ * floating point and string declarations take their arena explicitly.
+ * A NULL arena gives reference counted declarations.
+ */
+struct declaration_arena *bt_declaration_arena_create(void);
+void bt_declaration_arena_destroy(struct declaration_arena *arena);
+/* Allocate len bytes of zeroed memory, owned by the arena. */
+void *bt_declaration_arena_alloc(struct declaration_arena *arena, size_t len);
+GHashTable *bt_declaration_arena_hash_table_new(
+		struct declaration_arena *arena,
+		GHashFunc hash_func, GEqualFunc key_equal_func,
+		GDestroyNotify key_destroy_func,
+		GDestroyNotify value_destroy_func);
+GArray *bt_declaration_arena_array_new(struct declaration_arena *arena,
+		gboolean clear, guint element_size, guint reserved_size);
+
+/*
+ * Allocate zeroed memory for a declaration structure of len bytes,
+ * which must start with its struct bt_declaration, from the arena if
+ * not NULL.
+ */
+void *bt_declaration_alloc(struct declaration_arena *arena, size_t len);
+
 void bt_definition_ref(struct bt_definition *definition);
 void bt_definition_unref(struct bt_definition *definition);
 
 struct declaration_integer *bt_integer_declaration_new(size_t len, int byte_order,
 				  int signedness, size_t alignment,
 				  int base, enum ctf_string_encoding encoding,
-				  struct ctf_clock *clock);
+				  struct ctf_clock *clock,
+				  struct declaration_arena *arena);
 uint64_t bt_get_unsigned_int(const struct bt_definition *field);
 int64_t bt_get_signed_int(const struct bt_definition *field);
 int bt_get_int_signedness(const struct bt_definition *field);
@@ -408,7 +459,8 @@ enum ctf_string_encoding bt_get_int_encoding(const struct bt_definition *field);
  */
 struct declaration_float *bt_float_declaration_new(size_t mantissa_len,
 				  size_t exp_len, int byte_order,
-				  size_t alignment);
+				  size_t alignment,
+				  struct declaration_arena *arena);
 
 /*
  * A GQuark can be translated to/from strings with g_quark_from_string() and
@@ -446,7 +498,8 @@ struct declaration_enum *
 	bt_enum_declaration_new(struct declaration_integer *integer_declaration);
 
 struct declaration_string *
-	bt_string_declaration_new(enum ctf_string_encoding encoding);
+	bt_string_declaration_new(enum ctf_string_encoding encoding,
+				  struct declaration_arena *arena);
 char *bt_get_string(const struct bt_definition *field);
 enum ctf_string_encoding bt_get_string_encoding(const struct bt_definition *field);
 
@@ -28,12 +28,13 @@
 
 #include <fcntl.h>
 #include <math.h>
-#include <libgen.h>
 #include <stdio.h>
 #include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <dwarf.h>
 #include <glib.h>
 #include <babeltrace/dwarf.h>
@@ -42,6 +43,7 @@
 #include <babeltrace/babeltrace-internal.h>
 #include <babeltrace/utils.h>
 #include <errno.h>
+#include <pthread.h>
 
 /*
  * An address printed in hex is at most 20 bytes (16 for 64-bits +
@@ -50,6 +52,152 @@
  */
 #define ADDR_STR_LEN 20
 
+/*
+ * DWARF index images start with this magic, and are named after the
+ * binary they describe followed by this suffix in the cache directory.
+ */
+#define DWARF_INDEX_MAGIC "BTDWIDX"
+#define DWARF_INDEX_VERSION 1
+#define DWARF_INDEX_BYTE_ORDER 0x01020304
+#define DWARF_INDEX_SUFFIX ".idx"
+
+/*
+ * Address range of a function or inlined subroutine in the DWARF info.
+ */
+struct bin_info_addr_range {
+	uint64_t start;
+	uint64_t end;
+	/* Index of the function or inlined subroutine. */
+	uint32_t index;
+	/* Position in the DWARF info, to order ranges of a same start. */
+	uint32_t order;
+};
+
+/*
+ * Strings are offsets in the string table of the DWARF index, 0 for
+ * none.
+ */
+struct bin_info_dwarf_func {
+	uint64_t low_pc;
+	uint32_t name;
+	uint32_t padding;
+};
+
+struct bin_info_dwarf_inline {
+	uint64_t call_line;
+	uint32_t name;
+	uint32_t call_file;
+};
+
+struct bin_info_dwarf_line {
+	uint64_t addr;
+	uint32_t filename;
+	int32_t line_no;
+	uint32_t order;
+	uint32_t padding;
+};
+
+/*
+ * Header of a DWARF index image. It is followed by the tables of
+ * enum dwarf_index_table, in that order and each aligned on 8 bytes.
+ * An image is the same in memory and in the cache directory.
+ */
+struct bin_info_dwarf_index_header {
+	char magic[8];
+	uint32_t version;
+	/* DWARF_INDEX_BYTE_ORDER in the byte order of the image. */
+	uint32_t byte_order;
+	uint64_t func_count;
+	uint64_t func_range_count;
+	uint64_t inline_count;
+	uint64_t inline_depth_count;
+	uint64_t inline_range_count;
+	uint64_t line_count;
+	uint64_t strtab_len;
+};
+
+enum dwarf_index_table {
+	/* Functions, and their ranges sorted by address. */
+	DWARF_INDEX_FUNCS,
+	DWARF_INDEX_FUNC_RANGES,
+	/* Inlined subroutines. */
+	DWARF_INDEX_INLINES,
+	/*
+	 * Index of the first range of each inlining depth in the
+	 * inlined subroutine ranges, plus the range count. Depth 0 is
+	 * the one of the subroutines inlined directly in a function.
+	 */
+	DWARF_INDEX_INLINE_DEPTH_STARTS,
+	/* Ranges of the inlined subroutines by depth, each sorted. */
+	DWARF_INDEX_INLINE_RANGES,
+	/* Lines sorted by address. */
+	DWARF_INDEX_LINES,
+	/* Null-terminated strings, starting with an empty one. */
+	DWARF_INDEX_STRTAB,
+	DWARF_INDEX_TABLE_COUNT,
+};
+
+struct bin_info_dwarf_index {
+	/* Image of the index, either allocated or mapped. */
+	void *image;
+	size_t image_len;
+	bool mapped;
+	const struct bin_info_dwarf_index_header *header;
+	const struct bin_info_dwarf_func *funcs;
+	const struct bin_info_addr_range *func_ranges;
+	const struct bin_info_dwarf_inline *inlines;
+	const uint64_t *inline_depth_starts;
+	const struct bin_info_addr_range *inline_ranges;
+	const struct bin_info_dwarf_line *lines;
+	const char *strtab;
+};
+
+static
+void bin_info_dwarf_index_destroy(struct bin_info_dwarf_index *dwarf_index)
+{
+	if (!dwarf_index) {
+		return;
+	}
+
+	if (dwarf_index->mapped) {
+		munmap(dwarf_index->image, dwarf_index->image_len);
+	} else {
+		g_free(dwarf_index->image);
+	}
+
+	g_free(dwarf_index);
+}
+
+/*
+ * Function symbol of an ELF symbol table.
+ */
+struct bin_info_elf_symbol {
+	uint64_t addr;
+	/* Offset of the name in the string table of the symbols. */
+	uint32_t name;
+	/* Index in the symbol table, the first of aliases being kept. */
+	uint32_t index;
+};
+
+struct bin_info_elf_symbols {
+	/* Function symbols sorted by address, one per address. */
+	struct bin_info_elf_symbol *syms;
+	size_t nr_syms;
+	/* Section index of the string table of the symbols. */
+	size_t strtab;
+};
+
+static
+void bin_info_elf_symbols_destroy(struct bin_info_elf_symbols *elf_symbols)
+{
+	if (!elf_symbols) {
+		return;
+	}
+
+	g_free(elf_symbols->syms);
+	g_free(elf_symbols);
+}
+
 BT_HIDDEN
 int bin_info_init(void)
 {
@@ -64,11 +212,168 @@ int bin_info_init(void)
 	return ret;
 }
 
+/*
+ * Registry of the data shared by the bin_info instances of a same
+ * executable, mapped by different processes or traces.
+ *
+ * Hash table: key (see bin_info_data_get_key()) to bin_info_data.
+ */
+static GHashTable *bin_info_registry;
+static pthread_mutex_t bin_info_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Key of an executable in the registry: its build ID in hex, if known,
+ * and its path. The path is part of the key even with a build ID so
+ * that the files read are the ones at the path given by the trace.
+ */
+static
+char *bin_info_data_get_key(const char *elf_path, const uint8_t *build_id,
+		size_t build_id_len)
+{
+	GString *key = g_string_new(NULL);
+	size_t i;
+
+	for (i = 0; build_id && i < build_id_len; ++i) {
+		g_string_append_printf(key, "%02x", build_id[i]);
+	}
+
+	g_string_append_c(key, '/');
+	g_string_append(key, elf_path);
+
+	return g_string_free(key, FALSE);
+}
+
+static
+void bin_info_data_destroy(struct bin_info_data *data)
+{
+	if (!data) {
+		return;
+	}
+
+	bin_info_dwarf_index_destroy(data->dwarf_index);
+	bin_info_elf_symbols_destroy(data->elf_symbols);
+	dwarf_end(data->dwarf_info);
+
+	free(data->elf_path);
+	free(data->dwarf_path);
+	free(data->build_id);
+	free(data->dbg_link_filename);
+	g_free(data->key);
+
+	elf_end(data->elf_file);
+
+	if (data->elf_fd >= 0) {
+		close(data->elf_fd);
+	}
+	if (data->dwarf_fd >= 0) {
+		close(data->dwarf_fd);
+	}
+
+	pthread_mutex_destroy(&data->lock);
+	g_free(data);
+}
+
+/*
+ * Get a reference to the shared data of the executable at elf_path
+ * with the given build ID, if any, creating it if it is not in the
+ * registry yet.
+ */
+static
+struct bin_info_data *bin_info_data_get(const char *elf_path,
+		const uint8_t *build_id, size_t build_id_len)
+{
+	struct bin_info_data *data = NULL;
+	char *key;
+
+	key = bin_info_data_get_key(elf_path, build_id, build_id_len);
+	if (!key) {
+		return NULL;
+	}
+
+	pthread_mutex_lock(&bin_info_registry_lock);
+	if (!bin_info_registry) {
+		bin_info_registry = g_hash_table_new(g_str_hash, g_str_equal);
+		if (!bin_info_registry) {
+			goto error;
+		}
+	}
+
+	data = g_hash_table_lookup(bin_info_registry, key);
+	if (data) {
+		data->refcount++;
+		g_free(key);
+		goto end;
+	}
+
+	data = g_new0(struct bin_info_data, 1);
+	if (!data) {
+		goto error;
+	}
+
+	data->key = key;
+	data->refcount = 1;
+	data->elf_fd = -1;
+	data->dwarf_fd = -1;
+	pthread_mutex_init(&data->lock, NULL);
+
+	data->elf_path = strdup(elf_path);
+	if (!data->elf_path) {
+		goto error;
+	}
+
+	if (build_id) {
+		data->build_id = malloc(build_id_len);
+		if (!data->build_id) {
+			goto error;
+		}
+
+		memcpy(data->build_id, build_id, build_id_len);
+		data->build_id_len = build_id_len;
+	}
+
+	g_hash_table_insert(bin_info_registry, data->key, data);
+	goto end;
+
+error:
+	if (data) {
+		bin_info_data_destroy(data);
+	} else {
+		g_free(key);
+	}
+	data = NULL;
+end:
+	pthread_mutex_unlock(&bin_info_registry_lock);
+	return data;
+}
+
+/*
+ * Put a reference to shared data, destroying it along with its files
+ * once no bin_info instance uses it anymore.
+ */
+static
+void bin_info_data_put(struct bin_info_data *data)
+{
+	if (!data) {
+		return;
+	}
+
+	pthread_mutex_lock(&bin_info_registry_lock);
+	if (--data->refcount) {
+		data = NULL;
+	} else {
+		g_hash_table_remove(bin_info_registry, data->key);
+	}
+	pthread_mutex_unlock(&bin_info_registry_lock);
+
+	bin_info_data_destroy(data);
+}
+
 BT_HIDDEN
 struct bin_info *bin_info_create(const char *path, uint64_t low_addr,
 		uint64_t memsz, bool is_pic)
 {
 	struct bin_info *bin = NULL;
+	char *elf_path = NULL;
 
 	if (!path) {
 		goto error;
@@ -80,24 +385,32 @@ struct bin_info *bin_info_create(const char *path, uint64_t low_addr,
 	}
 
 	if (opt_debug_info_target_prefix) {
-		bin->elf_path = g_build_path("/", opt_debug_info_target_prefix,
+		elf_path = g_build_path("/", opt_debug_info_target_prefix,
 						path, NULL);
 	} else {
-		bin->elf_path = strdup(path);
+		elf_path = g_strdup(path);
+	}
+
+	if (!elf_path) {
+		goto error;
 	}
 
-	if (!bin->elf_path) {
+	bin->data = bin_info_data_get(elf_path, NULL, 0);
+	if (!bin->data) {
 		goto error;
 	}
 
+	bin->elf_path = bin->data->elf_path;
 	bin->is_pic = is_pic;
 	bin->memsz = memsz;
 	bin->low_addr = low_addr;
 	bin->high_addr = bin->low_addr + bin->memsz;
 
+	g_free(elf_path);
 	return bin;
 
 error:
+	g_free(elf_path);
 	bin_info_destroy(bin);
 	return NULL;
 }
@@ -109,18 +422,7 @@ void bin_info_destroy(struct bin_info *bin)
 		return;
 	}
 
-	dwarf_end(bin->dwarf_info);
-
-	free(bin->elf_path);
-	free(bin->dwarf_path);
-	free(bin->build_id);
-	free(bin->dbg_link_filename);
-
-	elf_end(bin->elf_file);
-
-	close(bin->elf_fd);
-	close(bin->dwarf_fd);
-
+	bin_info_data_put(bin->data);
 	g_free(bin);
 }
 
@@ -129,24 +431,42 @@ BT_HIDDEN
 int bin_info_set_build_id(struct bin_info *bin, uint8_t *build_id,
 		size_t build_id_len)
 {
+	struct bin_info_data *data, *old_data;
+
 	if (!bin || !build_id) {
 		goto error;
 	}
 
-	bin->build_id = malloc(build_id_len);
-	if (!bin->build_id) {
+	/*
+	 * Switch to the data of the executable with this build ID,
+	 * shared with the other instances which know it. This also
+	 * gives another chance to find separate debug info, using the
+	 * build ID, to executables which only had ELF symbols.
+	 */
+	old_data = bin->data;
+	data = bin_info_data_get(old_data->elf_path, build_id, build_id_len);
+	if (!data) {
 		goto error;
 	}
 
-	memcpy(bin->build_id, build_id, build_id_len);
-	bin->build_id_len = build_id_len;
+	if (data == old_data) {
+		bin_info_data_put(data);
+		return 0;
+	}
 
-	/*
-	 * Reset the is_elf_only flag in case it had been set
-	 * previously, because we might find separate debug info using
-	 * the new build id information.
-	 */
-	bin->is_elf_only = false;
+	pthread_mutex_lock(&old_data->lock);
+	pthread_mutex_lock(&data->lock);
+	if (old_data->dbg_link_filename && !data->dbg_link_filename) {
+		data->dbg_link_filename = strdup(old_data->dbg_link_filename);
+		data->dbg_link_crc = old_data->dbg_link_crc;
+		data->is_elf_only = false;
+	}
+	pthread_mutex_unlock(&data->lock);
+	pthread_mutex_unlock(&old_data->lock);
+
+	bin->data = data;
+	bin->elf_path = data->elf_path;
+	bin_info_data_put(old_data);
 
 	return 0;
 
@@ -158,25 +478,38 @@ error:
 BT_HIDDEN
 int bin_info_set_debug_link(struct bin_info *bin, char *filename, uint32_t crc)
 {
-	if (!bin || !filename) {
-		goto error;
-	}
+	struct bin_info_data *data;
+	int ret = 0;
 
-	bin->dbg_link_filename = strdup(filename);
-	if (!bin->dbg_link_filename) {
+	if (!bin || !filename) {
 		goto error;
 	}
 
-	bin->dbg_link_crc = crc;
+	data = bin->data;
+	pthread_mutex_lock(&data->lock);
 
 	/*
-	 * Reset the is_elf_only flag in case it had been set
-	 * previously, because we might find separate debug info using
-	 * the new build id information.
+	 * The debug link of an executable is the same for all the
+	 * instances sharing its data, so only the first one sets it.
 	 */
-	bin->is_elf_only = false;
+	if (!data->dbg_link_filename) {
+		data->dbg_link_filename = strdup(filename);
+		if (!data->dbg_link_filename) {
+			ret = -1;
+		}
 
-	return 0;
+		data->dbg_link_crc = crc;
+
+		/*
+		 * Reset the is_elf_only flag in case it had been set
+		 * previously, because we might find separate debug info
+		 * using the new debug link information.
+		 */
+		data->is_elf_only = false;
+	}
+
+	pthread_mutex_unlock(&data->lock);
+	return ret;
 
 error:
 
@@ -185,20 +518,20 @@ error:
 
 /**
  * Tries to read DWARF info from the location given by path, and
- * attach it to the given bin_info instance if it exists.
+ * attach it to the given bin_info_data instance if it exists.
  *
- * @param bin	bin_info instance for which to set DWARF info
+ * @param data	bin_info_data instance for which to set DWARF info
  * @param path	Presumed location of the DWARF info
  * @returns	0 on success, negative value on failure
  */
 static
-int bin_info_set_dwarf_info_from_path(struct bin_info *bin, char *path)
+int bin_info_set_dwarf_info_from_path(struct bin_info_data *data, char *path)
 {
 	int fd = -1, ret = 0;
 	struct bt_dwarf_cu *cu = NULL;
 	Dwarf *dwarf_info = NULL;
 
-	if (!bin || !path) {
+	if (!data || !path) {
 		goto error;
 	}
 
@@ -227,12 +560,12 @@ int bin_info_set_dwarf_info_from_path(struct bin_info *bin, char *path)
 		goto error;
 	}
 
-	bin->dwarf_fd = fd;
-	bin->dwarf_path = strdup(path);
-	if (!bin->dwarf_path) {
+	data->dwarf_fd = fd;
+	data->dwarf_path = strdup(path);
+	if (!data->dwarf_path) {
 		goto error;
 	}
-	bin->dwarf_info = dwarf_info;
+	data->dwarf_info = dwarf_info;
 	free(cu);
 
 	return 0;
@@ -253,37 +586,37 @@ error:
  * Try to set the dwarf_info for a given bin_info instance via the
  * build ID method.
  *
- * @param bin		bin_info instance for which to retrieve the
+ * @param data		bin_info_data instance for which to retrieve the
  *			DWARF info via build ID
  * @returns		0 on success (i.e. dwarf_info set), -1 on failure
  */
 static
-int bin_info_set_dwarf_info_build_id(struct bin_info *bin)
+int bin_info_set_dwarf_info_build_id(struct bin_info_data *data)
 {
 	int i = 0, ret = 0;
 	char *path = NULL, *build_id_file = NULL;
 	const char *dbg_dir = NULL;
 	size_t build_id_file_len;
 
-	if (!bin || !bin->build_id) {
+	if (!data || !data->build_id) {
 		goto error;
 	}
 
 	dbg_dir = opt_debug_info_dir ? : DEFAULT_DEBUG_DIR;
 
 	/* 2 characters per byte printed in hex, +1 for '/' and +1 for '\0' */
-	build_id_file_len = (2 * bin->build_id_len) + 1 +
+	build_id_file_len = (2 * data->build_id_len) + 1 +
 			strlen(BUILD_ID_SUFFIX) + 1;
 	build_id_file = malloc(build_id_file_len);
 	if (!build_id_file) {
 		goto error;
 	}
 
-	snprintf(build_id_file, 4, "%02x/", bin->build_id[0]);
-	for (i = 1; i < bin->build_id_len; ++i) {
+	snprintf(build_id_file, 4, "%02x/", data->build_id[0]);
+	for (i = 1; i < data->build_id_len; ++i) {
 		int path_idx = 3 + 2 * (i - 1);
 
-		snprintf(&build_id_file[path_idx], 3, "%02x", bin->build_id[i]);
+		snprintf(&build_id_file[path_idx], 3, "%02x", data->build_id[i]);
 	}
 	strcat(build_id_file, BUILD_ID_SUFFIX);
 
@@ -292,7 +625,7 @@ int bin_info_set_dwarf_info_build_id(struct bin_info *bin)
 		goto error;
 	}
 
-	ret = bin_info_set_dwarf_info_from_path(bin, path);
+	ret = bin_info_set_dwarf_info_from_path(data, path);
 	if (ret) {
 		goto error;
 	}
@@ -308,6 +641,108 @@ end:
 	return ret;
 }
 
+/*
+ * Identity of a file whose checksum was computed: the checksum of a
+ * debug file is only computed again if it is replaced or modified.
+ */
+struct debug_file_id {
+	uint64_t dev;
+	uint64_t ino;
+	int64_t mtime;
+	int64_t mtime_nsec;
+	uint64_t size;
+};
+
+struct debug_file_crc {
+	struct debug_file_id id;
+	uint32_t crc;
+};
+
+/*
+ * Hash table: struct debug_file_id to struct debug_file_crc, which
+ * contains its key; shared by all the bin_info instances.
+ */
+static GHashTable *debug_file_crcs;
+static pthread_mutex_t debug_file_crcs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static
+guint debug_file_id_hash(gconstpointer key)
+{
+	const struct debug_file_id *id = key;
+
+	return (guint) (id->ino ^ (id->ino >> 32) ^ id->dev ^ id->mtime);
+}
+
+static
+gboolean debug_file_id_equal(gconstpointer a, gconstpointer b)
+{
+	return !memcmp(a, b, sizeof(struct debug_file_id));
+}
+
+/**
+ * Get the checksum of an open debug file, from the checksums already
+ * computed if the file did not change since.
+ *
+ * @param fd	File descriptor of the debug file
+ * @param crc	Out parameter, the checksum of the file
+ * @returns	0 on success, -1 on failure
+ */
+static
+int debug_file_get_crc(int fd, uint32_t *crc)
+{
+	struct debug_file_crc *file_crc;
+	struct debug_file_id id;
+	struct stat st;
+	int ret;
+
+	if (fstat(fd, &st)) {
+		return -1;
+	}
+
+	memset(&id, 0, sizeof(id));
+	id.dev = st.st_dev;
+	id.ino = st.st_ino;
+	id.mtime = st.st_mtim.tv_sec;
+	id.mtime_nsec = st.st_mtim.tv_nsec;
+	id.size = st.st_size;
+
+	pthread_mutex_lock(&debug_file_crcs_lock);
+	if (!debug_file_crcs) {
+		debug_file_crcs = g_hash_table_new_full(debug_file_id_hash,
+				debug_file_id_equal, g_free, NULL);
+	}
+
+	file_crc = g_hash_table_lookup(debug_file_crcs, &id);
+	if (file_crc) {
+		*crc = file_crc->crc;
+	}
+	pthread_mutex_unlock(&debug_file_crcs_lock);
+
+	if (file_crc) {
+		return 0;
+	}
+
+	/* Computed outside of the lock, it reads the whole file. */
+	ret = crc32(fd, crc);
+	if (ret) {
+		return ret;
+	}
+
+	file_crc = g_new0(struct debug_file_crc, 1);
+	file_crc->id = id;
+	file_crc->crc = *crc;
+
+	pthread_mutex_lock(&debug_file_crcs_lock);
+	if (!g_hash_table_lookup(debug_file_crcs, &file_crc->id)) {
+		g_hash_table_insert(debug_file_crcs, &file_crc->id, file_crc);
+		file_crc = NULL;
+	}
+	pthread_mutex_unlock(&debug_file_crcs_lock);
+
+	g_free(file_crc);
+	return 0;
+}
+
 /**
  * Tests whether the file located at path exists and has the expected
  * checksum.
@@ -337,7 +772,7 @@ int is_valid_debug_file(char *path, uint32_t crc)
 		goto end_noclose;
 	}
 
-	ret = crc32(fd, &_crc);
+	ret = debug_file_get_crc(fd, &_crc);
 	if (ret) {
 		ret = 0;
 		goto end;
@@ -351,111 +786,91 @@ end_noclose:
 	return ret;
 }
 
-/**
- * Try to set the dwarf_info for a given bin_info instance via the
- * build ID method.
- *
- * @param bin		bin_info instance for which to retrieve the
- *			DWARF info via debug link
- * @returns		0 on success (i.e. dwarf_info set), -1 on failure
+/*
+ * Paths where the separate debug file named by the debug link of an
+ * executable is looked for, in order: the executable's directory, its
+ * .debug subdirectory and the global debug directory. Returns a
+ * NULL-terminated array to free with g_strfreev(), or NULL on error.
  */
 static
-int bin_info_set_dwarf_info_debug_link(struct bin_info *bin)
+gchar **bin_info_get_debug_link_paths(struct bin_info_data *data)
 {
-	int ret = 0;
-	const char *dbg_dir = NULL;
-	char *dir_name = NULL, *bin_dir = NULL, *path = NULL;
-	size_t max_path_len = 0;
+	const char *dbg_dir;
+	gchar *dir_name, **paths;
 
-	if (!bin || !bin->dbg_link_filename) {
-		goto error;
+	if (!data || !data->dbg_link_filename) {
+		return NULL;
 	}
 
 	dbg_dir = opt_debug_info_dir ? : DEFAULT_DEBUG_DIR;
 
-	dir_name = dirname(bin->elf_path);
+	/* dirname() may modify its argument, which is shared. */
+	dir_name = g_path_get_dirname(data->elf_path);
 	if (!dir_name) {
-		goto error;
-	}
-
-	/* bin_dir is just dir_name with a trailing slash */
-	bin_dir = malloc(strlen(dir_name) + 2);
-	if (!bin_dir) {
-		goto error;
-	}
-
-	strcpy(bin_dir, dir_name);
-	strcat(bin_dir, "/");
-
-	max_path_len = strlen(dbg_dir) + strlen(bin_dir) +
-			strlen(DEBUG_SUBDIR) + strlen(bin->dbg_link_filename)
-			+ 1;
-	path = malloc(max_path_len);
-	if (!path) {
-		goto error;
+		return NULL;
 	}
 
-	/* First look in the executable's dir */
-	strcpy(path, bin_dir);
-	strcat(path, bin->dbg_link_filename);
+	paths = g_new0(gchar *, 4);
+	paths[0] = g_strconcat(dir_name, "/", data->dbg_link_filename, NULL);
+	paths[1] = g_strconcat(dir_name, "/", DEBUG_SUBDIR,
+			data->dbg_link_filename, NULL);
+	paths[2] = g_strconcat(dbg_dir, dir_name, "/",
+			data->dbg_link_filename, NULL);
+	g_free(dir_name);
 
-	if (is_valid_debug_file(path, bin->dbg_link_crc)) {
-		goto found;
-	}
+	return paths;
+}
 
-	/* If not found, look in .debug subdir */
-	strcpy(path, bin_dir);
-	strcat(path, DEBUG_SUBDIR);
-	strcat(path, bin->dbg_link_filename);
+/**
+ * Try to set the dwarf_info for a given bin_info instance via the
+ * debug link method.
+ *
+ * @param data		bin_info_data instance for which to retrieve the
+ *			DWARF info via debug link
+ * @returns		0 on success (i.e. dwarf_info set), -1 on failure
+ */
+static
+int bin_info_set_dwarf_info_debug_link(struct bin_info_data *data)
+{
+	int i, ret = -1;
+	gchar **paths;
 
-	if (is_valid_debug_file(path, bin->dbg_link_crc)) {
-		goto found;
+	paths = bin_info_get_debug_link_paths(data);
+	if (!paths) {
+		goto end;
 	}
 
-	/* Lastly, look under the global debug directory */
-	strcpy(path, dbg_dir);
-	strcat(path, bin_dir);
-	strcat(path, bin->dbg_link_filename);
-
-	if (is_valid_debug_file(path, bin->dbg_link_crc)) {
-		goto found;
+	for (i = 0; paths[i]; i++) {
+		if (is_valid_debug_file(paths[i], data->dbg_link_crc)) {
+			ret = bin_info_set_dwarf_info_from_path(data,
+					paths[i]);
+			break;
+		}
 	}
 
-error:
-	ret = -1;
 end:
-	free(path);
-	free(bin_dir);
-
-	return ret;
-
-found:
-	ret = bin_info_set_dwarf_info_from_path(bin, path);
-	if (ret) {
-		goto error;
-	}
-
-	goto end;
+	g_strfreev(paths);
+	return ret ? -1 : 0;
 }
 
 /**
  * Initialize the DWARF info for a given executable.
  *
- * @param bin	bin_info instance
+ * @param data	bin_info_data instance
  * @returns	0 on success, negative value on failure
  */
 static
-int bin_info_set_dwarf_info(struct bin_info *bin)
+int bin_info_set_dwarf_info(struct bin_info_data *data)
 {
 	int ret = 0;
 
-	if (!bin) {
+	if (!data) {
 		ret = -1;
 		goto end;
 	}
 
 	/* First try to set the DWARF info from the ELF file */
-	ret = bin_info_set_dwarf_info_from_path(bin, bin->elf_path);
+	ret = bin_info_set_dwarf_info_from_path(data, data->elf_path);
 	if (!ret) {
 		goto end;
 	}
@@ -464,12 +879,12 @@ int bin_info_set_dwarf_info(struct bin_info *bin)
 	 * If that fails, try to find separate debug info via build ID
 	 * and debug link.
 	 */
-	ret = bin_info_set_dwarf_info_build_id(bin);
+	ret = bin_info_set_dwarf_info_build_id(data);
 	if (!ret) {
 		goto end;
 	}
 
-	ret = bin_info_set_dwarf_info_debug_link(bin);
+	ret = bin_info_set_dwarf_info_debug_link(data);
 	if (!ret) {
 		goto end;
 	}
@@ -481,27 +896,31 @@ end:
 /**
  * Initialize the ELF file for a given executable.
  *
- * @param bin	bin_info instance
+ * @param data	bin_info_data instance
  * @returns	0 on success, negative value on error.
  */
 static
-int bin_info_set_elf_file(struct bin_info *bin)
+int bin_info_set_elf_file(struct bin_info_data *data)
 {
 	int elf_fd = -1;
 	Elf *elf_file = NULL;
 
-	if (!bin) {
+	if (!data) {
 		goto error;
 	}
 
-	elf_fd = open(bin->elf_path, O_RDONLY);
+	elf_fd = open(data->elf_path, O_RDONLY);
 	if (elf_fd < 0) {
 		elf_fd = -errno;
-		printf_verbose("Failed to open %s\n", bin->elf_path);
+		printf_verbose("Failed to open %s\n", data->elf_path);
 		goto error;
 	}
 
-	elf_file = elf_begin(elf_fd, ELF_C_READ, NULL);
+	/*
+	 * Map the file rather than reading it whole: lookups only touch
+	 * its symbol tables.
+	 */
+	elf_file = elf_begin(elf_fd, ELF_C_READ_MMAP, NULL);
 	if (!elf_file) {
 		printf_debug("elf_begin failed: %s\n", elf_errmsg(-1));
 		goto error;
@@ -509,12 +928,12 @@ int bin_info_set_elf_file(struct bin_info *bin)
 
 	if (elf_kind(elf_file) != ELF_K_ELF) {
 		printf_verbose("Error: %s is not an ELF object\n",
-				bin->elf_path);
+				data->elf_path);
 		goto error;
 	}
 
-	bin->elf_fd = elf_fd;
-	bin->elf_file = elf_file;
+	data->elf_fd = elf_fd;
+	data->elf_file = elf_file;
 	return 0;
 
 error:
@@ -537,6 +956,24 @@ void source_location_destroy(struct source_location *src_loc)
 	g_free(src_loc);
 }
 
+BT_HIDDEN
+void inline_frames_destroy(struct inline_frame *frames,
+		unsigned int nr_frames)
+{
+	unsigned int i;
+
+	if (!frames) {
+		return;
+	}
+
+	for (i = 0; i < nr_frames; i++) {
+		free(frames[i].func_name);
+		free(frames[i].filename);
+	}
+
+	g_free(frames);
+}
+
 /**
  * Append a string representation of an address offset to an existing
  * string.
@@ -588,53 +1025,68 @@ error:
 	return -1;
 }
 
+static
+gint elf_symbol_compare(gconstpointer a, gconstpointer b)
+{
+	const struct bin_info_elf_symbol *sym_a = a, *sym_b = b;
+
+	if (sym_a->addr != sym_b->addr) {
+		return sym_a->addr < sym_b->addr ? -1 : 1;
+	}
+
+	return sym_a->index < sym_b->index ? -1 : sym_a->index > sym_b->index;
+}
+
 /**
- * Try to find the symbol closest to an address within a given ELF
- * section.
- *
- * Only function symbols are taken into account. The symbol's address
- * must precede `addr`. A symbol with a closer address might exist
- * after `addr` but is irrelevant because it cannot encompass `addr`.
+ * Build the index of the function symbols of the symbol table (symtab)
+ * of an ELF file, sorted by address.
  *
- * On success, if found, the out parameters `sym` and `shdr` are
- * set. On failure or if none are found, they remain unchanged.
+ * The dynamic symbol table (dynsym), which a stripped shared object
+ * still has, is indexed instead when there is no symtab: it only has
+ * the exported functions. Of the symbols at a same address, only the
+ * first one of the table is kept. The index is empty if neither table
+ * is found.
  *
- * @param scn		ELF section in which to look for the address
- * @param addr		Virtual memory address for which to find the
- *			nearest function symbol
- * @param sym		Out parameter, the nearest function symbol
- * @param shdr		Out parameter, the section header for scn
- * @returns		0 on success, -1 on failure
+ * @param elf_file	ELF file of which to index the symbols
+ * @returns		The index on success, NULL on failure
  */
 static
-int bin_info_get_nearest_symbol_from_section(Elf_Scn *scn, uint64_t addr,
-		GElf_Sym **sym, GElf_Shdr **shdr)
+struct bin_info_elf_symbols *bin_info_elf_symbols_create(Elf *elf_file)
 {
-	int i;
-	size_t symbol_count;
-	Elf_Data *data = NULL;
-	GElf_Shdr *_shdr = NULL;
-	GElf_Sym *nearest_sym = NULL;
-
-	if (!scn || !sym || !shdr) {
+	size_t i, nr_syms = 0, symbol_count;
+	Elf_Scn *scn = NULL, *dynsym_scn = NULL;
+	Elf_Data *data;
+	GElf_Shdr shdr, dynsym_shdr;
+	struct bin_info_elf_symbols *elf_symbols;
+	struct bin_info_elf_symbol *syms;
+
+	elf_symbols = g_new0(struct bin_info_elf_symbols, 1);
+	if (!elf_symbols) {
 		goto error;
 	}
 
-	_shdr = g_new0(GElf_Shdr, 1);
-	if (!_shdr) {
-		goto error;
-	}
+	while ((scn = elf_nextscn(elf_file, scn))) {
+		if (!gelf_getshdr(scn, &shdr)) {
+			goto error;
+		}
 
-	_shdr = gelf_getshdr(scn, _shdr);
-	if (!_shdr) {
-		goto error;
+		if (shdr.sh_type == SHT_SYMTAB) {
+			break;
+		}
+
+		if (shdr.sh_type == SHT_DYNSYM && !dynsym_scn) {
+			dynsym_scn = scn;
+			dynsym_shdr = shdr;
+		}
 	}
 
-	if (_shdr->sh_type != SHT_SYMTAB) {
-		/*
-		 * We are only interested in symbol table (symtab)
-		 * sections, skip this one.
-		 */
+	if (!scn && dynsym_scn) {
+		/* No symbol table, the file has been stripped. */
+		scn = dynsym_scn;
+		shdr = dynsym_shdr;
+	}
+
+	if (!scn || !shdr.sh_entsize) {
 		goto end;
 	}
 
@@ -643,49 +1095,115 @@ int bin_info_get_nearest_symbol_from_section(Elf_Scn *scn, uint64_t addr,
 		goto error;
 	}
 
-	symbol_count = _shdr->sh_size / _shdr->sh_entsize;
+	symbol_count = shdr.sh_size / shdr.sh_entsize;
+	if (!symbol_count) {
+		goto end;
+	}
+
+	syms = g_new(struct bin_info_elf_symbol, symbol_count);
+	if (!syms) {
+		goto error;
+	}
+	elf_symbols->syms = syms;
+	elf_symbols->strtab = shdr.sh_link;
 
 	for (i = 0; i < symbol_count; ++i) {
-		GElf_Sym *cur_sym = NULL;
+		GElf_Sym sym;
 
-		cur_sym = g_new0(GElf_Sym, 1);
-		if (!cur_sym) {
+		if (!gelf_getsym(data, i, &sym)) {
 			goto error;
 		}
-		cur_sym = gelf_getsym(data, i, cur_sym);
-		if (!cur_sym) {
-			goto error;
-		}
-		if (GELF_ST_TYPE(cur_sym->st_info) != STT_FUNC) {
+
+		if (GELF_ST_TYPE(sym.st_info) != STT_FUNC) {
 			/* We're only interested in the functions. */
-			g_free(cur_sym);
 			continue;
 		}
 
-		if (cur_sym->st_value <= addr &&
-				(!nearest_sym ||
-				cur_sym->st_value > nearest_sym->st_value)) {
-			g_free(nearest_sym);
-			nearest_sym = cur_sym;
-		} else {
-			g_free(cur_sym);
+		if (sym.st_shndx == SHN_UNDEF) {
+			/* Imported from another object. */
+			continue;
 		}
+
+		syms[nr_syms].addr = sym.st_value;
+		syms[nr_syms].name = sym.st_name;
+		syms[nr_syms].index = i;
+		nr_syms++;
 	}
 
-end:
-	if (nearest_sym) {
-		*sym = nearest_sym;
-		*shdr = _shdr;
-	} else {
-		g_free(_shdr);
+	qsort(syms, nr_syms, sizeof(*syms), elf_symbol_compare);
+
+	/* Keep the first symbol of each address. */
+	for (i = 0; i < nr_syms; ++i) {
+		if (elf_symbols->nr_syms &&
+				syms[elf_symbols->nr_syms - 1].addr ==
+				syms[i].addr) {
+			continue;
+		}
+
+		syms[elf_symbols->nr_syms++] = syms[i];
 	}
 
-	return 0;
+end:
+	return elf_symbols;
 
 error:
-	g_free(nearest_sym);
-	g_free(_shdr);
-	return -1;
+	bin_info_elf_symbols_destroy(elf_symbols);
+	return NULL;
+}
+
+/*
+ * Get the ELF symbol index of an executable, building it on the first
+ * call.
+ *
+ * Called with the lock of the data held.
+ */
+static
+struct bin_info_elf_symbols *bin_info_get_elf_symbols(
+		struct bin_info_data *data)
+{
+	if (data->elf_symbols) {
+		goto end;
+	}
+
+	/* Set ELF file if it hasn't been accessed yet. */
+	if (!data->elf_file && bin_info_set_elf_file(data)) {
+		goto end;
+	}
+
+	data->elf_symbols = bin_info_elf_symbols_create(data->elf_file);
+
+end:
+	return data->elf_symbols;
+}
+
+/*
+ * Find the function symbol closest to an address among sorted symbols.
+ *
+ * The symbol's address must precede `addr`. A symbol with a closer
+ * address might exist after `addr` but is irrelevant because it cannot
+ * encompass `addr`.
+ */
+static
+const struct bin_info_elf_symbol *elf_symbols_find_nearest(
+		const struct bin_info_elf_symbols *elf_symbols, uint64_t addr)
+{
+	size_t low = 0, high = elf_symbols->nr_syms;
+
+	while (low < high) {
+		size_t mid = low + (high - low) / 2;
+
+		if (elf_symbols->syms[mid].addr <= addr) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	if (low == 0) {
+		return NULL;
+	}
+
+	return &elf_symbols->syms[low - 1];
 }
 
 /**
@@ -699,7 +1217,7 @@ error:
  * If found, the out parameter `func_name` is set on success. On failure,
  * it remains unchanged.
  *
- * @param bin		bin_info instance for the executable containing
+ * @param data		bin_info_data instance for the executable containing
  *			the address
  * @param addr		Virtual memory address for which to find the
  *			function name
@@ -707,148 +1225,1010 @@ error:
  * @returns		0 on success, -1 on failure
  */
 static
-int bin_info_lookup_elf_function_name(struct bin_info *bin, uint64_t addr,
+int bin_info_lookup_elf_function_name(struct bin_info_data *data, uint64_t addr,
 		char **func_name)
 {
-	/*
-	 * TODO (possible optimisation): if an ELF has no symtab
-	 * section, it has been stripped. Therefore, it would be wise
-	 * to store a flag indicating the stripped status after the
-	 * first iteration to prevent subsequent ones.
-	 */
-	int ret = 0;
-	Elf_Scn *scn = NULL;
-	GElf_Sym *sym = NULL;
-	GElf_Shdr *shdr = NULL;
-	char *sym_name = NULL;
+	struct bin_info_elf_symbols *elf_symbols;
+	const struct bin_info_elf_symbol *sym;
+	char *sym_name;
 
-	/* Set ELF file if it hasn't been accessed yet. */
-	if (!bin->elf_file) {
-		ret = bin_info_set_elf_file(bin);
-		if (ret) {
-			/* Failed to set ELF file. */
-			goto error;
+	elf_symbols = bin_info_get_elf_symbols(data);
+	if (!elf_symbols) {
+		goto error;
+	}
+
+	sym = elf_symbols_find_nearest(elf_symbols, addr);
+	if (!sym) {
+		goto end;
+	}
+
+	sym_name = elf_strptr(data->elf_file, elf_symbols->strtab, sym->name);
+	if (!sym_name) {
+		goto error;
+	}
+
+	return bin_info_append_offset_str(sym_name, sym->addr, addr,
+			func_name);
+
+end:
+	return 0;
+
+error:
+	return -1;
+}
+
+/*
+ * DWARF index being built, with the strings of its tables interned in
+ * its string table.
+ */
+struct bin_info_dwarf_index_builder {
+	GArray *funcs;
+	GArray *func_ranges;
+	GArray *inlines;
+	/* Array of ranges (GArray *) by inlining depth. */
+	GPtrArray *inline_ranges;
+	GArray *lines;
+	GString *strtab;
+	/* Hash table: string owned by libdw to its offset in strtab. */
+	GHashTable *str_offsets;
+};
+
+static
+void dwarf_index_builder_fini(struct bin_info_dwarf_index_builder *builder)
+{
+	guint i;
+
+	if (builder->funcs) {
+		g_array_free(builder->funcs, TRUE);
+	}
+
+	if (builder->func_ranges) {
+		g_array_free(builder->func_ranges, TRUE);
+	}
+
+	if (builder->inlines) {
+		g_array_free(builder->inlines, TRUE);
+	}
+
+	if (builder->inline_ranges) {
+		for (i = 0; i < builder->inline_ranges->len; i++) {
+			g_array_free(g_ptr_array_index(
+					builder->inline_ranges, i), TRUE);
 		}
+
+		g_ptr_array_free(builder->inline_ranges, TRUE);
+	}
+
+	if (builder->lines) {
+		g_array_free(builder->lines, TRUE);
+	}
+
+	if (builder->strtab) {
+		g_string_free(builder->strtab, TRUE);
+	}
+
+	if (builder->str_offsets) {
+		g_hash_table_destroy(builder->str_offsets);
+	}
+}
+
+static
+uint32_t dwarf_index_builder_add_str(
+		struct bin_info_dwarf_index_builder *builder, const char *str)
+{
+	gpointer offset;
+
+	if (!str) {
+		return 0;
 	}
 
-	scn = elf_nextscn(bin->elf_file, scn);
-	if (!scn) {
+	if (g_hash_table_lookup_extended(builder->str_offsets, str, NULL,
+			&offset)) {
+		return GPOINTER_TO_UINT(offset);
+	}
+
+	offset = GUINT_TO_POINTER(builder->strtab->len);
+	g_string_append_len(builder->strtab, str, strlen(str) + 1);
+	g_hash_table_insert(builder->str_offsets, (gpointer) str, offset);
+
+	return GPOINTER_TO_UINT(offset);
+}
+
+static
+void dwarf_index_builder_add_ranges(GArray *ranges, Dwarf_Die *die,
+		uint32_t index)
+{
+	ptrdiff_t offset = 0;
+	Dwarf_Addr base, start, end;
+
+	while ((offset = dwarf_ranges(die, offset, &base, &start, &end)) > 0) {
+		struct bin_info_addr_range range;
+
+		if (start >= end) {
+			continue;
+		}
+
+		range.start = start;
+		range.end = end;
+		range.index = index;
+		range.order = ranges->len;
+		g_array_append_val(ranges, range);
+	}
+}
+
+/**
+ * Add the subroutines inlined in a DIE, and recursively those inlined
+ * in them, to a DWARF index.
+ *
+ * Lexical blocks are looked into as if their children were the DIE's.
+ *
+ * @param builder	DWARF index to add the subroutines to
+ * @param parent	Function or inlined subroutine DIE
+ * @param files		Source files of the CU, or NULL if unknown
+ * @param depth		Inlining depth of the children of `parent`,
+ *			0 for those of a function
+ */
+static
+void dwarf_index_builder_add_inlines(
+		struct bin_info_dwarf_index_builder *builder, Dwarf_Die *parent,
+		Dwarf_Files *files, guint depth)
+{
+	Dwarf_Die die;
+	int ret;
+
+	ret = dwarf_child(parent, &die);
+	while (ret == 0) {
+		int tag = dwarf_tag(&die);
+
+		if (tag == DW_TAG_inlined_subroutine) {
+			struct bin_info_dwarf_inline inl = { 0 };
+			Dwarf_Attribute attr;
+			Dwarf_Sword file_no;
+			Dwarf_Word line_no;
+			GArray *ranges;
+
+			inl.name = dwarf_index_builder_add_str(builder,
+					dwarf_diename(&die));
+			if (files && dwarf_attr(&die, DW_AT_call_file, &attr) &&
+					!dwarf_formsdata(&attr, &file_no)) {
+				inl.call_file = dwarf_index_builder_add_str(
+						builder, dwarf_filesrc(files,
+						file_no, NULL, NULL));
+			}
+
+			if (dwarf_attr(&die, DW_AT_call_line, &attr) &&
+					!dwarf_formudata(&attr, &line_no)) {
+				inl.call_line = line_no;
+			}
+
+			if (depth == builder->inline_ranges->len) {
+				g_ptr_array_add(builder->inline_ranges,
+						g_array_new(FALSE, FALSE,
+						sizeof(struct bin_info_addr_range)));
+			}
+
+			ranges = g_ptr_array_index(builder->inline_ranges,
+					depth);
+			dwarf_index_builder_add_ranges(ranges, &die,
+					builder->inlines->len);
+			g_array_append_val(builder->inlines, inl);
+			dwarf_index_builder_add_inlines(builder, &die, files,
+					depth + 1);
+		} else if (tag == DW_TAG_lexical_block) {
+			dwarf_index_builder_add_inlines(builder, &die, files,
+					depth);
+		}
+
+		ret = dwarf_siblingof(&die, &die);
+	}
+}
+
+/**
+ * Add the functions of a compile unit (CU), the subroutines inlined
+ * in them and its line table to a DWARF index.
+ *
+ * @param builder	DWARF index to add the CU to
+ * @param cu_die	Root DIE of the CU
+ */
+static
+void dwarf_index_builder_add_cu(struct bin_info_dwarf_index_builder *builder,
+		Dwarf_Die *cu_die)
+{
+	Dwarf_Files *files = NULL;
+	Dwarf_Lines *lines = NULL;
+	size_t line_count = 0, i;
+	Dwarf_Die die;
+	int ret;
+
+	if (dwarf_getsrcfiles(cu_die, &files, NULL)) {
+		files = NULL;
+	}
+
+	ret = dwarf_child(cu_die, &die);
+	while (ret == 0) {
+		if (dwarf_tag(&die) == DW_TAG_subprogram) {
+			const char *name = dwarf_diename(&die);
+			Dwarf_Addr low_pc;
+
+			if (name && !dwarf_lowpc(&die, &low_pc)) {
+				struct bin_info_dwarf_func func = { 0 };
+
+				func.low_pc = low_pc;
+				func.name = dwarf_index_builder_add_str(builder,
+						name);
+				dwarf_index_builder_add_ranges(
+						builder->func_ranges, &die,
+						builder->funcs->len);
+				g_array_append_val(builder->funcs, func);
+			}
+
+			dwarf_index_builder_add_inlines(builder, &die, files,
+					0);
+		}
+
+		ret = dwarf_siblingof(&die, &die);
+	}
+
+	if (dwarf_getsrclines(cu_die, &lines, &line_count)) {
+		return;
+	}
+
+	for (i = 0; i < line_count; i++) {
+		Dwarf_Line *line = dwarf_onesrcline(lines, i);
+		struct bin_info_dwarf_line entry = { 0 };
+		const char *filename;
+		bool end_sequence;
+		Dwarf_Addr addr;
+		int line_no;
+
+		if (!line || dwarf_lineendsequence(line, &end_sequence) ||
+				end_sequence) {
+			continue;
+		}
+
+		if (dwarf_lineaddr(line, &addr) ||
+				dwarf_lineno(line, &line_no)) {
+			continue;
+		}
+
+		filename = dwarf_linesrc(line, NULL, NULL);
+		if (!filename) {
+			continue;
+		}
+
+		entry.addr = addr;
+		entry.filename = dwarf_index_builder_add_str(builder, filename);
+		entry.line_no = line_no;
+		entry.order = builder->lines->len;
+		g_array_append_val(builder->lines, entry);
+	}
+}
+
+static
+gint addr_range_compare(gconstpointer a, gconstpointer b)
+{
+	const struct bin_info_addr_range *range_a = a, *range_b = b;
+
+	if (range_a->start != range_b->start) {
+		return range_a->start < range_b->start ? -1 : 1;
+	}
+
+	return range_a->order < range_b->order ? -1 :
+			range_a->order > range_b->order;
+}
+
+static
+gint dwarf_line_compare(gconstpointer a, gconstpointer b)
+{
+	const struct bin_info_dwarf_line *line_a = a, *line_b = b;
+
+	if (line_a->addr != line_b->addr) {
+		return line_a->addr < line_b->addr ? -1 : 1;
+	}
+
+	return line_a->order < line_b->order ? -1 :
+			line_a->order > line_b->order;
+}
+
+/*
+ * Sort ranges by start address, keeping only the first one in DWARF
+ * order among those of a same start.
+ */
+static
+void addr_ranges_sort(GArray *ranges)
+{
+	guint i, len = 0;
+
+	g_array_sort(ranges, addr_range_compare);
+
+	for (i = 0; i < ranges->len; i++) {
+		struct bin_info_addr_range range = g_array_index(ranges,
+				struct bin_info_addr_range, i);
+
+		if (len && g_array_index(ranges, struct bin_info_addr_range,
+				len - 1).start == range.start) {
+			continue;
+		}
+
+		g_array_index(ranges, struct bin_info_addr_range, len++) = range;
+	}
+
+	g_array_set_size(ranges, len);
+}
+
+/*
+ * Sort lines by address, keeping only the last one among those of a
+ * same address, like dwarf_getsrc_die() does.
+ */
+static
+void dwarf_lines_sort(GArray *lines)
+{
+	guint i, len = 0;
+
+	g_array_sort(lines, dwarf_line_compare);
+
+	for (i = 0; i < lines->len; i++) {
+		struct bin_info_dwarf_line line = g_array_index(lines,
+				struct bin_info_dwarf_line, i);
+
+		if (len && g_array_index(lines, struct bin_info_dwarf_line,
+				len - 1).addr == line.addr) {
+			len--;
+		}
+
+		g_array_index(lines, struct bin_info_dwarf_line, len++) = line;
+	}
+
+	g_array_set_size(lines, len);
+}
+
+/*
+ * Compute the offsets of the tables of a DWARF index image from its
+ * header, and return the length of the image.
+ */
+static
+uint64_t dwarf_index_layout(const struct bin_info_dwarf_index_header *header,
+		uint64_t *offsets)
+{
+	uint64_t lens[DWARF_INDEX_TABLE_COUNT];
+	uint64_t offset = sizeof(*header);
+	int i;
+
+	lens[DWARF_INDEX_FUNCS] = header->func_count *
+			sizeof(struct bin_info_dwarf_func);
+	lens[DWARF_INDEX_FUNC_RANGES] = header->func_range_count *
+			sizeof(struct bin_info_addr_range);
+	lens[DWARF_INDEX_INLINES] = header->inline_count *
+			sizeof(struct bin_info_dwarf_inline);
+	lens[DWARF_INDEX_INLINE_DEPTH_STARTS] =
+			(header->inline_depth_count + 1) * sizeof(uint64_t);
+	lens[DWARF_INDEX_INLINE_RANGES] = header->inline_range_count *
+			sizeof(struct bin_info_addr_range);
+	lens[DWARF_INDEX_LINES] = header->line_count *
+			sizeof(struct bin_info_dwarf_line);
+	lens[DWARF_INDEX_STRTAB] = header->strtab_len;
+
+	for (i = 0; i < DWARF_INDEX_TABLE_COUNT; i++) {
+		offsets[i] = offset;
+		offset += (lens[i] + 7) & ~(uint64_t) 7;
+	}
+
+	return offset;
+}
+
+/*
+ * Set the tables of a DWARF index from its image, after checking that
+ * they fit in it.
+ */
+static
+int dwarf_index_set_tables(struct bin_info_dwarf_index *dwarf_index)
+{
+	const struct bin_info_dwarf_index_header *header = dwarf_index->image;
+	const char *image = dwarf_index->image;
+	uint64_t offsets[DWARF_INDEX_TABLE_COUNT];
+
+	if (dwarf_index->image_len < sizeof(*header)) {
+		goto error;
+	}
+
+	if (memcmp(header->magic, DWARF_INDEX_MAGIC, sizeof(header->magic)) ||
+			header->version != DWARF_INDEX_VERSION ||
+			header->byte_order != DWARF_INDEX_BYTE_ORDER) {
+		goto error;
+	}
+
+	/* Indexes and string offsets are 32-bit. */
+	if (header->func_count > UINT32_MAX ||
+			header->func_range_count > UINT32_MAX ||
+			header->inline_count > UINT32_MAX ||
+			header->inline_depth_count > UINT32_MAX ||
+			header->inline_range_count > UINT32_MAX ||
+			header->line_count > UINT32_MAX ||
+			header->strtab_len > UINT32_MAX) {
 		goto error;
 	}
 
-	while (scn && !sym) {
-		ret = bin_info_get_nearest_symbol_from_section(
-				scn, addr, &sym, &shdr);
-		if (ret) {
+	if (dwarf_index_layout(header, offsets) > dwarf_index->image_len) {
+		goto error;
+	}
+
+	dwarf_index->header = header;
+	dwarf_index->funcs = (const void *) (image + offsets[DWARF_INDEX_FUNCS]);
+	dwarf_index->func_ranges = (const void *)
+			(image + offsets[DWARF_INDEX_FUNC_RANGES]);
+	dwarf_index->inlines = (const void *)
+			(image + offsets[DWARF_INDEX_INLINES]);
+	dwarf_index->inline_depth_starts = (const void *)
+			(image + offsets[DWARF_INDEX_INLINE_DEPTH_STARTS]);
+	dwarf_index->inline_ranges = (const void *)
+			(image + offsets[DWARF_INDEX_INLINE_RANGES]);
+	dwarf_index->lines = (const void *) (image + offsets[DWARF_INDEX_LINES]);
+	dwarf_index->strtab = image + offsets[DWARF_INDEX_STRTAB];
+
+	return 0;
+
+error:
+	return -1;
+}
+
+/*
+ * Check that the indexes and string offsets of the tables of a DWARF
+ * index read from a file are within bounds.
+ */
+static
+int dwarf_index_validate(const struct bin_info_dwarf_index *dwarf_index)
+{
+	const struct bin_info_dwarf_index_header *header = dwarf_index->header;
+	const uint64_t *starts = dwarf_index->inline_depth_starts;
+	uint64_t strtab_len = header->strtab_len;
+	uint64_t i;
+
+	if (!strtab_len || dwarf_index->strtab[strtab_len - 1] != '\0') {
+		goto error;
+	}
+
+	for (i = 0; i < header->func_count; i++) {
+		if (dwarf_index->funcs[i].name >= strtab_len) {
 			goto error;
 		}
+	}
 
-		scn = elf_nextscn(bin->elf_file, scn);
+	for (i = 0; i < header->func_range_count; i++) {
+		if (dwarf_index->func_ranges[i].index >= header->func_count) {
+			goto error;
+		}
 	}
 
-	if (sym) {
-		sym_name = elf_strptr(bin->elf_file, shdr->sh_link,
-				sym->st_name);
-		if (!sym_name) {
+	for (i = 0; i < header->inline_count; i++) {
+		if (dwarf_index->inlines[i].name >= strtab_len ||
+				dwarf_index->inlines[i].call_file >=
+				strtab_len) {
 			goto error;
 		}
+	}
+
+	if (starts[0] != 0 ||
+			starts[header->inline_depth_count] !=
+			header->inline_range_count) {
+		goto error;
+	}
+
+	for (i = 0; i < header->inline_depth_count; i++) {
+		if (starts[i] > starts[i + 1]) {
+			goto error;
+		}
+	}
 
-		ret = bin_info_append_offset_str(sym_name, sym->st_value, addr,
-						func_name);
-		if (ret) {
+	for (i = 0; i < header->inline_range_count; i++) {
+		if (dwarf_index->inline_ranges[i].index >=
+				header->inline_count) {
+			goto error;
+		}
+	}
+
+	for (i = 0; i < header->line_count; i++) {
+		if (dwarf_index->lines[i].filename >= strtab_len) {
 			goto error;
 		}
 	}
 
-	g_free(shdr);
-	g_free(sym);
 	return 0;
 
 error:
-	g_free(shdr);
-	g_free(sym);
+	return -1;
+}
+
+/*
+ * Lay out the tables of a built DWARF index in an image.
+ */
+static
+struct bin_info_dwarf_index *dwarf_index_builder_finish(
+		struct bin_info_dwarf_index_builder *builder)
+{
+	struct bin_info_dwarf_index *dwarf_index = NULL;
+	struct bin_info_dwarf_index_header header;
+	uint64_t offsets[DWARF_INDEX_TABLE_COUNT];
+	uint64_t *starts;
+	uint64_t len, range_count = 0;
+	char *image = NULL;
+	guint i;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, DWARF_INDEX_MAGIC, sizeof(header.magic));
+	header.version = DWARF_INDEX_VERSION;
+	header.byte_order = DWARF_INDEX_BYTE_ORDER;
+	header.func_count = builder->funcs->len;
+	header.func_range_count = builder->func_ranges->len;
+	header.inline_count = builder->inlines->len;
+	header.inline_depth_count = builder->inline_ranges->len;
+	for (i = 0; i < builder->inline_ranges->len; i++) {
+		GArray *ranges = g_ptr_array_index(builder->inline_ranges, i);
+
+		header.inline_range_count += ranges->len;
+	}
+	header.line_count = builder->lines->len;
+	header.strtab_len = builder->strtab->len;
+
+	len = dwarf_index_layout(&header, offsets);
+	if (len > SIZE_MAX) {
+		goto error;
+	}
+
+	image = g_malloc0(len);
+	if (!image) {
+		goto error;
+	}
+
+	memcpy(image, &header, sizeof(header));
+	memcpy(image + offsets[DWARF_INDEX_FUNCS], builder->funcs->data,
+			builder->funcs->len *
+			sizeof(struct bin_info_dwarf_func));
+	memcpy(image + offsets[DWARF_INDEX_FUNC_RANGES],
+			builder->func_ranges->data, builder->func_ranges->len *
+			sizeof(struct bin_info_addr_range));
+	memcpy(image + offsets[DWARF_INDEX_INLINES], builder->inlines->data,
+			builder->inlines->len *
+			sizeof(struct bin_info_dwarf_inline));
+
+	starts = (uint64_t *) (image + offsets[DWARF_INDEX_INLINE_DEPTH_STARTS]);
+	for (i = 0; i < builder->inline_ranges->len; i++) {
+		GArray *ranges = g_ptr_array_index(builder->inline_ranges, i);
+
+		starts[i] = range_count;
+		memcpy(image + offsets[DWARF_INDEX_INLINE_RANGES] +
+				range_count * sizeof(struct bin_info_addr_range),
+				ranges->data, ranges->len *
+				sizeof(struct bin_info_addr_range));
+		range_count += ranges->len;
+	}
+	starts[i] = range_count;
+
+	memcpy(image + offsets[DWARF_INDEX_LINES], builder->lines->data,
+			builder->lines->len *
+			sizeof(struct bin_info_dwarf_line));
+	memcpy(image + offsets[DWARF_INDEX_STRTAB], builder->strtab->str,
+			builder->strtab->len);
+
+	dwarf_index = g_new0(struct bin_info_dwarf_index, 1);
+	if (!dwarf_index) {
+		goto error;
+	}
+
+	dwarf_index->image = image;
+	dwarf_index->image_len = len;
+	if (dwarf_index_set_tables(dwarf_index)) {
+		/* Ownership passed to dwarf_index. */
+		image = NULL;
+		goto error;
+	}
+
+	return dwarf_index;
+
+error:
+	bin_info_dwarf_index_destroy(dwarf_index);
+	g_free(image);
+	return NULL;
+}
+
+/**
+ * Build the address tables of the DWARF info of an executable.
+ *
+ * @param dwarf_info	DWARF info of the executable
+ * @returns		Pointer to the new DWARF index on success,
+ *			NULL on failure
+ */
+static
+struct bin_info_dwarf_index *bin_info_dwarf_index_create(Dwarf *dwarf_info)
+{
+	struct bin_info_dwarf_index_builder builder;
+	struct bin_info_dwarf_index *dwarf_index = NULL;
+	struct bt_dwarf_cu *cu = NULL;
+	guint i;
+
+	memset(&builder, 0, sizeof(builder));
+	builder.funcs = g_array_new(FALSE, FALSE,
+			sizeof(struct bin_info_dwarf_func));
+	builder.func_ranges = g_array_new(FALSE, FALSE,
+			sizeof(struct bin_info_addr_range));
+	builder.inlines = g_array_new(FALSE, FALSE,
+			sizeof(struct bin_info_dwarf_inline));
+	builder.inline_ranges = g_ptr_array_new();
+	builder.lines = g_array_new(FALSE, FALSE,
+			sizeof(struct bin_info_dwarf_line));
+	/* Offset 0 is the empty string, standing for none. */
+	builder.strtab = g_string_new_len("", 1);
+	builder.str_offsets = g_hash_table_new(g_str_hash, g_str_equal);
+	if (!builder.funcs || !builder.func_ranges || !builder.inlines ||
+			!builder.inline_ranges || !builder.lines ||
+			!builder.strtab || !builder.str_offsets) {
+		goto end;
+	}
+
+	cu = bt_dwarf_cu_create(dwarf_info);
+	if (!cu) {
+		goto end;
+	}
+
+	while (bt_dwarf_cu_next(cu) == 0) {
+		struct bt_dwarf_die *cu_die;
+
+		cu_die = bt_dwarf_die_create(cu);
+		if (!cu_die) {
+			goto end;
+		}
+
+		dwarf_index_builder_add_cu(&builder, cu_die->dwarf_die);
+		bt_dwarf_die_destroy(cu_die);
+	}
+
+	addr_ranges_sort(builder.func_ranges);
+	for (i = 0; i < builder.inline_ranges->len; i++) {
+		addr_ranges_sort(g_ptr_array_index(builder.inline_ranges, i));
+	}
+	dwarf_lines_sort(builder.lines);
+
+	dwarf_index = dwarf_index_builder_finish(&builder);
+
+end:
+	bt_dwarf_cu_destroy(cu);
+	dwarf_index_builder_fini(&builder);
+	return dwarf_index;
+}
+
+/*
+ * Path of the cached DWARF index of an executable: named after its
+ * build ID if known, otherwise after a checksum of its path, inode,
+ * size and modification time, and of those of its debug link file.
+ */
+static
+char *bin_info_get_dwarf_index_cache_path(struct bin_info_data *data)
+{
+	char *key = NULL, *filename = NULL, *path = NULL;
+	int i;
+
+	if (data->build_id) {
+		GString *build_id = g_string_new(NULL);
+
+		for (i = 0; i < data->build_id_len; ++i) {
+			g_string_append_printf(build_id, "%02x",
+					data->build_id[i]);
+		}
+
+		key = g_string_free(build_id, FALSE);
+	} else {
+		GString *id = g_string_new(NULL);
+		gchar **paths;
+		struct stat st;
+
+		if (stat(data->elf_path, &st)) {
+			g_string_free(id, TRUE);
+			goto end;
+		}
+
+		g_string_append_printf(id, "%s:%" PRIu64 ":%" PRIu64
+				":%" PRIu64 ":%" PRId64, data->elf_path,
+				(uint64_t) st.st_dev, (uint64_t) st.st_ino,
+				(uint64_t) st.st_size, (int64_t) st.st_mtime);
+
+		/*
+		 * The DWARF info may come from the separate debug file
+		 * named by the debug link, which can be installed or
+		 * replaced without the executable changing: add its
+		 * CRC and the identity of the first candidate file.
+		 */
+		paths = bin_info_get_debug_link_paths(data);
+		if (paths) {
+			g_string_append_printf(id, ":%08" PRIx32,
+					data->dbg_link_crc);
+			for (i = 0; paths[i]; i++) {
+				if (stat(paths[i], &st)) {
+					continue;
+				}
+
+				g_string_append_printf(id, ":%s:%" PRIu64
+						":%" PRIu64 ":%" PRIu64
+						":%" PRId64, paths[i],
+						(uint64_t) st.st_dev,
+						(uint64_t) st.st_ino,
+						(uint64_t) st.st_size,
+						(int64_t) st.st_mtime);
+				break;
+			}
+			g_strfreev(paths);
+		}
+
+		key = g_compute_checksum_for_string(G_CHECKSUM_SHA1, id->str,
+				-1);
+		g_string_free(id, TRUE);
+	}
+
+	if (!key) {
+		goto end;
+	}
+
+	filename = g_strconcat(key, DWARF_INDEX_SUFFIX, NULL);
+	path = g_build_path("/", opt_debug_info_cache_dir, filename, NULL);
+
+end:
+	g_free(filename);
+	g_free(key);
+	return path;
+}
+
+/**
+ * Try to map the DWARF index of an executable from the cache
+ * directory.
+ *
+ * @param data	bin_info_data instance
+ * @returns	0 on success (i.e. dwarf_index set), -1 on failure
+ */
+static
+int bin_info_load_dwarf_index(struct bin_info_data *data)
+{
+	struct bin_info_dwarf_index *dwarf_index = NULL;
+	char *path = NULL;
+	struct stat st;
+	int fd = -1, ret = -1;
+	void *image;
+
+	if (!opt_debug_info_cache_dir) {
+		goto end;
+	}
+
+	path = bin_info_get_dwarf_index_cache_path(data);
+	if (!path) {
+		goto end;
+	}
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		goto end;
+	}
+
+	if (fstat(fd, &st) || st.st_size <= 0 || st.st_size > SIZE_MAX) {
+		goto end;
+	}
+
+	image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (image == MAP_FAILED) {
+		goto end;
+	}
+
+	dwarf_index = g_new0(struct bin_info_dwarf_index, 1);
+	if (!dwarf_index) {
+		munmap(image, st.st_size);
+		goto end;
+	}
+
+	dwarf_index->image = image;
+	dwarf_index->image_len = st.st_size;
+	dwarf_index->mapped = true;
+	if (dwarf_index_set_tables(dwarf_index) ||
+			dwarf_index_validate(dwarf_index)) {
+		printf_verbose("Ignoring invalid debug info cache file %s\n",
+				path);
+		goto end;
+	}
+
+	data->dwarf_index = dwarf_index;
+	dwarf_index = NULL;
+	ret = 0;
+
+end:
+	bin_info_dwarf_index_destroy(dwarf_index);
+	if (fd >= 0) {
+		close(fd);
+	}
+	g_free(path);
 	return ret;
 }
 
 /**
- * Get the name of the function containing a given address within a
- * given compile unit (CU).
+ * Write the DWARF index of an executable to the cache directory.
  *
- * If found, the out parameter `func_name` is set on success. On
- * failure, it remains unchanged.
+ * The index is written to a temporary file renamed once complete, so
+ * that concurrent readers only ever map complete indexes.
  *
- * @param cu		bt_dwarf_cu instance which may contain the address
- * @param addr		Virtual memory address for which to find the
- *			function name
- * @param func_name	Out parameter, the function name
- * @returns		0 on success, -1 on failure
+ * @param data	bin_info_data instance
+ * @returns	0 on success, -1 on failure
  */
 static
-int bin_info_lookup_cu_function_name(struct bt_dwarf_cu *cu, uint64_t addr,
-		char **func_name)
+int bin_info_save_dwarf_index(struct bin_info_data *data)
 {
-	int ret = 0;
-	bool found = false;
-	struct bt_dwarf_die *die = NULL;
+	struct bin_info_dwarf_index *dwarf_index = data->dwarf_index;
+	char *path = NULL, *tmp_path = NULL;
+	const char *buf = dwarf_index->image;
+	size_t len = dwarf_index->image_len;
+	int fd = -1, ret = 0;
+
+	path = bin_info_get_dwarf_index_cache_path(data);
+	if (!path) {
+		goto error;
+	}
 
-	if (!cu || !func_name) {
+	if (g_mkdir_with_parents(opt_debug_info_cache_dir, 0755)) {
 		goto error;
 	}
 
-	die = bt_dwarf_die_create(cu);
-	if (!die) {
+	tmp_path = g_strconcat(path, ".XXXXXX", NULL);
+	fd = mkstemp(tmp_path);
+	if (fd < 0) {
 		goto error;
 	}
 
-	while (bt_dwarf_die_next(die) == 0) {
-		int tag;
+	while (len) {
+		ssize_t written = write(fd, buf, len);
+
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
 
-		ret = bt_dwarf_die_get_tag(die, &tag);
-		if (ret) {
 			goto error;
 		}
 
-		if (tag == DW_TAG_subprogram) {
-			ret = bt_dwarf_die_contains_addr(die, addr, &found);
-			if (ret) {
-				goto error;
+		buf += written;
+		len -= written;
+	}
+
+	ret = close(fd);
+	fd = -1;
+	if (ret) {
+		goto error;
+	}
+
+	ret = rename(tmp_path, path);
+	if (ret) {
+		goto error;
+	}
+
+	goto end;
+
+error:
+	printf_verbose("Failed to write debug info cache file %s\n",
+			path ? : data->elf_path);
+	if (fd >= 0) {
+		close(fd);
+	}
+	if (tmp_path) {
+		unlink(tmp_path);
+	}
+	ret = -1;
+end:
+	g_free(tmp_path);
+	g_free(path);
+	return ret;
+}
+
+/**
+ * Initialize the DWARF info for a given executable, or only its
+ * DWARF index if it is in the cache directory.
+ *
+ * @param data	bin_info_data instance
+ * @returns	0 on success, negative value on failure
+ */
+static
+int bin_info_set_dwarf_index_or_info(struct bin_info_data *data)
+{
+	if (!bin_info_load_dwarf_index(data)) {
+		return 0;
+	}
+
+	return bin_info_set_dwarf_info(data);
+}
+
+/*
+ * Get the DWARF index of an executable with DWARF info, building it on
+ * the first call and saving it to the cache directory, if any.
+ */
+static
+struct bin_info_dwarf_index *bin_info_get_dwarf_index(
+		struct bin_info_data *data)
+{
+	if (!data->dwarf_index) {
+		data->dwarf_index = bin_info_dwarf_index_create(data->dwarf_info);
+		if (data->dwarf_index && opt_debug_info_cache_dir) {
+			(void) bin_info_save_dwarf_index(data);
+		}
+
+		/*
+		 * The index has copies of all it needs from the DWARF
+		 * info: release it, and its file, rather than keeping
+		 * them open for each binary of the trace.
+		 */
+		if (data->dwarf_index) {
+			dwarf_end(data->dwarf_info);
+			data->dwarf_info = NULL;
+			if (data->dwarf_fd >= 0) {
+				close(data->dwarf_fd);
+				data->dwarf_fd = -1;
 			}
+		}
+	}
+
+	return data->dwarf_index;
+}
+
+static
+const char *dwarf_index_get_str(const struct bin_info_dwarf_index *dwarf_index,
+		uint32_t offset)
+{
+	return offset ? dwarf_index->strtab + offset : NULL;
+}
+
+/*
+ * Find the range containing an address among sorted ranges which do not
+ * overlap.
+ */
+static
+const struct bin_info_addr_range *addr_ranges_find(
+		const struct bin_info_addr_range *ranges, uint64_t count,
+		uint64_t addr)
+{
+	uint64_t low = 0, high = count;
 
-			if (found) {
-				break;
-			}
+	while (low < high) {
+		uint64_t mid = low + (high - low) / 2;
+
+		if (ranges[mid].start <= addr) {
+			low = mid + 1;
+		} else {
+			high = mid;
 		}
 	}
 
-	if (found) {
-		uint64_t low_addr = 0;
-		char *die_name = NULL;
+	if (low == 0 || addr >= ranges[low - 1].end) {
+		return NULL;
+	}
 
-		ret = bt_dwarf_die_get_name(die, &die_name);
-		if (ret) {
-			goto error;
-		}
+	return &ranges[low - 1];
+}
 
-		ret = dwarf_lowpc(die->dwarf_die, &low_addr);
-		if (ret) {
-			free(die_name);
-			goto error;
-		}
+/*
+ * Find the line starting exactly at an address among sorted lines.
+ */
+static
+const struct bin_info_dwarf_line *dwarf_lines_find(
+		const struct bin_info_dwarf_line *lines, uint64_t count,
+		uint64_t addr)
+{
+	uint64_t low = 0, high = count;
 
-		ret = bin_info_append_offset_str(die_name, low_addr, addr,
-						func_name);
-		free(die_name);
-		if (ret) {
-			goto error;
+	while (low < high) {
+		uint64_t mid = low + (high - low) / 2;
+
+		if (lines[mid].addr < addr) {
+			low = mid + 1;
+		} else {
+			high = mid;
 		}
 	}
 
-	bt_dwarf_die_destroy(die);
-	return 0;
+	if (low == count || lines[low].addr != addr) {
+		return NULL;
+	}
 
-error:
-	bt_dwarf_die_destroy(die);
-	return -1;
+	return &lines[low];
 }
 
 /**
@@ -858,7 +2238,7 @@ error:
  * If found, the out parameter `func_name` is set on success. On
  * failure, it remains unchanged.
  *
- * @param bin		bin_info instance for the executable containing
+ * @param data		bin_info_data instance for the executable containing
  *			the address
  * @param addr		Virtual memory address for which to find the
  *			function name
@@ -866,68 +2246,69 @@ error:
  * @returns		0 on success, -1 on failure
  */
 static
-int bin_info_lookup_dwarf_function_name(struct bin_info *bin, uint64_t addr,
-		char **func_name)
+int bin_info_lookup_dwarf_function_name(struct bin_info_data *data,
+		uint64_t addr, char **func_name)
 {
-	int ret = 0;
-	char *_func_name = NULL;
-	struct bt_dwarf_cu *cu = NULL;
+	struct bin_info_dwarf_index *dwarf_index;
+	const struct bin_info_addr_range *range;
+	const struct bin_info_dwarf_func *func;
 
-	if (!bin || !func_name) {
+	if (!data || !func_name) {
 		goto error;
 	}
 
-	cu = bt_dwarf_cu_create(bin->dwarf_info);
-	if (!cu) {
+	dwarf_index = bin_info_get_dwarf_index(data);
+	if (!dwarf_index) {
 		goto error;
 	}
 
-	while (bt_dwarf_cu_next(cu) == 0) {
-		ret = bin_info_lookup_cu_function_name(cu, addr, &_func_name);
-		if (ret) {
-			goto error;
-		}
-
-		if (_func_name) {
-			break;
-		}
-	}
-
-	if (_func_name) {
-		*func_name = _func_name;
-	} else {
+	range = addr_ranges_find(dwarf_index->func_ranges,
+			dwarf_index->header->func_range_count, addr);
+	if (!range) {
 		goto error;
 	}
 
-	bt_dwarf_cu_destroy(cu);
-	return 0;
+	func = &dwarf_index->funcs[range->index];
+	return bin_info_append_offset_str(
+			dwarf_index_get_str(dwarf_index, func->name),
+			func->low_pc, addr, func_name);
 
 error:
-	bt_dwarf_cu_destroy(cu);
 	return -1;
 }
 
+/*
+ * Set the DWARF info, or only the DWARF index, of an executable if it
+ * hasn't been accessed yet, falling back to ELF symbols if it has none.
+ *
+ * Called with the lock of the data held.
+ */
+static
+void bin_info_data_set_debug_info(struct bin_info_data *data)
+{
+	if (data->dwarf_info || data->dwarf_index || data->is_elf_only) {
+		return;
+	}
+
+	if (bin_info_set_dwarf_index_or_info(data)) {
+		printf_verbose("Failed to set bin dwarf info, falling back to ELF lookup.\n");
+		/* Failed to set DWARF info, fallback to ELF. */
+		data->is_elf_only = true;
+	}
+}
+
 BT_HIDDEN
 int bin_info_lookup_function_name(struct bin_info *bin, uint64_t addr,
 		char **func_name)
 {
 	int ret = 0;
 	char *_func_name = NULL;
+	struct bin_info_data *data;
 
 	if (!bin || !func_name) {
 		goto error;
 	}
 
-	/* Set DWARF info if it hasn't been accessed yet. */
-	if (!bin->dwarf_info && !bin->is_elf_only) {
-		ret = bin_info_set_dwarf_info(bin);
-		if (ret) {
-			printf_verbose("Failed to set bin dwarf info, falling back to ELF lookup.\n");
-			/* Failed to set DWARF info, fallback to ELF. */
-			bin->is_elf_only = true;
-		}
-	}
-
 	if (!bin_info_has_address(bin, addr)) {
 		goto error;
 	}
@@ -940,13 +2321,17 @@ int bin_info_lookup_function_name(struct bin_info *bin, uint64_t addr,
 		addr -= bin->low_addr;
 	}
 
-	if (bin->is_elf_only) {
-		ret = bin_info_lookup_elf_function_name(bin, addr, &_func_name);
+	data = bin->data;
+	pthread_mutex_lock(&data->lock);
+	bin_info_data_set_debug_info(data);
+	if (data->is_elf_only) {
+		ret = bin_info_lookup_elf_function_name(data, addr, &_func_name);
 		printf_verbose("Failed to lookup function name (elf), error %i\n", ret);
 	} else {
-		ret = bin_info_lookup_dwarf_function_name(bin, addr, &_func_name);
+		ret = bin_info_lookup_dwarf_function_name(data, addr, &_func_name);
 		printf_verbose("Failed to lookup function name (dwarf), error %i\n", ret);
 	}
+	pthread_mutex_unlock(&data->lock);
 
 	*func_name = _func_name;
 	return 0;
@@ -956,351 +2341,177 @@ error:
 }
 
 BT_HIDDEN
-int bin_info_get_bin_loc(struct bin_info *bin, uint64_t addr, char **bin_loc)
+void bin_info_prefetch(struct bin_info *bin)
 {
-	int ret = 0;
-	char *_bin_loc = NULL;
+	struct bin_info_data *data;
 
-	if (!bin || !bin_loc) {
-		goto error;
+	if (!bin) {
+		return;
 	}
 
-	if (bin->is_pic) {
-		addr -= bin->low_addr;
-		ret = asprintf(&_bin_loc, "+%#0" PRIx64, addr);
+	data = bin->data;
+	pthread_mutex_lock(&data->lock);
+	bin_info_data_set_debug_info(data);
+	if (!data->is_elf_only) {
+		(void) bin_info_get_dwarf_index(data);
 	} else {
-		ret = asprintf(&_bin_loc, "@%#0" PRIx64, addr);
+		(void) bin_info_get_elf_symbols(data);
 	}
-
-	if (ret == -1 || !_bin_loc) {
-		goto error;
-	}
-
-	*bin_loc = _bin_loc;
-	return 0;
-
-error:
-	return -1;
+	pthread_mutex_unlock(&data->lock);
 }
 
-/**
- * Predicate used to determine whether the children of a given DIE
- * contain a specific address.
- *
- * More specifically, the parameter `die` is expected to be a
- * subprogram (function) DIE, and this predicate tells whether any
- * subroutines are inlined within this function and would contain
- * `addr`.
- *
- * On success, the out parameter `contains` is set with the boolean
- * value indicating whether the DIE's range covers `addr`. On failure,
- * it remains unchanged.
- *
- * Do note that this function advances the position of `die`. If the
- * address is found within one of its children, `die` will be pointing
- * to that child upon returning from the function, allowing to extract
- * the information deemed necessary.
- *
- * @param die		The parent DIE in whose children the address will be
- *			looked for
- * @param addr		The address for which to look for in the DIEs
- * @param contains	Out parameter, true if addr is contained,
- *			false if not
- * @returns		Returns 0 on success, -1 on failure
- */
-static
-int bin_info_child_die_has_address(struct bt_dwarf_die *die, uint64_t addr, bool *contains)
+BT_HIDDEN
+bool bin_info_is_elf_only(struct bin_info *bin)
 {
-	int ret = 0;
-	bool _contains = false;
-
-	if (!die) {
-		goto error;
-	}
-
-	ret = bt_dwarf_die_child(die);
-	if (ret) {
-		goto error;
-	}
-
-	do {
-		int tag;
-
-		ret = bt_dwarf_die_get_tag(die, &tag);
-		if (ret) {
-			goto error;
-		}
-
-		if (tag == DW_TAG_inlined_subroutine) {
-			ret = bt_dwarf_die_contains_addr(die, addr, &_contains);
-			if (ret) {
-				goto error;
-			}
-
-			if (_contains) {
-				goto end;
-			}
-		}
-	} while (bt_dwarf_die_next(die) == 0);
+	bool is_elf_only;
 
-end:
-	*contains = _contains;
-	return 0;
+	pthread_mutex_lock(&bin->data->lock);
+	is_elf_only = bin->data->is_elf_only;
+	pthread_mutex_unlock(&bin->data->lock);
 
-error:
-	return -1;
+	return is_elf_only;
 }
 
-/**
- * Lookup the source location for a given address within a CU, making
- * the assumption that it is contained within an inline routine in a
- * function.
- *
- * @param cu		bt_dwarf_cu instance in which to look for the address
- * @param addr		The address for which to look for
- * @param src_loc	Out parameter, the source location (filename and
- *			line number) for the address
- * @returns		0 on success, -1 on failure
- */
-static
-int bin_info_lookup_cu_src_loc_inl(struct bt_dwarf_cu *cu, uint64_t addr,
-		struct source_location **src_loc)
+BT_HIDDEN
+int bin_info_get_bin_loc(struct bin_info *bin, uint64_t addr, char **bin_loc)
 {
 	int ret = 0;
-	bool found = false;
-	struct bt_dwarf_die *die = NULL;
-	struct source_location *_src_loc = NULL;
-
-	if (!cu || !src_loc) {
-		goto error;
-	}
+	char *_bin_loc = NULL;
 
-	die = bt_dwarf_die_create(cu);
-	if (!die) {
+	if (!bin || !bin_loc) {
 		goto error;
 	}
 
-	while (bt_dwarf_die_next(die) == 0) {
-		int tag;
-
-		ret = bt_dwarf_die_get_tag(die, &tag);
-		if (ret) {
-			goto error;
-		}
-
-		if (tag == DW_TAG_subprogram) {
-			bool contains = false;
-
-			ret = bt_dwarf_die_contains_addr(die, addr, &contains);
-			if (ret) {
-				goto error;
-			}
-
-			if (contains) {
-				/*
-				 * Try to find an inlined subroutine
-				 * child of this DIE containing addr.
-				 */
-				ret = bin_info_child_die_has_address(die, addr,
-						&found);
-				if(ret) {
-					goto error;
-				}
-
-				goto end;
-			}
-		}
+	if (bin->is_pic) {
+		addr -= bin->low_addr;
+		ret = asprintf(&_bin_loc, "+%#0" PRIx64, addr);
+	} else {
+		ret = asprintf(&_bin_loc, "@%#0" PRIx64, addr);
 	}
 
-end:
-	if (found) {
-		char *filename = NULL;
-		uint64_t line_no;
-
-		_src_loc = g_new0(struct source_location, 1);
-		if (!_src_loc) {
-			goto error;
-		}
-
-		ret = bt_dwarf_die_get_call_file(die, &filename);
-		if (ret) {
-			goto error;
-		}
-		ret = bt_dwarf_die_get_call_line(die, &line_no);
-		if (ret) {
-			free(filename);
-			goto error;
-		}
-
-		_src_loc->filename = filename;
-		_src_loc->line_no = line_no;
-		*src_loc = _src_loc;
+	if (ret == -1 || !_bin_loc) {
+		goto error;
 	}
 
-	bt_dwarf_die_destroy(die);
+	*bin_loc = _bin_loc;
 	return 0;
 
 error:
-	source_location_destroy(_src_loc);
-	bt_dwarf_die_destroy(die);
 	return -1;
 }
 
-/**
- * Lookup the source location for a given address within a CU,
- * assuming that it is contained within an inlined function.
- *
- * A source location can be found regardless of inlining status for
- * this method, but in the case of an inlined function, the returned
- * source location will point not to the callsite but rather to the
- * definition site of the inline function.
- *
- * @param cu		bt_dwarf_cu instance in which to look for the address
- * @param addr		The address for which to look for
- * @param src_loc	Out parameter, the source location (filename and
- *			line number) for the address
- * @returns		0 on success, -1 on failure
- */
-static
-int bin_info_lookup_cu_src_loc_no_inl(struct bt_dwarf_cu *cu, uint64_t addr,
+BT_HIDDEN
+int bin_info_lookup_source_location(struct bin_info *bin, uint64_t addr,
 		struct source_location **src_loc)
 {
+	struct bin_info_dwarf_index *dwarf_index;
+	const struct bin_info_addr_range *range = NULL;
 	struct source_location *_src_loc = NULL;
-	struct bt_dwarf_die *die = NULL;
-	const char *filename = NULL;
-	Dwarf_Line *line = NULL;
-	Dwarf_Addr line_addr;
-	int ret, line_no;
+	struct bin_info_data *data = NULL;
+	const char *filename;
+	uint64_t line_no;
 
-	if (!cu || !src_loc) {
+	if (!bin || !src_loc) {
 		goto error;
 	}
 
-	die = bt_dwarf_die_create(cu);
-	if (!die) {
+	if (!bin_info_has_address(bin, addr)) {
 		goto error;
 	}
 
-	line = dwarf_getsrc_die(die->dwarf_die, addr);
-	if (!line) {
-		goto error;
+	/*
+	 * Addresses in ELF and DWARF are relative to base address for
+	 * PIC, so make the address argument relative too if needed.
+	 */
+	if (bin->is_pic) {
+		addr -= bin->low_addr;
 	}
 
-	ret = dwarf_lineaddr(line, &line_addr);
-	if (ret) {
+	data = bin->data;
+	pthread_mutex_lock(&data->lock);
+	bin_info_data_set_debug_info(data);
+	if (data->is_elf_only) {
+		/* We cannot lookup source location without DWARF info. */
 		goto error;
 	}
 
-	filename = dwarf_linesrc(line, NULL, NULL);
-	if (!filename) {
+	dwarf_index = bin_info_get_dwarf_index(data);
+	if (!dwarf_index) {
 		goto error;
 	}
 
-	if (addr == line_addr) {
-		_src_loc = g_new0(struct source_location, 1);
-		if (!_src_loc) {
-			goto error;
-		}
-
-		ret = dwarf_lineno(line, &line_no);
-		if (ret) {
-			goto error;
-		}
+	/*
+	 * An address within an inlined subroutine is located at the
+	 * call site in the function it is inlined in. Otherwise, it
+	 * only has a source location if a line starts at it.
+	 */
+	if (dwarf_index->header->inline_depth_count) {
+		const uint64_t *starts = dwarf_index->inline_depth_starts;
 
-		_src_loc->line_no = line_no;
-		_src_loc->filename = strdup(filename);
+		range = addr_ranges_find(dwarf_index->inline_ranges,
+				starts[1] - starts[0], addr);
 	}
 
-	bt_dwarf_die_destroy(die);
-
-	if (_src_loc) {
-		*src_loc = _src_loc;
-	}
+	if (range) {
+		const struct bin_info_dwarf_inline *inl;
 
-	return 0;
+		inl = &dwarf_index->inlines[range->index];
+		filename = dwarf_index_get_str(dwarf_index, inl->call_file);
+		if (!filename) {
+			goto error;
+		}
 
-error:
-	source_location_destroy(_src_loc);
-	bt_dwarf_die_destroy(die);
-	return -1;
-}
+		line_no = inl->call_line;
+	} else {
+		const struct bin_info_dwarf_line *line;
 
-/**
- * Get the source location (file name and line number) for a given
- * address within a compile unit (CU).
- *
- * On success, the out parameter `src_loc` is set if found. On
- * failure, it remains unchanged.
- *
- * @param cu		bt_dwarf_cu instance for the compile unit which
- *			may contain the address
- * @param addr		Virtual memory address for which to find the
- *			source location
- * @param src_loc	Out parameter, the source location
- * @returns		0 on success, -1 on failure
- */
-static
-int bin_info_lookup_cu_src_loc(struct bt_dwarf_cu *cu, uint64_t addr,
-		struct source_location **src_loc)
-{
-	int ret = 0;
-	struct source_location *_src_loc = NULL;
+		line = dwarf_lines_find(dwarf_index->lines,
+				dwarf_index->header->line_count, addr);
+		if (!line) {
+			goto end;
+		}
 
-	if (!cu || !src_loc) {
-		goto error;
+		filename = dwarf_index_get_str(dwarf_index, line->filename);
+		line_no = line->line_no;
 	}
 
-	ret = bin_info_lookup_cu_src_loc_inl(cu, addr, &_src_loc);
-	if (ret) {
+	_src_loc = g_new0(struct source_location, 1);
+	if (!_src_loc) {
 		goto error;
 	}
 
-	if (_src_loc) {
-		goto end;
-	}
-
-	ret = bin_info_lookup_cu_src_loc_no_inl(cu, addr, &_src_loc);
-	if (ret) {
+	_src_loc->filename = strdup(filename);
+	if (!_src_loc->filename) {
 		goto error;
 	}
 
-	if (_src_loc) {
-		goto end;
-	}
+	_src_loc->line_no = line_no;
+	*src_loc = _src_loc;
 
 end:
-	if (_src_loc) {
-		*src_loc = _src_loc;
-	}
-
+	pthread_mutex_unlock(&data->lock);
 	return 0;
 
 error:
+	if (data) {
+		pthread_mutex_unlock(&data->lock);
+	}
 	source_location_destroy(_src_loc);
 	return -1;
 }
 
 BT_HIDDEN
-int bin_info_lookup_source_location(struct bin_info *bin, uint64_t addr,
-		struct source_location **src_loc)
+int bin_info_lookup_inline_frames(struct bin_info *bin, uint64_t addr,
+		struct inline_frame **frames, unsigned int *nr_frames)
 {
-	struct bt_dwarf_cu *cu = NULL;
-	struct source_location *_src_loc = NULL;
-
-	if (!bin || !src_loc) {
-		goto error;
-	}
-
-	/* Set DWARF info if it hasn't been accessed yet. */
-	if (!bin->dwarf_info && !bin->is_elf_only) {
-		if (bin_info_set_dwarf_info(bin)) {
-			/* Failed to set DWARF info. */
-			bin->is_elf_only = true;
-		}
-	}
-
-	if (bin->is_elf_only) {
-		/* We cannot lookup source location without DWARF info. */
+	struct bin_info_dwarf_index *dwarf_index;
+	struct bin_info_data *data = NULL;
+	struct inline_frame *_frames = NULL;
+	const struct bin_info_dwarf_inline **inls = NULL;
+	const uint64_t *starts;
+	uint64_t depth, nr_inls = 0;
+
+	if (!bin || !frames || !nr_frames) {
 		goto error;
 	}
 
@@ -1316,33 +2527,96 @@ int bin_info_lookup_source_location(struct bin_info *bin, uint64_t addr,
 		addr -= bin->low_addr;
 	}
 
-	cu = bt_dwarf_cu_create(bin->dwarf_info);
-	if (!cu) {
+	data = bin->data;
+	pthread_mutex_lock(&data->lock);
+	bin_info_data_set_debug_info(data);
+	if (data->is_elf_only) {
+		/* We cannot lookup inlined subroutines without DWARF info. */
 		goto error;
 	}
 
-	while (bt_dwarf_cu_next(cu) == 0) {
-		int ret;
-
-		ret = bin_info_lookup_cu_src_loc(cu, addr, &_src_loc);
-		if (ret) {
-			goto error;
-		}
+	dwarf_index = bin_info_get_dwarf_index(data);
+	if (!dwarf_index) {
+		goto error;
+	}
 
-		if (_src_loc) {
+	/*
+	 * The subroutine inlined at the address at a depth contains the
+	 * ones at the next depths, so stop at the first depth without
+	 * one.
+	 */
+	starts = dwarf_index->inline_depth_starts;
+	inls = g_new0(const struct bin_info_dwarf_inline *,
+			dwarf_index->header->inline_depth_count);
+	for (depth = 0; depth < dwarf_index->header->inline_depth_count;
+			depth++) {
+		const struct bin_info_addr_range *range;
+
+		range = addr_ranges_find(&dwarf_index->inline_ranges[starts[depth]],
+				starts[depth + 1] - starts[depth], addr);
+		if (!range) {
 			break;
 		}
+
+		inls[nr_inls++] = &dwarf_index->inlines[range->index];
 	}
 
-	bt_dwarf_cu_destroy(cu);
-	if (_src_loc) {
-		*src_loc = _src_loc;
+	if (!nr_inls) {
+		goto end;
+	}
+
+	_frames = g_new0(struct inline_frame, nr_inls);
+	for (depth = 0; depth < nr_inls; depth++) {
+		struct inline_frame *frame = &_frames[nr_inls - 1 - depth];
+		const char *func_name, *filename;
+
+		func_name = dwarf_index_get_str(dwarf_index,
+				inls[depth]->name);
+		if (func_name) {
+			frame->func_name = strdup(func_name);
+			if (!frame->func_name) {
+				goto error;
+			}
+		}
+
+		if (depth + 1 < nr_inls) {
+			filename = dwarf_index_get_str(dwarf_index,
+					inls[depth + 1]->call_file);
+			frame->line_no = inls[depth + 1]->call_line;
+		} else {
+			const struct bin_info_dwarf_line *line;
+
+			line = dwarf_lines_find(dwarf_index->lines,
+					dwarf_index->header->line_count, addr);
+			if (!line) {
+				continue;
+			}
+
+			filename = dwarf_index_get_str(dwarf_index,
+					line->filename);
+			frame->line_no = line->line_no;
+		}
+
+		if (filename) {
+			frame->filename = strdup(filename);
+			if (!frame->filename) {
+				goto error;
+			}
+		}
 	}
 
+end:
+	pthread_mutex_unlock(&data->lock);
+	g_free(inls);
+	*frames = _frames;
+	*nr_frames = nr_inls;
 	return 0;
 
 error:
-	source_location_destroy(_src_loc);
-	bt_dwarf_cu_destroy(cu);
+	if (data) {
+		pthread_mutex_unlock(&data->lock);
+	}
+	g_free(inls);
+	inline_frames_destroy(_frames, nr_inls);
 	return -1;
 }
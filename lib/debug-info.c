@@ -26,6 +26,9 @@
  */
 
 #include <assert.h>
+#include <inttypes.h>
+#include <string.h>
+#include <pthread.h>
 #include <glib.h>
 #include <babeltrace/types.h>
 #include <babeltrace/ctf-ir/metadata.h>
@@ -34,6 +37,29 @@
 #include <babeltrace/babeltrace-internal.h>
 #include <babeltrace/utils.h>
 
+/*
+ * Maximum number of addresses of a call stack for which debug
+ * information is looked up, well below the size of the cache so that
+ * it holds those of a whole event.
+ */
+#define DEBUG_INFO_STACK_MAX_DEPTH	4096
+
+struct ip_cache_entry {
+	/* Key of ip_to_debug_info_src. */
+	uint64_t ip;
+	/* Binary the instruction pointer belongs to. */
+	struct bin_info *bin;
+	struct debug_info_source *debug_info_src;
+	/* Node of the LRU list, most recently used first. */
+	GList lru_node;
+};
+
+/* Address of a call stack, and its position within the stack. */
+struct stack_ip {
+	uint64_t ip;
+	unsigned int index;
+};
+
 struct proc_debug_info_sources {
 	/*
 	 * Hash table: base address (pointer to uint64_t) to bin info; owned by
@@ -42,10 +68,66 @@ struct proc_debug_info_sources {
 	GHashTable *baddr_to_bin_info;
 
 	/*
-	 * Hash table: IP (pointer to uint64_t) to (struct debug_info_source *);
+	 * Array of (struct bin_info *) sorted by base address, to find
+	 * the binary mapped at an address by binary search; the bin
+	 * infos are owned by baddr_to_bin_info.
+	 */
+	GArray *bin_infos;
+
+	/*
+	 * Largest size of the bin infos added since the last clear, which
+	 * bounds the search for a mapping containing another one.
+	 */
+	uint64_t max_memsz;
+
+	/*
+	 * Hash table: IP (pointer to uint64_t) to (struct ip_cache_entry *);
 	 * owned by proc_debug_info_sources.
 	 */
 	GHashTable *ip_to_debug_info_src;
+
+	/* Entries of ip_to_debug_info_src, most recently used first. */
+	GQueue ip_cache_lru;
+};
+
+/*
+ * Lookup of the debug info of an address missing from the IP cache,
+ * done by a worker thread or by the reading thread.
+ */
+struct ip_lookup {
+	struct bin_info *bin;
+	uint64_t ip;
+	struct debug_info_source *debug_info_src;
+};
+
+/*
+ * Threads reading the ELF and DWARF info of binaries and building their
+ * address tables ahead of their first lookup, and looking up the
+ * addresses of a call stack missing from the IP cache.
+ */
+struct debug_info_workers {
+	pthread_t *threads;
+	unsigned int nr_threads;
+	pthread_mutex_t lock;
+	/* Signaled when binaries or lookups are queued, or on exit. */
+	pthread_cond_t work_cond;
+	/* Signaled when a binary is prepared, or the lookups are done. */
+	pthread_cond_t done_cond;
+	/* Binaries (struct bin_info *) to prepare, oldest first. */
+	GQueue queue;
+	/*
+	 * Lookups (struct ip_lookup *) of the call stack being read,
+	 * taken before the binaries as the reading thread waits for
+	 * them, and the number of those not done yet.
+	 */
+	GQueue lookups;
+	unsigned int nr_pending_lookups;
+	/*
+	 * Hash table: binaries (struct bin_info *) queued or being
+	 * prepared, which the reading thread must not use meanwhile.
+	 */
+	GHashTable *busy;
+	bool exiting;
 };
 
 struct debug_info {
@@ -54,6 +136,21 @@ struct debug_info {
 	 * (struct ctf_proc_debug_infos*); owned by debug_info.
 	 */
 	GHashTable *vpid_to_proc_dbg_info_src;
+
+	/* NULL unless binaries are prepared by worker threads. */
+	struct debug_info_workers *workers;
+	/*
+	 * Binaries (struct bin_info *) mapped since the last event which
+	 * is not a state dump or library event, not yet handed to the
+	 * workers as their build ID or debug link may follow.
+	 */
+	GPtrArray *pending_bins;
+	/*
+	 * Addresses (uint64_t) of the call stack of the current event,
+	 * and their debug info (struct debug_info_source *).
+	 */
+	GArray *stack_ips;
+	GPtrArray *stack_srcs;
 	GQuark q_statedump_bin_info;
 	GQuark q_statedump_debug_link;
 	GQuark q_statedump_build_id;
@@ -61,6 +158,14 @@ struct debug_info {
 	GQuark q_dl_open;
 	GQuark q_lib_load;
 	GQuark q_lib_unload;
+
+	/*
+	 * IP cache statistics, reported in verbose mode and by
+	 * debug_info_get_stats().
+	 */
+	uint64_t ip_cache_hits;
+	uint64_t ip_cache_misses;
+	uint64_t ip_cache_evictions;
 };
 
 static
@@ -81,13 +186,305 @@ int debug_info_init(struct debug_info *info)
 	return bin_info_init();
 }
 
+static
+struct debug_info_source *debug_info_source_create_from_bin(
+		struct bin_info *bin, uint64_t ip);
+
+/*
+ * Run the queued lookups until none is left. Called with the workers
+ * lock held, which is released during each lookup.
+ */
+static
+void debug_info_workers_run_lookups(struct debug_info_workers *workers)
+{
+	struct ip_lookup *lookup;
+
+	while ((lookup = g_queue_pop_head(&workers->lookups))) {
+		pthread_mutex_unlock(&workers->lock);
+		lookup->debug_info_src = debug_info_source_create_from_bin(
+				lookup->bin, lookup->ip);
+		pthread_mutex_lock(&workers->lock);
+		if (--workers->nr_pending_lookups == 0) {
+			pthread_cond_broadcast(&workers->done_cond);
+		}
+	}
+}
+
+static
+void *debug_info_worker_thread(void *data)
+{
+	struct debug_info_workers *workers = data;
+
+	pthread_mutex_lock(&workers->lock);
+	for (;;) {
+		struct bin_info *bin;
+
+		while (!workers->exiting && g_queue_is_empty(&workers->queue)
+				&& g_queue_is_empty(&workers->lookups)) {
+			pthread_cond_wait(&workers->work_cond, &workers->lock);
+		}
+
+		if (workers->exiting) {
+			break;
+		}
+
+		if (!g_queue_is_empty(&workers->lookups)) {
+			debug_info_workers_run_lookups(workers);
+			continue;
+		}
+
+		bin = g_queue_pop_head(&workers->queue);
+		pthread_mutex_unlock(&workers->lock);
+
+		bin_info_prefetch(bin);
+
+		pthread_mutex_lock(&workers->lock);
+		(void) g_hash_table_remove(workers->busy, bin);
+		pthread_cond_broadcast(&workers->done_cond);
+	}
+	pthread_mutex_unlock(&workers->lock);
+
+	return NULL;
+}
+
+/*
+ * Stop the worker threads, once they are done with the binary they are
+ * preparing, if any.
+ */
+static
+void debug_info_workers_destroy(struct debug_info_workers *workers)
+{
+	unsigned int i;
+
+	if (!workers) {
+		return;
+	}
+
+	pthread_mutex_lock(&workers->lock);
+	workers->exiting = true;
+	pthread_cond_broadcast(&workers->work_cond);
+	pthread_mutex_unlock(&workers->lock);
+
+	for (i = 0; i < workers->nr_threads; i++) {
+		pthread_join(workers->threads[i], NULL);
+	}
+
+	g_queue_clear(&workers->queue);
+	g_queue_clear(&workers->lookups);
+	if (workers->busy) {
+		g_hash_table_destroy(workers->busy);
+	}
+	pthread_cond_destroy(&workers->done_cond);
+	pthread_cond_destroy(&workers->work_cond);
+	pthread_mutex_destroy(&workers->lock);
+	g_free(workers->threads);
+	g_free(workers);
+}
+
+static
+struct debug_info_workers *debug_info_workers_create(unsigned int nr_threads)
+{
+	struct debug_info_workers *workers;
+	int ret;
+
+	workers = g_new0(struct debug_info_workers, 1);
+	if (!workers) {
+		goto error;
+	}
+
+	pthread_mutex_init(&workers->lock, NULL);
+	pthread_cond_init(&workers->work_cond, NULL);
+	pthread_cond_init(&workers->done_cond, NULL);
+	g_queue_init(&workers->queue);
+	g_queue_init(&workers->lookups);
+	workers->busy = g_hash_table_new(g_direct_hash, g_direct_equal);
+	workers->threads = g_new0(pthread_t, nr_threads);
+	if (!workers->busy || !workers->threads) {
+		goto error;
+	}
+
+	for (; workers->nr_threads < nr_threads; workers->nr_threads++) {
+		ret = pthread_create(&workers->threads[workers->nr_threads],
+				NULL, debug_info_worker_thread, workers);
+		if (ret) {
+			fprintf(stderr, "[error] Cannot create debug info worker thread: %s\n",
+					strerror(ret));
+			goto error;
+		}
+	}
+
+	return workers;
+
+error:
+	debug_info_workers_destroy(workers);
+	return NULL;
+}
+
+/*
+ * Hand the binaries mapped so far to the workers.
+ */
+static
+void debug_info_submit_pending_bins(struct debug_info *debug_info)
+{
+	struct debug_info_workers *workers = debug_info->workers;
+	guint i;
+
+	if (!workers || !debug_info->pending_bins->len) {
+		return;
+	}
+
+	pthread_mutex_lock(&workers->lock);
+	for (i = 0; i < debug_info->pending_bins->len; i++) {
+		struct bin_info *bin = g_ptr_array_index(
+				debug_info->pending_bins, i);
+
+		g_queue_push_tail(&workers->queue, bin);
+		g_hash_table_insert(workers->busy, bin, bin);
+	}
+	pthread_cond_broadcast(&workers->work_cond);
+	pthread_mutex_unlock(&workers->lock);
+
+	g_ptr_array_set_size(debug_info->pending_bins, 0);
+}
+
+/*
+ * Take a binary back from the workers if none of them started
+ * preparing it yet. Returns whether it was still queued. Called with
+ * the workers lock held.
+ */
+static
+bool debug_info_workers_take_bin(struct debug_info_workers *workers,
+		struct bin_info *bin)
+{
+	if (!g_queue_remove(&workers->queue, bin)) {
+		return false;
+	}
+
+	(void) g_hash_table_remove(workers->busy, bin);
+	return true;
+}
+
+/*
+ * Wait until the workers are done with a binary, before using it.
+ */
+static
+void debug_info_wait_bin(struct debug_info *debug_info, struct bin_info *bin)
+{
+	struct debug_info_workers *workers = debug_info->workers;
+
+	if (!workers) {
+		return;
+	}
+
+	pthread_mutex_lock(&workers->lock);
+	while (g_hash_table_lookup(workers->busy, bin)) {
+		pthread_cond_wait(&workers->done_cond, &workers->lock);
+	}
+	pthread_mutex_unlock(&workers->lock);
+}
+
+/*
+ * Get a binary ready for a lookup: a binary still queued behind others
+ * is prepared right away rather than waited for.
+ */
+static
+void debug_info_get_bin(struct debug_info *debug_info, struct bin_info *bin)
+{
+	struct debug_info_workers *workers = debug_info->workers;
+	bool taken;
+
+	if (!workers) {
+		return;
+	}
+
+	pthread_mutex_lock(&workers->lock);
+	taken = debug_info_workers_take_bin(workers, bin);
+	pthread_mutex_unlock(&workers->lock);
+
+	if (taken) {
+		bin_info_prefetch(bin);
+	} else {
+		debug_info_wait_bin(debug_info, bin);
+	}
+}
+
+/*
+ * Look up addresses missing from the IP cache with the help of the
+ * workers, the reading thread taking its share.
+ *
+ * The binaries of the lookups still queued are taken back from the
+ * workers rather than waited for: a lookup prepares its binary first,
+ * under the lock of the binary, which also serializes it with a
+ * worker preparing that binary, or looking up another address of it.
+ */
+static
+void debug_info_run_lookups(struct debug_info *debug_info,
+		struct ip_lookup *lookups, unsigned int nr_lookups)
+{
+	struct debug_info_workers *workers = debug_info->workers;
+	unsigned int i;
+
+	if (!workers || nr_lookups < 2) {
+		for (i = 0; i < nr_lookups; i++) {
+			debug_info_get_bin(debug_info, lookups[i].bin);
+			lookups[i].debug_info_src =
+				debug_info_source_create_from_bin(
+					lookups[i].bin, lookups[i].ip);
+		}
+		return;
+	}
+
+	pthread_mutex_lock(&workers->lock);
+	for (i = 0; i < nr_lookups; i++) {
+		(void) debug_info_workers_take_bin(workers, lookups[i].bin);
+		g_queue_push_tail(&workers->lookups, &lookups[i]);
+	}
+	workers->nr_pending_lookups += nr_lookups;
+	pthread_cond_broadcast(&workers->work_cond);
+
+	debug_info_workers_run_lookups(workers);
+	while (workers->nr_pending_lookups) {
+		pthread_cond_wait(&workers->done_cond, &workers->lock);
+	}
+	pthread_mutex_unlock(&workers->lock);
+}
+
+/*
+ * Make sure the workers are not handed a binary, nor still using it,
+ * before destroying it.
+ */
+static
+void debug_info_forget_bin(struct debug_info *debug_info,
+		struct bin_info *bin)
+{
+	if (!debug_info->workers) {
+		return;
+	}
+
+	(void) g_ptr_array_remove_fast(debug_info->pending_bins, bin);
+
+	/* No use preparing it if it is still queued. */
+	pthread_mutex_lock(&debug_info->workers->lock);
+	(void) debug_info_workers_take_bin(debug_info->workers, bin);
+	pthread_mutex_unlock(&debug_info->workers->lock);
+	debug_info_wait_bin(debug_info, bin);
+}
+
 static
 void debug_info_source_destroy(struct debug_info_source *debug_info_src)
 {
+	unsigned int i;
+
 	if (!debug_info_src) {
 		return;
 	}
 
+	for (i = 0; i < debug_info_src->nr_inline_frames; i++) {
+		free(debug_info_src->inline_frames[i].func);
+		free(debug_info_src->inline_frames[i].src_path);
+	}
+
+	g_free(debug_info_src->inline_frames);
 	free(debug_info_src->func);
 	free(debug_info_src->src_path);
 	free(debug_info_src->bin_path);
@@ -95,6 +492,52 @@ void debug_info_source_destroy(struct debug_info_source *debug_info_src)
 	g_free(debug_info_src);
 }
 
+/*
+ * Set the subroutines inlined at the address of a debug info source,
+ * taking the strings of the frames found by bin_info.
+ */
+static
+int debug_info_source_set_inline_frames(
+		struct debug_info_source *debug_info_src, struct bin_info *bin,
+		uint64_t ip)
+{
+	struct inline_frame *frames = NULL;
+	unsigned int nr_frames = 0, i;
+	int ret;
+
+	ret = bin_info_lookup_inline_frames(bin, ip, &frames, &nr_frames);
+	if (ret || !frames) {
+		goto end;
+	}
+
+	debug_info_src->inline_frames = g_new0(struct debug_info_inline_frame,
+			nr_frames);
+	if (!debug_info_src->inline_frames) {
+		ret = -1;
+		goto end;
+	}
+
+	debug_info_src->nr_inline_frames = nr_frames;
+	for (i = 0; i < nr_frames; i++) {
+		struct debug_info_inline_frame *frame =
+				&debug_info_src->inline_frames[i];
+
+		frame->func = frames[i].func_name;
+		frames[i].func_name = NULL;
+		frame->line_no = frames[i].line_no;
+		frame->src_path = frames[i].filename;
+		frames[i].filename = NULL;
+		if (frame->src_path) {
+			frame->short_src_path = get_filename_from_path(
+					frame->src_path);
+		}
+	}
+
+end:
+	inline_frames_destroy(frames, nr_frames);
+	return ret;
+}
+
 static
 struct debug_info_source *debug_info_source_create_from_bin(struct bin_info *bin,
 		uint64_t ip)
@@ -116,7 +559,7 @@ struct debug_info_source *debug_info_source_create_from_bin(struct bin_info *bin
 	}
 
 	/* Can't retrieve src_loc from ELF, or could not find binary, skip. */
-	if (!bin->is_elf_only || !debug_info_src->func) {
+	if (!bin_info_is_elf_only(bin) || !debug_info_src->func) {
 		/* Lookup source location */
 		ret = bin_info_lookup_source_location(bin, ip, &src_loc);
 		printf_verbose("Failed to lookup source location (err: %i)\n", ret);
@@ -136,6 +579,13 @@ struct debug_info_source *debug_info_source_create_from_bin(struct bin_info *bin
 		}
 
 		source_location_destroy(src_loc);
+
+		/* Lookup the subroutines inlined at the address, if any. */
+		ret = debug_info_source_set_inline_frames(debug_info_src,
+				bin, ip);
+		if (ret) {
+			printf_verbose("Failed to lookup inlined subroutines\n");
+		}
 	}
 
 	if (bin->elf_path) {
@@ -161,6 +611,13 @@ error:
 	return NULL;
 }
 
+static
+void ip_cache_entry_destroy(struct ip_cache_entry *entry)
+{
+	debug_info_source_destroy(entry->debug_info_src);
+	g_free(entry);
+}
+
 static
 void proc_debug_info_sources_destroy(
 		struct proc_debug_info_sources *proc_dbg_info_src)
@@ -177,6 +634,10 @@ void proc_debug_info_sources_destroy(
 		g_hash_table_destroy(proc_dbg_info_src->ip_to_debug_info_src);
 	}
 
+	if (proc_dbg_info_src->bin_infos) {
+		g_array_free(proc_dbg_info_src->bin_infos, TRUE);
+	}
+
 	g_free(proc_dbg_info_src);
 }
 
@@ -198,12 +659,20 @@ struct proc_debug_info_sources *proc_debug_info_sources_create(void)
 	}
 
 	proc_dbg_info_src->ip_to_debug_info_src = g_hash_table_new_full(
-			g_int64_hash, g_int64_equal, (GDestroyNotify) g_free,
-			(GDestroyNotify) debug_info_source_destroy);
+			g_int64_hash, g_int64_equal, NULL,
+			(GDestroyNotify) ip_cache_entry_destroy);
 	if (!proc_dbg_info_src->ip_to_debug_info_src) {
 		goto error;
 	}
 
+	g_queue_init(&proc_dbg_info_src->ip_cache_lru);
+
+	proc_dbg_info_src->bin_infos = g_array_new(FALSE, FALSE,
+			sizeof(struct bin_info *));
+	if (!proc_dbg_info_src->bin_infos) {
+		goto error;
+	}
+
 end:
 	return proc_dbg_info_src;
 
@@ -245,60 +714,268 @@ end:
 	return proc_dbg_info_src;
 }
 
+/*
+ * Index of the first bin info of the sorted array whose base address is
+ * greater than addr.
+ */
 static
-struct debug_info_source *proc_debug_info_sources_get_entry(
+guint bin_infos_upper_bound(GArray *bin_infos, uint64_t addr)
+{
+	guint low = 0, high = bin_infos->len;
+
+	while (low < high) {
+		guint mid = low + (high - low) / 2;
+		struct bin_info *bin;
+
+		bin = g_array_index(bin_infos, struct bin_info *, mid);
+		if (bin->low_addr <= addr) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	return low;
+}
+
+static
+void proc_debug_info_sources_add_bin_info(
+		struct proc_debug_info_sources *proc_dbg_info_src,
+		struct bin_info *bin)
+{
+	guint i = bin_infos_upper_bound(proc_dbg_info_src->bin_infos,
+			bin->low_addr);
+
+	g_array_insert_val(proc_dbg_info_src->bin_infos, i, bin);
+	proc_dbg_info_src->max_memsz = MAX(proc_dbg_info_src->max_memsz,
+			bin->memsz);
+}
+
+static
+void proc_debug_info_sources_remove_bin_info(
+		struct proc_debug_info_sources *proc_dbg_info_src,
+		struct bin_info *bin)
+{
+	GArray *bin_infos = proc_dbg_info_src->bin_infos;
+	guint i = bin_infos_upper_bound(bin_infos, bin->low_addr);
+
+	while (i-- > 0) {
+		struct bin_info *cur;
+
+		cur = g_array_index(bin_infos, struct bin_info *, i);
+		if (cur->low_addr != bin->low_addr) {
+			break;
+		}
+
+		if (cur == bin) {
+			g_array_remove_index(bin_infos, i);
+			break;
+		}
+	}
+}
+
+/*
+ * Find the bin info mapped at an address: the one with the greatest
+ * base address not above it which contains it. Mappings of a trace may
+ * overlap, e.g. when an unload event is missing: the nearest one does
+ * not contain the address if it ends below it, but one with a lower
+ * base address, within the size of the largest mapping, may.
+ *
+ * If next_base is not NULL, it is set to the base address of the next
+ * mapping above addr, or UINT64_MAX: the same bin info is found for
+ * the addresses up to it which it contains.
+ */
+static
+struct bin_info *proc_debug_info_sources_find_bin_info(
+		struct proc_debug_info_sources *proc_dbg_info_src,
+		uint64_t addr, uint64_t *next_base)
+{
+	GArray *bin_infos = proc_dbg_info_src->bin_infos;
+	struct bin_info *bin;
+	guint i;
+
+	i = bin_infos_upper_bound(bin_infos, addr);
+	if (next_base) {
+		*next_base = UINT64_MAX;
+		if (i < bin_infos->len) {
+			*next_base = g_array_index(bin_infos,
+					struct bin_info *, i)->low_addr;
+		}
+	}
+
+	while (i-- > 0) {
+		bin = g_array_index(bin_infos, struct bin_info *, i);
+		if (addr - bin->low_addr >= proc_dbg_info_src->max_memsz) {
+			break;
+		}
+
+		if (bin_info_has_address(bin, addr) == 1) {
+			return bin;
+		}
+	}
+
+	return NULL;
+}
+
+static
+void proc_debug_info_sources_remove_ip_cache_entry(
+		struct proc_debug_info_sources *proc_dbg_info_src,
+		struct ip_cache_entry *entry)
+{
+	g_queue_unlink(&proc_dbg_info_src->ip_cache_lru, &entry->lru_node);
+	/* Destroys the entry. */
+	(void) g_hash_table_remove(proc_dbg_info_src->ip_to_debug_info_src,
+			&entry->ip);
+}
+
+/*
+ * Drop the cached debug information of the instruction pointers of a
+ * binary, before it is unmapped.
+ */
+static
+void proc_debug_info_sources_invalidate_bin_info(
+		struct proc_debug_info_sources *proc_dbg_info_src,
+		struct bin_info *bin)
+{
+	GList *node = proc_dbg_info_src->ip_cache_lru.head;
+
+	while (node) {
+		struct ip_cache_entry *entry = node->data;
+
+		node = node->next;
+		if (entry->bin == bin) {
+			proc_debug_info_sources_remove_ip_cache_entry(
+					proc_dbg_info_src, entry);
+		}
+	}
+}
+
+static
+void proc_debug_info_sources_clear(
+		struct proc_debug_info_sources *proc_dbg_info_src)
+{
+	g_queue_init(&proc_dbg_info_src->ip_cache_lru);
+	g_hash_table_remove_all(proc_dbg_info_src->ip_to_debug_info_src);
+	g_array_set_size(proc_dbg_info_src->bin_infos, 0);
+	proc_dbg_info_src->max_memsz = 0;
+	g_hash_table_remove_all(proc_dbg_info_src->baddr_to_bin_info);
+}
+
+/*
+ * Look up the debug info of an instruction pointer in the cache of a
+ * process, marking it as the most recently used if found.
+ */
+static
+struct ip_cache_entry *proc_debug_info_sources_lookup_ip_cache(
+		struct debug_info *debug_info,
 		struct proc_debug_info_sources *proc_dbg_info_src, uint64_t ip)
 {
-	struct debug_info_source *debug_info_src = NULL;
-	gpointer key = g_new0(uint64_t, 1);
-	GHashTableIter iter;
-	gpointer baddr, value;
+	GQueue *lru = &proc_dbg_info_src->ip_cache_lru;
+	struct ip_cache_entry *entry;
 
-	if (!key) {
+	entry = g_hash_table_lookup(proc_dbg_info_src->ip_to_debug_info_src,
+			&ip);
+	if (!entry) {
+		debug_info->ip_cache_misses++;
 		goto end;
 	}
 
-	*((uint64_t *) key) = ip;
+	debug_info->ip_cache_hits++;
+	g_queue_unlink(lru, &entry->lru_node);
+	g_queue_push_head_link(lru, &entry->lru_node);
 
-	/* Look in IP to debug infos hash table first. */
-	debug_info_src = g_hash_table_lookup(
-			proc_dbg_info_src->ip_to_debug_info_src,
-			key);
-	if (debug_info_src) {
+end:
+	return entry;
+}
+
+/*
+ * Add the debug info of an instruction pointer within a binary to the
+ * cache of the process, which takes ownership of it. Returns NULL if
+ * it cannot be added.
+ */
+static
+struct debug_info_source *proc_debug_info_sources_insert_ip_cache_entry(
+		struct debug_info *debug_info,
+		struct proc_debug_info_sources *proc_dbg_info_src,
+		struct bin_info *bin, uint64_t ip,
+		struct debug_info_source *debug_info_src)
+{
+	GQueue *lru = &proc_dbg_info_src->ip_cache_lru;
+	struct ip_cache_entry *entry;
+
+	if (!debug_info_src) {
 		goto end;
 	}
 
-	/* Check in all bin_infos. */
-	g_hash_table_iter_init(&iter, proc_dbg_info_src->baddr_to_bin_info);
+	entry = g_new0(struct ip_cache_entry, 1);
+	if (!entry) {
+		debug_info_source_destroy(debug_info_src);
+		debug_info_src = NULL;
+		goto end;
+	}
 
-	while (g_hash_table_iter_next(&iter, &baddr, &value))
-	{
-		struct bin_info *bin = value;
+	/* Found; add it to cache, evicting the least recently used. */
+	if (lru->length >= DEBUG_INFO_IP_CACHE_SIZE) {
+		debug_info->ip_cache_evictions++;
+		proc_debug_info_sources_remove_ip_cache_entry(
+				proc_dbg_info_src, lru->tail->data);
+	}
 
-		if (!bin_info_has_address(value, ip)) {
-			continue;
-		}
+	entry->ip = ip;
+	entry->bin = bin;
+	entry->debug_info_src = debug_info_src;
+	entry->lru_node.data = entry;
+	g_hash_table_insert(proc_dbg_info_src->ip_to_debug_info_src,
+			&entry->ip, entry);
+	g_queue_push_head_link(lru, &entry->lru_node);
 
-		/*
-		 * Found; add it to cache.
-		 *
-		 * FIXME: this should be bounded in size (and implement
-		 * a caching policy), and entries should be prunned when
-		 * libraries are unmapped.
-		 */
-		debug_info_src = debug_info_source_create_from_bin(bin, ip);
-		if (debug_info_src) {
-			g_hash_table_insert(
-					proc_dbg_info_src->ip_to_debug_info_src,
-					key, debug_info_src);
-			/* Ownership passed to ht. */
-			key = NULL;
-		}
-		break;
+end:
+	return debug_info_src;
+}
+
+/*
+ * Look up the debug info of an instruction pointer within a binary,
+ * and add it to the cache of the process.
+ */
+static
+struct debug_info_source *proc_debug_info_sources_add_ip_cache_entry(
+		struct debug_info *debug_info,
+		struct proc_debug_info_sources *proc_dbg_info_src,
+		struct bin_info *bin, uint64_t ip)
+{
+	debug_info_get_bin(debug_info, bin);
+	return proc_debug_info_sources_insert_ip_cache_entry(debug_info,
+			proc_dbg_info_src, bin, ip,
+			debug_info_source_create_from_bin(bin, ip));
+}
+
+static
+struct debug_info_source *proc_debug_info_sources_get_entry(
+		struct debug_info *debug_info,
+		struct proc_debug_info_sources *proc_dbg_info_src, uint64_t ip)
+{
+	struct debug_info_source *debug_info_src = NULL;
+	struct ip_cache_entry *entry;
+	struct bin_info *bin;
+
+	/* Look in IP to debug infos hash table first. */
+	entry = proc_debug_info_sources_lookup_ip_cache(debug_info,
+			proc_dbg_info_src, ip);
+	if (entry) {
+		debug_info_src = entry->debug_info_src;
+		goto end;
+	}
+
+	bin = proc_debug_info_sources_find_bin_info(proc_dbg_info_src, ip,
+			NULL);
+	if (!bin) {
+		goto end;
 	}
 
+	debug_info_src = proc_debug_info_sources_add_ip_cache_entry(
+			debug_info, proc_dbg_info_src, bin, ip);
+
 end:
-	free(key);
 	return debug_info_src;
 }
 
@@ -315,7 +992,7 @@ struct debug_info_source *debug_info_query(struct debug_info *debug_info,
 		goto end;
 	}
 
-	dbg_info_src = proc_debug_info_sources_get_entry(
+	dbg_info_src = proc_debug_info_sources_get_entry(debug_info,
 			proc_dbg_info_src, ip);
 	if (!dbg_info_src) {
 		goto end;
@@ -325,6 +1002,127 @@ end:
 	return dbg_info_src;
 }
 
+static
+gint stack_ip_compare(gconstpointer a, gconstpointer b)
+{
+	const struct stack_ip *ip_a = a, *ip_b = b;
+
+	if (ip_a->ip != ip_b->ip) {
+		return ip_a->ip < ip_b->ip ? -1 : 1;
+	}
+
+	return ip_a->index < ip_b->index ? -1 : ip_a->index > ip_b->index;
+}
+
+BT_HIDDEN
+void debug_info_query_stack(struct debug_info *debug_info, int64_t vpid,
+		const uint64_t *ips, unsigned int nr_ips,
+		struct debug_info_source **srcs)
+{
+	struct proc_debug_info_sources *proc_dbg_info_src;
+	struct stack_ip *misses = NULL, *prev = NULL;
+	struct ip_lookup *lookups = NULL;
+	struct bin_info *bin = NULL;
+	uint64_t next_base = 0;
+	unsigned int nr_misses = 0, nr_lookups = 0, i, j;
+
+	memset(srcs, 0, nr_ips * sizeof(*srcs));
+
+	proc_dbg_info_src = proc_debug_info_sources_ht_get_entry(
+			debug_info->vpid_to_proc_dbg_info_src, vpid);
+	if (!proc_dbg_info_src) {
+		goto end;
+	}
+
+	/*
+	 * The debug info of the whole stack must stay in the cache
+	 * until the event is printed.
+	 */
+	nr_ips = MIN(nr_ips, DEBUG_INFO_STACK_MAX_DEPTH);
+
+	misses = g_new(struct stack_ip, nr_ips);
+	lookups = g_new(struct ip_lookup, nr_ips);
+	if (!misses || !lookups) {
+		goto end;
+	}
+
+	for (i = 0; i < nr_ips; i++) {
+		struct ip_cache_entry *entry;
+
+		entry = proc_debug_info_sources_lookup_ip_cache(debug_info,
+				proc_dbg_info_src, ips[i]);
+		if (entry) {
+			srcs[i] = entry->debug_info_src;
+		} else {
+			misses[nr_misses].ip = ips[i];
+			misses[nr_misses].index = i;
+			nr_misses++;
+		}
+	}
+
+	/*
+	 * Sort the addresses missing from the cache, so that those of a
+	 * same binary follow each other and only the first one searches
+	 * for the binary, and so that a repeated address, as in a
+	 * recursion, is only looked up once.
+	 */
+	qsort(misses, nr_misses, sizeof(*misses), stack_ip_compare);
+	for (i = 0; i < nr_misses; i++) {
+		struct stack_ip *miss = &misses[i];
+
+		if (prev && prev->ip == miss->ip) {
+			continue;
+		}
+
+		prev = miss;
+		if (!bin || miss->ip >= next_base ||
+				!bin_info_has_address(bin, miss->ip)) {
+			bin = proc_debug_info_sources_find_bin_info(
+					proc_dbg_info_src, miss->ip, &next_base);
+			if (!bin) {
+				continue;
+			}
+		}
+
+		lookups[nr_lookups].bin = bin;
+		lookups[nr_lookups].ip = miss->ip;
+		lookups[nr_lookups].debug_info_src = NULL;
+		nr_lookups++;
+	}
+
+	/* The lookups are independent: run them in parallel. */
+	debug_info_run_lookups(debug_info, lookups, nr_lookups);
+
+	/*
+	 * Only the reading thread updates the cache. The lookups follow
+	 * the order of the distinct addresses found in a binary.
+	 */
+	for (i = 0, j = 0, prev = NULL; i < nr_misses; i++) {
+		struct stack_ip *miss = &misses[i];
+		struct ip_lookup *lookup = &lookups[j];
+
+		if (prev && prev->ip == miss->ip) {
+			srcs[miss->index] = srcs[prev->index];
+			continue;
+		}
+
+		prev = miss;
+		if (j == nr_lookups || lookup->ip != miss->ip) {
+			continue;
+		}
+
+		srcs[miss->index] =
+			proc_debug_info_sources_insert_ip_cache_entry(
+				debug_info, proc_dbg_info_src, lookup->bin,
+				lookup->ip, lookup->debug_info_src);
+		j++;
+	}
+
+end:
+	g_free(lookups);
+	g_free(misses);
+}
+
 BT_HIDDEN
 struct debug_info *debug_info_create(void)
 {
@@ -348,13 +1146,53 @@ struct debug_info *debug_info_create(void)
 		goto error;
 	}
 
+	debug_info->pending_bins = g_ptr_array_new();
+	if (!debug_info->pending_bins) {
+		goto error;
+	}
+
+	debug_info->stack_ips = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	debug_info->stack_srcs = g_ptr_array_new();
+	if (!debug_info->stack_ips || !debug_info->stack_srcs) {
+		goto error;
+	}
+
+	if (opt_debug_info_jobs > 0) {
+		debug_info->workers = debug_info_workers_create(
+				opt_debug_info_jobs);
+		if (!debug_info->workers) {
+			printf_verbose("Reading debug info without worker threads\n");
+		}
+	}
+
 end:
 	return debug_info;
 error:
+	if (debug_info->stack_srcs) {
+		g_ptr_array_free(debug_info->stack_srcs, TRUE);
+	}
+	if (debug_info->stack_ips) {
+		g_array_free(debug_info->stack_ips, TRUE);
+	}
+	if (debug_info->pending_bins) {
+		g_ptr_array_free(debug_info->pending_bins, TRUE);
+	}
+	if (debug_info->vpid_to_proc_dbg_info_src) {
+		g_hash_table_destroy(debug_info->vpid_to_proc_dbg_info_src);
+	}
 	g_free(debug_info);
 	return NULL;
 }
 
+BT_HIDDEN
+void debug_info_get_stats(struct debug_info *debug_info,
+		struct debug_info_stats *stats)
+{
+	stats->ip_cache_hits = debug_info->ip_cache_hits;
+	stats->ip_cache_misses = debug_info->ip_cache_misses;
+	stats->ip_cache_evictions = debug_info->ip_cache_evictions;
+}
+
 BT_HIDDEN
 void debug_info_destroy(struct debug_info *debug_info)
 {
@@ -362,6 +1200,26 @@ void debug_info_destroy(struct debug_info *debug_info)
 		goto end;
 	}
 
+	printf_verbose("Debug info IP cache: %" PRIu64 " hits, %" PRIu64
+			" misses, %" PRIu64 " evictions\n",
+			debug_info->ip_cache_hits, debug_info->ip_cache_misses,
+			debug_info->ip_cache_evictions);
+
+	/* Workers first, as they may still use the binaries. */
+	debug_info_workers_destroy(debug_info->workers);
+
+	if (debug_info->pending_bins) {
+		g_ptr_array_free(debug_info->pending_bins, TRUE);
+	}
+
+	if (debug_info->stack_ips) {
+		g_array_free(debug_info->stack_ips, TRUE);
+	}
+
+	if (debug_info->stack_srcs) {
+		g_ptr_array_free(debug_info->stack_srcs, TRUE);
+	}
+
 	if (debug_info->vpid_to_proc_dbg_info_src) {
 		g_hash_table_destroy(debug_info->vpid_to_proc_dbg_info_src);
 	}
@@ -459,6 +1317,7 @@ void handle_statedump_build_id_event(struct debug_info *debug_info,
 		goto end;
 	}
 
+	debug_info_wait_bin(debug_info, bin);
 	bin_info_set_build_id(bin, build_id, build_id_len);
 
 end:
@@ -549,6 +1408,7 @@ void handle_statedump_debug_link_event(struct debug_info *debug_info,
 	filename = bt_get_string(filename_def);
 	crc32 = bt_get_unsigned_int(crc32_def);
 
+	debug_info_wait_bin(debug_info, bin);
 	bin_info_set_debug_link(bin, filename, crc32);
 
 end:
@@ -679,6 +1539,10 @@ void handle_bin_info_event(struct debug_info *debug_info,
 			key, bin);
 	/* Ownership passed to ht. */
 	key = NULL;
+	proc_debug_info_sources_add_bin_info(proc_dbg_info_src, bin);
+	if (debug_info->workers) {
+		g_ptr_array_add(debug_info->pending_bins, bin);
+	}
 
 end:
 	g_free(key);
@@ -708,6 +1572,7 @@ void handle_lib_unload_event(struct debug_info *debug_info,
 	struct bt_definition *sec_def = NULL;
 	struct bt_definition *vpid_def = NULL;
 	struct proc_debug_info_sources *proc_dbg_info_src;
+	struct bin_info *bin;
 	uint64_t baddr;
 	int64_t vpid;
 	gpointer key_ptr = NULL;
@@ -746,6 +1611,15 @@ void handle_lib_unload_event(struct debug_info *debug_info,
 	}
 
 	key_ptr = (gpointer) &baddr;
+	bin = g_hash_table_lookup(proc_dbg_info_src->baddr_to_bin_info,
+			key_ptr);
+	if (!bin) {
+		goto end;
+	}
+
+	debug_info_forget_bin(debug_info, bin);
+	proc_debug_info_sources_invalidate_bin_info(proc_dbg_info_src, bin);
+	proc_debug_info_sources_remove_bin_info(proc_dbg_info_src, bin);
 	(void) g_hash_table_remove(proc_dbg_info_src->baddr_to_bin_info,
 			key_ptr);
 end:
@@ -760,6 +1634,7 @@ void handle_statedump_start(struct debug_info *debug_info,
 	struct bt_definition *sec_def = NULL;
 	struct proc_debug_info_sources *proc_dbg_info_src;
 	int64_t vpid;
+	guint i;
 
 	sec_def = (struct bt_definition *)
 			event_def->stream->stream_event_context;
@@ -780,8 +1655,81 @@ void handle_statedump_start(struct debug_info *debug_info,
 		goto end;
 	}
 
-	g_hash_table_remove_all(proc_dbg_info_src->baddr_to_bin_info);
-	g_hash_table_remove_all(proc_dbg_info_src->ip_to_debug_info_src);
+	for (i = 0; i < proc_dbg_info_src->bin_infos->len; i++) {
+		debug_info_forget_bin(debug_info, g_array_index(
+				proc_dbg_info_src->bin_infos,
+				struct bin_info *, i));
+	}
+
+	proc_debug_info_sources_clear(proc_dbg_info_src);
+
+end:
+	return;
+}
+
+/*
+ * Set the debug info of each address of a call stack context field, a
+ * sequence or an array of integers.
+ */
+static
+void register_callstack_debug_infos(struct debug_info *debug_info,
+		struct bt_definition *callstack_def, int64_t vpid)
+{
+	struct bt_declaration *elem;
+	GPtrArray *elems;
+	uint64_t len, i;
+
+	switch (callstack_def->declaration->id) {
+	case BT_CTF_TYPE_ID_SEQUENCE:
+	{
+		struct definition_sequence *sequence_def = container_of(
+				callstack_def, struct definition_sequence, p);
+
+		elem = sequence_def->declaration->elem;
+		elems = sequence_def->elems;
+		len = bt_sequence_len(sequence_def);
+		break;
+	}
+	case BT_CTF_TYPE_ID_ARRAY:
+	{
+		struct definition_array *array_def = container_of(
+				callstack_def, struct definition_array, p);
+
+		elem = array_def->declaration->elem;
+		elems = array_def->elems;
+		len = bt_array_len(array_def);
+		break;
+	}
+	default:
+		goto end;
+	}
+
+	if (elem->id != BT_CTF_TYPE_ID_INTEGER || !elems) {
+		goto end;
+	}
+
+	g_array_set_size(debug_info->stack_ips, len);
+	for (i = 0; i < len; i++) {
+		struct definition_integer *ip_def =
+				g_ptr_array_index(elems, i);
+
+		g_array_index(debug_info->stack_ips, uint64_t, i) =
+				ip_def->value._unsigned;
+	}
+
+	g_ptr_array_set_size(debug_info->stack_srcs, len);
+	debug_info_query_stack(debug_info, vpid,
+			(uint64_t *) debug_info->stack_ips->data, len,
+			(struct debug_info_source **) debug_info->stack_srcs->pdata);
+
+	for (i = 0; i < len; i++) {
+		struct definition_integer *ip_def =
+				g_ptr_array_index(elems, i);
+
+		ip_def->debug_info_src = g_ptr_array_index(
+				debug_info->stack_srcs, i);
+		ip_def->debug_info_stack_frame = 1;
+	}
 
 end:
 	return;
@@ -791,7 +1739,7 @@ static
 void register_event_debug_infos(struct debug_info *debug_info,
 		struct ctf_event_definition *event)
 {
-	struct bt_definition *ip_def, *vpid_def;
+	struct bt_definition *ip_def, *vpid_def, *callstack_def;
 	int64_t vpid;
 	uint64_t ip;
 	struct bt_definition *sec_def;
@@ -802,21 +1750,30 @@ void register_event_debug_infos(struct debug_info *debug_info,
 		goto end;
 	}
 
-	/* Get "ip" and "vpid" definitions. */
+	/* Get "ip", "callstack_user" and "vpid" definitions. */
 	vpid_def = bt_lookup_definition((struct bt_definition *) sec_def,
 			 "_vpid");
 	ip_def = bt_lookup_definition((struct bt_definition *) sec_def, "_ip");
+	callstack_def = bt_lookup_definition(
+			(struct bt_definition *) sec_def, "_callstack_user");
 
-	if (!vpid_def || !ip_def) {
+	if (!vpid_def || (!ip_def && !callstack_def)) {
 		 goto end;
 	}
 
 	vpid = bt_get_signed_int(vpid_def);
-	ip = bt_get_unsigned_int(ip_def);
 
 	/* Get debug info for this context. */
-	((struct definition_integer *) ip_def)->debug_info_src =
-			debug_info_query(debug_info, vpid, ip);
+	if (ip_def) {
+		ip = bt_get_unsigned_int(ip_def);
+		((struct definition_integer *) ip_def)->debug_info_src =
+				debug_info_query(debug_info, vpid, ip);
+	}
+
+	if (callstack_def) {
+		register_callstack_debug_infos(debug_info, callstack_def,
+				vpid);
+	}
 
 end:
 	return;
@@ -863,6 +1820,12 @@ void debug_info_handle_event(struct debug_info *debug_info,
 		handle_statedump_build_id_event(debug_info, event);
 	} else if (event_class->name == debug_info-> q_lib_unload) {
 		handle_lib_unload_event(debug_info, event);
+	} else {
+		/*
+		 * The build IDs and debug links of the binaries mapped
+		 * so far are known: prepare them in the background.
+		 */
+		debug_info_submit_pending_bins(debug_info);
 	}
 
 	/* All events: register debug infos */
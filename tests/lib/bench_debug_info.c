@@ -0,0 +1,404 @@
+/*
+ * bench_debug_info.c
+ *
+ * Measure the cost of the debug info resolution of UST traces.
+ *
+ * A trace is synthesized with the CTF writer: a state dump of the
+ * libraries of each process (lttng_ust_statedump:bin_info and
+ * lttng_ust_lib:load events), followed by events whose _ip context
+ * spans a given number of distinct addresses within those libraries.
+ * The trace is then read back and each event is handed to
+ * debug_info_handle_event(), as the text and JSON outputs do, before
+ * every distinct address is queried again with debug_info_query().
+ *
+ * The libraries are the binaries given on the command line, mapped
+ * round-robin at distinct base addresses in each process.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; under version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <babeltrace/context.h>
+#include <babeltrace/iterator.h>
+#include <babeltrace/ctf/iterator.h>
+#include <babeltrace/ctf/events-internal.h>
+#include <babeltrace/compat/stdlib.h>
+#include <babeltrace/debug-info.h>
+#include <babeltrace/babeltrace-internal.h>	/* For symbol side-effects */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <glib.h>
+
+#include "common.h"
+#include "ust_trace.h"
+
+#define BENCH_BASE_ADDR		0x7f0000000000ULL
+#define BENCH_VPID_BASE		1000
+#define BENCH_IP_STRIDE		16
+
+struct bench_config {
+	unsigned int nr_procs;
+	unsigned int nr_libs;
+	unsigned int nr_ips;
+	unsigned int nr_events;
+	unsigned int nr_rounds;
+	const char **paths;
+	unsigned int nr_paths;
+	uint64_t *memszs;	/* Mapping size of each path. */
+};
+
+static
+int64_t bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static
+void usage(FILE *fp, const char *name)
+{
+	fprintf(fp, "Usage: %s [OPTIONS] BINARY...\n", name);
+	fprintf(fp, "  -p N  Number of processes (default 16)\n");
+	fprintf(fp, "  -l N  Number of libraries mapped by each process "
+		"(default 8)\n");
+	fprintf(fp, "  -i N  Number of distinct addresses of each process "
+		"(default 1024)\n");
+	fprintf(fp, "  -e N  Number of events (default 1000000)\n");
+	fprintf(fp, "  -q N  Number of query rounds over all the addresses "
+		"(default 10)\n");
+	fprintf(fp, "  -j N  Number of threads preparing the binaries "
+		"(default 0)\n");
+	fprintf(fp, "  -c DIR  Directory of the address table cache\n");
+	fprintf(fp, "  -d DIR  Directory of the separate debug info files\n");
+}
+
+static
+uint64_t lib_base_addr(unsigned int proc, unsigned int lib)
+{
+	return BENCH_BASE_ADDR + ((uint64_t) proc << 32) +
+		((uint64_t) lib << 24);
+}
+
+/*
+ * Distinct addresses of a process, spread over its libraries.
+ */
+static
+uint64_t proc_ip(struct bench_config *config, unsigned int proc,
+		unsigned int index)
+{
+	unsigned int lib = index % config->nr_libs;
+	uint64_t memsz = config->memszs[lib % config->nr_paths];
+	uint64_t offset = (uint64_t) (index / config->nr_libs) *
+		BENCH_IP_STRIDE;
+
+	return lib_base_addr(proc, lib) + offset % memsz;
+}
+
+/*
+ * Write the state dump of every process, half of the libraries being
+ * found by the state dump and the other half loaded afterwards, then
+ * the events, at addresses picked pseudo-randomly.
+ */
+static
+int write_trace(struct bench_config *config, const char *path)
+{
+	struct ust_trace_writer w;
+	uint32_t seed = 1;
+	unsigned int proc, lib, i;
+	int ret;
+
+	ret = ust_trace_writer_init(&w, path, "bench:event");
+	if (ret) {
+		goto end;
+	}
+
+	for (proc = 0; proc < config->nr_procs; proc++) {
+		int32_t vpid = BENCH_VPID_BASE + proc;
+
+		ret = ust_trace_append_event(&w, w.statedump_start, vpid,
+			0, 0, 0, NULL);
+		for (lib = 0; !ret && lib < config->nr_libs; lib++) {
+			unsigned int path_index = lib % config->nr_paths;
+
+			ret = ust_trace_append_event(&w,
+				lib % 2 ? w.lib_load : w.statedump_bin_info,
+				vpid, 0, lib_base_addr(proc, lib),
+				config->memszs[path_index],
+				config->paths[path_index]);
+		}
+		if (ret) {
+			goto end;
+		}
+	}
+
+	for (i = 0; i < config->nr_events; i++) {
+		proc = i % config->nr_procs;
+
+		/* xorshift32 */
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		ret = ust_trace_append_event(&w, w.event,
+			BENCH_VPID_BASE + proc,
+			proc_ip(config, proc, seed % config->nr_ips), 0, 0,
+			NULL);
+		if (ret) {
+			goto end;
+		}
+	}
+end:
+	if (ust_trace_writer_fini(&w)) {
+		ret = -1;
+	}
+	if (ret) {
+		fprintf(stderr, "[error] Writing the trace to %s failed\n",
+			path);
+	}
+	return ret;
+}
+
+/*
+ * Hand every event of the trace to debug_info, timing only
+ * debug_info_handle_event().
+ */
+static
+int read_trace(struct debug_info *debug_info, const char *path,
+		uint64_t *nr_events, int64_t *duration)
+{
+	struct bt_context *ctx;
+	struct bt_ctf_iter *iter = NULL;
+	struct bt_ctf_event *event;
+	int ret = -1;
+
+	*nr_events = 0;
+	*duration = 0;
+	ctx = bt_context_create();
+	if (!ctx) {
+		return -1;
+	}
+	if (bt_context_add_trace(ctx, path, "ctf", NULL, NULL, NULL) < 0) {
+		fprintf(stderr, "[error] Reading %s failed\n", path);
+		goto end;
+	}
+	iter = bt_ctf_iter_create(ctx, NULL, NULL);
+	if (!iter) {
+		goto end;
+	}
+
+	while ((event = bt_ctf_iter_read_event(iter))) {
+		int64_t begin = bench_now();
+
+		debug_info_handle_event(debug_info, event->parent);
+		*duration += bench_now() - begin;
+		(*nr_events)++;
+		if (bt_iter_next(bt_ctf_get_iter(iter)) < 0) {
+			goto end;
+		}
+	}
+	ret = 0;
+end:
+	if (iter) {
+		bt_ctf_iter_destroy(iter);
+	}
+	bt_context_put(ctx);
+	return ret;
+}
+
+static
+uint64_t query_addresses(struct bench_config *config,
+		struct debug_info *debug_info, uint64_t *nr_found)
+{
+	unsigned int round, proc, i;
+	uint64_t nr_queries = 0;
+
+	*nr_found = 0;
+	for (round = 0; round < config->nr_rounds; round++) {
+		for (proc = 0; proc < config->nr_procs; proc++) {
+			for (i = 0; i < config->nr_ips; i++) {
+				if (debug_info_query(debug_info,
+						BENCH_VPID_BASE + proc,
+						proc_ip(config, proc, i))) {
+					(*nr_found)++;
+				}
+				nr_queries++;
+			}
+		}
+	}
+	return nr_queries;
+}
+
+static
+void print_stats(const char *phase, struct debug_info_stats *before,
+		struct debug_info_stats *after)
+{
+	uint64_t hits = after->ip_cache_hits - before->ip_cache_hits;
+	uint64_t misses = after->ip_cache_misses - before->ip_cache_misses;
+
+	printf("%s IP cache: %" PRIu64 " hits, %" PRIu64 " misses (%.1f%% "
+		"hit rate), %" PRIu64 " evictions\n", phase, hits, misses,
+		hits + misses ? 100.0 * hits / (hits + misses) : 0,
+		after->ip_cache_evictions - before->ip_cache_evictions);
+}
+
+static
+int parse_uint(const char *arg, unsigned int *value)
+{
+	char *end;
+	unsigned long v;
+
+	v = strtoul(arg, &end, 10);
+	if (*arg == '\0' || *end != '\0' || v > UINT_MAX) {
+		return -1;
+	}
+	*value = v;
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct bench_config config = {
+		.nr_procs = 16,
+		.nr_libs = 8,
+		.nr_ips = 1024,
+		.nr_events = 1000000,
+		.nr_rounds = 10,
+	};
+	char trace_path[] = "/tmp/bench_debug_info_XXXXXX";
+	struct debug_info *debug_info = NULL;
+	struct debug_info_stats start_stats, read_stats, query_stats;
+	struct rusage rusage;
+	uint64_t nr_events, nr_queries, nr_found;
+	int64_t duration, begin;
+	unsigned int i, jobs = 0;
+	int opt, ret = EXIT_FAILURE;
+
+	while ((opt = getopt(argc, argv, "p:l:i:e:q:j:c:d:h")) != -1) {
+		int err = 0;
+
+		switch (opt) {
+		case 'p':
+			err = parse_uint(optarg, &config.nr_procs);
+			break;
+		case 'l':
+			err = parse_uint(optarg, &config.nr_libs);
+			break;
+		case 'i':
+			err = parse_uint(optarg, &config.nr_ips);
+			break;
+		case 'e':
+			err = parse_uint(optarg, &config.nr_events);
+			break;
+		case 'q':
+			err = parse_uint(optarg, &config.nr_rounds);
+			break;
+		case 'j':
+			err = parse_uint(optarg, &jobs);
+			break;
+		case 'c':
+			opt_debug_info_cache_dir = optarg;
+			break;
+		case 'd':
+			opt_debug_info_dir = optarg;
+			break;
+		case 'h':
+			usage(stdout, argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			err = -1;
+			break;
+		}
+		if (err) {
+			usage(stderr, argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (optind == argc || !config.nr_procs || !config.nr_libs ||
+			!config.nr_ips) {
+		usage(stderr, argv[0]);
+		return EXIT_FAILURE;
+	}
+	opt_debug_info_jobs = jobs;
+
+	config.paths = (const char **) &argv[optind];
+	config.nr_paths = argc - optind;
+	config.memszs = g_new0(uint64_t, config.nr_paths);
+	for (i = 0; i < config.nr_paths; i++) {
+		struct stat st;
+
+		if (stat(config.paths[i], &st)) {
+			perror(config.paths[i]);
+			goto end_free;
+		}
+		/* Map the whole file, rounded up to a page. */
+		config.memszs[i] = (st.st_size + 0xfff) & ~0xfffULL;
+		if (!config.memszs[i]) {
+			config.memszs[i] = 0x1000;
+		}
+	}
+
+	if (!bt_mkdtemp(trace_path)) {
+		perror("bt_mkdtemp");
+		goto end_free;
+	}
+	if (write_trace(&config, trace_path)) {
+		goto end_rmdir;
+	}
+
+	debug_info = debug_info_create();
+	if (!debug_info) {
+		goto end_rmdir;
+	}
+	debug_info_get_stats(debug_info, &start_stats);
+	if (read_trace(debug_info, trace_path, &nr_events, &duration)) {
+		goto end_destroy;
+	}
+	debug_info_get_stats(debug_info, &read_stats);
+	printf("events: %" PRIu64 "\n", nr_events);
+	printf("handle duration: %.3f s\n", duration / 1e9);
+	printf("events/s: %.0f\n",
+		duration > 0 ? nr_events / (duration / 1e9) : 0);
+	print_stats("events", &start_stats, &read_stats);
+
+	begin = bench_now();
+	nr_queries = query_addresses(&config, debug_info, &nr_found);
+	duration = bench_now() - begin;
+	debug_info_get_stats(debug_info, &query_stats);
+	printf("queries: %" PRIu64 " (%" PRIu64 " found)\n", nr_queries,
+		nr_found);
+	printf("queries/s: %.0f\n",
+		duration > 0 ? nr_queries / (duration / 1e9) : 0);
+	print_stats("queries", &read_stats, &query_stats);
+
+	if (!getrusage(RUSAGE_SELF, &rusage)) {
+		printf("peak RSS: %ld KiB\n", rusage.ru_maxrss);
+	}
+	ret = EXIT_SUCCESS;
+
+end_destroy:
+	debug_info_destroy(debug_info);
+end_rmdir:
+	recursive_rmdir(trace_path);
+end_free:
+	g_free(config.memszs);
+	return ret;
+}
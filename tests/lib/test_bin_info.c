@@ -23,29 +23,40 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <babeltrace/bin-info.h>
 #include "tap/tap.h"
 
-#define NR_TESTS 36
+#define NR_TESTS 64
 #define SO_NAME "libhello_so"
 #define SO_NAME_ELF "libhello_elf_so"
+#define SO_NAME_DYNSYM "libhello_dynsym_so"
 #define SO_NAME_BUILD_ID "libhello_build_id_so"
 #define SO_NAME_DEBUG_LINK "libhello_debug_link_so"
 #define SO_LOW_ADDR 0x400000
 #define SO_MEMSZ 0x400000
+#define SO_OTHER_LOW_ADDR 0x7f0000000000
 #define FUNC_FOO_ADDR 0x4014ee
 #define FUNC_FOO_LINE_NO 8
 #define FUNC_FOO_FILENAME "/efficios/libhello.c"
 #define FUNC_FOO_TP_ADDR 0x4014d3
 #define FUNC_FOO_TP_LINE_NO 7
 #define FUNC_FOO_TP_FILENAME "/efficios/libhello.c"
+#define FUNC_FOO_TP_INLINE_ADDR 0x401460
+#define FUNC_FOO_TP_INLINE_NAME "__tracepoint_cb_my_provider___my_first_tracepoint"
+#define FUNC_FOO_TP_INLINE_LINE_NO 12
+#define FUNC_FOO_TP_INLINE_FILENAME "/efficios/tp.h"
 #define FUNC_FOO_ADDR_ELF 0x4013ef
+#define FUNC_BAR_ADDR_ELF 0x4014ad
 #define FUNC_FOO_ADDR_DBG_LINK 0x40148e
 #define FUNC_FOO_NAME "foo+0xc3"
 #define FUNC_FOO_NAME_ELF "foo+0x24"
+#define FUNC_BAR_NAME_ELF "bar+0x10"
 #define BUILD_ID_LEN 20
 
 char *opt_debug_info_dir;
+char *opt_debug_info_cache_dir;
 char *opt_debug_info_target_prefix;
 
 static
@@ -56,6 +67,8 @@ void test_bin_info_build_id(const char *data_dir)
 	char *func_name = NULL;
 	struct bin_info *bin = NULL;
 	struct source_location *src_loc = NULL;
+	struct inline_frame *frames = NULL;
+	unsigned int nr_frames = 0;
 	uint8_t build_id[BUILD_ID_LEN] = {
 		0xcd, 0xd9, 0x8c, 0xdd, 0x87, 0xf7, 0xfe, 0x64, 0xc1, 0x3b,
 		0x6d, 0xaa, 0xd5, 0x53, 0x98, 0x7e, 0xaf, 0xd4, 0x0c, 0xbb
@@ -96,6 +109,39 @@ void test_bin_info_build_id(const char *data_dir)
 		skip(2, "bin_info_lookup_source_location - src_loc is NULL");
 	}
 
+	/* Test source location lookup within an inlined subroutine */
+	src_loc = NULL;
+	ret = bin_info_lookup_source_location(bin, FUNC_FOO_TP_ADDR, &src_loc);
+	ok(ret == 0, "bin_info_lookup_source_location successful (inline)");
+	if (src_loc) {
+		ok(src_loc->line_no == FUNC_FOO_TP_LINE_NO,
+			"bin_info_lookup_source_location - correct line_no (inline)");
+		ok(strcmp(src_loc->filename, FUNC_FOO_TP_FILENAME) == 0,
+			"bin_info_lookup_source_location - correct filename (inline)");
+		source_location_destroy(src_loc);
+	} else {
+		skip(2, "bin_info_lookup_source_location - src_loc is NULL");
+	}
+
+	/* Test inlined subroutines lookup */
+	ret = bin_info_lookup_inline_frames(bin, FUNC_FOO_TP_INLINE_ADDR,
+			&frames, &nr_frames);
+	ok(ret == 0 && nr_frames == 1,
+		"bin_info_lookup_inline_frames successful");
+	if (frames) {
+		ok(frames[0].func_name &&
+			strcmp(frames[0].func_name, FUNC_FOO_TP_INLINE_NAME) == 0,
+			"bin_info_lookup_inline_frames - correct func_name");
+		ok(frames[0].line_no == FUNC_FOO_TP_INLINE_LINE_NO,
+			"bin_info_lookup_inline_frames - correct line_no");
+		ok(frames[0].filename &&
+			strcmp(frames[0].filename, FUNC_FOO_TP_INLINE_FILENAME) == 0,
+			"bin_info_lookup_inline_frames - correct filename");
+		inline_frames_destroy(frames, nr_frames);
+	} else {
+		skip(3, "bin_info_lookup_inline_frames - frames is NULL");
+	}
+
 	bin_info_destroy(bin);
 }
 
@@ -178,6 +224,18 @@ void test_bin_info_elf(const char *data_dir)
 		skip(1, "bin_info_lookup_function_name - func_name is NULL");
 	}
 
+	/* Test function name lookup of another function (with ELF) */
+	ret = bin_info_lookup_function_name(bin, FUNC_BAR_ADDR_ELF, &func_name);
+	ok(ret == 0, "bin_info_lookup_function_name successful - other function");
+	if (func_name) {
+		ok(strcmp(func_name, FUNC_BAR_NAME_ELF) == 0,
+			"bin_info_lookup_function_name - correct other func_name value");
+		free(func_name);
+		func_name = NULL;
+	} else {
+		skip(1, "bin_info_lookup_function_name - func_name is NULL");
+	}
+
 	/* Test function name lookup - erroneous address */
 	ret = bin_info_lookup_function_name(bin, 0, &func_name);
 	ok(ret == -1 && func_name == NULL,
@@ -191,6 +249,54 @@ void test_bin_info_elf(const char *data_dir)
 	bin_info_destroy(bin);
 }
 
+static
+void test_bin_info_dynsym(const char *data_dir)
+{
+	int ret;
+	char path[PATH_MAX];
+	char *func_name = NULL;
+	struct bin_info *bin = NULL;
+	struct source_location *src_loc = NULL;
+
+	diag("bin-info tests - dynamic symbols only");
+
+	snprintf(path, PATH_MAX, "%s/%s", data_dir, SO_NAME_DYNSYM);
+
+	bin = bin_info_create(path, SO_LOW_ADDR, SO_MEMSZ, true);
+	ok(bin != NULL, "bin_info_create successful");
+
+	/* Test function name lookup (with the dynamic symbols) */
+	ret = bin_info_lookup_function_name(bin, FUNC_FOO_ADDR_ELF, &func_name);
+	ok(ret == 0, "bin_info_lookup_function_name successful (dynsym)");
+	if (func_name) {
+		ok(strcmp(func_name, FUNC_FOO_NAME_ELF) == 0,
+			"bin_info_lookup_function_name - correct func_name value (dynsym)");
+		free(func_name);
+		func_name = NULL;
+	} else {
+		skip(1, "bin_info_lookup_function_name - func_name is NULL");
+	}
+
+	/* Test function name lookup of another function */
+	ret = bin_info_lookup_function_name(bin, FUNC_BAR_ADDR_ELF, &func_name);
+	ok(ret == 0, "bin_info_lookup_function_name successful - other function (dynsym)");
+	if (func_name) {
+		ok(strcmp(func_name, FUNC_BAR_NAME_ELF) == 0,
+			"bin_info_lookup_function_name - correct other func_name value (dynsym)");
+		free(func_name);
+		func_name = NULL;
+	} else {
+		skip(1, "bin_info_lookup_function_name - func_name is NULL");
+	}
+
+	/* Test source location location - should fail without DWARF */
+	ret = bin_info_lookup_source_location(bin, FUNC_FOO_ADDR_ELF, &src_loc);
+	ok(ret == -1, "bin_info_lookup_source_location - fail on stripped file");
+
+	source_location_destroy(src_loc);
+	bin_info_destroy(bin);
+}
+
 static
 void test_bin_info(const char *data_dir)
 {
@@ -273,6 +379,129 @@ void test_bin_info(const char *data_dir)
 	bin_info_destroy(bin);
 }
 
+static
+void test_bin_info_shared(const char *data_dir)
+{
+	int ret;
+	char path[PATH_MAX];
+	char *func_name = NULL;
+	struct bin_info *bin = NULL, *other_bin = NULL, *rebuilt_bin = NULL;
+	uint8_t build_id[BUILD_ID_LEN] = {
+		0xcd, 0xd9, 0x8c, 0xdd, 0x87, 0xf7, 0xfe, 0x64, 0xc1, 0x3b,
+		0x6d, 0xaa, 0xd5, 0x53, 0x98, 0x7e, 0xaf, 0xd4, 0x0c, 0xbb
+	};
+	uint8_t rebuilt_build_id[BUILD_ID_LEN] = { 0 };
+
+	diag("bin-info tests - data shared between processes");
+
+	snprintf(path, PATH_MAX, "%s/%s", data_dir, SO_NAME_BUILD_ID);
+
+	/* Same executable mapped at different addresses. */
+	bin = bin_info_create(path, SO_LOW_ADDR, SO_MEMSZ, true);
+	other_bin = bin_info_create(path, SO_OTHER_LOW_ADDR, SO_MEMSZ, true);
+	rebuilt_bin = bin_info_create(path, SO_LOW_ADDR, SO_MEMSZ, true);
+	ok(bin != NULL && other_bin != NULL && rebuilt_bin != NULL,
+		"bin_info_create successful");
+
+	ret = bin_info_set_build_id(bin, build_id, BUILD_ID_LEN);
+	ret |= bin_info_set_build_id(other_bin, build_id, BUILD_ID_LEN);
+	ret |= bin_info_set_build_id(rebuilt_bin, rebuilt_build_id,
+			BUILD_ID_LEN);
+	ok(ret == 0, "bin_info_set_build_id successful");
+
+	ok(bin->data == other_bin->data,
+		"bin_info instances with the same build ID share their data");
+	ok(bin->data != rebuilt_bin->data,
+		"bin_info instances with different build IDs do not share their data");
+
+	/* The shared data outlives the first instance. */
+	bin_info_destroy(bin);
+	ret = bin_info_lookup_function_name(other_bin,
+			FUNC_FOO_ADDR - SO_LOW_ADDR + SO_OTHER_LOW_ADDR,
+			&func_name);
+	ok(ret == 0, "bin_info_lookup_function_name successful (shared)");
+	if (func_name) {
+		ok(strcmp(func_name, FUNC_FOO_NAME) == 0,
+			"bin_info_lookup_function_name - correct func_name value (shared)");
+		free(func_name);
+	} else {
+		skip(1, "bin_info_lookup_function_name - func_name is NULL");
+	}
+
+	bin_info_destroy(other_bin);
+	bin_info_destroy(rebuilt_bin);
+}
+
+static
+void test_bin_info_cache(const char *data_dir)
+{
+	int ret;
+	char path[PATH_MAX];
+	char cache_dir[] = "/tmp/test_bin_info_XXXXXX";
+	char *func_name = NULL;
+	struct bin_info *bin = NULL;
+	struct source_location *src_loc = NULL;
+	struct stat st;
+	uint8_t build_id[BUILD_ID_LEN] = {
+		0xcd, 0xd9, 0x8c, 0xdd, 0x87, 0xf7, 0xfe, 0x64, 0xc1, 0x3b,
+		0x6d, 0xaa, 0xd5, 0x53, 0x98, 0x7e, 0xaf, 0xd4, 0x0c, 0xbb
+	};
+
+	diag("bin-info tests - DWARF index cache directory");
+
+	opt_debug_info_cache_dir = mkdtemp(cache_dir);
+	if (!opt_debug_info_cache_dir) {
+		skip(7, "Cannot create cache directory");
+		return;
+	}
+
+	/* Test filling the cache */
+	snprintf(path, PATH_MAX, "%s/%s", data_dir, SO_NAME_BUILD_ID);
+	bin = bin_info_create(path, SO_LOW_ADDR, SO_MEMSZ, true);
+	bin_info_set_build_id(bin, build_id, BUILD_ID_LEN);
+	ret = bin_info_lookup_function_name(bin, FUNC_FOO_ADDR, &func_name);
+	ok(ret == 0 && func_name && strcmp(func_name, FUNC_FOO_NAME) == 0,
+		"bin_info_lookup_function_name - correct func_name value");
+	free(func_name);
+	func_name = NULL;
+	bin_info_destroy(bin);
+
+	snprintf(path, PATH_MAX, "%s/cdd98cdd87f7fe64c13b6daad553987eafd40cbb.idx",
+		cache_dir);
+	ok(stat(path, &st) == 0, "DWARF index written to the cache directory");
+
+	/* Test lookups served from the cache, without the binary */
+	bin = bin_info_create("/nonexistent/libhello_build_id_so",
+			SO_LOW_ADDR, SO_MEMSZ, true);
+	bin_info_set_build_id(bin, build_id, BUILD_ID_LEN);
+	ret = bin_info_lookup_function_name(bin, FUNC_FOO_ADDR, &func_name);
+	ok(ret == 0, "bin_info_lookup_function_name successful (cached)");
+	if (func_name) {
+		ok(strcmp(func_name, FUNC_FOO_NAME) == 0,
+			"bin_info_lookup_function_name - correct func_name value (cached)");
+		free(func_name);
+	} else {
+		skip(1, "bin_info_lookup_function_name - func_name is NULL");
+	}
+
+	ret = bin_info_lookup_source_location(bin, FUNC_FOO_TP_ADDR, &src_loc);
+	ok(ret == 0, "bin_info_lookup_source_location successful (cached)");
+	if (src_loc) {
+		ok(src_loc->line_no == FUNC_FOO_TP_LINE_NO,
+			"bin_info_lookup_source_location - correct line_no (cached)");
+		ok(strcmp(src_loc->filename, FUNC_FOO_TP_FILENAME) == 0,
+			"bin_info_lookup_source_location - correct filename (cached)");
+		source_location_destroy(src_loc);
+	} else {
+		skip(2, "bin_info_lookup_source_location - src_loc is NULL");
+	}
+
+	bin_info_destroy(bin);
+	unlink(path);
+	rmdir(cache_dir);
+	opt_debug_info_cache_dir = NULL;
+}
+
 int main(int argc, char **argv)
 {
 	int ret;
@@ -290,8 +519,11 @@ int main(int argc, char **argv)
 
 	test_bin_info(opt_debug_info_dir);
 	test_bin_info_elf(opt_debug_info_dir);
+	test_bin_info_dynsym(opt_debug_info_dir);
 	test_bin_info_build_id(opt_debug_info_dir);
 	test_bin_info_debug_link(opt_debug_info_dir);
+	test_bin_info_shared(opt_debug_info_dir);
+	test_bin_info_cache(opt_debug_info_dir);
 
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,568 @@
+/*
+ * test_debug_info.c
+ *
+ * Babeltrace debug info tests
+ *
+ * A trace is synthesized with the mappings of the test libraries in
+ * processes, read back with each event handed to
+ * debug_info_handle_event(), and the debug info of addresses of those
+ * processes is then queried.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; under version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <babeltrace/context.h>
+#include <babeltrace/iterator.h>
+#include <babeltrace/ctf/iterator.h>
+#include <babeltrace/ctf/events-internal.h>
+#include <babeltrace/compat/stdlib.h>
+#include <babeltrace/bin-info.h>
+#include <babeltrace/debug-info.h>
+#include <babeltrace/babeltrace-internal.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <glib.h>
+
+#include "tap/tap.h"
+#include "common.h"
+#include "ust_trace.h"
+
+#define NR_TESTS 24
+#define SO_NAME "libhello_so"
+#define SO_NAME_ELF "libhello_elf_so"
+#define SO_MEMSZ 0x400000
+/* Offsets of foo from the base address, as in test_bin_info.c. */
+#define FUNC_FOO_OFFSET 0x14ee
+#define FUNC_FOO_NAME "foo+0xc3"
+#define FUNC_FOO_OFFSET_ELF 0x13ef
+#define FUNC_FOO_NAME_ELF "foo+0x24"
+
+/*
+ * Process mapping SO_NAME with SO_NAME_ELF right after it, then
+ * SO_NAME_ELF within a larger mapping of SO_NAME, above the start of
+ * its code and below foo.
+ */
+#define LAYOUT_VPID 1
+#define ADJ_LOW_ADDR 0x400000
+#define ADJ_ELF_LOW_ADDR (ADJ_LOW_ADDR + SO_MEMSZ)
+#define OUTER_LOW_ADDR 0x10000000
+#define OUTER_MEMSZ 0x1000000
+#define INNER_LOW_ADDR (OUTER_LOW_ADDR + 0x10)
+#define INNER_MEMSZ 0x1400
+
+/*
+ * Process whose events hit the cached debug info of SO_NAME and
+ * SO_NAME_ELF before SO_NAME is unloaded.
+ */
+#define UNLOAD_VPID 2
+#define UNLOAD_LOW_ADDR 0x400000
+#define UNLOAD_ELF_LOW_ADDR 0x800000
+#define NR_UNLOAD_EVENTS 6
+
+/* Process whose addresses overflow the IP cache. */
+#define LRU_VPID 3
+#define LRU_LOW_ADDR 0x400000
+#define LRU_IP_STRIDE 16
+
+/* Jobs compared with a single worker thread. */
+#define NR_JOBS 4
+/* Addresses of LAYOUT_VPID and UNLOAD_VPID compared across jobs. */
+#define NR_JOBS_IPS 512
+
+/* Debug info of the _ip context of an event, once handled. */
+struct event_result {
+	bool found;
+	char *func;
+	struct debug_info_stats stats;
+};
+
+static
+int write_trace(const char *path, const char *data_dir)
+{
+	struct ust_trace_writer w;
+	char so_path[PATH_MAX], elf_path[PATH_MAX];
+	unsigned int i;
+	int ret;
+
+	snprintf(so_path, PATH_MAX, "%s/%s", data_dir, SO_NAME);
+	snprintf(elf_path, PATH_MAX, "%s/%s", data_dir, SO_NAME_ELF);
+
+	ret = ust_trace_writer_init(&w, path, "test:event");
+	if (ret) {
+		goto end;
+	}
+
+	ret |= ust_trace_append_event(&w, w.statedump_start, LAYOUT_VPID,
+		0, 0, 0, NULL);
+	ret |= ust_trace_append_event(&w, w.statedump_bin_info, LAYOUT_VPID,
+		0, ADJ_LOW_ADDR, SO_MEMSZ, so_path);
+	ret |= ust_trace_append_event(&w, w.statedump_bin_info, LAYOUT_VPID,
+		0, ADJ_ELF_LOW_ADDR, SO_MEMSZ, elf_path);
+	ret |= ust_trace_append_event(&w, w.lib_load, LAYOUT_VPID,
+		0, OUTER_LOW_ADDR, OUTER_MEMSZ, so_path);
+	ret |= ust_trace_append_event(&w, w.lib_load, LAYOUT_VPID,
+		0, INNER_LOW_ADDR, INNER_MEMSZ, elf_path);
+
+	ret |= ust_trace_append_event(&w, w.statedump_start, UNLOAD_VPID,
+		0, 0, 0, NULL);
+	ret |= ust_trace_append_event(&w, w.statedump_bin_info, UNLOAD_VPID,
+		0, UNLOAD_LOW_ADDR, SO_MEMSZ, so_path);
+	ret |= ust_trace_append_event(&w, w.statedump_bin_info, UNLOAD_VPID,
+		0, UNLOAD_ELF_LOW_ADDR, SO_MEMSZ, elf_path);
+
+	ret |= ust_trace_append_event(&w, w.statedump_start, LRU_VPID,
+		0, 0, 0, NULL);
+	ret |= ust_trace_append_event(&w, w.statedump_bin_info, LRU_VPID,
+		0, LRU_LOW_ADDR, SO_MEMSZ, so_path);
+
+	ret |= ust_trace_append_event(&w, w.event, LAYOUT_VPID,
+		ADJ_LOW_ADDR + FUNC_FOO_OFFSET, 0, 0, NULL);
+
+	/* Each address twice, then once SO_NAME is unloaded. */
+	for (i = 0; i < 3; i++) {
+		if (i == 2) {
+			ret |= ust_trace_append_event(&w, w.lib_unload,
+				UNLOAD_VPID, 0, UNLOAD_LOW_ADDR, 0, NULL);
+		}
+		ret |= ust_trace_append_event(&w, w.event, UNLOAD_VPID,
+			UNLOAD_LOW_ADDR + FUNC_FOO_OFFSET, 0, 0, NULL);
+		ret |= ust_trace_append_event(&w, w.event, UNLOAD_VPID,
+			UNLOAD_ELF_LOW_ADDR + FUNC_FOO_OFFSET_ELF, 0, 0, NULL);
+	}
+end:
+	if (ust_trace_writer_fini(&w)) {
+		ret = -1;
+	}
+	return ret;
+}
+
+/*
+ * Record the debug info of the events of UNLOAD_VPID, valid until the
+ * next event is handled.
+ */
+static
+void record_event(struct debug_info *debug_info, struct bt_ctf_event *event,
+		struct event_result *results, unsigned int *nr_results)
+{
+	struct bt_definition *sec_def, *vpid_def, *ip_def;
+	struct debug_info_source *src;
+	struct event_result *result;
+
+	sec_def = (struct bt_definition *)
+		event->parent->stream->stream_event_context;
+	vpid_def = bt_lookup_definition(sec_def, "_vpid");
+	ip_def = bt_lookup_definition(sec_def, "_ip");
+	if (strcmp(bt_ctf_event_name(event), "test:event") || !vpid_def ||
+			!ip_def || bt_get_signed_int(vpid_def) != UNLOAD_VPID ||
+			*nr_results == NR_UNLOAD_EVENTS) {
+		return;
+	}
+
+	src = ((struct definition_integer *) ip_def)->debug_info_src;
+	result = &results[(*nr_results)++];
+	result->found = src != NULL;
+	result->func = src ? g_strdup(src->func) : NULL;
+	debug_info_get_stats(debug_info, &result->stats);
+}
+
+static
+void free_results(struct event_result *results)
+{
+	unsigned int i;
+
+	for (i = 0; i < NR_UNLOAD_EVENTS; i++) {
+		g_free(results[i].func);
+	}
+}
+
+/*
+ * Hand every event of the trace to a new debug_info, whose binaries
+ * are prepared by jobs worker threads, recording the debug info of the
+ * events of UNLOAD_VPID in results.
+ */
+static
+struct debug_info *read_trace(const char *path, unsigned int jobs,
+		struct event_result *results)
+{
+	struct debug_info *debug_info;
+	struct bt_context *ctx = NULL;
+	struct bt_ctf_iter *iter = NULL;
+	struct bt_ctf_event *event;
+	unsigned int nr_results = 0;
+
+	opt_debug_info_jobs = jobs;
+	debug_info = debug_info_create();
+	if (!debug_info) {
+		return NULL;
+	}
+	ctx = create_context_with_path(path);
+	if (!ctx) {
+		goto error;
+	}
+	iter = bt_ctf_iter_create(ctx, NULL, NULL);
+	if (!iter) {
+		goto error;
+	}
+
+	while ((event = bt_ctf_iter_read_event(iter))) {
+		debug_info_handle_event(debug_info, event->parent);
+		record_event(debug_info, event, results, &nr_results);
+		if (bt_iter_next(bt_ctf_get_iter(iter)) < 0) {
+			goto error;
+		}
+	}
+	goto end;
+
+error:
+	debug_info_destroy(debug_info);
+	debug_info = NULL;
+end:
+	if (iter) {
+		bt_ctf_iter_destroy(iter);
+	}
+	if (ctx) {
+		bt_context_put(ctx);
+	}
+	return debug_info;
+}
+
+/*
+ * Whether the debug info of an address is the one of bin_name, and
+ * the one of function func if not NULL.
+ */
+static
+bool source_is(struct debug_info_source *src, const char *bin_name,
+		const char *func)
+{
+	if (!bin_name) {
+		return !src;
+	}
+
+	return src && !g_strcmp0(src->short_bin_path, bin_name) &&
+		(!func || !g_strcmp0(src->func, func));
+}
+
+static
+void test_layout(struct debug_info *debug_info)
+{
+	struct debug_info_source *srcs[3];
+	/* Not queried before: the lookup sorts them. */
+	uint64_t stack_ips[3] = {
+		OUTER_LOW_ADDR + FUNC_FOO_OFFSET + 0x10,
+		INNER_LOW_ADDR + FUNC_FOO_OFFSET_ELF + 0x10,
+		OUTER_LOW_ADDR + 0x4,
+	};
+
+	diag("debug-info tests - adjacent and nested mappings");
+
+	ok(source_is(debug_info_query(debug_info, LAYOUT_VPID,
+			ADJ_LOW_ADDR + FUNC_FOO_OFFSET), SO_NAME,
+			FUNC_FOO_NAME),
+		"Address of a mapping followed by an adjacent one");
+	ok(source_is(debug_info_query(debug_info, LAYOUT_VPID,
+			ADJ_ELF_LOW_ADDR - 1), SO_NAME, NULL),
+		"Last address of a mapping followed by an adjacent one");
+	ok(source_is(debug_info_query(debug_info, LAYOUT_VPID,
+			ADJ_ELF_LOW_ADDR), SO_NAME_ELF, NULL),
+		"First address of an adjacent mapping");
+	ok(source_is(debug_info_query(debug_info, LAYOUT_VPID,
+			ADJ_ELF_LOW_ADDR + FUNC_FOO_OFFSET_ELF), SO_NAME_ELF,
+			FUNC_FOO_NAME_ELF),
+		"Address of an adjacent mapping");
+	ok(source_is(debug_info_query(debug_info, LAYOUT_VPID,
+			ADJ_LOW_ADDR - 1), NULL, NULL),
+		"Address below the mappings is not found");
+	ok(source_is(debug_info_query(debug_info, LAYOUT_VPID,
+			ADJ_ELF_LOW_ADDR + SO_MEMSZ), NULL, NULL),
+		"Address between mappings is not found");
+	ok(source_is(debug_info_query(debug_info, LAYOUT_VPID,
+			INNER_LOW_ADDR + FUNC_FOO_OFFSET_ELF), SO_NAME_ELF,
+			FUNC_FOO_NAME_ELF),
+		"Address of a nested mapping");
+	ok(source_is(debug_info_query(debug_info, LAYOUT_VPID,
+			OUTER_LOW_ADDR + FUNC_FOO_OFFSET), SO_NAME,
+			FUNC_FOO_NAME),
+		"Address of a mapping above the one nested in it");
+	ok(source_is(debug_info_query(debug_info, LAYOUT_VPID,
+			OUTER_LOW_ADDR + 0x8), SO_NAME, NULL),
+		"Address of a mapping below the one nested in it");
+	ok(source_is(debug_info_query(debug_info, LAYOUT_VPID,
+			OUTER_LOW_ADDR + OUTER_MEMSZ), NULL, NULL),
+		"Address after the end of the last mapping is not found");
+
+	debug_info_query_stack(debug_info, LAYOUT_VPID, stack_ips, 3, srcs);
+	ok(source_is(srcs[0], SO_NAME, NULL) &&
+		source_is(srcs[1], SO_NAME_ELF, NULL) &&
+		source_is(srcs[2], SO_NAME, NULL),
+		"Call stack addresses around a nested mapping");
+}
+
+static
+void test_unload(struct event_result *results)
+{
+	diag("debug-info tests - library unloaded after cache hits");
+
+	ok(results[0].found && !g_strcmp0(results[0].func, FUNC_FOO_NAME) &&
+		results[1].found &&
+		!g_strcmp0(results[1].func, FUNC_FOO_NAME_ELF),
+		"Addresses of the loaded libraries are found");
+	ok(results[2].stats.ip_cache_hits ==
+			results[1].stats.ip_cache_hits + 1 &&
+		results[3].stats.ip_cache_hits ==
+			results[2].stats.ip_cache_hits + 1 &&
+		!g_strcmp0(results[2].func, FUNC_FOO_NAME) &&
+		!g_strcmp0(results[3].func, FUNC_FOO_NAME_ELF),
+		"Repeated addresses are cache hits");
+	ok(!results[4].found,
+		"Address of an unloaded library is not found");
+	ok(results[4].stats.ip_cache_hits == results[3].stats.ip_cache_hits,
+		"Cached debug info of an unloaded library is dropped");
+	ok(results[5].found && !g_strcmp0(results[5].func, FUNC_FOO_NAME_ELF) &&
+		results[5].stats.ip_cache_hits ==
+			results[4].stats.ip_cache_hits + 1,
+		"Cached debug info of the other libraries is kept");
+}
+
+static
+bool source_equal(struct debug_info_source *a, struct debug_info_source *b)
+{
+	unsigned int i;
+
+	if (!a || !b) {
+		return a == b;
+	}
+
+	if (g_strcmp0(a->func, b->func) || a->line_no != b->line_no ||
+			g_strcmp0(a->src_path, b->src_path) ||
+			g_strcmp0(a->bin_path, b->bin_path) ||
+			g_strcmp0(a->bin_loc, b->bin_loc) ||
+			a->nr_inline_frames != b->nr_inline_frames) {
+		return false;
+	}
+
+	for (i = 0; i < a->nr_inline_frames; i++) {
+		struct debug_info_inline_frame *fa = &a->inline_frames[i];
+		struct debug_info_inline_frame *fb = &b->inline_frames[i];
+
+		if (g_strcmp0(fa->func, fb->func) ||
+				fa->line_no != fb->line_no ||
+				g_strcmp0(fa->src_path, fb->src_path)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Addresses spread over the mappings of LAYOUT_VPID or UNLOAD_VPID,
+ * and around them, in no particular order. Those of a same seed
+ * differ from those of another one.
+ */
+static
+void jobs_ips(uint64_t *ips, unsigned int seed)
+{
+	static const uint64_t bases[] = {
+		ADJ_LOW_ADDR, ADJ_ELF_LOW_ADDR, OUTER_LOW_ADDR,
+		INNER_LOW_ADDR, OUTER_LOW_ADDR + INNER_MEMSZ,
+	};
+	unsigned int i;
+
+	for (i = 0; i < NR_JOBS_IPS; i++) {
+		unsigned int n = (i * 37) % NR_JOBS_IPS;
+
+		ips[i] = bases[n % G_N_ELEMENTS(bases)] - 0x100 +
+			(n / G_N_ELEMENTS(bases)) * 0x30 + seed;
+	}
+}
+
+static
+void test_jobs(struct debug_info *debug_info_1,
+		struct event_result *results_1,
+		struct debug_info *debug_info_n,
+		struct event_result *results_n)
+{
+	struct debug_info_source *srcs_1[NR_JOBS_IPS], *srcs_n[NR_JOBS_IPS];
+	uint64_t ips[NR_JOBS_IPS];
+	unsigned int i, nr_found = 0;
+	bool same = true;
+	int64_t vpid;
+
+	diag("debug-info tests - %d jobs against a single one", NR_JOBS);
+
+	for (i = 0; i < NR_UNLOAD_EVENTS; i++) {
+		if (results_1[i].found != results_n[i].found ||
+				g_strcmp0(results_1[i].func,
+					results_n[i].func)) {
+			same = false;
+		}
+	}
+	ok(same, "Events get the same debug info with %d jobs", NR_JOBS);
+
+	jobs_ips(ips, 1);
+	for (i = 0, same = true; i < NR_JOBS_IPS; i++) {
+		struct debug_info_source *src_1, *src_n;
+
+		vpid = i % 2 ? LAYOUT_VPID : UNLOAD_VPID;
+		src_1 = debug_info_query(debug_info_1, vpid, ips[i]);
+		src_n = debug_info_query(debug_info_n, vpid, ips[i]);
+		if (!source_equal(src_1, src_n)) {
+			same = false;
+		}
+		if (src_1) {
+			nr_found++;
+		}
+	}
+	ok(same && nr_found > 0,
+		"Addresses get the same debug info with %d jobs", NR_JOBS);
+
+	jobs_ips(ips, 0x17);
+	for (vpid = LAYOUT_VPID, same = true, nr_found = 0;
+			vpid <= UNLOAD_VPID; vpid++) {
+		debug_info_query_stack(debug_info_1, vpid, ips,
+			NR_JOBS_IPS, srcs_1);
+		debug_info_query_stack(debug_info_n, vpid, ips,
+			NR_JOBS_IPS, srcs_n);
+		for (i = 0; i < NR_JOBS_IPS; i++) {
+			if (!source_equal(srcs_1[i], srcs_n[i])) {
+				same = false;
+			}
+			if (srcs_1[i]) {
+				nr_found++;
+			}
+		}
+	}
+	ok(same && nr_found > 0,
+		"Call stacks get the same debug info with %d jobs", NR_JOBS);
+}
+
+/*
+ * Distinct addresses of LRU_VPID, foo first.
+ */
+static
+uint64_t lru_ip(unsigned int index)
+{
+	if (!index) {
+		return LRU_LOW_ADDR + FUNC_FOO_OFFSET;
+	}
+
+	return LRU_LOW_ADDR + 0x10000 + (uint64_t) index * LRU_IP_STRIDE;
+}
+
+static
+void test_lru(struct debug_info *debug_info)
+{
+	struct debug_info_stats before, after;
+	struct debug_info_source *src;
+	unsigned int i;
+
+	diag("debug-info tests - IP cache eviction");
+
+	debug_info_get_stats(debug_info, &before);
+	(void) debug_info_query(debug_info, LRU_VPID, lru_ip(0));
+	src = debug_info_query(debug_info, LRU_VPID, lru_ip(0));
+	debug_info_get_stats(debug_info, &after);
+	ok(source_is(src, SO_NAME, FUNC_FOO_NAME) &&
+		after.ip_cache_hits == before.ip_cache_hits + 1,
+		"Repeated address is a cache hit");
+
+	for (i = 1; i < DEBUG_INFO_IP_CACHE_SIZE; i++) {
+		(void) debug_info_query(debug_info, LRU_VPID, lru_ip(i));
+	}
+	debug_info_get_stats(debug_info, &after);
+	ok(after.ip_cache_evictions == before.ip_cache_evictions,
+		"No address is evicted until the cache is full");
+
+	/* Use the oldest address: the second oldest is evicted instead. */
+	(void) debug_info_query(debug_info, LRU_VPID, lru_ip(0));
+	(void) debug_info_query(debug_info, LRU_VPID,
+		lru_ip(DEBUG_INFO_IP_CACHE_SIZE));
+	debug_info_get_stats(debug_info, &after);
+	ok(after.ip_cache_evictions == before.ip_cache_evictions + 1,
+		"An address is evicted beyond the cache size");
+
+	debug_info_get_stats(debug_info, &before);
+	src = debug_info_query(debug_info, LRU_VPID, lru_ip(0));
+	debug_info_get_stats(debug_info, &after);
+	ok(source_is(src, SO_NAME, FUNC_FOO_NAME) &&
+		after.ip_cache_hits == before.ip_cache_hits + 1,
+		"Recently used address is kept in the cache");
+
+	debug_info_get_stats(debug_info, &before);
+	src = debug_info_query(debug_info, LRU_VPID, lru_ip(1));
+	debug_info_get_stats(debug_info, &after);
+	ok(source_is(src, SO_NAME, NULL) &&
+		after.ip_cache_hits == before.ip_cache_hits &&
+		after.ip_cache_misses == before.ip_cache_misses + 1,
+		"Least recently used address is evicted and looked up again");
+}
+
+int main(int argc, char **argv)
+{
+	char trace_path[] = "/tmp/test_debug_info_XXXXXX";
+	struct event_result results[NR_UNLOAD_EVENTS] = { { 0 } };
+	struct event_result results_1[NR_UNLOAD_EVENTS] = { { 0 } };
+	struct event_result results_n[NR_UNLOAD_EVENTS] = { { 0 } };
+	struct debug_info *debug_info, *debug_info_1, *debug_info_n;
+
+	plan_tests(NR_TESTS);
+
+	if (argc != 2) {
+		return EXIT_FAILURE;
+	}
+
+	if (bin_info_init()) {
+		return EXIT_FAILURE;
+	}
+
+	if (!bt_mkdtemp(trace_path)) {
+		perror("# bt_mkdtemp");
+		return EXIT_FAILURE;
+	}
+
+	if (write_trace(trace_path, argv[1])) {
+		diag("Writing the trace to %s failed", trace_path);
+		goto end;
+	}
+
+	debug_info = read_trace(trace_path, 0, results);
+	if (!debug_info) {
+		diag("Reading the trace at %s failed", trace_path);
+		goto end;
+	}
+	test_layout(debug_info);
+	test_unload(results);
+	test_lru(debug_info);
+	debug_info_destroy(debug_info);
+
+	debug_info_1 = read_trace(trace_path, 1, results_1);
+	debug_info_n = read_trace(trace_path, NR_JOBS, results_n);
+	if (!debug_info_1 || !debug_info_n) {
+		diag("Reading the trace at %s with jobs failed", trace_path);
+	} else {
+		test_jobs(debug_info_1, results_1, debug_info_n, results_n);
+	}
+	debug_info_destroy(debug_info_n);
+	debug_info_destroy(debug_info_1);
+
+end:
+	free_results(results_n);
+	free_results(results_1);
+	free_results(results);
+	recursive_rmdir(trace_path);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,291 @@
+/*
+ * ust_trace.c
+ *
+ * Write synthetic lttng-ust traces carrying the library mappings of
+ * processes, for the debug info tests.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; under version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <babeltrace/ctf-writer/writer.h>
+#include <babeltrace/ctf-writer/clock.h>
+#include <babeltrace/ctf-writer/stream.h>
+#include <babeltrace/ctf-writer/event.h>
+#include <babeltrace/ctf-writer/event-types.h>
+#include <babeltrace/ctf-writer/event-fields.h>
+#include <babeltrace/ctf-writer/stream-class.h>
+#include <babeltrace/ref.h>
+
+#include <string.h>
+
+#include "ust_trace.h"
+
+#define UST_TRACE_EVENTS_PER_PACKET	4096
+
+/* Payload fields of an event class. */
+#define UST_FIELD_BADDR		(1U << 0)
+#define UST_FIELD_MEMSZ_PATH	(1U << 1)
+#define UST_FIELD_IS_PIC	(1U << 2)
+
+static
+int add_field(struct bt_ctf_event_class *event_class, const char *name,
+		unsigned int size, int is_signed)
+{
+	struct bt_ctf_field_type *type;
+	int ret;
+
+	if (size) {
+		type = bt_ctf_field_type_integer_create(size);
+		if (!type) {
+			return -1;
+		}
+		ret = bt_ctf_field_type_integer_set_signed(type, is_signed);
+		if (!ret && size == 64) {
+			ret = bt_ctf_field_type_integer_set_base(type,
+				BT_CTF_INTEGER_BASE_HEXADECIMAL);
+		}
+	} else {
+		type = bt_ctf_field_type_string_create();
+		if (!type) {
+			return -1;
+		}
+		ret = 0;
+	}
+	if (!ret) {
+		ret = bt_ctf_event_class_add_field(event_class, type, name);
+	}
+	bt_put(type);
+	return ret;
+}
+
+static
+struct bt_ctf_event_class *add_event_class(
+		struct bt_ctf_stream_class *stream_class, const char *name,
+		unsigned int fields)
+{
+	struct bt_ctf_event_class *event_class;
+	int ret = 0;
+
+	event_class = bt_ctf_event_class_create(name);
+	if (!event_class) {
+		return NULL;
+	}
+	if (fields & UST_FIELD_BADDR) {
+		ret |= add_field(event_class, "_baddr", 64, 0);
+	}
+	if (fields & UST_FIELD_MEMSZ_PATH) {
+		ret |= add_field(event_class, "_memsz", 64, 0);
+		ret |= add_field(event_class, "_path", 0, 0);
+	}
+	if (fields & UST_FIELD_IS_PIC) {
+		ret |= add_field(event_class, "_is_pic", 8, 0);
+	}
+	if (!ret) {
+		ret = bt_ctf_stream_class_add_event_class(stream_class,
+			event_class);
+	}
+	if (ret) {
+		BT_PUT(event_class);
+	}
+	return event_class;
+}
+
+/*
+ * Stream event context of the events: the _vpid and _ip contexts of
+ * lttng-ust.
+ */
+static
+struct bt_ctf_field_type *create_event_context_type(void)
+{
+	struct bt_ctf_field_type *context_type, *vpid_type, *ip_type;
+	int ret = 0;
+
+	context_type = bt_ctf_field_type_structure_create();
+	vpid_type = bt_ctf_field_type_integer_create(32);
+	ip_type = bt_ctf_field_type_integer_create(64);
+	if (!context_type || !vpid_type || !ip_type) {
+		ret = -1;
+		goto end;
+	}
+	ret |= bt_ctf_field_type_integer_set_signed(vpid_type, 1);
+	ret |= bt_ctf_field_type_integer_set_base(ip_type,
+		BT_CTF_INTEGER_BASE_HEXADECIMAL);
+	ret |= bt_ctf_field_type_structure_add_field(context_type, vpid_type,
+		"_vpid");
+	ret |= bt_ctf_field_type_structure_add_field(context_type, ip_type,
+		"_ip");
+end:
+	bt_put(vpid_type);
+	bt_put(ip_type);
+	if (ret) {
+		BT_PUT(context_type);
+	}
+	return context_type;
+}
+
+int ust_trace_writer_init(struct ust_trace_writer *w, const char *path,
+		const char *event_name)
+{
+	struct bt_ctf_stream_class *stream_class = NULL;
+	struct bt_ctf_field_type *context_type = NULL;
+	int ret = -1;
+
+	memset(w, 0, sizeof(*w));
+	w->writer = bt_ctf_writer_create(path);
+	if (!w->writer) {
+		goto end;
+	}
+	w->clock = bt_ctf_clock_create("monotonic");
+	if (!w->clock || bt_ctf_writer_add_clock(w->writer, w->clock)) {
+		goto end;
+	}
+	stream_class = bt_ctf_stream_class_create("ust");
+	if (!stream_class ||
+			bt_ctf_stream_class_set_clock(stream_class, w->clock)) {
+		goto end;
+	}
+	context_type = create_event_context_type();
+	if (!context_type || bt_ctf_stream_class_set_event_context_type(
+			stream_class, context_type)) {
+		goto end;
+	}
+
+	w->statedump_start = add_event_class(stream_class,
+		"lttng_ust_statedump:start", 0);
+	w->statedump_bin_info = add_event_class(stream_class,
+		"lttng_ust_statedump:bin_info",
+		UST_FIELD_BADDR | UST_FIELD_MEMSZ_PATH | UST_FIELD_IS_PIC);
+	w->lib_load = add_event_class(stream_class, "lttng_ust_lib:load",
+		UST_FIELD_BADDR | UST_FIELD_MEMSZ_PATH);
+	w->lib_unload = add_event_class(stream_class, "lttng_ust_lib:unload",
+		UST_FIELD_BADDR);
+	w->event = add_event_class(stream_class, event_name, 0);
+	if (!w->statedump_start || !w->statedump_bin_info ||
+			!w->lib_load || !w->lib_unload || !w->event) {
+		goto end;
+	}
+
+	w->stream = bt_ctf_writer_create_stream(w->writer, stream_class);
+	if (!w->stream) {
+		goto end;
+	}
+	ret = 0;
+end:
+	bt_put(context_type);
+	bt_put(stream_class);
+	return ret;
+}
+
+int ust_trace_writer_fini(struct ust_trace_writer *w)
+{
+	int ret = 0;
+
+	if (w->stream && w->nr_pending) {
+		ret = bt_ctf_stream_flush(w->stream);
+	}
+	if (w->writer) {
+		bt_ctf_writer_flush_metadata(w->writer);
+	}
+	bt_put(w->event);
+	bt_put(w->lib_unload);
+	bt_put(w->lib_load);
+	bt_put(w->statedump_bin_info);
+	bt_put(w->statedump_start);
+	bt_put(w->stream);
+	bt_put(w->clock);
+	bt_put(w->writer);
+	return ret;
+}
+
+static
+int set_uint_field(struct bt_ctf_field *parent, const char *name,
+		uint64_t value)
+{
+	struct bt_ctf_field *field;
+	int ret;
+
+	field = bt_ctf_field_structure_get_field(parent, name);
+	if (!field) {
+		return -1;
+	}
+	ret = bt_ctf_field_unsigned_integer_set_value(field, value);
+	bt_put(field);
+	return ret;
+}
+
+int ust_trace_append_event(struct ust_trace_writer *w,
+		struct bt_ctf_event_class *event_class, int32_t vpid,
+		uint64_t ip, uint64_t baddr, uint64_t memsz, const char *path)
+{
+	struct bt_ctf_event *event;
+	struct bt_ctf_field *context = NULL, *payload = NULL, *field = NULL;
+	int ret = -1;
+
+	if (bt_ctf_clock_set_time(w->clock, ++w->time)) {
+		return -1;
+	}
+	event = bt_ctf_event_create(event_class);
+	if (!event) {
+		return -1;
+	}
+
+	context = bt_ctf_event_get_stream_event_context(event);
+	if (!context) {
+		goto end;
+	}
+	field = bt_ctf_field_structure_get_field(context, "_vpid");
+	if (!field || bt_ctf_field_signed_integer_set_value(field, vpid)) {
+		goto end;
+	}
+	if (set_uint_field(context, "_ip", ip)) {
+		goto end;
+	}
+
+	if (event_class == w->lib_unload) {
+		payload = bt_ctf_event_get_payload(event, NULL);
+		if (!payload || set_uint_field(payload, "_baddr", baddr)) {
+			goto end;
+		}
+	} else if (path) {
+		payload = bt_ctf_event_get_payload(event, NULL);
+		if (!payload) {
+			goto end;
+		}
+		if (set_uint_field(payload, "_baddr", baddr) ||
+				set_uint_field(payload, "_memsz", memsz)) {
+			goto end;
+		}
+		BT_PUT(field);
+		field = bt_ctf_field_structure_get_field(payload, "_path");
+		if (!field || bt_ctf_field_string_set_value(field, path)) {
+			goto end;
+		}
+		if (event_class == w->statedump_bin_info &&
+				set_uint_field(payload, "_is_pic", 1)) {
+			goto end;
+		}
+	}
+
+	ret = bt_ctf_stream_append_event(w->stream, event);
+	if (!ret && ++w->nr_pending == UST_TRACE_EVENTS_PER_PACKET) {
+		ret = bt_ctf_stream_flush(w->stream);
+		w->nr_pending = 0;
+	}
+end:
+	bt_put(field);
+	bt_put(payload);
+	bt_put(context);
+	bt_put(event);
+	return ret;
+}
@@ -0,0 +1,67 @@
+/*
+ * ust_trace.h
+ *
+ * Write synthetic lttng-ust traces carrying the library mappings of
+ * processes, for the debug info tests.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; under version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef _TESTS_UST_TRACE_H
+#define _TESTS_UST_TRACE_H
+
+#include <stdint.h>
+
+struct bt_ctf_writer;
+struct bt_ctf_clock;
+struct bt_ctf_stream;
+struct bt_ctf_event_class;
+
+/*
+ * A single stream whose events have the _vpid and _ip contexts of
+ * lttng-ust.
+ */
+struct ust_trace_writer {
+	struct bt_ctf_writer *writer;
+	struct bt_ctf_clock *clock;
+	struct bt_ctf_stream *stream;
+	struct bt_ctf_event_class *statedump_start;
+	struct bt_ctf_event_class *statedump_bin_info;
+	struct bt_ctf_event_class *lib_load;
+	struct bt_ctf_event_class *lib_unload;
+	/* Class of the other events, without payload. */
+	struct bt_ctf_event_class *event;
+	uint64_t time;
+	unsigned int nr_pending;
+};
+
+/*
+ * Create a trace at path, whose other events are named event_name.
+ */
+int ust_trace_writer_init(struct ust_trace_writer *w, const char *path,
+		const char *event_name);
+
+/*
+ * Flush the events and the metadata, and release the writer.
+ */
+int ust_trace_writer_fini(struct ust_trace_writer *w);
+
+/*
+ * Append an event of a process, with the given library mapping as
+ * payload if its class has one: only baddr for lib_unload.
+ */
+int ust_trace_append_event(struct ust_trace_writer *w,
+		struct bt_ctf_event_class *event_class, int32_t vpid,
+		uint64_t ip, uint64_t baddr, uint64_t memsz, const char *path);
+
+#endif /* _TESTS_UST_TRACE_H */
@@ -0,0 +1,141 @@
+/*
+ * bench_live.c
+ *
+ * Measure the throughput and end-to-end latency of the lttng-live
+ * reader against the relay stand-in, run in the same process.
+ *
+ * The latency of an event is the time elapsed between the moment its
+ * timestamp is reached in replay time and the moment the reader hands
+ * it to the output, so it is only measured when the trace is replayed
+ * at a given pace (-x).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; under version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <babeltrace/format.h>
+#include <babeltrace/lttng-live-internal.h>
+#include <babeltrace/ctf-text/types.h>
+#include <babeltrace/ctf-ir/metadata.h>
+#include <babeltrace/babeltrace-internal.h>	/* For symbol side-effects */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <glib.h>
+
+#include "relay.h"
+
+static struct relay *relay;
+static uint64_t nr_events;
+static GArray *latencies;	/* int64_t, in ns */
+
+static
+int bench_event_cb(struct bt_stream_pos *pos,
+		struct ctf_stream_definition *stream)
+{
+	int64_t replay;
+
+	nr_events++;
+	replay = relay_replay_time(relay, stream->real_timestamp);
+	if (replay >= 0) {
+		int64_t latency = relay_now() - replay;
+
+		g_array_append_val(latencies, latency);
+	}
+	return 0;
+}
+
+static
+gint compare_latency(gconstpointer a, gconstpointer b)
+{
+	int64_t la = *(const int64_t *) a, lb = *(const int64_t *) b;
+
+	return la < lb ? -1 : la > lb;
+}
+
+static
+double latency_ms(unsigned int percentile)
+{
+	guint i = (latencies->len - 1) * percentile / 100;
+
+	return g_array_index(latencies, int64_t, i) / 1e6;
+}
+
+static
+void print_results(int64_t duration)
+{
+	struct relay_stats stats;
+	double seconds = duration / 1e9;
+
+	relay_get_stats(relay, &stats);
+	printf("events: %" PRIu64 "\n", nr_events);
+	printf("duration: %.3f s\n", seconds);
+	printf("events/s: %.0f\n", seconds > 0 ? nr_events / seconds : 0);
+	printf("packets: %" PRIu64 " (%" PRIu64 " bytes, %.1f MiB/s)\n",
+		stats.packets, stats.bytes,
+		seconds > 0 ? stats.bytes / seconds / (1 << 20) : 0);
+	printf("injected: %" PRIu64 " retry, %" PRIu64 " inactive, %"
+		PRIu64 " new streams, %" PRIu64 " disconnects\n",
+		stats.retries, stats.inactive, stats.new_streams,
+		stats.disconnects);
+	if (!latencies->len)
+		return;
+	g_array_sort(latencies, compare_latency);
+	printf("latency: min %.3f ms, median %.3f ms, p99 %.3f ms, max %.3f ms\n",
+		latency_ms(0), latency_ms(50), latency_ms(99),
+		latency_ms(100));
+}
+
+int main(int argc, char **argv)
+{
+	struct relay_config config;
+	struct ctf_text_stream_pos output;
+	char url[1024];
+	int64_t begin;
+	int next, ret = EXIT_FAILURE;
+
+	next = relay_parse_args(&config, argc, argv);
+	if (next < 0) {
+		relay_usage(stderr, argv[0]);
+		fprintf(stderr, "An argument after TRACE is appended to the "
+			"lttng-live URL options, e.g. \"connections=4\".\n");
+		return EXIT_FAILURE;
+	}
+	relay = relay_create(&config);
+	if (!relay)
+		return EXIT_FAILURE;
+	latencies = g_array_new(FALSE, FALSE, sizeof(int64_t));
+
+	memset(&output, 0, sizeof(output));
+	output.parent.event_cb = bench_event_cb;
+	output.parent.trace = &output.trace_descriptor;
+
+	snprintf(url, sizeof(url), "net://localhost:%d/host/%s/%s%s%s",
+		relay_port(relay), config.hostname, config.session_name,
+		next < argc ? "?" : "", next < argc ? argv[next] : "");
+
+	begin = relay_now();
+	if (bt_lttng_live_read_trace(url, &output.trace_descriptor) < 0) {
+		fprintf(stderr, "[error] Reading %s failed\n", url);
+		goto end;
+	}
+	print_results(relay_now() - begin);
+	ret = EXIT_SUCCESS;
+
+end:
+	g_array_free(latencies, TRUE);
+	relay_destroy(relay);
+	return ret;
+}
@@ -0,0 +1,1061 @@
+/*
+ * relay.c
+ *
+ * Stand-in for lttng-relayd serving a CTF trace from disk over the
+ * live viewer protocol, with configurable latency, pacing, copies of
+ * the trace, injection of RETRY, INACTIVE and NEW_STREAM answers, and
+ * of a disconnection.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; under version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <babeltrace/format.h>
+#include <babeltrace/ctf/types.h>
+#include <babeltrace/ctf/metadata.h>
+#include <babeltrace/ctf-ir/metadata.h>
+#include <babeltrace/babeltrace-internal.h>	/* For symbol side-effects */
+#include <babeltrace/endian.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <glib.h>
+
+#include "lttng-viewer-abi.h"
+#include "relay.h"
+
+#define RELAY_SESSION_ID	1
+#define RELAY_MAJOR		2
+#define RELAY_MINOR		4
+
+struct relay_stream {
+	uint64_t id;
+	unsigned int copy;		/* Sent as the CTF trace ID */
+	int metadata;
+	int announced;			/* Sent to the viewer */
+	int hup;			/* HUP sent to the viewer */
+	int metadata_sent;
+	struct relay_stream *metadata_stream;	/* Of the same copy */
+	int fd;				/* Owned by the CTF trace */
+	uint64_t stream_class_id;
+	GArray *index;			/* Owned by the CTF trace */
+	unsigned int next;		/* Next packet to serve */
+	char path[LTTNG_VIEWER_PATH_MAX];
+	char channel[LTTNG_VIEWER_NAME_MAX];
+};
+
+struct relay_conn {
+	struct relay *relay;
+	int sock;
+	pthread_t thread;
+	int done;
+};
+
+struct relay {
+	struct relay_config config;
+	int sock;
+	int port;
+	pthread_t thread;
+	/* Protects everything below. */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct bt_format *fmt;
+	struct bt_trace_descriptor *td;
+	gchar *metadata;
+	gsize metadata_len;
+	GPtrArray *streams;		/* struct relay_stream */
+	GPtrArray *conns;		/* struct relay_conn */
+	int nr_conns;			/* Connections still open */
+	int attached;
+	int reset_pending;		/* Serve from the beginning on attach */
+	int copies_visible;		/* Copies announced or to announce */
+	int64_t epoch;			/* Replay start, -1 before attach */
+	uint64_t trace_begin;		/* Trace start, in ns */
+	uint64_t next_viewer_id;
+	unsigned int rand_state;
+	int quit;
+	struct relay_stats stats;
+};
+
+int64_t relay_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void relay_usage(FILE *fp, const char *name)
+{
+	fprintf(fp, "usage : %s [OPTIONS] TRACE\n", name);
+	fprintf(fp, "\n");
+	fprintf(fp, "Serve the CTF trace at TRACE as a live session.\n");
+	fprintf(fp, "\n");
+	fprintf(fp, "  -p PORT        Listen on PORT (default: any free port)\n");
+	fprintf(fp, "  -H HOSTNAME    Traced host name (default: relay)\n");
+	fprintf(fp, "  -s SESSION     Session name (default: live)\n");
+	fprintf(fp, "  -l MS          Delay each data response by MS ms\n");
+	fprintf(fp, "  -r PCT         Answer PCT %% of the indexes with RETRY\n");
+	fprintf(fp, "  -i PCT         Answer PCT %% of the indexes with INACTIVE\n");
+	fprintf(fp, "  -n COPIES      Serve COPIES copies of the trace (default: 1)\n");
+	fprintf(fp, "  -N PACKETS     Announce the copies after the first one with\n");
+	fprintf(fp, "                 the NEW_STREAM flag, after PACKETS packets\n");
+	fprintf(fp, "  -x SPEED       Replay the trace at SPEED times its pace\n");
+	fprintf(fp, "                 (default: 0, all packets available at once)\n");
+	fprintf(fp, "  -S SEED        Seed of the injected answers\n");
+	fprintf(fp, "  -k PACKETS     Close the viewer connections once, after\n");
+	fprintf(fp, "                 PACKETS packets\n");
+	fprintf(fp, "\n");
+}
+
+static
+int parse_int(const char *arg, int *value)
+{
+	char *end;
+	long v;
+
+	errno = 0;
+	v = strtol(arg, &end, 10);
+	if (errno || *end != '\0' || v < 0 || v > INT32_MAX) {
+		fprintf(stderr, "[error] Invalid value \"%s\"\n", arg);
+		return -1;
+	}
+	*value = v;
+	return 0;
+}
+
+/*
+ * Parse the relay options. Returns the index of the first argument
+ * after the trace path, or a negative value on error.
+ */
+int relay_parse_args(struct relay_config *config, int argc, char **argv)
+{
+	int opt, value;
+	char *end;
+
+	memset(config, 0, sizeof(*config));
+	config->hostname = "relay";
+	config->session_name = "live";
+	config->copies = 1;
+	config->seed = 1;
+
+	while ((opt = getopt(argc, argv, "p:H:s:l:r:i:n:N:x:S:k:h")) != -1) {
+		switch (opt) {
+		case 'p':
+			if (parse_int(optarg, &config->port))
+				return -1;
+			break;
+		case 'H':
+			config->hostname = optarg;
+			break;
+		case 's':
+			config->session_name = optarg;
+			break;
+		case 'l':
+			if (parse_int(optarg, &config->latency))
+				return -1;
+			break;
+		case 'r':
+			if (parse_int(optarg, &config->retry_pct))
+				return -1;
+			break;
+		case 'i':
+			if (parse_int(optarg, &config->inactive_pct))
+				return -1;
+			break;
+		case 'n':
+			if (parse_int(optarg, &config->copies))
+				return -1;
+			if (!config->copies) {
+				fprintf(stderr, "[error] At least one copy is needed\n");
+				return -1;
+			}
+			break;
+		case 'N':
+			if (parse_int(optarg, &config->new_stream_after))
+				return -1;
+			break;
+		case 'x':
+			config->speed = strtod(optarg, &end);
+			if (*end != '\0' || config->speed < 0) {
+				fprintf(stderr, "[error] Invalid speed \"%s\"\n",
+					optarg);
+				return -1;
+			}
+			break;
+		case 'S':
+			if (parse_int(optarg, &value))
+				return -1;
+			config->seed = value;
+			break;
+		case 'k':
+			if (parse_int(optarg, &config->disconnect_after))
+				return -1;
+			break;
+		case 'h':
+		default:
+			return -1;
+		}
+	}
+	if (config->retry_pct + config->inactive_pct > 100) {
+		fprintf(stderr, "[error] More than 100%% of injected answers\n");
+		return -1;
+	}
+	if (optind >= argc) {
+		fprintf(stderr, "[error] Missing trace path\n");
+		return -1;
+	}
+	config->trace_path = argv[optind];
+	return optind + 1;
+}
+
+static
+int send_all(int sock, const void *buf, size_t len)
+{
+	const char *p = buf;
+	ssize_t ret;
+
+	while (len) {
+		ret = send(sock, p, len, MSG_NOSIGNAL);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return -1;
+		p += ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+/*
+ * Returns 1 on success, 0 if the viewer closed the connection, -1 on
+ * error.
+ */
+static
+int recv_all(int sock, void *buf, size_t len)
+{
+	char *p = buf;
+	ssize_t ret;
+
+	while (len) {
+		ret = recv(sock, p, len, 0);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret == 0 && p == buf)
+			return 0;
+		if (ret <= 0)
+			return -1;
+		p += ret;
+		len -= ret;
+	}
+	return 1;
+}
+
+static
+struct relay_stream *add_stream(struct relay *relay, unsigned int copy)
+{
+	struct relay_stream *stream;
+
+	stream = g_new0(struct relay_stream, 1);
+	stream->id = relay->streams->len + 1;
+	stream->copy = copy;
+	stream->fd = -1;
+	g_ptr_array_add(relay->streams, stream);
+	return stream;
+}
+
+/*
+ * Open the trace with the CTF reader, which indexes the packets of
+ * each stream file, and describe one relay stream per file for each
+ * copy of the trace.
+ */
+static
+int load_trace(struct relay *relay)
+{
+	struct ctf_trace *trace;
+	gchar *metadata_path;
+	GError *error = NULL;
+	unsigned int copy;
+	int i, j, ret = -1;
+
+	relay->fmt = bt_lookup_format(g_quark_from_static_string("ctf"));
+	if (!relay->fmt) {
+		fprintf(stderr, "[error] CTF format not found\n");
+		goto end;
+	}
+	relay->td = relay->fmt->open_trace(relay->config.trace_path,
+			O_RDONLY, NULL, NULL);
+	if (!relay->td) {
+		fprintf(stderr, "[error] Unable to open trace \"%s\"\n",
+			relay->config.trace_path);
+		goto end;
+	}
+	trace = container_of(relay->td, struct ctf_trace, parent);
+
+	metadata_path = g_build_filename(relay->config.trace_path,
+			"metadata", NULL);
+	if (!g_file_get_contents(metadata_path, &relay->metadata,
+			&relay->metadata_len, &error)) {
+		fprintf(stderr, "[error] Unable to read metadata: %s\n",
+			error->message);
+		g_error_free(error);
+		g_free(metadata_path);
+		goto end;
+	}
+	g_free(metadata_path);
+
+	relay->trace_begin = UINT64_MAX;
+	for (copy = 0; copy < relay->config.copies; copy++) {
+		struct relay_stream *stream, *metadata_stream;
+
+		metadata_stream = stream = add_stream(relay, copy);
+		stream->metadata = 1;
+		snprintf(stream->path, sizeof(stream->path), "copy%u", copy);
+		snprintf(stream->channel, sizeof(stream->channel),
+			"metadata");
+
+		for (i = 0; i < trace->streams->len; i++) {
+			struct ctf_stream_declaration *stream_class;
+
+			stream_class = g_ptr_array_index(trace->streams, i);
+			if (!stream_class)
+				continue;
+			for (j = 0; j < stream_class->streams->len; j++) {
+				struct ctf_file_stream *file_stream;
+				struct packet_index *index;
+
+				file_stream = g_ptr_array_index(
+						stream_class->streams, j);
+				if (!file_stream)
+					continue;
+				stream = add_stream(relay, copy);
+				stream->metadata_stream = metadata_stream;
+				stream->fd = file_stream->pos.fd;
+				stream->index = file_stream->pos.packet_index;
+				stream->stream_class_id =
+					stream_class->stream_id;
+				snprintf(stream->path, sizeof(stream->path),
+					"copy%u", copy);
+				snprintf(stream->channel,
+					sizeof(stream->channel),
+					"channel%" PRIu64 "_%d",
+					stream_class->stream_id, j);
+				if (!stream->index->len)
+					continue;
+				index = &g_array_index(stream->index,
+						struct packet_index, 0);
+				if (index->ts_real.timestamp_begin
+						< relay->trace_begin)
+					relay->trace_begin =
+						index->ts_real.timestamp_begin;
+			}
+		}
+	}
+	if (relay->trace_begin == UINT64_MAX)
+		relay->trace_begin = 0;
+	ret = 0;
+end:
+	return ret;
+}
+
+/*
+ * Release the hidden copies once enough packets have been served, or
+ * when the visible streams are all over. Called with relay->lock held.
+ */
+static
+void release_copies(struct relay *relay)
+{
+	int i, all_hup = 1;
+
+	if (relay->copies_visible == relay->config.copies)
+		return;
+	for (i = 0; i < relay->streams->len; i++) {
+		struct relay_stream *stream;
+
+		stream = g_ptr_array_index(relay->streams, i);
+		if (stream->announced && !stream->metadata && !stream->hup)
+			all_hup = 0;
+	}
+	if (relay->stats.packets >= relay->config.new_stream_after
+			|| all_hup)
+		relay->copies_visible = relay->config.copies;
+}
+
+/*
+ * Called with relay->lock held.
+ */
+static
+int nr_pending_streams(struct relay *relay)
+{
+	int i, nr = 0;
+
+	for (i = 0; i < relay->streams->len; i++) {
+		struct relay_stream *stream;
+
+		stream = g_ptr_array_index(relay->streams, i);
+		if (!stream->announced
+				&& stream->copy < relay->copies_visible)
+			nr++;
+	}
+	return nr;
+}
+
+/*
+ * Called with relay->lock held.
+ */
+static
+int session_over(struct relay *relay)
+{
+	int i;
+
+	if (relay->copies_visible < relay->config.copies)
+		return 0;
+	for (i = 0; i < relay->streams->len; i++) {
+		struct relay_stream *stream;
+
+		stream = g_ptr_array_index(relay->streams, i);
+		if (!stream->announced)
+			return 0;
+		if (!stream->metadata && !stream->hup)
+			return 0;
+	}
+	return 1;
+}
+
+static
+struct relay_stream *lookup_stream(struct relay *relay, uint64_t id)
+{
+	if (id == 0 || id > relay->streams->len)
+		return NULL;
+	return g_ptr_array_index(relay->streams, id - 1);
+}
+
+/*
+ * Send the status and the streams not announced yet, for the attach and
+ * new streams commands, which share their response layout.
+ */
+static
+int send_streams(struct relay *relay, int sock, uint32_t status)
+{
+	struct lttng_viewer_new_streams_response rp;
+	GArray *streams;
+	int i, ret;
+
+	streams = g_array_new(FALSE, TRUE, sizeof(struct lttng_viewer_stream));
+	pthread_mutex_lock(&relay->lock);
+	for (i = 0; i < relay->streams->len; i++) {
+		struct relay_stream *stream;
+		struct lttng_viewer_stream vs;
+
+		stream = g_ptr_array_index(relay->streams, i);
+		if (stream->announced || stream->copy >= relay->copies_visible)
+			continue;
+		memset(&vs, 0, sizeof(vs));
+		vs.id = htobe64(stream->id);
+		vs.ctf_trace_id = htobe64(stream->copy);
+		vs.metadata_flag = htobe32(stream->metadata);
+		strncpy(vs.path_name, stream->path, sizeof(vs.path_name) - 1);
+		strncpy(vs.channel_name, stream->channel,
+			sizeof(vs.channel_name) - 1);
+		g_array_append_val(streams, vs);
+		stream->announced = 1;
+		if (stream->copy > 0)
+			relay->stats.new_streams++;
+	}
+	pthread_mutex_unlock(&relay->lock);
+
+	memset(&rp, 0, sizeof(rp));
+	rp.status = htobe32(status);
+	rp.streams_count = htobe32(streams->len);
+	ret = send_all(sock, &rp, sizeof(rp));
+	if (!ret && streams->len)
+		ret = send_all(sock, streams->data,
+			streams->len * sizeof(struct lttng_viewer_stream));
+	g_array_free(streams, TRUE);
+	return ret;
+}
+
+static
+int cmd_connect(struct relay *relay, int sock, void *payload)
+{
+	struct lttng_viewer_connect *connect = payload;
+
+	pthread_mutex_lock(&relay->lock);
+	connect->viewer_session_id = htobe64(++relay->next_viewer_id);
+	pthread_mutex_unlock(&relay->lock);
+	connect->major = htobe32(RELAY_MAJOR);
+	connect->minor = htobe32(RELAY_MINOR);
+	return send_all(sock, connect, sizeof(*connect));
+}
+
+static
+int cmd_list_sessions(struct relay *relay, int sock)
+{
+	struct lttng_viewer_list_sessions list;
+	struct lttng_viewer_session session;
+	int i, nr_streams = 0;
+
+	memset(&session, 0, sizeof(session));
+	pthread_mutex_lock(&relay->lock);
+	for (i = 0; i < relay->streams->len; i++) {
+		struct relay_stream *stream;
+
+		stream = g_ptr_array_index(relay->streams, i);
+		if (stream->copy < relay->copies_visible)
+			nr_streams++;
+	}
+	session.clients = htobe32(relay->attached ? 1 : 0);
+	pthread_mutex_unlock(&relay->lock);
+	session.id = htobe64(RELAY_SESSION_ID);
+	session.streams = htobe32(nr_streams);
+	strncpy(session.hostname, relay->config.hostname,
+		sizeof(session.hostname) - 1);
+	strncpy(session.session_name, relay->config.session_name,
+		sizeof(session.session_name) - 1);
+
+	list.sessions_count = htobe32(1);
+	if (send_all(sock, &list, sizeof(list)))
+		return -1;
+	return send_all(sock, &session, sizeof(session));
+}
+
+static
+int cmd_create_session(struct relay *relay, int sock)
+{
+	struct lttng_viewer_create_session_response rp;
+
+	rp.status = htobe32(LTTNG_VIEWER_CREATE_SESSION_OK);
+	return send_all(sock, &rp, sizeof(rp));
+}
+
+/*
+ * Close all the connections of the viewer, as if the relay daemon had
+ * restarted. Called with relay->lock held.
+ */
+static
+void drop_viewer(struct relay *relay)
+{
+	int i;
+
+	for (i = 0; i < relay->conns->len; i++) {
+		struct relay_conn *conn = g_ptr_array_index(relay->conns, i);
+
+		if (!conn->done)
+			shutdown(conn->sock, SHUT_RDWR);
+	}
+	relay->attached = 0;
+	relay->reset_pending = 1;
+	relay->stats.disconnects++;
+}
+
+/*
+ * Serve the streams from the beginning to a viewer attaching again after
+ * drop_viewer(), once the connections of its previous attachment are
+ * all closed. The streams which have hung up stay so. Called with
+ * relay->lock held.
+ */
+static
+void reset_streams(struct relay *relay)
+{
+	int i;
+
+	while (relay->nr_conns > 1)
+		pthread_cond_wait(&relay->cond, &relay->lock);
+	for (i = 0; i < relay->streams->len; i++) {
+		struct relay_stream *stream;
+
+		stream = g_ptr_array_index(relay->streams, i);
+		stream->announced = 0;
+		stream->metadata_sent = 0;
+		stream->next = 0;
+	}
+	relay->reset_pending = 0;
+}
+
+static
+int cmd_attach_session(struct relay *relay, int sock, void *payload)
+{
+	struct lttng_viewer_attach_session_request *rq = payload;
+	struct lttng_viewer_attach_session_response rp;
+
+	if (be64toh(rq->session_id) != RELAY_SESSION_ID) {
+		memset(&rp, 0, sizeof(rp));
+		rp.status = htobe32(LTTNG_VIEWER_ATTACH_UNK);
+		return send_all(sock, &rp, sizeof(rp));
+	}
+	pthread_mutex_lock(&relay->lock);
+	if (relay->reset_pending)
+		reset_streams(relay);
+	relay->attached = 1;
+	if (relay->epoch < 0)
+		relay->epoch = relay_now();
+	pthread_mutex_unlock(&relay->lock);
+	return send_streams(relay, sock, LTTNG_VIEWER_ATTACH_OK);
+}
+
+static
+int cmd_get_new_streams(struct relay *relay, int sock, void *payload)
+{
+	struct lttng_viewer_new_streams_request *rq = payload;
+	struct lttng_viewer_new_streams_response rp;
+	uint32_t status;
+
+	memset(&rp, 0, sizeof(rp));
+	if (be64toh(rq->session_id) != RELAY_SESSION_ID) {
+		rp.status = htobe32(LTTNG_VIEWER_NEW_STREAMS_ERR);
+		return send_all(sock, &rp, sizeof(rp));
+	}
+	pthread_mutex_lock(&relay->lock);
+	release_copies(relay);
+	if (nr_pending_streams(relay))
+		status = LTTNG_VIEWER_NEW_STREAMS_OK;
+	else if (session_over(relay))
+		status = LTTNG_VIEWER_NEW_STREAMS_HUP;
+	else
+		status = LTTNG_VIEWER_NEW_STREAMS_NO_NEW;
+	pthread_mutex_unlock(&relay->lock);
+
+	if (status == LTTNG_VIEWER_NEW_STREAMS_OK)
+		return send_streams(relay, sock, status);
+	rp.status = htobe32(status);
+	return send_all(sock, &rp, sizeof(rp));
+}
+
+static
+void inject_latency(struct relay *relay)
+{
+	if (relay->config.latency)
+		usleep(relay->config.latency * 1000);
+}
+
+static
+int64_t replay_time(struct relay *relay, uint64_t timestamp)
+{
+	if (relay->epoch < 0 || relay->config.speed <= 0)
+		return -1;
+	if (timestamp < relay->trace_begin)
+		return relay->epoch;
+	return relay->epoch + (int64_t) ((timestamp - relay->trace_begin)
+			/ relay->config.speed);
+}
+
+static
+int cmd_get_next_index(struct relay *relay, int sock, void *payload)
+{
+	struct lttng_viewer_get_next_index *rq = payload;
+	struct lttng_viewer_index rp;
+	struct relay_stream *stream;
+	struct packet_index *index;
+	uint32_t status, flags = 0;
+	int dice;
+
+	inject_latency(relay);
+	memset(&rp, 0, sizeof(rp));
+
+	pthread_mutex_lock(&relay->lock);
+	stream = lookup_stream(relay, be64toh(rq->stream_id));
+	if (!stream || stream->metadata || !stream->announced) {
+		status = LTTNG_VIEWER_INDEX_ERR;
+		goto send;
+	}
+	rp.stream_id = htobe64(stream->stream_class_id);
+	if (stream->next >= stream->index->len) {
+		status = LTTNG_VIEWER_INDEX_HUP;
+		stream->hup = 1;
+		pthread_cond_broadcast(&relay->cond);
+		goto send;
+	}
+	index = &g_array_index(stream->index, struct packet_index,
+			stream->next);
+	if (relay->config.speed > 0 && relay_now()
+			< replay_time(relay, index->ts_real.timestamp_end)) {
+		status = LTTNG_VIEWER_INDEX_RETRY;
+		goto send;
+	}
+	dice = rand_r(&relay->rand_state) % 100;
+	if (dice < relay->config.retry_pct) {
+		status = LTTNG_VIEWER_INDEX_RETRY;
+		relay->stats.retries++;
+		goto send;
+	}
+	if (stream->next > 0 && dice < relay->config.retry_pct
+			+ relay->config.inactive_pct) {
+		struct packet_index *prev;
+
+		/* Beacon: nothing new up to the end of the last packet. */
+		prev = &g_array_index(stream->index, struct packet_index,
+				stream->next - 1);
+		status = LTTNG_VIEWER_INDEX_INACTIVE;
+		rp.timestamp_end = htobe64(prev->ts_cycles.timestamp_end);
+		relay->stats.inactive++;
+		goto send;
+	}
+
+	status = LTTNG_VIEWER_INDEX_OK;
+	rp.offset = htobe64(index->offset);
+	rp.packet_size = htobe64(index->packet_size);
+	rp.content_size = htobe64(index->content_size);
+	rp.timestamp_begin = htobe64(index->ts_cycles.timestamp_begin);
+	rp.timestamp_end = htobe64(index->ts_cycles.timestamp_end);
+	rp.events_discarded = htobe64(index->events_discarded);
+	stream->next++;
+	relay->stats.packets++;
+	if (relay->stats.packets == relay->config.disconnect_after) {
+		/* The viewer never gets this index. */
+		drop_viewer(relay);
+	}
+	release_copies(relay);
+	if (nr_pending_streams(relay))
+		flags |= LTTNG_VIEWER_FLAG_NEW_STREAM;
+	if (!stream->metadata_stream->metadata_sent)
+		flags |= LTTNG_VIEWER_FLAG_NEW_METADATA;
+send:
+	pthread_mutex_unlock(&relay->lock);
+	rp.status = htobe32(status);
+	rp.flags = htobe32(flags);
+	return send_all(sock, &rp, sizeof(rp));
+}
+
+static
+int cmd_get_packet(struct relay *relay, int sock, void *payload)
+{
+	struct lttng_viewer_get_packet *rq = payload;
+	struct lttng_viewer_trace_packet rp;
+	struct relay_stream *stream;
+	uint32_t len = be32toh(rq->len);
+	char *data = NULL;
+	ssize_t ret_len;
+	int ret;
+
+	inject_latency(relay);
+	memset(&rp, 0, sizeof(rp));
+
+	pthread_mutex_lock(&relay->lock);
+	stream = lookup_stream(relay, be64toh(rq->stream_id));
+	pthread_mutex_unlock(&relay->lock);
+	if (!stream || stream->metadata) {
+		rp.status = htobe32(LTTNG_VIEWER_GET_PACKET_ERR);
+		return send_all(sock, &rp, sizeof(rp));
+	}
+
+	data = malloc(len);
+	if (!data) {
+		rp.status = htobe32(LTTNG_VIEWER_GET_PACKET_ERR);
+		return send_all(sock, &rp, sizeof(rp));
+	}
+	ret_len = pread(stream->fd, data, len, be64toh(rq->offset));
+	if (ret_len != len) {
+		fprintf(stderr, "[error] Unable to read packet of stream %"
+			PRIu64 "\n", stream->id);
+		rp.status = htobe32(LTTNG_VIEWER_GET_PACKET_ERR);
+		ret = send_all(sock, &rp, sizeof(rp));
+		goto end;
+	}
+
+	pthread_mutex_lock(&relay->lock);
+	relay->stats.bytes += len;
+	pthread_mutex_unlock(&relay->lock);
+	rp.status = htobe32(LTTNG_VIEWER_GET_PACKET_OK);
+	rp.len = htobe32(len);
+	ret = send_all(sock, &rp, sizeof(rp));
+	if (!ret)
+		ret = send_all(sock, data, len);
+end:
+	free(data);
+	return ret;
+}
+
+static
+int cmd_get_metadata(struct relay *relay, int sock, void *payload)
+{
+	struct lttng_viewer_get_metadata *rq = payload;
+	struct lttng_viewer_metadata_packet rp;
+	struct relay_stream *stream;
+	int send_metadata = 0;
+
+	memset(&rp, 0, sizeof(rp));
+	pthread_mutex_lock(&relay->lock);
+	stream = lookup_stream(relay, be64toh(rq->stream_id));
+	if (!stream || !stream->metadata) {
+		rp.status = htobe32(LTTNG_VIEWER_METADATA_ERR);
+	} else if (stream->metadata_sent) {
+		rp.status = htobe32(LTTNG_VIEWER_NO_NEW_METADATA);
+	} else {
+		rp.status = htobe32(LTTNG_VIEWER_METADATA_OK);
+		rp.len = htobe64(relay->metadata_len);
+		stream->metadata_sent = 1;
+		send_metadata = 1;
+	}
+	pthread_mutex_unlock(&relay->lock);
+
+	if (send_all(sock, &rp, sizeof(rp)))
+		return -1;
+	if (send_metadata)
+		return send_all(sock, relay->metadata, relay->metadata_len);
+	return 0;
+}
+
+static
+void *conn_thread(void *data)
+{
+	struct relay_conn *conn = data;
+	struct relay *relay = conn->relay;
+
+	for (;;) {
+		struct lttng_viewer_cmd cmd;
+		char payload[sizeof(struct lttng_viewer_attach_session_request)
+			+ sizeof(struct lttng_viewer_connect)];
+		uint64_t size;
+		int ret;
+
+		ret = recv_all(conn->sock, &cmd, sizeof(cmd));
+		if (ret <= 0)
+			break;
+		size = be64toh(cmd.data_size);
+		if (size > sizeof(payload)) {
+			fprintf(stderr, "[error] Command payload too large\n");
+			break;
+		}
+		if (size && recv_all(conn->sock, payload, size) <= 0)
+			break;
+
+		switch (be32toh(cmd.cmd)) {
+		case LTTNG_VIEWER_CONNECT:
+			ret = cmd_connect(relay, conn->sock, payload);
+			break;
+		case LTTNG_VIEWER_LIST_SESSIONS:
+			ret = cmd_list_sessions(relay, conn->sock);
+			break;
+		case LTTNG_VIEWER_CREATE_SESSION:
+			ret = cmd_create_session(relay, conn->sock);
+			break;
+		case LTTNG_VIEWER_ATTACH_SESSION:
+			ret = cmd_attach_session(relay, conn->sock, payload);
+			break;
+		case LTTNG_VIEWER_GET_NEW_STREAMS:
+			ret = cmd_get_new_streams(relay, conn->sock, payload);
+			break;
+		case LTTNG_VIEWER_GET_NEXT_INDEX:
+			ret = cmd_get_next_index(relay, conn->sock, payload);
+			break;
+		case LTTNG_VIEWER_GET_PACKET:
+			ret = cmd_get_packet(relay, conn->sock, payload);
+			break;
+		case LTTNG_VIEWER_GET_METADATA:
+			ret = cmd_get_metadata(relay, conn->sock, payload);
+			break;
+		default:
+			fprintf(stderr, "[error] Unknown command %u\n",
+				be32toh(cmd.cmd));
+			ret = -1;
+			break;
+		}
+		if (ret)
+			break;
+	}
+
+	pthread_mutex_lock(&relay->lock);
+	conn->done = 1;
+	relay->nr_conns--;
+	pthread_cond_broadcast(&relay->cond);
+	pthread_mutex_unlock(&relay->lock);
+	return NULL;
+}
+
+static
+void *accept_thread(void *data)
+{
+	struct relay *relay = data;
+
+	for (;;) {
+		struct relay_conn *conn;
+		int sock, one = 1;
+
+		sock = accept(relay->sock, NULL, NULL);
+		if (sock < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+		conn = g_new0(struct relay_conn, 1);
+		conn->relay = relay;
+		conn->sock = sock;
+		pthread_mutex_lock(&relay->lock);
+		if (relay->quit) {
+			pthread_mutex_unlock(&relay->lock);
+			close(sock);
+			g_free(conn);
+			break;
+		}
+		if (pthread_create(&conn->thread, NULL, conn_thread, conn)) {
+			pthread_mutex_unlock(&relay->lock);
+			close(sock);
+			g_free(conn);
+			continue;
+		}
+		g_ptr_array_add(relay->conns, conn);
+		relay->nr_conns++;
+		pthread_mutex_unlock(&relay->lock);
+	}
+	return NULL;
+}
+
+static
+int listen_socket(struct relay *relay)
+{
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+	int one = 1;
+
+	relay->sock = socket(AF_INET, SOCK_STREAM, 0);
+	if (relay->sock < 0) {
+		perror("socket");
+		return -1;
+	}
+	setsockopt(relay->sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(relay->config.port);
+	if (bind(relay->sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		perror("bind");
+		goto error;
+	}
+	if (listen(relay->sock, 16) < 0) {
+		perror("listen");
+		goto error;
+	}
+	if (getsockname(relay->sock, (struct sockaddr *) &addr,
+			&addr_len) < 0) {
+		perror("getsockname");
+		goto error;
+	}
+	relay->port = ntohs(addr.sin_port);
+	return 0;
+
+error:
+	close(relay->sock);
+	relay->sock = -1;
+	return -1;
+}
+
+struct relay *relay_create(const struct relay_config *config)
+{
+	struct relay *relay;
+
+	relay = g_new0(struct relay, 1);
+	relay->config = *config;
+	relay->sock = -1;
+	relay->epoch = -1;
+	relay->rand_state = config->seed;
+	relay->copies_visible = config->new_stream_after ? 1 : config->copies;
+	relay->streams = g_ptr_array_new_with_free_func(g_free);
+	relay->conns = g_ptr_array_new();
+	pthread_mutex_init(&relay->lock, NULL);
+	pthread_cond_init(&relay->cond, NULL);
+
+	if (load_trace(relay))
+		goto error;
+	if (listen_socket(relay))
+		goto error;
+	if (pthread_create(&relay->thread, NULL, accept_thread, relay)) {
+		fprintf(stderr, "[error] Unable to create relay thread\n");
+		close(relay->sock);
+		relay->sock = -1;
+		goto error;
+	}
+	return relay;
+
+error:
+	relay_destroy(relay);
+	return NULL;
+}
+
+int relay_port(struct relay *relay)
+{
+	return relay->port;
+}
+
+/*
+ * Wait for a viewer to attach and then close all its connections.
+ */
+void relay_wait(struct relay *relay)
+{
+	pthread_mutex_lock(&relay->lock);
+	while (!relay->attached || relay->nr_conns)
+		pthread_cond_wait(&relay->cond, &relay->lock);
+	pthread_mutex_unlock(&relay->lock);
+}
+
+int64_t relay_replay_time(struct relay *relay, uint64_t timestamp)
+{
+	int64_t ret;
+
+	pthread_mutex_lock(&relay->lock);
+	ret = replay_time(relay, timestamp);
+	pthread_mutex_unlock(&relay->lock);
+	return ret;
+}
+
+void relay_get_stats(struct relay *relay, struct relay_stats *stats)
+{
+	pthread_mutex_lock(&relay->lock);
+	*stats = relay->stats;
+	pthread_mutex_unlock(&relay->lock);
+}
+
+void relay_destroy(struct relay *relay)
+{
+	int i;
+
+	if (relay->sock >= 0) {
+		pthread_mutex_lock(&relay->lock);
+		relay->quit = 1;
+		pthread_mutex_unlock(&relay->lock);
+		shutdown(relay->sock, SHUT_RDWR);
+		pthread_join(relay->thread, NULL);
+		close(relay->sock);
+	}
+	for (i = 0; i < relay->conns->len; i++) {
+		struct relay_conn *conn = g_ptr_array_index(relay->conns, i);
+
+		shutdown(conn->sock, SHUT_RDWR);
+		pthread_join(conn->thread, NULL);
+		close(conn->sock);
+		g_free(conn);
+	}
+	g_ptr_array_free(relay->conns, TRUE);
+	g_ptr_array_free(relay->streams, TRUE);
+	g_free(relay->metadata);
+	if (relay->td)
+		relay->fmt->close_trace(relay->td);
+	pthread_cond_destroy(&relay->cond);
+	pthread_mutex_destroy(&relay->lock);
+	g_free(relay);
+}
@@ -0,0 +1,86 @@
+#ifndef _TESTS_LIVE_RELAY_H
+#define _TESTS_LIVE_RELAY_H
+
+/*
+ * relay.h
+ *
+ * Stand-in for lttng-relayd serving a CTF trace from disk over the
+ * live viewer protocol.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; under version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+struct relay_config {
+	const char *trace_path;
+	const char *hostname;
+	const char *session_name;
+	int port;		/* 0 to let the kernel pick one */
+	int latency;		/* Delay before each data response, in ms */
+	int retry_pct;		/* Share of indexes answered RETRY, in % */
+	int inactive_pct;	/* Share of indexes answered INACTIVE, in % */
+	int copies;		/* Number of copies of the trace served */
+	/*
+	 * Number of packets served before the copies after the first
+	 * one are announced with the NEW_STREAM flag. All the copies
+	 * are announced on attach if 0.
+	 */
+	int new_stream_after;
+	/*
+	 * Trace time elapsed per unit of wall time. A packet is only
+	 * served once its end is reached in replay time. All packets are
+	 * available right away if 0.
+	 */
+	double speed;
+	unsigned int seed;
+	/*
+	 * Number of packets served before all the connections of the
+	 * viewer are closed, once, as if the relay daemon had restarted.
+	 * The viewer is served from the beginning when it attaches again.
+	 * Never if 0.
+	 */
+	int disconnect_after;
+};
+
+struct relay_stats {
+	uint64_t packets;
+	uint64_t bytes;
+	uint64_t retries;
+	uint64_t inactive;
+	uint64_t new_streams;
+	uint64_t disconnects;
+};
+
+struct relay;
+
+int relay_parse_args(struct relay_config *config, int argc, char **argv);
+void relay_usage(FILE *fp, const char *name);
+
+struct relay *relay_create(const struct relay_config *config);
+int relay_port(struct relay *relay);
+void relay_wait(struct relay *relay);
+void relay_destroy(struct relay *relay);
+
+/*
+ * Wall clock time, in ns, at which a trace timestamp in ns is reached
+ * in replay time. Returns -1 if the replay has not started or is not
+ * paced.
+ */
+int64_t relay_replay_time(struct relay *relay, uint64_t timestamp);
+void relay_get_stats(struct relay *relay, struct relay_stats *stats);
+int64_t relay_now(void);
+
+#endif /* _TESTS_LIVE_RELAY_H */
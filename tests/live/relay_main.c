@@ -0,0 +1,45 @@
+/*
+ * relay_main.c
+ *
+ * Serve a CTF trace as a live session until a viewer has attached to
+ * it and disconnected. The port listened on is printed on stdout.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; under version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "relay.h"
+
+int main(int argc, char **argv)
+{
+	struct relay_config config;
+	struct relay *relay;
+
+	if (relay_parse_args(&config, argc, argv) < 0) {
+		relay_usage(stderr, argv[0]);
+		return EXIT_FAILURE;
+	}
+	relay = relay_create(&config);
+	if (!relay)
+		return EXIT_FAILURE;
+
+	printf("%d\n", relay_port(relay));
+	fflush(stdout);
+
+	relay_wait(relay);
+	relay_destroy(relay);
+	return EXIT_SUCCESS;
+}
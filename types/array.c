@@ -77,7 +77,8 @@ struct declaration_array *
 	struct declaration_array *array_declaration;
 	struct bt_declaration *declaration;
 
-	array_declaration = g_new(struct declaration_array, 1);
+	array_declaration = bt_declaration_alloc(parent_scope->arena,
+			sizeof(struct declaration_array));
 	declaration = &array_declaration->p;
 	array_declaration->len = len;
 	bt_declaration_ref(elem_declaration);
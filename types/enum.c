@@ -273,13 +273,23 @@ GArray *bt_enum_quark_to_range_set(const struct declaration_enum *enum_declarati
 				   (gconstpointer) (unsigned long) q);
 }
 
+static
+struct enum_range_to_quark *
+	enum_range_to_quark_new(struct declaration_enum *enum_declaration)
+{
+	if (enum_declaration->p.arena)
+		return bt_declaration_arena_alloc(enum_declaration->p.arena,
+				sizeof(struct enum_range_to_quark));
+	return g_new(struct enum_range_to_quark, 1);
+}
+
 static
 void bt_enum_signed_insert_range_to_quark(struct declaration_enum *enum_declaration,
                         int64_t start, int64_t end, GQuark q)
 {
 	struct enum_range_to_quark *rtoq;
 
-	rtoq = g_new(struct enum_range_to_quark, 1);
+	rtoq = enum_range_to_quark_new(enum_declaration);
 	bt_list_add(&rtoq->node, &enum_declaration->table.range_to_quark);
 	rtoq->range.start._signed = start;
 	rtoq->range.end._signed = end;
@@ -292,7 +302,7 @@ void bt_enum_unsigned_insert_range_to_quark(struct declaration_enum *enum_declar
 {
 	struct enum_range_to_quark *rtoq;
 
-	rtoq = g_new(struct enum_range_to_quark, 1);
+	rtoq = enum_range_to_quark_new(enum_declaration);
 	bt_list_add(&rtoq->node, &enum_declaration->table.range_to_quark);
 	rtoq->range.start._unsigned = start;
 	rtoq->range.end._unsigned = end;
@@ -395,16 +405,18 @@ struct declaration_enum *
 {
 	struct declaration_enum *enum_declaration;
 
-	enum_declaration = g_new(struct declaration_enum, 1);
+	enum_declaration = bt_declaration_alloc(integer_declaration->p.arena,
+			sizeof(struct declaration_enum));
 
-	enum_declaration->table.value_to_quark_set = g_hash_table_new_full(enum_val_hash,
-							    enum_val_equal,
-							    enum_val_free,
-							    enum_range_set_free);
+	enum_declaration->table.value_to_quark_set =
+		bt_declaration_arena_hash_table_new(enum_declaration->p.arena,
+					enum_val_hash, enum_val_equal,
+					enum_val_free, enum_range_set_free);
 	BT_INIT_LIST_HEAD(&enum_declaration->table.range_to_quark);
-	enum_declaration->table.quark_to_range_set = g_hash_table_new_full(g_direct_hash,
-							g_direct_equal,
-							NULL, enum_range_set_free);
+	enum_declaration->table.quark_to_range_set =
+		bt_declaration_arena_hash_table_new(enum_declaration->p.arena,
+					g_direct_hash, g_direct_equal,
+					NULL, enum_range_set_free);
 	bt_declaration_ref(&integer_declaration->p);
 	enum_declaration->integer_declaration = integer_declaration;
 	enum_declaration->p.id = CTF_TYPE_ENUM;
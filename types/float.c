@@ -53,12 +53,14 @@ void _float_declaration_free(struct bt_declaration *declaration)
 
 struct declaration_float *
 	bt_float_declaration_new(size_t mantissa_len,
-		       size_t exp_len, int byte_order, size_t alignment)
+		       size_t exp_len, int byte_order, size_t alignment,
+		       struct declaration_arena *arena)
 {
 	struct declaration_float *float_declaration;
 	struct bt_declaration *declaration;
 
-	float_declaration = g_new(struct declaration_float, 1);
+	float_declaration = bt_declaration_alloc(arena,
+			sizeof(struct declaration_float));
 	declaration = &float_declaration->p;
 	declaration->id = CTF_TYPE_FLOAT;
 	declaration->alignment = alignment;
@@ -70,13 +72,13 @@ struct declaration_float *
 
 	float_declaration->sign = bt_integer_declaration_new(1,
 						byte_order, false, 1, 2,
-						CTF_STRING_NONE, NULL);
+						CTF_STRING_NONE, NULL, arena);
 	float_declaration->mantissa = bt_integer_declaration_new(mantissa_len - 1,
 						byte_order, false, 1, 10,
-						CTF_STRING_NONE, NULL);
+						CTF_STRING_NONE, NULL, arena);
 	float_declaration->exp = bt_integer_declaration_new(exp_len,
 						byte_order, true, 1, 10,
-						CTF_STRING_NONE, NULL);
+						CTF_STRING_NONE, NULL, arena);
 	return float_declaration;
 }
 
@@ -52,11 +52,13 @@ struct declaration_integer *
 	bt_integer_declaration_new(size_t len, int byte_order,
 			 int signedness, size_t alignment, int base,
 			 enum ctf_string_encoding encoding,
-			 struct ctf_clock *clock)
+			 struct ctf_clock *clock,
+			 struct declaration_arena *arena)
 {
 	struct declaration_integer *integer_declaration;
 
-	integer_declaration = g_new0(struct declaration_integer, 1);
+	integer_declaration = bt_declaration_alloc(arena,
+			sizeof(struct declaration_integer));
 	integer_declaration->p.id = CTF_TYPE_INTEGER;
 	integer_declaration->p.alignment = alignment;
 	integer_declaration->p.declaration_free = _integer_declaration_free;
@@ -107,10 +107,13 @@ struct declaration_sequence *
 	struct declaration_sequence *sequence_declaration;
 	struct bt_declaration *declaration;
 
-	sequence_declaration = g_new(struct declaration_sequence, 1);
+	sequence_declaration = bt_declaration_alloc(parent_scope->arena,
+			sizeof(struct declaration_sequence));
 	declaration = &sequence_declaration->p;
 
-	sequence_declaration->length_name = g_array_new(FALSE, TRUE, sizeof(GQuark));
+	sequence_declaration->length_name =
+		bt_declaration_arena_array_new(declaration->arena, TRUE,
+					sizeof(GQuark), 0);
 	bt_append_scope_path(length, sequence_declaration->length_name);
 
 	bt_declaration_ref(elem_declaration);
@@ -48,11 +48,13 @@ void _string_declaration_free(struct bt_declaration *declaration)
 }
 
 struct declaration_string *
-	bt_string_declaration_new(enum ctf_string_encoding encoding)
+	bt_string_declaration_new(enum ctf_string_encoding encoding,
+			struct declaration_arena *arena)
 {
 	struct declaration_string *string_declaration;
 
-	string_declaration = g_new(struct declaration_string, 1);
+	string_declaration = bt_declaration_alloc(arena,
+			sizeof(struct declaration_string));
 	string_declaration->p.id = CTF_TYPE_STRING;
 	string_declaration->p.alignment = CHAR_BIT;
 	string_declaration->p.declaration_free = _string_declaration_free;
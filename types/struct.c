@@ -87,13 +87,17 @@ struct declaration_struct *
 	struct declaration_struct *struct_declaration;
 	struct bt_declaration *declaration;
 
-	struct_declaration = g_new(struct declaration_struct, 1);
+	struct_declaration = bt_declaration_alloc(parent_scope->arena,
+			sizeof(struct declaration_struct));
 	declaration = &struct_declaration->p;
-	struct_declaration->fields_by_name = g_hash_table_new(g_direct_hash,
-						       g_direct_equal);
-	struct_declaration->fields = g_array_sized_new(FALSE, TRUE,
-						sizeof(struct declaration_field),
-						DEFAULT_NR_STRUCT_FIELDS);
+	struct_declaration->fields_by_name =
+		bt_declaration_arena_hash_table_new(declaration->arena,
+					g_direct_hash, g_direct_equal,
+					NULL, NULL);
+	struct_declaration->fields =
+		bt_declaration_arena_array_new(declaration->arena, TRUE,
+					sizeof(struct declaration_field),
+					DEFAULT_NR_STRUCT_FIELDS);
 	struct_declaration->scope = bt_new_declaration_scope(parent_scope);
 	declaration->id = CTF_TYPE_STRUCT;
 	declaration->alignment = max(1, min_align);
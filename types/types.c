@@ -288,10 +288,147 @@ void bt_declaration_unref(struct bt_declaration *declaration)
 {
 	if (!declaration)
 		return;
-	if (!--declaration->ref)
+	/* Declarations of an arena are released along with it. */
+	if (!--declaration->ref && !declaration->arena)
 		declaration->declaration_free(declaration);
 }
 
+#define DECLARATION_ARENA_ALIGN		8
+#define DECLARATION_ARENA_INIT_LEN	4096
+
+struct declaration_arena_chunk {
+	struct declaration_arena_chunk *prev;
+	size_t len;
+	size_t used_len;
+	char __attribute__ ((aligned (DECLARATION_ARENA_ALIGN))) data[];
+};
+
+/* Hash table or array owned by an arena. */
+struct declaration_arena_object {
+	struct declaration_arena_object *prev;
+	GDestroyNotify destroy;
+	gpointer data;
+};
+
+struct declaration_arena {
+	struct declaration_arena_chunk *last;	/* Chunk being filled */
+	struct declaration_arena_object *last_object;
+};
+
+static
+struct declaration_arena_chunk *arena_chunk_new(
+		struct declaration_arena_chunk *prev, size_t len)
+{
+	struct declaration_arena_chunk *chunk;
+
+	chunk = g_malloc0(sizeof(*chunk) + len);
+	chunk->prev = prev;
+	chunk->len = len;
+	return chunk;
+}
+
+static
+void arena_own(struct declaration_arena *arena, GDestroyNotify destroy,
+		gpointer data)
+{
+	struct declaration_arena_object *object;
+
+	object = bt_declaration_arena_alloc(arena, sizeof(*object));
+	object->prev = arena->last_object;
+	object->destroy = destroy;
+	object->data = data;
+	arena->last_object = object;
+}
+
+static
+void arena_array_free(gpointer data)
+{
+	g_array_free(data, TRUE);
+}
+
+struct declaration_arena *bt_declaration_arena_create(void)
+{
+	struct declaration_arena *arena;
+
+	arena = g_new0(struct declaration_arena, 1);
+	arena->last = arena_chunk_new(NULL, DECLARATION_ARENA_INIT_LEN);
+	return arena;
+}
+
+void bt_declaration_arena_destroy(struct declaration_arena *arena)
+{
+	struct declaration_arena_chunk *chunk, *prev;
+	struct declaration_arena_object *object;
+
+	if (!arena)
+		return;
+	/*
+	 * Hash tables and arrays first, since destroying them may
+	 * access declarations of the arena.
+	 */
+	for (object = arena->last_object; object; object = object->prev)
+		object->destroy(object->data);
+	for (chunk = arena->last; chunk; chunk = prev) {
+		prev = chunk->prev;
+		g_free(chunk);
+	}
+	g_free(arena);
+}
+
+void *bt_declaration_arena_alloc(struct declaration_arena *arena, size_t len)
+{
+	struct declaration_arena_chunk *chunk;
+	void *p;
+
+	len = ALIGN(len, DECLARATION_ARENA_ALIGN);
+	chunk = arena->last;
+	if (chunk->len - chunk->used_len < len) {
+		/* Double the chunk size, like the parser object stack. */
+		chunk = arena_chunk_new(chunk, max(chunk->len << 1, len));
+		arena->last = chunk;
+	}
+	p = &chunk->data[chunk->used_len];
+	chunk->used_len += len;
+	return p;
+}
+
+GHashTable *bt_declaration_arena_hash_table_new(
+		struct declaration_arena *arena,
+		GHashFunc hash_func, GEqualFunc key_equal_func,
+		GDestroyNotify key_destroy_func,
+		GDestroyNotify value_destroy_func)
+{
+	GHashTable *table;
+
+	table = g_hash_table_new_full(hash_func, key_equal_func,
+			key_destroy_func, value_destroy_func);
+	if (arena)
+		arena_own(arena, (GDestroyNotify) g_hash_table_destroy, table);
+	return table;
+}
+
+GArray *bt_declaration_arena_array_new(struct declaration_arena *arena,
+		gboolean clear, guint element_size, guint reserved_size)
+{
+	GArray *array;
+
+	array = g_array_sized_new(FALSE, clear, element_size, reserved_size);
+	if (arena)
+		arena_own(arena, arena_array_free, array);
+	return array;
+}
+
+void *bt_declaration_alloc(struct declaration_arena *arena, size_t len)
+{
+	struct bt_declaration *declaration;
+
+	if (!arena)
+		return g_malloc0(len);
+	declaration = bt_declaration_arena_alloc(arena, len);
+	declaration->arena = arena;
+	return declaration;
+}
+
 void bt_definition_ref(struct bt_definition *definition)
 {
 	definition->ref++;
@@ -305,29 +442,52 @@ void bt_definition_unref(struct bt_definition *definition)
 		definition->declaration->definition_free(definition);
 }
 
-struct declaration_scope *
-	bt_new_declaration_scope(struct declaration_scope *parent_scope)
+static
+struct declaration_scope *new_declaration_scope(
+		struct declaration_scope *parent_scope,
+		struct declaration_arena *arena)
 {
-	struct declaration_scope *scope = g_new(struct declaration_scope, 1);
+	struct declaration_scope *scope;
 
-	scope->typedef_declarations = g_hash_table_new_full(g_direct_hash,
-					g_direct_equal, NULL,
+	if (arena)
+		scope = bt_declaration_arena_alloc(arena, sizeof(*scope));
+	else
+		scope = g_new(struct declaration_scope, 1);
+	scope->typedef_declarations = bt_declaration_arena_hash_table_new(arena,
+					g_direct_hash, g_direct_equal, NULL,
 					(GDestroyNotify) bt_declaration_unref);
-	scope->struct_declarations = g_hash_table_new_full(g_direct_hash,
-					g_direct_equal, NULL,
+	scope->struct_declarations = bt_declaration_arena_hash_table_new(arena,
+					g_direct_hash, g_direct_equal, NULL,
 					(GDestroyNotify) bt_declaration_unref);
-	scope->variant_declarations = g_hash_table_new_full(g_direct_hash,
-					g_direct_equal, NULL,
+	scope->variant_declarations = bt_declaration_arena_hash_table_new(arena,
+					g_direct_hash, g_direct_equal, NULL,
 					(GDestroyNotify) bt_declaration_unref);
-	scope->enum_declarations = g_hash_table_new_full(g_direct_hash,
-					g_direct_equal, NULL,
+	scope->enum_declarations = bt_declaration_arena_hash_table_new(arena,
+					g_direct_hash, g_direct_equal, NULL,
 					(GDestroyNotify) bt_declaration_unref);
 	scope->parent_scope = parent_scope;
+	scope->arena = arena;
 	return scope;
 }
 
+struct declaration_scope *
+	bt_new_declaration_scope(struct declaration_scope *parent_scope)
+{
+	return new_declaration_scope(parent_scope,
+			parent_scope ? parent_scope->arena : NULL);
+}
+
+struct declaration_scope *
+	bt_new_root_declaration_scope(struct declaration_arena *arena)
+{
+	return new_declaration_scope(NULL, arena);
+}
+
 void bt_free_declaration_scope(struct declaration_scope *scope)
 {
+	/* Scopes of an arena are released along with it. */
+	if (scope->arena)
+		return;
 	g_hash_table_destroy(scope->enum_declarations);
 	g_hash_table_destroy(scope->variant_declarations);
 	g_hash_table_destroy(scope->struct_declarations);
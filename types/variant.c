@@ -78,13 +78,17 @@ struct declaration_untagged_variant *bt_untagged_bt_variant_declaration_new(
 	struct declaration_untagged_variant *untagged_variant_declaration;
 	struct bt_declaration *declaration;
 
-	untagged_variant_declaration = g_new(struct declaration_untagged_variant, 1);
+	untagged_variant_declaration = bt_declaration_alloc(parent_scope->arena,
+			sizeof(struct declaration_untagged_variant));
 	declaration = &untagged_variant_declaration->p;
-	untagged_variant_declaration->fields_by_tag = g_hash_table_new(g_direct_hash,
-						       g_direct_equal);
-	untagged_variant_declaration->fields = g_array_sized_new(FALSE, TRUE,
-						 sizeof(struct declaration_field),
-						 DEFAULT_NR_STRUCT_FIELDS);
+	untagged_variant_declaration->fields_by_tag =
+		bt_declaration_arena_hash_table_new(declaration->arena,
+					g_direct_hash, g_direct_equal,
+					NULL, NULL);
+	untagged_variant_declaration->fields =
+		bt_declaration_arena_array_new(declaration->arena, TRUE,
+					sizeof(struct declaration_field),
+					DEFAULT_NR_STRUCT_FIELDS);
 	untagged_variant_declaration->scope = bt_new_declaration_scope(parent_scope);
 	declaration->id = CTF_TYPE_UNTAGGED_VARIANT;
 	declaration->alignment = 1;
@@ -112,11 +116,14 @@ struct declaration_variant *
 	struct declaration_variant *variant_declaration;
 	struct bt_declaration *declaration;
 
-	variant_declaration = g_new(struct declaration_variant, 1);
+	variant_declaration = bt_declaration_alloc(untagged_variant->p.arena,
+			sizeof(struct declaration_variant));
 	declaration = &variant_declaration->p;
 	variant_declaration->untagged_variant = untagged_variant;
 	bt_declaration_ref(&untagged_variant->p);
-	variant_declaration->tag_name = g_array_new(FALSE, TRUE, sizeof(GQuark));
+	variant_declaration->tag_name =
+		bt_declaration_arena_array_new(declaration->arena, TRUE,
+					sizeof(GQuark), 0);
 	bt_append_scope_path(tag, variant_declaration->tag_name);
 	declaration->id = CTF_TYPE_VARIANT;
 	declaration->alignment = 1;